@@ -92,9 +92,10 @@ ifeq ($(ARCH),AARCH64)
     CFLAGS+=-DWOLFBOOT_UBOOT_LEGACY
     # PLM owns RVBAR on Versal in JTAG boot; skip RVBAR writes
     CFLAGS+=-DSKIP_RVBAR=1
-    # Disable SDMA for multi-block transfers - use PIO instead.
+    # Disable SDMA for multi-block transfers - use ADMA2 (or PIO) instead.
     # The Versal Arasan SDHCI controller does not restart SDMA after
     # boundary crossings via SRS22/SRS23 writes (Cadence-specific behavior).
+    # ADMA2 needs no boundary restarts and stays enabled.
     CFLAGS_EXTRA+=-DSDHCI_SDMA_DISABLED
   endif
 
@@ -314,3 +314,47 @@ WEAKFUNCTION int hal_attestation_get_iak_private_key(uint8_t *buf, size_t *len)
     (void)len;
     return -1;
 }
+
+#ifdef WOLFBOOT_VERIFY_TICKET
+WEAKFUNCTION int hal_verify_ticket_read(uint8_t *buf, uint32_t len)
+{
+    (void)buf;
+    (void)len;
+    return -1;
+}
+
+WEAKFUNCTION int hal_verify_ticket_write(const uint8_t *buf, uint32_t len)
+{
+    (void)buf;
+    (void)len;
+    return -1;
+}
+
+WEAKFUNCTION int hal_monotonic_counter_read(uint32_t *value)
+{
+    (void)value;
+    return -1;
+}
+
+WEAKFUNCTION int hal_monotonic_counter_increment(uint32_t *value)
+{
+    (void)value;
+    return -1;
+}
+#endif /* WOLFBOOT_VERIFY_TICKET */
+
+#if defined(WOLFBOOT_MEASURED_BOOT) && defined(WOLFBOOT_MEASURED_BOOT_SELF_CACHE)
+WEAKFUNCTION int hal_measured_self_read(uint8_t *buf, uint32_t len)
+{
+    (void)buf;
+    (void)len;
+    return -1;
+}
+
+WEAKFUNCTION int hal_measured_self_write(const uint8_t *buf, uint32_t len)
+{
+    (void)buf;
+    (void)len;
+    return -1;
+}
+#endif /* WOLFBOOT_MEASURED_BOOT && WOLFBOOT_MEASURED_BOOT_SELF_CACHE */
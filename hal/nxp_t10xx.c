@@ -3351,10 +3351,21 @@ void* hal_get_dts_address(void)
     return (void*)WOLFBOOT_DTS_BOOT_ADDRESS;
 }
 
+#ifndef BUILD_LOADER_STAGE1
+#define FDT_INDEX_NODES 256
+/* worst case of the edits in one transaction: memory, 6 per core, soc,
+ * 4 serial ports (2 DUARTs), QE and one per LIODN entry */
+#define FDT_TX_PROPS    (1 + (CPU_NUMCORES * 6) + 1 + 4 + 3 + \
+    (int)(sizeof(liodn_tbl) / sizeof(liodn_tbl[0])))
+static struct fdt_index_node fdt_nodes[FDT_INDEX_NODES];
+static struct fdt_tx_prop fdt_props[FDT_TX_PROPS];
+#endif
+
 int hal_dts_fixup(void* dts_addr)
 {
 #ifndef BUILD_LOADER_STAGE1
     struct fdt_header *fdt = (struct fdt_header *)dts_addr;
+    struct fdt_tx tx;
     int off, i;
     uint32_t *reg;
     const char* prev_compat;
@@ -3374,6 +3385,15 @@ int hal_dts_fixup(void* dts_addr)
     fdt->totalsize += 2048; /* expand by 2KB */
     wolfBoot_printf("FDT: Expanded (2KB) to %d bytes\n", fdt->totalsize);
 
+    /* index the nodes for the lookups below (walks the tree on failure) */
+    off = fdt_index_build(fdt, fdt_nodes, FDT_INDEX_NODES);
+    if (off < 0) {
+        wolfBoot_printf("FDT: Index failed %d\n", off);
+    }
+
+    /* the property fixups up to the LIODN are applied in one pass */
+    fdt_tx_begin(&tx, fdt, fdt_props, FDT_TX_PROPS);
+
     /* fixup the memory region - single bank */
     off = fdt_find_devtype(fdt, -1, "memory");
     if (off != -FDT_ERR_NOTFOUND) {
@@ -3385,7 +3405,7 @@ int hal_dts_fixup(void* dts_addr)
         p += sizeof(uint64_t);
         wolfBoot_printf("FDT: Set memory, start=0x%x, size=0x%x\n",
             DDR_ADDRESS, (uint32_t)DDR_SIZE);
-        fdt_setprop(fdt, off, "reg", ranges, (int)(p - ranges));
+        fdt_tx_setprop(&tx, off, "reg", ranges, (int)(p - ranges));
     }
 
     /* fixup CPU status and, release address and enable method */
@@ -3406,12 +3426,12 @@ int hal_dts_fixup(void* dts_addr)
         core_spin_table = (uint64_t)((uintptr_t)(
                   (uint8_t*)&_spin_table + (core * ENTRY_SIZE)));
 
-        fdt_fixup_str(fdt, off, "cpu", "status", (core == 0) ? "okay" : "disabled");
-        fdt_fixup_val64(fdt, off, "cpu", "cpu-release-addr", core_spin_table);
-        fdt_fixup_str(fdt, off, "cpu", "enable-method", "spin-table");
-        fdt_fixup_val(fdt, off, "cpu", "timebase-frequency", TIMEBASE_HZ);
-        fdt_fixup_val(fdt, off, "cpu", "clock-frequency", hal_get_core_clk());
-        fdt_fixup_val(fdt, off, "cpu", "bus-frequency", hal_get_plat_clk());
+        fdt_tx_fixup_str(&tx, off, "cpu", "status", (core == 0) ? "okay" : "disabled");
+        fdt_tx_fixup_val64(&tx, off, "cpu", "cpu-release-addr", core_spin_table);
+        fdt_tx_fixup_str(&tx, off, "cpu", "enable-method", "spin-table");
+        fdt_tx_fixup_val(&tx, off, "cpu", "timebase-frequency", TIMEBASE_HZ);
+        fdt_tx_fixup_val(&tx, off, "cpu", "clock-frequency", hal_get_core_clk());
+        fdt_tx_fixup_val(&tx, off, "cpu", "bus-frequency", hal_get_plat_clk());
 
         off = fdt_find_devtype(fdt, off, "cpu");
     }
@@ -3419,22 +3439,22 @@ int hal_dts_fixup(void* dts_addr)
     /* fixup the soc clock */
     off = fdt_find_devtype(fdt, -1, "soc");
     if (off != -FDT_ERR_NOTFOUND) {
-        fdt_fixup_val(fdt, off, "soc", "bus-frequency", hal_get_plat_clk());
+        fdt_tx_fixup_val(&tx, off, "soc", "bus-frequency", hal_get_plat_clk());
     }
 
     /* fixup the serial clocks */
     off = fdt_find_devtype(fdt, -1, "serial");
     while (off != -FDT_ERR_NOTFOUND) {
-        fdt_fixup_val(fdt, off, "serial", "clock-frequency", hal_get_bus_clk());
+        fdt_tx_fixup_val(&tx, off, "serial", "clock-frequency", hal_get_bus_clk());
         off = fdt_find_devtype(fdt, off, "serial");
     }
 
     /* fixup the QE bridge and bus blocks */
     off = fdt_find_devtype(fdt, -1, "qe");
     if (off != -FDT_ERR_NOTFOUND) {
-        fdt_fixup_val(fdt, off, "qe", "clock-frequency", hal_get_bus_clk());
-        fdt_fixup_val(fdt, off, "qe", "bus-frequency", hal_get_bus_clk());
-        fdt_fixup_val(fdt, off, "qe", "brg-frequency", hal_get_bus_clk()/2);
+        fdt_tx_fixup_val(&tx, off, "qe", "clock-frequency", hal_get_bus_clk());
+        fdt_tx_fixup_val(&tx, off, "qe", "bus-frequency", hal_get_bus_clk());
+        fdt_tx_fixup_val(&tx, off, "qe", "brg-frequency", hal_get_bus_clk()/2);
     }
 
     /* fixup the LIODN */
@@ -3445,12 +3465,23 @@ int hal_dts_fixup(void* dts_addr)
         }
         off = fdt_node_offset_by_compatible(fdt, off, liodn_tbl[i].compat);
         if (off >= 0) {
-            fdt_fixup_val(fdt, off, liodn_tbl[i].compat, "fsl,liodn",
+            fdt_tx_fixup_val(&tx, off, liodn_tbl[i].compat, "fsl,liodn",
                 liodn_tbl[i].id);
         }
         prev_compat = liodn_tbl[i].compat;
     }
 
+    off = fdt_tx_commit(&tx);
+    if (off != 0) {
+        /* keep the fixups that could be recorded */
+        wolfBoot_printf("FDT: Fixups commit failed %d, applying one by one\n",
+            off);
+        off = fdt_tx_apply(&tx);
+        if (off != 0) {
+            wolfBoot_printf("FDT: Fixups failed! %d\n", off);
+        }
+    }
+
     /* fixup the QMAN portals */
     off = fdt_node_offset_by_compatible(fdt, -1, "fsl,qman-portal");
     while (off != -FDT_ERR_NOTFOUND) {
@@ -3569,6 +3600,7 @@ int hal_dts_fixup(void* dts_addr)
         fdt_fixup_str(fdt, off, "cpu", "status", "okay");
     }
 
+    fdt_index_clear();
 #endif /* !BUILD_LOADER_STAGE1 */
     (void)dts_addr;
     return 0;
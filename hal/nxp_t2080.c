@@ -999,10 +999,20 @@ void* hal_get_dts_address(void)
     return (void*)WOLFBOOT_DTS_BOOT_ADDRESS;
 }
 
+#ifndef BUILD_LOADER_STAGE1
+#define FDT_INDEX_NODES 256
+/* worst case of the edits in one transaction: memory, 6 per core, soc and
+ * 4 serial ports (2 DUARTs) */
+#define FDT_TX_PROPS    (1 + (CPU_NUMCORES * 6) + 1 + 4)
+static struct fdt_index_node fdt_nodes[FDT_INDEX_NODES];
+static struct fdt_tx_prop fdt_props[FDT_TX_PROPS];
+#endif
+
 int hal_dts_fixup(void* dts_addr)
 {
 #ifndef BUILD_LOADER_STAGE1
     struct fdt_header *fdt = (struct fdt_header *)dts_addr;
+    struct fdt_tx tx;
     int off;
     uint32_t *reg;
 
@@ -1025,6 +1035,15 @@ int hal_dts_fixup(void* dts_addr)
             fdt_totalsize(fdt));
     }
 
+    /* index the nodes for the lookups below (walks the tree on failure) */
+    off = fdt_index_build(fdt, fdt_nodes, FDT_INDEX_NODES);
+    if (off < 0) {
+        wolfBoot_printf("FDT: Index failed %d\n", off);
+    }
+
+    /* the property fixups are applied in one pass */
+    fdt_tx_begin(&tx, fdt, fdt_props, FDT_TX_PROPS);
+
     /* fixup the memory region - single bank */
     off = fdt_find_devtype(fdt, -1, "memory");
     if (off >= 0) {
@@ -1034,7 +1053,7 @@ int hal_dts_fixup(void* dts_addr)
         ranges[1] = cpu_to_fdt64(DDR_SIZE);
         wolfBoot_printf("FDT: Set memory, start=0x%x, size=0x%x\n",
             DDR_ADDRESS, (uint32_t)DDR_SIZE);
-        fdt_setprop(fdt, off, "reg", ranges, sizeof(ranges));
+        fdt_tx_setprop(&tx, off, "reg", ranges, sizeof(ranges));
     }
 
     /* fixup CPU status and release address and enable method */
@@ -1060,13 +1079,13 @@ int hal_dts_fixup(void* dts_addr)
          * address, and XIP flash is read-only. */
         core_spin_table = (uint64_t)(g_spin_table_ddr + (core * ENTRY_SIZE));
 
-        fdt_fixup_str(fdt, off, "cpu", "status", (core == 0) ? "okay" : "disabled");
-        fdt_fixup_val64(fdt, off, "cpu", "cpu-release-addr", core_spin_table);
-        fdt_fixup_str(fdt, off, "cpu", "enable-method", "spin-table");
+        fdt_tx_fixup_str(&tx, off, "cpu", "status", (core == 0) ? "okay" : "disabled");
+        fdt_tx_fixup_val64(&tx, off, "cpu", "cpu-release-addr", core_spin_table);
+        fdt_tx_fixup_str(&tx, off, "cpu", "enable-method", "spin-table");
     #endif
-        fdt_fixup_val(fdt, off, "cpu", "timebase-frequency", TIMEBASE_HZ);
-        fdt_fixup_val(fdt, off, "cpu", "clock-frequency", hal_get_core_clk());
-        fdt_fixup_val(fdt, off, "cpu", "bus-frequency", hal_get_plat_clk());
+        fdt_tx_fixup_val(&tx, off, "cpu", "timebase-frequency", TIMEBASE_HZ);
+        fdt_tx_fixup_val(&tx, off, "cpu", "clock-frequency", hal_get_core_clk());
+        fdt_tx_fixup_val(&tx, off, "cpu", "bus-frequency", hal_get_plat_clk());
 
         off = fdt_find_devtype(fdt, off, "cpu");
     }
@@ -1074,16 +1093,27 @@ int hal_dts_fixup(void* dts_addr)
     /* fixup the soc clock */
     off = fdt_find_devtype(fdt, -1, "soc");
     if (off >= 0) {
-        fdt_fixup_val(fdt, off, "soc", "bus-frequency", hal_get_plat_clk());
+        fdt_tx_fixup_val(&tx, off, "soc", "bus-frequency", hal_get_plat_clk());
     }
 
     /* fixup the serial clocks */
     off = fdt_find_devtype(fdt, -1, "serial");
     while (off >= 0) {
-        fdt_fixup_val(fdt, off, "serial", "clock-frequency", hal_get_bus_clk());
+        fdt_tx_fixup_val(&tx, off, "serial", "clock-frequency", hal_get_bus_clk());
         off = fdt_find_devtype(fdt, off, "serial");
     }
 
+    off = fdt_tx_commit(&tx);
+    if (off != 0) {
+        /* keep the fixups that could be recorded */
+        wolfBoot_printf("FDT: Fixups commit failed %d, applying one by one\n",
+            off);
+        off = fdt_tx_apply(&tx);
+        if (off != 0) {
+            wolfBoot_printf("FDT: Fixups failed! %d\n", off);
+        }
+    }
+    fdt_index_clear();
 #endif /* !BUILD_LOADER_STAGE1 */
     (void)dts_addr;
     return 0;
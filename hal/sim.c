@@ -33,6 +33,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 
 #ifdef __APPLE__
 #include <mach-o/loader.h>
@@ -71,6 +72,13 @@ uint32_t erasefail_address = 0xFFFFFFFF;
 int flashLocked = 1;
 int extFlashLocked = 1;
 
+/* Simulated erase time per sector ("erase_us" argument), to measure the
+ * effect of background erase in the update */
+static uint64_t sim_erase_us = 0;
+static uint64_t sim_erase_busy_until = 0;
+static uint64_t sim_erase_wait_us = 0;
+static int sim_erase_count = 0;
+
 #define INTERNAL_FLASH_FILE "./internal_flash.dd"
 #define EXTERNAL_FLASH_FILE "./external_flash.dd"
 
@@ -345,14 +353,44 @@ void hal_flash_dualbank_swap(void)
 }
 #endif
 
+static uint64_t sim_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/* Block until the erase in progress completes */
+static void sim_erase_wait(void)
+{
+    uint64_t now = sim_time_us();
+    if (now < sim_erase_busy_until) {
+        usleep((useconds_t)(sim_erase_busy_until - now));
+        sim_erase_wait_us += sim_erase_busy_until - now;
+    }
+    sim_erase_busy_until = 0;
+}
+
+static void sim_erase_begin(int len)
+{
+    uint32_t sectors = (len + WOLFBOOT_SECTOR_SIZE - 1) / WOLFBOOT_SECTOR_SIZE;
+    sim_erase_count++;
+    if (sim_erase_us > 0)
+        sim_erase_busy_until = sim_time_us() + sim_erase_us * sectors;
+}
+
 void hal_prepare_boot(void)
 {
-    /* no op */
+    if (sim_erase_us > 0) {
+        wolfBoot_printf("Simulated erase: %d erases, %lu ms waiting\n",
+            sim_erase_count, (unsigned long)(sim_erase_wait_us / 1000));
+    }
 }
 
 int hal_flash_write(uintptr_t address, const uint8_t *data, int len)
 {
     int i;
+    sim_erase_wait();
     if (flashLocked == 1) {
         wolfBoot_printf("FLASH IS BEING WRITTEN TO WHILE LOCKED\n");
         return -1;
@@ -384,8 +422,11 @@ int hal_flash_write(uintptr_t address, const uint8_t *data, int len)
     return 0;
 }
 
-int hal_flash_erase(uintptr_t address, int len)
+/* The erase takes effect immediately; the simulated latency is paid by the
+ * next flash operation or poll */
+int hal_flash_erase_start(uintptr_t address, int len)
 {
+    sim_erase_wait();
     if (flashLocked == 1) {
         wolfBoot_printf("FLASH IS BEING ERASED WHILE LOCKED\n");
         return -1;
@@ -399,9 +440,35 @@ int hal_flash_erase(uintptr_t address, int len)
         exit(0);
     }
     memset((void*)address, FLASH_BYTE_ERASED, len);
+    sim_erase_begin(len);
+    return 0;
+}
+
+int hal_flash_erase_poll(void)
+{
+    uint64_t now = sim_time_us();
+    uint64_t step;
+    if (sim_erase_busy_until != 0 && now < sim_erase_busy_until) {
+        /* caller is blocked on the erase: account the time */
+        step = sim_erase_busy_until - now;
+        if (step > 100)
+            step = 100;
+        usleep((useconds_t)step);
+        sim_erase_wait_us += step;
+        return 1;
+    }
+    sim_erase_busy_until = 0;
     return 0;
 }
 
+int hal_flash_erase(uintptr_t address, int len)
+{
+    int ret = hal_flash_erase_start(address, len);
+    if (ret == 0)
+        sim_erase_wait();
+    return ret;
+}
+
 void hal_init(void)
 {
     int ret;
@@ -437,6 +504,9 @@ void hal_init(void)
          * emergency fallback feature */
         else if (strcmp(main_argv[i], "emergency") == 0)
             forceEmergency = 1;
+        /* simulated erase time per sector, in microseconds */
+        else if (strcmp(main_argv[i], "erase_us") == 0)
+            sim_erase_us = strtoul(main_argv[++i], NULL, 10);
     }
 }
 
@@ -288,6 +288,51 @@ int qspi_transfer(uint8_t fmode, const uint8_t cmd,
 
     return 0;
 }
+
+#ifdef QSPI_FLASH_MMAP
+void* qspi_mmap_enable(const uint8_t cmd,
+    uint32_t addrSz, uint32_t addrMode,
+    uint32_t alt, uint32_t altSz, uint32_t altMode,
+    uint32_t dummySz, uint32_t dataMode)
+{
+    uint32_t adsz = 0, absz = 0;
+
+    if (addrSz > 0) {
+        adsz = addrSz-1;
+    }
+    if (altSz > 0) {
+        absz = altSz-1;
+    }
+
+    /* Configure read command for memory-mapped mode */
+    OCTOSPI_CR &= ~(OCTOSPI_CR_EN | OCTOSPI_CR_FMODE_MASK);
+    OCTOSPI_CR |= OCTOSPI_CR_FMODE(QSPI_MODE_MMAP);
+    OCTOSPI_CCR = (
+        OCTOSPI_CCR_IMODE(1) |         /* Instruction Mode - always single SPI */
+        OCTOSPI_CCR_ADMODE(addrMode) | /* Address Mode */
+        OCTOSPI_CCR_ADSIZE(adsz) |     /* Address Size */
+        OCTOSPI_CCR_ABMODE(altMode) |  /* Alternate byte mode */
+        OCTOSPI_CCR_ABSIZE(absz ) |    /* Alternate byte size */
+        OCTOSPI_CCR_DMODE(dataMode)    /* Data Mode */
+    );
+    OCTOSPI_TCR = OCTOSPI_TCR_DCYC(dummySz);
+    OCTOSPI_IR = cmd;
+    if (altSz > 0) {
+        OCTOSPI_ABR = alt;
+    }
+    OCTOSPI_CR |= OCTOSPI_CR_EN;
+
+    return (void*)QSPI_MMAP_BASE;
+}
+
+void qspi_mmap_disable(void)
+{
+    /* Abort the memory-mapped read and return to indirect mode */
+    OCTOSPI_CR |= OCTOSPI_CR_ABORT;
+    while (OCTOSPI_CR & OCTOSPI_CR_ABORT);
+    OCTOSPI_CR &= ~(OCTOSPI_CR_EN | OCTOSPI_CR_FMODE_MASK);
+}
+#endif /* QSPI_FLASH_MMAP */
 #elif defined(QSPI_FLASH)
 int qspi_transfer(uint8_t fmode, const uint8_t cmd,
     uint32_t addr, uint32_t addrSz, uint32_t addrMode,
@@ -370,6 +415,54 @@ int qspi_transfer(uint8_t fmode, const uint8_t cmd,
 
     return 0;
 }
+
+#ifdef QSPI_FLASH_MMAP
+void* qspi_mmap_enable(const uint8_t cmd,
+    uint32_t addrSz, uint32_t addrMode,
+    uint32_t alt, uint32_t altSz, uint32_t altMode,
+    uint32_t dummySz, uint32_t dataMode)
+{
+    uint32_t adsz = 0, absz = 0;
+
+    if (addrSz > 0) {
+        adsz = addrSz-1;
+    }
+    if (altSz > 0) {
+        absz = altSz-1;
+    }
+
+    /* Enable the QSPI peripheral */
+    QUADSPI_CR |= QUADSPI_CR_EN;
+
+    /* Set optional alternate bytes before the mode is entered */
+    if (altSz > 0) {
+        QUADSPI_ABR = alt;
+    }
+
+    /* Read command used for every access to the memory-mapped window */
+    QUADSPI_CCR = (
+        QUADSPI_CCR_FMODE(QSPI_MODE_MMAP) | /* Functional Mode */
+        QUADSPI_CCR_IMODE(1) |         /* Instruction Mode - always single SPI */
+        QUADSPI_CCR_ADMODE(addrMode) | /* Address Mode */
+        QUADSPI_CCR_ADSIZE(adsz) |     /* Address Size */
+        QUADSPI_CCR_ABMODE(altMode) |  /* Alternate byte mode */
+        QUADSPI_CCR_ABSIZE(absz ) |    /* Alternate byte size */
+        QUADSPI_CCR_DMODE(dataMode) |  /* Data Mode */
+        QUADSPI_CCR_DCYC(dummySz) |    /* Dummy Cycles (between instruction and read) */
+        cmd                            /* Instruction / Command byte */
+    );
+
+    return (void*)QSPI_MMAP_BASE;
+}
+
+void qspi_mmap_disable(void)
+{
+    /* Abort the memory-mapped read and return to indirect mode */
+    QUADSPI_CR |= QUADSPI_CR_ABORT;
+    while (QUADSPI_CR & QUADSPI_CR_ABORT);
+    QUADSPI_CR &= ~QUADSPI_CR_EN;
+}
+#endif /* QSPI_FLASH_MMAP */
 #endif /* QSPI_FLASH */
 
 #if defined(SPI_FLASH) || defined(WOLFBOOT_TPM)
@@ -386,6 +479,38 @@ void RAMFUNCTION spi_write(const char byte)
 }
 #endif /* SPI_FLASH || WOLFBOOT_TPM */
 
+#ifdef SPI_FLASH
+/* Bytes in flight during a burst: the H5 SPI has a data FIFO, the older
+ * peripheral only a single receive buffer. */
+#ifndef SPI_BURST_DEPTH
+    #if defined(TARGET_stm32h5)
+        #define SPI_BURST_DEPTH 8
+    #else
+        #define SPI_BURST_DEPTH 1
+    #endif
+#endif
+
+void RAMFUNCTION spi_burst(const uint8_t *tx, uint8_t *rx, uint32_t sz)
+{
+    uint32_t txn = 0, rxn = 0;
+    uint8_t b;
+    while (rxn < sz) {
+        /* keep the transmit side ahead of the receive side */
+        while ((txn < sz) && ((txn - rxn) < SPI_BURST_DEPTH) &&
+                (SPI1_SR & SPI_SR_TX_EMPTY)) {
+            SPI1_TXDR = (tx != NULL) ? tx[txn] : 0xFF;
+            txn++;
+        }
+        if (SPI1_SR & SPI_SR_RX_NOTEMPTY) {
+            b = SPI1_RXDR;
+            if (rx != NULL)
+                rx[rxn] = b;
+            rxn++;
+        }
+    }
+}
+#endif /* SPI_FLASH */
+
 static int initialized = 0;
 void RAMFUNCTION spi_init(int polarity, int phase)
 {
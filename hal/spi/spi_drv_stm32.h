@@ -75,6 +75,9 @@
 #ifndef OCTOSPI_BASE
 #define OCTOSPI_BASE OCTOSPI2_BASE
 #endif
+#ifndef QSPI_MMAP_BASE
+#define QSPI_MMAP_BASE 0x70000000UL /* OCTOSPI2 window (OCTOSPI1: 0x90000000) */
+#endif
 
 /* Registers mapping */
 #define APB2PERIPH_BASE (PERIPH_BASE + 0x00012C00UL)
@@ -426,6 +429,11 @@
 
 #define SPI1_APB2_CLOCK_ER_VAL     (1 << 12)
 
+#ifdef SPI_FLASH
+/* spi_burst() is implemented by the driver */
+#define SPI_DRV_HAS_BURST
+#endif
+
 #if defined(TARGET_stm32h5)
 /* newer SPI/I2S peripheral */
 #define SPI1_CR1      (*(volatile uint32_t *)(SPI1_BASE))
@@ -526,6 +534,10 @@
 #ifndef QUADSPI_BASE
 #define QUADSPI_BASE      0x52005000UL
 #endif
+/* Memory-mapped window of the QUADSPI/OCTOSPI flash */
+#ifndef QSPI_MMAP_BASE
+#define QSPI_MMAP_BASE    0x90000000UL
+#endif
 
 #define QUADSPI_CR                (*(volatile uint32_t *)(QUADSPI_BASE + 0x00)) /* Control register */
 #define QUADSPI_DCR               (*(volatile uint32_t *)(QUADSPI_BASE + 0x04)) /* Device Configuration register */
@@ -1677,6 +1677,46 @@ void sdhci_platform_set_bus_mode(int is_emmc)
 #endif
     /* Nothing additional needed for Versal - mode is set in generic driver */
 }
+
+/* DMA cache maintenance - called from sdhci_transfer() around SDMA/ADMA2
+ * transfers, and for the ADMA2 descriptor table. The D-cache is on, so:
+ *   - Before DMA write (card<-memory): clean D-cache so DMA reads correct data
+ *   - Before/after DMA read (card->memory): invalidate so the CPU sees the
+ *     data written by the controller */
+void sdhci_platform_dma_prepare(void *buf, uint32_t sz, int is_write)
+{
+    uintptr_t addr;
+    uintptr_t start = (uintptr_t)buf & ~(CACHE_LINE_SIZE - 1);
+    uintptr_t end = ((uintptr_t)buf + sz + CACHE_LINE_SIZE - 1) &
+        ~(CACHE_LINE_SIZE - 1);
+
+    if (is_write) {
+        for (addr = start; addr < end; addr += CACHE_LINE_SIZE) {
+            __asm__ volatile("dc cvac, %0" : : "r"(addr) : "memory");
+        }
+    } else {
+        for (addr = start; addr < end; addr += CACHE_LINE_SIZE) {
+            __asm__ volatile("dc civac, %0" : : "r"(addr) : "memory");
+        }
+    }
+    __asm__ volatile("dsb sy" : : : "memory");
+}
+
+void sdhci_platform_dma_complete(void *buf, uint32_t sz, int is_write)
+{
+    uintptr_t addr;
+    uintptr_t start = (uintptr_t)buf & ~(CACHE_LINE_SIZE - 1);
+    uintptr_t end = ((uintptr_t)buf + sz + CACHE_LINE_SIZE - 1) &
+        ~(CACHE_LINE_SIZE - 1);
+
+    /* Nothing for the CPU to see after a DMA write (card<-memory) */
+    if (!is_write) {
+        for (addr = start; addr < end; addr += CACHE_LINE_SIZE) {
+            __asm__ volatile("dc civac, %0" : : "r"(addr) : "memory");
+        }
+        __asm__ volatile("dsb sy" : : : "memory");
+    }
+}
 #endif /* DISK_SDCARD || DISK_EMMC */
 
 
@@ -1979,9 +1979,10 @@ uint32_t sdhci_reg_read(uint32_t offset)
 
         {
             uint32_t val = *((volatile uint32_t *)(base + std_off));
-            /* Mask out A64S from Capabilities to prevent HV4E init */
+            /* Mask out A64S from Capabilities to prevent HV4E init, and
+             * ADMA2S since SRS22 is redirected to the SDMA address */
             if (std_off == 0x40) { /* SRS16 - Capabilities */
-                val &= ~SDHCI_SRS16_A64S;
+                val &= ~(SDHCI_SRS16_A64S | SDHCI_SRS16_ADMA2S);
             }
             return val;
         }
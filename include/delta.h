@@ -41,6 +41,54 @@
 #define DELTA_PATCH_BLOCK_SIZE 1024
 #endif
 
+/* Range-coded patch container (HDR_IMG_TYPE_DIFF_RC)
+ *
+ * The patch stream is split in frames of WB_RC_FRAME_SIZE bytes, each
+ * compressed independently with an adaptive binary range coder:
+ *
+ *  - container header: raw patch size (4 bytes, LE), frame size (2 bytes,
+ *    LE), format version (2 bytes, LE)
+ *  - each frame: 2 bytes (LE) with the compressed size of the frame, followed
+ *    by the compressed data. If bit 15 is set, the frame is stored verbatim.
+ *
+ * The decoder needs no frame buffer: wb_patch() pulls bytes from it through
+ * a small window of WB_RC_WINDOW_SIZE bytes.
+ */
+#if defined(DELTA_RANGE_CODER) || !defined(__WOLFBOOT)
+#define WB_PATCH_RC
+#endif
+
+#define WB_RC_HDR_SIZE      8
+#define WB_RC_VERSION       1
+#define WB_RC_FRAME_STORED  0x8000
+#define WB_RC_FRAME_MAX     0x7FFF
+#ifndef WB_RC_FRAME_SIZE
+#define WB_RC_FRAME_SIZE    4096
+#endif
+#if (WB_RC_FRAME_SIZE > WB_RC_FRAME_MAX)
+#error "WB_RC_FRAME_SIZE too large"
+#endif
+#define WB_RC_WINDOW_SIZE   32
+#define WB_RC_CONTEXTS      4
+
+#ifdef WB_PATCH_RC
+struct wb_patch_rc {
+    uint16_t probs[WB_RC_CONTEXTS][256];
+    uint32_t range;
+    uint32_t code;
+    uint32_t c_size;     /* Size of the container */
+    uint32_t c_off;      /* Next byte to read from the container */
+    uint32_t frame_end;  /* End of the current frame in the container */
+    uint32_t frame_left; /* Bytes left to decode in the current frame */
+    uint32_t frame_size;
+    uint32_t win_start;  /* Offset in the patch stream of win[0] */
+    uint32_t win_len;
+    uint8_t win[WB_RC_WINDOW_SIZE];
+    uint8_t stored;
+    uint8_t state;
+};
+#endif
+
 struct wb_patch_ctx {
     uint8_t *src_base;
     uint32_t src_size;
@@ -54,12 +102,47 @@ struct wb_patch_ctx {
     uint8_t patch_cache[DELTA_PATCH_BLOCK_SIZE];
     uint32_t patch_cache_start;
 #endif
+#ifdef WB_PATCH_RC
+    int coded;
+    struct wb_patch_rc rc;
+#endif
 };
 
+/* Match finder used by wb_diff() */
+#define WB_DIFF_MODE_LINEAR 0 /* Scan every position (default) */
+#define WB_DIFF_MODE_HASH   1 /* Hash-indexed lookup, same output as linear */
+#define WB_DIFF_MODE_OPTIMAL 2 /* Longest matches, cheapest encoding overall */
+
+#if !defined(__WOLFBOOT) && !defined(_WIN32)
+#define WB_DIFF_THREADS /* wb_diff_generate() can use POSIX threads */
+#endif
+
+#ifndef __WOLFBOOT
+/* Index of all the BLOCK_HDR_SIZE sequences contained in a source buffer.
+ * Only used on the host side, to speed up the match finder in wb_diff().
+ */
+struct wb_diff_index {
+    uint32_t *bucket;   /* hash -> first key (offset of first occurrence) */
+    uint32_t *next_key; /* key -> next key in the same bucket */
+    uint32_t *next_pos; /* offset -> next offset with the same content */
+    uint32_t *cursor;   /* key -> first candidate not yet discarded */
+    uint32_t n_pos;
+    uint32_t bits;
+};
+#endif
+
 struct wb_diff_ctx {
     uint8_t *src_a;
     uint8_t *src_b;
     uint32_t size_a, size_b, off_b;
+#ifndef __WOLFBOOT
+    int mode;
+    int index_ready;
+    struct wb_diff_index idx_a;
+    struct wb_diff_index idx_b;
+    uint32_t *plan_len; /* WB_DIFF_MODE_OPTIMAL: match length at each offset */
+    uint32_t *plan_src; /* WB_DIFF_MODE_OPTIMAL: match source at each offset */
+#endif
 };
 
 
@@ -67,8 +150,22 @@ typedef struct wb_patch_ctx WB_PATCH_CTX;
 typedef struct wb_diff_ctx WB_DIFF_CTX;
 
 int wb_diff_init(WB_DIFF_CTX *ctx, uint8_t *src_a, uint32_t len_a, uint8_t *src_b, uint32_t len_b);
+int wb_diff_init_ex(WB_DIFF_CTX *ctx, uint8_t *src_a, uint32_t len_a,
+    uint8_t *src_b, uint32_t len_b, int mode);
 int wb_diff(WB_DIFF_CTX *ctx, uint8_t *patch, uint32_t len);
+void wb_diff_free(WB_DIFF_CTX *ctx);
+#ifndef __WOLFBOOT
+int wb_diff_generate(WB_DIFF_CTX *ctx, int jobs, uint8_t **patch,
+    uint32_t *patch_len);
+uint32_t wb_diff_rc_bound(uint32_t raw_len);
+int wb_diff_rc_encode(const uint8_t *raw, uint32_t raw_len, uint8_t *out,
+    uint32_t out_len);
+#endif
 int wb_patch_init(WB_PATCH_CTX *bm, uint8_t *src, uint32_t ssz, uint8_t *patch, uint32_t psz);
+#ifdef WB_PATCH_RC
+int wb_patch_init_rc(WB_PATCH_CTX *bm, uint8_t *src, uint32_t ssz,
+    uint8_t *patch, uint32_t psz);
+#endif
 int wb_patch(WB_PATCH_CTX *ctx, uint8_t *dst, uint32_t len);
 int wolfBoot_get_delta_info(uint8_t part, int inverse, uint32_t **img_offset,
     uint32_t **img_size, uint8_t **base_hash, uint16_t *base_hash_size);
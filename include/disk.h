@@ -71,5 +71,20 @@ int disk_part_read(int drv, int part, uint64_t off, uint64_t sz, uint8_t *buf);
 int disk_part_write(int drv, int part, uint64_t off, uint64_t sz, const uint8_t *buf);
 int disk_find_partition_by_label(int drv, const char *label);
 
+#ifdef WOLFBOOT_DISK_CACHE
+/**
+ * @brief Counters of the block cache, see disk_cache_get_stats().
+ */
+struct disk_cache_stats {
+    uint32_t hits;          /* Block accesses served from the cache */
+    uint32_t misses;        /* Blocks read into the cache on demand */
+    uint32_t prefetched;    /* Blocks read ahead on sequential access */
+    uint32_t direct;        /* Whole blocks read into the caller's buffer */
+};
+
+void disk_cache_invalidate(int drv);
+void disk_cache_get_stats(struct disk_cache_stats *stats);
+#endif
+
 #endif /* _WOLFBOOT_DISK_H */
 
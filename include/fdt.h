@@ -157,6 +157,71 @@ int fdt_fixup_val64(void* fdt, int off, const char* node, const char* name, uint
 
 int fdt_shrink(void* fdt);
 
+/* Node index: one pass over the tree records the offset, depth, name hash
+ * and phandle of every node. While an index is active for a tree, the
+ * lookups below walk the index instead of the struct block, and only look
+ * at the properties of the nodes whose filter matches the "compatible" or
+ * "device_type" searched. It follows the edits done with the fdt_* API, and
+ * must be built again if the tree is changed in any other way. */
+struct fdt_index_node {
+    int32_t  offset;   /* node offset in the struct block */
+    int32_t  depth;    /* 1 for the root node */
+    uint32_t hash;     /* hash of the full node name (with unit address) */
+    uint32_t phandle;  /* 0 if the node has none */
+    uint32_t filter;   /* one bit per "compatible" and "device_type" string */
+};
+
+int  fdt_index_build(const void* fdt, struct fdt_index_node* nodes, int max);
+void fdt_index_clear(void);
+
+int fdt_path_offset(const void* fdt, const char* path);
+int fdt_node_offset_by_phandle(const void* fdt, uint32_t phandle);
+
+/* Fixup transaction: property edits are recorded against the unmodified
+ * tree (node offsets stay valid) and applied by fdt_tx_commit() with one
+ * move of each part of the struct and strings blocks. Values up to
+ * FDT_TX_INLINE_SIZE bytes are copied, longer ones must stay valid until
+ * the commit. If any edit fails, or the tree is too small for the result,
+ * the commit returns the error and leaves the tree untouched: the edits
+ * recorded can then be applied one by one with fdt_tx_apply(). */
+#ifndef FDT_TX_INLINE_SIZE
+#define FDT_TX_INLINE_SIZE 16
+#endif
+
+struct fdt_tx_prop {
+    const char* name;
+    const void* val;   /* NULL when the value is in buf */
+    int nodeoff;
+    int pos;           /* start of the region replaced in the struct block */
+    int oldlen;        /* size of the region replaced, 0 for a new property */
+    int len;
+    int nameoff;       /* -1 until the name is found or added */
+    int seq;
+    uint8_t buf[FDT_TX_INLINE_SIZE];
+};
+
+struct fdt_tx {
+    void* fdt;
+    struct fdt_tx_prop* props;
+    int max;
+    int count;
+    int err;
+};
+
+void fdt_tx_begin(struct fdt_tx* tx, void* fdt, struct fdt_tx_prop* props,
+    int max);
+int fdt_tx_setprop(struct fdt_tx* tx, int nodeoffset, const char* name,
+    const void* val, int len);
+int fdt_tx_commit(struct fdt_tx* tx);
+int fdt_tx_apply(struct fdt_tx* tx);
+
+int fdt_tx_fixup_str(struct fdt_tx* tx, int off, const char* node,
+    const char* name, const char* str);
+int fdt_tx_fixup_val(struct fdt_tx* tx, int off, const char* node,
+    const char* name, uint32_t val);
+int fdt_tx_fixup_val64(struct fdt_tx* tx, int off, const char* node,
+    const char* name, uint64_t val);
+
 /* FIT */
 const char* fit_find_images(void* fdt, const char** pkernel, const char** pflat_dt);
 void* fit_load_image(void* fdt, const char* image, int* lenp);
@@ -85,6 +85,14 @@ uint64_t hal_get_timer_us(void);
     int hal_flash_write(uint32_t address, const uint8_t *data, int len);
     int hal_flash_erase(uint32_t address, int len);
 #endif
+/* Optional background erase. hal_flash_erase_start() may return before the
+ * erase completes; hal_flash_erase_poll() returns 1 while it is in progress,
+ * then its result (0 or negative). hal_flash_write() and hal_flash_erase()
+ * must wait for a started erase to complete. Weak synchronous defaults in
+ * update_flash.c.
+ */
+int hal_flash_erase_start(haladdr_t address, int len);
+int hal_flash_erase_poll(void);
 void hal_flash_unlock(void);
 void hal_flash_lock(void);
 void hal_prepare_boot(void);
@@ -131,6 +139,19 @@ void hal_prepare_boot(void);
     }
 #endif /* !SPI_FLASH */
 
+#ifdef EXT_FLASH
+    /* Split-phase external flash read, used to fetch the next chunk of an
+     * image while the current one is being hashed. Weak default in image.c.
+     */
+    int  ext_flash_read_start(uintptr_t address, uint8_t *data, int len);
+    int  ext_flash_read_wait(void);
+    /* Memory-mapped read access to external flash: returns the CPU address
+     * of the range, or NULL if it must be read with ext_flash_read(). Valid
+     * until the next external write or erase. Weak default in image.c.
+     */
+    const uint8_t *ext_flash_mmap(uintptr_t address, int len);
+#endif
+
 #ifdef TZEN
 
 /* TrustZone hal API */
@@ -162,6 +183,20 @@ int hal_attestation_get_implementation_id(uint8_t *buf, size_t *len);
 int hal_attestation_get_ueid(uint8_t *buf, size_t *len);
 int hal_attestation_get_iak_private_key(uint8_t *buf, size_t *len);
 
+#ifdef WOLFBOOT_VERIFY_TICKET
+/* Verification ticket storage and monotonic counter (weak stubs available). */
+int hal_verify_ticket_read(uint8_t *buf, uint32_t len);
+int hal_verify_ticket_write(const uint8_t *buf, uint32_t len);
+int hal_monotonic_counter_read(uint32_t *value);
+int hal_monotonic_counter_increment(uint32_t *value);
+#endif
+
+#if defined(WOLFBOOT_MEASURED_BOOT) && defined(WOLFBOOT_MEASURED_BOOT_SELF_CACHE)
+/* Storage for the cached self-measurement (weak stubs available). */
+int hal_measured_self_read(uint8_t *buf, uint32_t len);
+int hal_measured_self_write(const uint8_t *buf, uint32_t len);
+#endif
+
 #ifdef FLASH_OTP_KEYSTORE
 
 int hal_flash_otp_write(uint32_t flashAddress, const void* data, uint16_t length);
@@ -46,11 +46,13 @@ extern "C" {
 #define SECT_FLAG_NEW      0x0F
 #define SECT_FLAG_SWAPPING 0x07
 #define SECT_FLAG_BACKUP   0x03
+#define SECT_FLAG_SAME     0x0B
 #define SECT_FLAG_UPDATED  0x00
 #else
 #define SECT_FLAG_NEW       0x00
 #define SECT_FLAG_SWAPPING  0x08
 #define SECT_FLAG_BACKUP    0x0c
+#define SECT_FLAG_SAME      0x04
 #define SECT_FLAG_UPDATED   0x0f
 #endif
 
@@ -1261,7 +1263,37 @@ int wolfBoot_open_self_address(struct wolfBoot_image *img, uint8_t *hdr,
     uint8_t *image);
 #endif
 int wolfBoot_verify_integrity(struct wolfBoot_image *img);
+#if defined(WOLFBOOT_UPDATE_DISK) || defined(WOLFBOOT_LZ4)
+int wolfBoot_hash_stream_init(struct wolfBoot_image *img);
+void wolfBoot_hash_stream_update(const uint8_t *data, uint32_t len);
+int wolfBoot_verify_integrity_stream(struct wolfBoot_image *img);
+#endif
+#ifdef WOLFBOOT_LZ4
+int wolfBoot_image_compressed(struct wolfBoot_image *img, uint32_t *raw_size);
+#endif
 int wolfBoot_verify_authenticity(struct wolfBoot_image *img);
+#ifdef WOLFBOOT_VERIFY_TICKET
+int wolfBoot_check_verify_ticket(struct wolfBoot_image *img);
+int wolfBoot_store_verify_ticket(struct wolfBoot_image *img);
+#endif
+#ifdef WOLFBOOT_MERKLE
+/* Parameters of the HDR_MERKLE_ROOT TLV: one leaf hash per sector of the
+ * partition, stored at 'table_off' in the firmware */
+struct wolfBoot_merkle {
+    uint32_t leaf_size;
+    uint32_t table_off;
+    uint32_t first;     /* Sector of the partition covered by leaf 0 */
+    uint32_t n_leaves;
+    uint8_t root[WOLFBOOT_SHA_DIGEST_SIZE];
+};
+int wolfBoot_merkle_open(struct wolfBoot_image *img, struct wolfBoot_merkle *m);
+int wolfBoot_merkle_check_leaf(struct wolfBoot_image *img,
+    const struct wolfBoot_merkle *m, uint32_t leaf);
+int wolfBoot_merkle_verify_leaves(struct wolfBoot_image *img,
+    const struct wolfBoot_merkle *m);
+int wolfBoot_merkle_check_sector(const struct wolfBoot_merkle *m,
+    uint32_t sector, uint8_t part);
+#endif
 int wolfBoot_set_partition_state(uint8_t part, uint8_t newst);
 int wolfBoot_get_update_sector_flag(uint16_t sector, uint8_t *flag);
 int wolfBoot_set_update_sector_flag(uint16_t sector, uint8_t newflag);
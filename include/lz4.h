@@ -0,0 +1,107 @@
+/* lz4.h
+ *
+ * LZ4 frame decoder for compressed firmware payloads, and the matching
+ * encoder used by the host tools.
+ *
+ * Compile with LZ4=1
+ *
+ * Use tools/keytools/sign with the --compress option to create an image
+ * whose payload is an LZ4 frame (HDR_IMG_TYPE_LZ4). The digest and the
+ * signature cover the compressed stream, so the payload can be verified
+ * while it is inflated straight into its load address.
+ *
+ *
+ * Copyright (C) 2025 wolfSSL Inc.
+ *
+ * This file is part of wolfBoot.
+ *
+ * wolfBoot is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfBoot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335, USA
+ */
+#ifndef WOLFBOOT_LZ4_H
+#define WOLFBOOT_LZ4_H
+
+#include <stdint.h>
+
+/* Frame format, as produced by the reference 'lz4' tool:
+ *
+ *  - magic (4 bytes, LE), FLG, BD, optional content size (8 bytes, LE),
+ *    header checksum (1 byte)
+ *  - blocks: size (4 bytes, LE, bit 31 set for a stored block), data,
+ *    optional block checksum (4 bytes)
+ *  - end mark (4 zero bytes), optional content checksum (4 bytes)
+ *
+ * The decoder does not check the xxHash checksums: the integrity of the
+ * stream is already guaranteed by the image digest. Frames that need an
+ * external dictionary are rejected.
+ */
+#define LZ4_FRAME_MAGIC         0x184D2204UL
+#define LZ4_FRAME_HDR_MAX       19
+#define LZ4_FLG_VERSION         0x40
+#define LZ4_FLG_VERSION_MASK    0xC0
+#define LZ4_FLG_BLOCK_INDEP     0x20
+#define LZ4_FLG_BLOCK_CHECKSUM  0x10
+#define LZ4_FLG_CONTENT_SIZE    0x08
+#define LZ4_FLG_CONTENT_CHECKSUM 0x04
+#define LZ4_FLG_DICT_ID         0x01
+#define LZ4_BLOCK_STORED        0x80000000UL
+#define LZ4_MIN_MATCH           4
+
+/* Largest decompressed payload accepted by the loaders. The output size
+ * comes from the manifest header, before its signature is verified. */
+#ifndef WOLFBOOT_LZ4_MAX_SIZE
+    #ifdef WOLFBOOT_RAMBOOT_MAX_SIZE
+        #define WOLFBOOT_LZ4_MAX_SIZE WOLFBOOT_RAMBOOT_MAX_SIZE
+    #else
+        #define WOLFBOOT_LZ4_MAX_SIZE (64 * 1024 * 1024)
+    #endif
+#endif
+
+struct lz4_stream {
+    uint8_t *dst;           /* Start of the output */
+    uint32_t dst_size;      /* Room available at dst */
+    uint32_t out;           /* Bytes written to dst */
+    uint32_t left;          /* Bytes left in the current block or field */
+    uint32_t len;           /* Literal or match length being decoded */
+    uint32_t offset;        /* Match offset being decoded */
+    uint64_t content_size;  /* From the frame header, 0 if not present */
+    uint8_t hdr[LZ4_FRAME_HDR_MAX];
+    uint8_t hdr_len;        /* Bytes collected in hdr */
+    uint8_t hdr_need;       /* Size of the field being collected in hdr */
+    uint8_t flg;
+    uint8_t token;
+    uint8_t state;
+    uint8_t next;           /* State after skipping 'left' bytes */
+};
+
+/* Streaming decoder: the compressed stream can be passed in chunks of any
+ * size, the output is written in order to dst, which must hold the whole
+ * decompressed payload (matches refer back into it).
+ */
+void lz4_stream_init(struct lz4_stream *s, uint8_t *dst, uint32_t dst_size);
+int lz4_stream_update(struct lz4_stream *s, const uint8_t *in, uint32_t len);
+int lz4_stream_final(struct lz4_stream *s);
+
+/* One-shot helper. Returns the decompressed size, or -1 on error. */
+int lz4_decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst,
+        uint32_t dst_size);
+
+#ifndef __WOLFBOOT
+/* Encoder, host tools only */
+uint32_t lz4_compress_bound(uint32_t len);
+int lz4_compress(const uint8_t *src, uint32_t len, uint8_t *dst,
+        uint32_t dst_size);
+#endif
+
+#endif /* WOLFBOOT_LZ4_H */
@@ -94,6 +94,28 @@
 #endif
 
 /* Timeouts */
+/* ADMA2 descriptor table: each entry moves up to 64KB, so the default table
+ * covers an 8MB CMD18/CMD25 transfer without CPU involvement */
+#ifndef SDHCI_ADMA2_DESC_COUNT
+#define SDHCI_ADMA2_DESC_COUNT  128
+#endif
+#ifndef SDHCI_ADMA2_DESC_MAX_LEN
+#define SDHCI_ADMA2_DESC_MAX_LEN (64U * 1024U)
+#endif
+#ifndef SDHCI_ADMA2_THRESHOLD
+#define SDHCI_ADMA2_THRESHOLD   (4U * 1024U)
+#endif
+
+/* Number of CMD19/CMD21 tuning iterations before giving up */
+#ifndef SDHCI_TUNING_LOOPS
+#define SDHCI_TUNING_LOOPS      40
+#endif
+
+/* eMMC data bus width (HS400 requires MMC_EXT_CSD_WIDTH_8BIT) */
+#ifndef SDHCI_EMMC_BUS_WIDTH
+#define SDHCI_EMMC_BUS_WIDTH    MMC_EXT_CSD_WIDTH_4BIT
+#endif
+
 #ifndef SDHCI_INIT_TIMEOUT_US
 #define SDHCI_INIT_TIMEOUT_US   500000      /* 500ms for initialization */
 #endif
@@ -111,6 +133,15 @@
 #ifndef SDHCI_CLK_50MHZ
 #define SDHCI_CLK_50MHZ         50000
 #endif
+#ifndef SDHCI_CLK_100MHZ
+#define SDHCI_CLK_100MHZ        100000
+#endif
+#ifndef SDHCI_CLK_200MHZ
+#define SDHCI_CLK_200MHZ        200000
+#endif
+#ifndef SDHCI_CLK_208MHZ
+#define SDHCI_CLK_208MHZ        208000
+#endif
 
 /* ============================================================================
  * Cadence SDHCI Register Offsets (SD4HC Standard)
@@ -143,6 +174,7 @@
 #define SDHCI_SRS16             0x240   /* Capabilities 1 */
 #define SDHCI_SRS17             0x244   /* Capabilities 2 */
 #define SDHCI_SRS18             0x248   /* Maximum Current */
+#define SDHCI_SRS21             0x254   /* ADMA Error Status */
 #define SDHCI_SRS22             0x258   /* ADMA2/SDMA Address (low) */
 #define SDHCI_SRS23             0x25C   /* ADMA2/SDMA Address (high) */
 
@@ -167,6 +199,9 @@
 #define SDHCI_HRS06_EMM_MASK    0x07
 #define SDHCI_HRS06_MODE_SD     0x00    /* SD mode */
 #define SDHCI_HRS06_MODE_LEGACY 0x02    /* eMMC legacy mode */
+#define SDHCI_HRS06_MODE_HS     0x03    /* eMMC high speed SDR */
+#define SDHCI_HRS06_MODE_HS200  0x05    /* eMMC HS200 */
+#define SDHCI_HRS06_MODE_HS400  0x06    /* eMMC HS400 */
 
 /* SRS01 - Block Size / Block Count Register */
 #define SDHCI_SRS01_BCCT_SHIFT  16      /* Block count shift */
@@ -208,6 +243,7 @@
 #define SDHCI_SRS09_CICMD       (1U << 0)   /* Command inhibit (CMD) */
 #define SDHCI_SRS09_CIDAT       (1U << 1)   /* Command inhibit (DAT) */
 #define SDHCI_SRS09_DAT0_LVL    (1U << 20)  /* DAT0 signal level */
+#define SDHCI_SRS09_DATSL_MASK  (0xFU << 20) /* DAT[3:0] signal levels */
 
 /* SRS10 - Host Control 1 / Power / Block Gap / Wakeup */
 #define SDHCI_SRS10_DTW         (1U << 1)   /* Data transfer width (4-bit) */
@@ -220,7 +256,9 @@
 #define SDHCI_SRS10_BVS_1_8V    (0x5U << 9)
 #define SDHCI_SRS10_BVS_3_0V    (0x6U << 9)
 #define SDHCI_SRS10_BVS_3_3V    (0x7U << 9)
+#define SDHCI_SRS10_DMA_MASK    (0x3U << 3)
 #define SDHCI_SRS10_DMA_SDMA    (0x0U << 3)
+#define SDHCI_SRS10_DMA_ADMA2   (0x2U << 3)
 
 /* SRS11 - Clock Control / Timeout / Software Reset */
 #define SDHCI_SRS11_ICE         (1U << 0)   /* Internal clock enable */
@@ -297,7 +335,12 @@
 #define SDHCI_SRS15_A64         (1U << 29)  /* 64-bit addressing */
 #define SDHCI_SRS15_HV4E        (1U << 28)  /* Host version 4 enable */
 #define SDHCI_SRS15_UMS_MASK    (0x7U << 16)
+#define SDHCI_SRS15_UMS_SDR12   (0x0U << 16)
 #define SDHCI_SRS15_UMS_SDR25   (0x1U << 16)
+#define SDHCI_SRS15_UMS_SDR50   (0x2U << 16)
+#define SDHCI_SRS15_UMS_SDR104  (0x3U << 16)  /* also eMMC HS200 */
+#define SDHCI_SRS15_UMS_HS400   (0x5U << 16)  /* vendor defined (Arasan) */
+#define SDHCI_SRS15_V18SE       (1U << 19)  /* 1.8V signaling enable */
 #define SDHCI_SRS15_DSS_MASK    (0x3U << 20)
 #define SDHCI_SRS15_DSS_TYPE_B  (0x0U << 20)
 #define SDHCI_SRS15_EXTNG       (1U << 22)  /* Execute tuning */
@@ -309,6 +352,7 @@
 #define SDHCI_SRS16_TCU         (1U << 7)   /* Timeout clock unit (1=MHz) */
 #define SDHCI_SRS16_BCSDCLK_SHIFT   8
 #define SDHCI_SRS16_BCSDCLK_MASK    (0xFFU << 8)
+#define SDHCI_SRS16_ADMA2S      (1U << 19)  /* ADMA2 supported */
 #define SDHCI_SRS16_VS33        (1U << 24)  /* 3.3V supported */
 #define SDHCI_SRS16_VS30        (1U << 25)  /* 3.0V supported */
 #define SDHCI_SRS16_VS18        (1U << 26)  /* 1.8V supported */
@@ -321,6 +365,13 @@
 #define SDHCI_SRS17_TSDR50      (1U << 13)  /* Tuning for SDR50 required */
 
 /* SRS18 - Maximum Current */
+/* ADMA2 descriptor attributes (word 0: attributes [15:0], length [31:16]) */
+#define SDHCI_ADMA2_ATTR_VALID  (1U << 0)
+#define SDHCI_ADMA2_ATTR_END    (1U << 1)
+#define SDHCI_ADMA2_ATTR_INT    (1U << 2)
+#define SDHCI_ADMA2_ATTR_TRAN   (0x2U << 4)
+#define SDHCI_ADMA2_LEN_SHIFT   16
+
 #define SDHCI_SRS18_MC33_SHIFT  0
 #define SDHCI_SRS18_MC33_MASK   (0xFFU << 0)
 #define SDHCI_SRS18_MC18_SHIFT  16
@@ -335,6 +386,7 @@
 #define MMC_CMD2_ALL_SEND_CID   2
 #define MMC_CMD3_SET_REL_ADDR   3
 #define MMC_CMD7_SELECT_CARD    7
+#define MMC_CMD8_SEND_EXT_CSD   8
 #define MMC_CMD9_SEND_CSD       9
 #define MMC_CMD12_STOP_TRANS    12
 #define MMC_CMD13_SEND_STATUS   13
@@ -342,10 +394,12 @@
 #define MMC_CMD18_READ_MULTIPLE 18
 #define MMC_CMD24_WRITE_SINGLE  24
 #define MMC_CMD25_WRITE_MULTIPLE 25
+#define MMC_CMD21_SEND_TUNING   21
 
 /* SD card-specific commands */
 #define SD_CMD6_SWITCH_FUNC     6
 #define SD_CMD8_SEND_IF_COND    8
+#define SD_CMD11_VOLTAGE_SWITCH 11
 #define SD_CMD16                16
 #define SD_CMD19_SEND_TUNING    19
 #define SD_CMD55_APP_CMD        55
@@ -378,6 +432,9 @@
 #define SDCARD_SWITCH_FUNC_MODE_CHECK   (0U << 31)
 #define SDCARD_SWITCH_FUNC_MODE_SWITCH  (1U << 31)
 #define SDCARD_SWITCH_ACCESS_MODE_SDR25 0x01
+#define SDCARD_SWITCH_ACCESS_MODE_SDR50 0x02
+#define SDCARD_SWITCH_ACCESS_MODE_SDR104 0x03
+#define SDCARD_TUNING_BLOCK_SIZE 64
 
 /* SCR register */
 #define SCR_REG_DATA_SIZE       8
@@ -392,6 +449,18 @@
 #define MMC_EXT_CSD_WIDTH_8BIT  0x02U
 #define MMC_EXT_CSD_WIDTH_4BIT_DDR  0x05U
 #define MMC_EXT_CSD_WIDTH_8BIT_DDR  0x06U
+#define MMC_EXT_CSD_SIZE        512
+#define MMC_SWITCH_WRITE_BYTE   0x03000000U
+#define MMC_EXT_CSD_BUS_WIDTH   183
+#define MMC_EXT_CSD_HS_TIMING   185
+#define MMC_EXT_CSD_DEVICE_TYPE 196
+#define MMC_EXT_CSD_SEC_COUNT   212
+#define MMC_EXT_CSD_TIMING_LEGACY   0x00U
+#define MMC_EXT_CSD_TIMING_HS       0x01U
+#define MMC_EXT_CSD_TIMING_HS200    0x02U
+#define MMC_EXT_CSD_TIMING_HS400    0x03U
+#define MMC_EXT_CSD_TYPE_HS200_1_8V (1U << 4)
+#define MMC_EXT_CSD_TYPE_HS400_1_8V (1U << 6)
 
 /* IRQ status flags */
 #define SDHCI_IRQ_FLAG_CC       0x01
@@ -81,6 +81,10 @@ void spi_cs_on(uint32_t base, int pin);
 void spi_cs_off(uint32_t base, int pin);
 void spi_write(const char byte);
 uint8_t spi_read(void);
+/* Clock sz bytes with CS already asserted. tx == NULL sends 0xFF, rx == NULL
+ * discards. Drivers with a FIFO/DMA burst define SPI_DRV_HAS_BURST, otherwise
+ * spi_flash.c falls back to spi_write()/spi_read() per byte. */
+void spi_burst(const uint8_t *tx, uint8_t *rx, uint32_t sz);
 #endif
 
 #ifdef WOLFBOOT_TPM
@@ -118,6 +122,20 @@ int qspi_transfer(uint8_t fmode, const uint8_t cmd,
     uint8_t* data, uint32_t dataSz, uint32_t dataMode
 );
 
+#ifdef QSPI_FLASH_MMAP
+#define QSPI_MODE_MMAP  3
+
+/* Switch the controller to memory-mapped reads using the given read command.
+ * Returns the CPU address of flash offset 0, or NULL on failure. */
+void* qspi_mmap_enable(const uint8_t cmd,
+    uint32_t addrSz, uint32_t addrMode,
+    uint32_t alt, uint32_t altSz, uint32_t altMode,
+    uint32_t dummySz, uint32_t dataMode
+);
+/* Leave memory-mapped mode, before any qspi_transfer() */
+void qspi_mmap_disable(void);
+#endif
+
 #endif /* QSPI_FLASH || OCTOSPI_FLASH */
 
 #ifndef SPI_CS_FLASH
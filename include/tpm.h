@@ -70,6 +70,9 @@ int CSME_NSE_API wolfBoot_tpm2_parse_attest(const TPM2B_ATTEST* in, TPMS_ATTEST*
 
 /* Internal wolfBoot TPM API's */
 int  wolfBoot_tpm2_init(void);
+void wolfBoot_tpm2_init_start(void);
+int  wolfBoot_tpm2_init_poll(void);
+int  wolfBoot_tpm2_init_wait(void);
 void wolfBoot_tpm2_deinit(void);
 
 int wolfBoot_tpm2_clear(void);
@@ -119,11 +122,42 @@ uint32_t wolfBoot_tpm_pcrmask_sel(uint32_t pcrMask, uint8_t* pcrArray,
 #endif
 
 #ifdef WOLFBOOT_MEASURED_BOOT
+#ifndef WOLFBOOT_MEASURED_LOG_ENTRIES
+    #define WOLFBOOT_MEASURED_LOG_ENTRIES 4
+#endif
+#define WOLFBOOT_MEASURED_EVENT_SZ        16
+
+/* TCG PC Client event types used for the event log entries */
+#define WOLFBOOT_EV_POST_CODE             0x00000001 /* wolfBoot code */
+#define WOLFBOOT_EV_IPL                   0x0000000D /* verified image */
+
+/* Event log entry, same fields as a TCG_PCR_EVENT2 with a single digest of
+ * the PCR bank WOLFBOOT_TPM_PCR_ALG */
+struct wolfBoot_tpm_event {
+    uint32_t pcrIndex;
+    uint32_t eventType;
+    uint8_t  digest[WOLFBOOT_TPM_PCR_DIG_SZ];
+    uint32_t eventSize;
+    uint8_t  event[WOLFBOOT_MEASURED_EVENT_SZ];
+};
+
 int wolfBoot_tpm2_extend(uint8_t pcrIndex, uint8_t* hash, int line);
+int wolfBoot_tpm2_measure(uint8_t pcrIndex, uint32_t eventType,
+    const uint8_t* hash, const char* desc);
+int wolfBoot_tpm2_measure_image(uint8_t pcrIndex, struct wolfBoot_image* img);
+int wolfBoot_tpm2_get_event_log(const struct wolfBoot_tpm_event** log,
+    uint32_t* count);
 
-/* helper for measuring boot at line */
+/* helper for measuring wolfBoot code */
 #define measure_boot(hash) \
-    wolfBoot_tpm2_extend(WOLFBOOT_MEASURED_PCR_A, (hash), __LINE__)
+    wolfBoot_tpm2_measure(WOLFBOOT_MEASURED_PCR_A, WOLFBOOT_EV_POST_CODE, \
+        (hash), "wolfBoot")
+
+#ifdef WOLFBOOT_MEASURED_BOOT_APP_PARTITION
+/* helper for measuring the boot image, once verified */
+#define measure_image(img) \
+    wolfBoot_tpm2_measure_image(WOLFBOOT_MEASURED_PCR_A, (img))
+#endif
 #endif /* WOLFBOOT_MEASURED_BOOT */
 
 int wolfBoot_tpm_self_test(void);
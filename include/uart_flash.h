@@ -42,4 +42,67 @@
     #define uart_send_current_version() do{}while(0)
 #endif /* UART_FLASH */
 
+/* Protocol v1: every byte is acknowledged with CMD_ACK */
+#define CMD_HDR_WOLF  'W'
+#define CMD_HDR_VER   'V'
+#define CMD_APP_VER   '*'
+#define CMD_HDR_WRITE 0x01
+#define CMD_HDR_READ  0x02
+#define CMD_HDR_ERASE 0x03
+#define CMD_HDR_HELLO 0x10 /* Answered with CMD_ACK + protocol version */
+#define CMD_ACK       0x06
+
+#define UART_FLASH_PROTO_V1 0x01
+#define UART_FLASH_PROTO_V2 0x02
+
+/* Protocol v2: frames
+ *
+ *   SOF | type | seq | len (LE16) | payload (len) | CRC-16 (LE16)
+ *
+ * The CRC (CCITT, init 0xFFFF) covers type, seq, len and payload.
+ *
+ * A transfer starts with a command frame (WRITE, READ, ERASE) carrying
+ * address and length (LE32 each). Its seq is a running counter kept by the
+ * target across transfers, so that stale frames from a previous transfer are
+ * never taken for new ones. Data frames follow with seq + 1, seq + 2, ...
+ * (modulo 256), each carrying up to UART_FLASH_FRAME_MAX bytes. The sender
+ * keeps up to UART_FLASH_WINDOW frames in flight; the receiver answers each
+ * frame received in order with ACK(next seq), and a corrupted or
+ * out-of-order frame with NAK(next seq), after which the sender goes back to
+ * that frame. ERASE is acknowledged with ACK(seq + 1) once done. ERR rejects
+ * a command.
+ */
+#define UART_FLASH_SOF              0xA5
+#define UART_FLASH_FRAME_MAX        256
+#define UART_FLASH_WINDOW           4
+#define UART_FLASH_FRAME_HDR_SIZE   4
+#define UART_FLASH_CMD_SIZE         8
+
+#define UART_FLASH_FRAME_WRITE      0x01
+#define UART_FLASH_FRAME_READ       0x02
+#define UART_FLASH_FRAME_ERASE      0x03
+#define UART_FLASH_FRAME_DATA       0x10
+#define UART_FLASH_FRAME_ACK        0x11
+#define UART_FLASH_FRAME_NAK        0x12
+#define UART_FLASH_FRAME_ERR        0x13
+
+#define UART_FLASH_CRC_INIT         0xFFFF
+
+static inline uint16_t uart_flash_crc16(uint16_t crc, const uint8_t *p,
+    uint32_t len)
+{
+    uint32_t i;
+    int b;
+    for (i = 0; i < len; i++) {
+        crc ^= (uint16_t)p[i] << 8;
+        for (b = 0; b < 8; b++) {
+            if (crc & 0x8000)
+                crc = (uint16_t)((crc << 1) ^ 0x1021);
+            else
+                crc = (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
 #endif /* !UART_FLASH_DRI_H */
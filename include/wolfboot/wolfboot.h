@@ -164,6 +164,24 @@ extern "C" {
 #    endif
 #endif
 
+/* Sectors reserved at the end of each partition for the trailer (flags) */
+#ifdef NVM_FLASH_JOURNAL
+#    ifndef NVM_FLASH_WRITEONCE
+#        error "NVM_FLASH_JOURNAL requires NVM_FLASH_WRITEONCE"
+#    endif
+#    ifndef NVM_JOURNAL_SECTORS
+#        define NVM_JOURNAL_SECTORS 4
+#    endif
+#    if NVM_JOURNAL_SECTORS < 2
+#        error "NVM_JOURNAL_SECTORS must be at least 2"
+#    endif
+#    define WOLFBOOT_TRAILER_SECTORS NVM_JOURNAL_SECTORS
+#elif defined(NVM_FLASH_WRITEONCE)
+#    define WOLFBOOT_TRAILER_SECTORS 2
+#else
+#    define WOLFBOOT_TRAILER_SECTORS 1
+#endif
+
 #ifdef WOLFBOOT_SELF_HEADER
 #ifndef WOLFBOOT_SELF_HEADER_SIZE
 #define WOLFBOOT_SELF_HEADER_SIZE IMAGE_HEADER_SIZE
@@ -201,6 +219,7 @@ extern "C" {
 #define HDR_IMG_DELTA_BASE          0x05
 #define HDR_IMG_DELTA_SIZE          0x06
 #define HDR_IMG_DELTA_BASE_HASH     0x07
+#define HDR_MERKLE_ROOT             0x08
 #define HDR_PUBKEY                  0x10
 #define HDR_SECONDARY_CIPHER        0x11
 #define HDR_SECONDARY_PUBKEY        0x12
@@ -208,6 +227,7 @@ extern "C" {
 #define HDR_SHA384                  0x14
 #define HDR_IMG_DELTA_INVERSE       0x15
 #define HDR_IMG_DELTA_INVERSE_SIZE  0x16
+#define HDR_IMG_RAW_SIZE            0x17
 #define HDR_SIGNATURE               0x20
 #define HDR_POLICY_SIGNATURE        0x21
 #define HDR_SECONDARY_SIGNATURE     0x22
@@ -249,6 +269,8 @@ extern "C" {
 #define HDR_IMG_TYPE_AUTH_ML_DSA  (AUTH_KEY_ML_DSA  << 8)
 
 #define HDR_IMG_TYPE_DIFF         0x00D0
+#define HDR_IMG_TYPE_DIFF_RC      0x00E0 /* Delta, range-coded patch */
+#define HDR_IMG_TYPE_LZ4          0x00C0 /* Payload is an LZ4 frame */
 
 #define HDR_IMG_TYPE_PART_MASK    0x000F
 #define HDR_IMG_TYPE_WOLFBOOT     0x0000
@@ -120,6 +120,8 @@
 
 #define AHCI_CAP_SSS  (1 << 27)      /* Staggered spin-up mode supported */
 #define AHCI_CAP_SAM (1 << 18)
+#define AHCI_CAP_SNCQ (1 << 30)      /* Native Command Queuing supported */
+#define AHCI_CAP_NCS(cap) ((((cap) >> 8) & 0x1F) + 1) /* Command slots */
 
 #define AHCI_PORT_CMD_CPD  (1 << 20) /* Cold-presence detection */
 #define AHCI_PORT_CMD_POD  (1 << 2)  /* Power On Device */
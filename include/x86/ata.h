@@ -51,6 +51,12 @@ int ata_security_freeze_lock(int drv);
 int ata_security_unlock_device(int drv, const char *passphrase, int master);
 int ata_cmd_complete_async();
 
+/* Each AHCI port has one command table per command slot, see HBA_TBL_SIZE in
+ * ahci.c. Queued reads use up to ATA_MAX_CMD_SLOTS slots at a time.
+ */
+#define ATA_MAX_CMD_SLOTS   8
+#define ATA_CMD_TABLE_SIZE  0x100
+
 /* @brief Enum with the possible state for each drive.
  * See ATA/ATAPI Command Set (ATA8-ACS) section 4.7.4
  */
@@ -87,6 +93,7 @@ enum ata_security_state ata_security_get_state(int);
 /* ATA commands */
 
 #define ATA_CMD_READ_DMA_EX 0x25
+#define ATA_CMD_READ_FPDMA_QUEUED 0x60
 #define ATA_CMD_WRITE_DMA_EX 0x35
 #define ATA_CMD_DEVICE_CONFIGURATION_IDENTIFY 0xB1
 #define ATA_CMD_WRITE_DMA 0xCA
@@ -41,6 +41,13 @@ ifeq ($(MEASURED_BOOT),1)
   ifeq ($(MEASURED_BOOT_APP_PARTITION),1)
     CFLAGS+=-D"WOLFBOOT_MEASURED_BOOT_APP_PARTITION"
   endif
+  ifeq ($(MEASURED_BOOT_SELF_CACHE),1)
+    CFLAGS+=-D"WOLFBOOT_MEASURED_BOOT_SELF_CACHE"
+    ifeq ($(WOLFBOOT_BUILD_ID),)
+      $(error WOLFBOOT_BUILD_ID must be set when MEASURED_BOOT_SELF_CACHE=1)
+    endif
+    CFLAGS+=-DWOLFBOOT_BUILD_ID='"$(WOLFBOOT_BUILD_ID)"'
+  endif
 endif
 
 ## TPM keystore
@@ -569,6 +576,9 @@ ifeq ($(SPI_FLASH),1)
   else
     WOLFCRYPT_OBJS+=hal/spi/spi_drv_$(SPI_TARGET).o
   endif
+  ifeq ($(SPI_FLASH_SFDP),1)
+    CFLAGS+=-D"SPI_FLASH_SFDP"
+  endif
 endif
 
 ifeq ($(OCTOSPI_FLASH),1)
@@ -586,6 +596,9 @@ ifeq ($(QSPI_FLASH),1)
   else
     WOLFCRYPT_OBJS+=hal/spi/spi_drv_$(SPI_TARGET).o
   endif
+  ifeq ($(QSPI_FLASH_MMAP),1)
+    CFLAGS+=-D"QSPI_FLASH_MMAP"
+  endif
 endif
 
 # SD Card support (Cadence SDHCI controller)
@@ -705,6 +718,10 @@ ifeq ($(BOOT_BENCHMARK),1)
   CFLAGS+=-D"BOOT_BENCHMARK"
 endif
 
+ifneq ($(WOLFBOOT_HASH_CHUNK_SIZE),)
+  CFLAGS+=-DWOLFBOOT_HASH_CHUNK_SIZE=$(WOLFBOOT_HASH_CHUNK_SIZE)
+endif
+
 ifeq ($(ALLOW_DOWNGRADE),1)
   CFLAGS+= -D"ALLOW_DOWNGRADE"
 endif
@@ -713,8 +730,27 @@ ifeq ($(WOLFBOOT_SKIP_BOOT_VERIFY),1)
   CFLAGS+=-D"WOLFBOOT_SKIP_BOOT_VERIFY"
 endif
 
+ifeq ($(WOLFBOOT_VERIFY_TICKET),1)
+  CFLAGS+=-D"WOLFBOOT_VERIFY_TICKET"
+endif
+
+ifeq ($(WOLFBOOT_MERKLE),1)
+  CFLAGS+=-D"WOLFBOOT_MERKLE"
+  SIGN_OPTIONS+=--merkle
+endif
+
+ifeq ($(WOLFBOOT_SKIP_SAME_SECTORS),1)
+  CFLAGS+=-D"WOLFBOOT_SKIP_SAME_SECTORS"
+endif
+
 ifeq ($(NVM_FLASH_WRITEONCE),1)
   CFLAGS+= -D"NVM_FLASH_WRITEONCE"
+  ifeq ($(NVM_FLASH_JOURNAL),1)
+    CFLAGS+= -D"NVM_FLASH_JOURNAL"
+    ifneq ($(NVM_JOURNAL_SECTORS),)
+      CFLAGS+= -D"NVM_JOURNAL_SECTORS=$(NVM_JOURNAL_SECTORS)"
+    endif
+  endif
 endif
 
 ifeq ($(DISABLE_BACKUP),1)
@@ -777,6 +813,9 @@ ifeq ($(DELTA_UPDATES),1)
   ifneq ($(DELTA_BLOCK_SIZE),)
     CFLAGS+=-DDELTA_BLOCK_SIZE=$(DELTA_BLOCK_SIZE)
   endif
+  ifeq ($(DELTA_RANGE_CODER),1)
+    CFLAGS+=-DDELTA_RANGE_CODER
+  endif
 endif
 
 ifeq ($(ARMORED),1)
@@ -904,6 +943,9 @@ ifeq ($(WOLFTPM),1)
   CFLAGS+=-I$(WOLFBOOT_LIB_WOLFTPM)
   CFLAGS+=-D"WOLFBOOT_TPM"
   CFLAGS+=-D"WOLFTPM_SMALL_STACK"
+  ifeq ($(WOLFBOOT_TPM_INIT_ASYNC),1)
+    CFLAGS+=-D"WOLFBOOT_TPM_INIT_ASYNC"
+  endif
   ifneq ($(SPI_FLASH),1)
     # don't use spi if we're using simulator
     ifeq ($(TARGET),sim)
@@ -1000,6 +1042,11 @@ ifeq ($(ELF),1)
 
 endif
 
+ifeq ($(LZ4),1)
+  CFLAGS+=-DWOLFBOOT_LZ4
+  OBJS += src/lz4.o
+endif
+
 ifeq ($(MULTIBOOT2),1)
   CFLAGS+=-DWOLFBOOT_MULTIBOOT2
   OBJS += src/multiboot.o
@@ -1020,6 +1067,10 @@ ifeq ($(WOLFBOOT_UNIVERSAL_KEYSTORE),1)
   CFLAGS+=-DWOLFBOOT_UNIVERSAL_KEYSTORE
 endif
 
+ifeq ($(WOLFBOOT_DISK_CACHE),1)
+  CFLAGS+=-D"WOLFBOOT_DISK_CACHE"
+endif
+
 ifeq ($(DISK_LOCK),1)
   CFLAGS+=-DWOLFBOOT_ATA_DISK_LOCK
   ifneq ($(DISK_LOCK_PASSWORD),)
@@ -282,8 +282,7 @@ int wolfBoot_image_measure(uint8_t *image)
     }
 
     wolfBoot_print_hexstr(img.sha_hash, WOLFBOOT_SHA_DIGEST_SIZE, 0);
-    return wolfBoot_tpm2_extend(WOLFBOOT_MEASURED_PCR_A, img.sha_hash,
-        __LINE__);
+    return wolfBoot_tpm2_measure_image(WOLFBOOT_MEASURED_PCR_A, &img);
 }
 #endif /* WOLFBOOT_MEASURED_BOOT */
 
@@ -406,7 +405,8 @@ static int self_extend_pcr(void)
     } while (position < sz);
     wc_Sha256Final(&sha256_ctx, hash);
     wolfBoot_print_hexstr(hash, SHA256_DIGEST_SIZE, 0);
-    return wolfBoot_tpm2_extend(WOLFBOOT_MEASURED_PCR_A, hash, __LINE__);
+    return wolfBoot_tpm2_measure(WOLFBOOT_MEASURED_PCR_A,
+        WOLFBOOT_EV_POST_CODE, hash, "stage1");
 }
 #endif
 
@@ -68,6 +68,41 @@ int wb_patch_init(WB_PATCH_CTX *bm, uint8_t *src, uint32_t ssz, uint8_t *patch,
     return 0;
 }
 
+#ifdef WB_PATCH_RC
+#define RC_TOP        (1UL << 24)
+#define RC_MODEL_BITS 11
+#define RC_MOVE_BITS  5
+#define RC_PROB_INIT  (1 << (RC_MODEL_BITS - 1))
+
+/* The model used for each byte depends on its role in the patch stream:
+ * literal, byte following ESC, offset or size field of a block header.
+ */
+static uint8_t rc_next_state(uint8_t state, uint8_t c)
+{
+    switch (state) {
+        case 0:
+            return (c == ESC) ? 1 : 0;
+        case 1:
+            return (c == ESC) ? 0 : 2;
+        case 5:
+            return 0;
+        default:
+            return state + 1;
+    }
+}
+
+static const uint8_t rc_state_model[6] = { 0, 1, 2, 2, 3, 3 };
+
+static void rc_reset_models(uint16_t probs[WB_RC_CONTEXTS][256])
+{
+    int i, j;
+    for (i = 0; i < WB_RC_CONTEXTS; i++) {
+        for (j = 0; j < 256; j++)
+            probs[i][j] = RC_PROB_INIT;
+    }
+}
+#endif
+
 #ifdef EXT_FLASH
 #define PATCH_CACHE_SIZE 256
 #define DELTA_SWAP_CACHE_SIZE 1024
@@ -90,6 +125,23 @@ static inline uint8_t *patch_read_cache(WB_PATCH_CTX *ctx)
 }
 
 
+#ifdef WB_PATCH_RC
+/* Read one byte from the range-coded container */
+static inline int rc_fetch(WB_PATCH_CTX *ctx, uint32_t off)
+{
+    if (off >= ctx->rc.c_size)
+        return -1;
+    if ((ctx->patch_cache_start == 0xFFFFFFFF) ||
+            (off < ctx->patch_cache_start) ||
+            (off >= ctx->patch_cache_start + DELTA_PATCH_BLOCK_SIZE)) {
+        ctx->patch_cache_start = off;
+        ext_flash_check_read((uintptr_t)(ctx->patch_base + off),
+                ctx->patch_cache, DELTA_PATCH_BLOCK_SIZE);
+    }
+    return ctx->patch_cache[off - ctx->patch_cache_start];
+}
+#endif
+
 #else
 
 static inline uint8_t *patch_read_cache(WB_PATCH_CTX *ctx)
@@ -97,8 +149,165 @@ static inline uint8_t *patch_read_cache(WB_PATCH_CTX *ctx)
     return ctx->patch_base + ctx->p_off;
 }
 
+#ifdef WB_PATCH_RC
+static inline int rc_fetch(WB_PATCH_CTX *ctx, uint32_t off)
+{
+    if (off >= ctx->rc.c_size)
+        return -1;
+    return ctx->patch_base[off];
+}
 #endif
 
+#endif
+
+#ifdef WB_PATCH_RC
+int wb_patch_init_rc(WB_PATCH_CTX *bm, uint8_t *src, uint32_t ssz,
+        uint8_t *patch, uint32_t psz)
+{
+    uint8_t hdr[WB_RC_HDR_SIZE];
+    uint32_t raw_size;
+    int i, c;
+
+    if (psz < WB_RC_HDR_SIZE)
+        return -1;
+    if (wb_patch_init(bm, src, ssz, patch, psz) != 0)
+        return -1;
+    bm->coded = 1;
+    bm->rc.c_size = psz;
+    for (i = 0; i < WB_RC_HDR_SIZE; i++) {
+        c = rc_fetch(bm, i);
+        if (c < 0)
+            return -1;
+        hdr[i] = (uint8_t)c;
+    }
+    raw_size = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) |
+        ((uint32_t)hdr[3] << 24);
+    bm->rc.frame_size = hdr[4] | (hdr[5] << 8);
+    if ((raw_size == 0) || (bm->rc.frame_size == 0) ||
+            (bm->rc.frame_size > WB_RC_FRAME_MAX) ||
+            ((hdr[6] | (hdr[7] << 8)) != WB_RC_VERSION))
+        return -1;
+    /* From now on, patch_size and p_off refer to the decoded stream */
+    bm->patch_size = raw_size;
+    bm->rc.c_off = WB_RC_HDR_SIZE;
+    return 0;
+}
+
+static int rc_start_frame(WB_PATCH_CTX *ctx)
+{
+    struct wb_patch_rc *rc = &ctx->rc;
+    uint32_t decoded = rc->win_start + rc->win_len;
+    int lo, hi, i, c;
+    uint32_t c_len;
+
+    lo = rc_fetch(ctx, rc->c_off);
+    hi = rc_fetch(ctx, rc->c_off + 1);
+    if ((lo < 0) || (hi < 0))
+        return -1;
+    rc->c_off += 2;
+    rc->frame_left = ctx->patch_size - decoded;
+    if (rc->frame_left > rc->frame_size)
+        rc->frame_left = rc->frame_size;
+    c_len = (uint32_t)lo | ((uint32_t)(hi & 0x7F) << 8);
+    rc->stored = ((hi << 8) & WB_RC_FRAME_STORED) ? 1 : 0;
+    if (rc->stored && (c_len != rc->frame_left))
+        return -1;
+    if (c_len > rc->c_size - rc->c_off)
+        return -1;
+    rc->frame_end = rc->c_off + c_len;
+    if (!rc->stored) {
+        if (c_len < 5)
+            return -1;
+        rc_reset_models(rc->probs);
+        rc->range = 0xFFFFFFFFUL;
+        rc->code = 0;
+        for (i = 0; i < 5; i++) {
+            c = rc_fetch(ctx, rc->c_off++);
+            if (c < 0)
+                return -1;
+            rc->code = (rc->code << 8) | (uint32_t)c;
+        }
+    }
+    return 0;
+}
+
+static int rc_decode_byte(WB_PATCH_CTX *ctx)
+{
+    struct wb_patch_rc *rc = &ctx->rc;
+    uint16_t *probs;
+    uint32_t m = 1;
+    int c;
+
+    if ((rc->frame_left == 0) && (rc_start_frame(ctx) < 0))
+        return -1;
+    if (rc->stored) {
+        c = rc_fetch(ctx, rc->c_off++);
+        if (c < 0)
+            return -1;
+    } else {
+        probs = rc->probs[rc_state_model[rc->state]];
+        while (m < 0x100) {
+            uint32_t bound = (rc->range >> RC_MODEL_BITS) * probs[m];
+            if (rc->code < bound) {
+                rc->range = bound;
+                probs[m] += ((1 << RC_MODEL_BITS) - probs[m]) >> RC_MOVE_BITS;
+                m <<= 1;
+            } else {
+                rc->code -= bound;
+                rc->range -= bound;
+                probs[m] -= probs[m] >> RC_MOVE_BITS;
+                m = (m << 1) | 1;
+            }
+            if (rc->range < RC_TOP) {
+                if (rc->c_off >= rc->frame_end)
+                    return -1;
+                c = rc_fetch(ctx, rc->c_off++);
+                if (c < 0)
+                    return -1;
+                rc->range <<= 8;
+                rc->code = (rc->code << 8) | (uint32_t)c;
+            }
+        }
+        c = (int)(m - 0x100);
+    }
+    rc->state = rc_next_state(rc->state, (uint8_t)c);
+    if (--rc->frame_left == 0)
+        rc->c_off = rc->frame_end;
+    return c;
+}
+
+/* Returns a pointer to the decoded patch stream at p_off, with at least
+ * BLOCK_HDR_SIZE bytes available (or whatever is left until the end).
+ */
+static uint8_t *patch_read_coded(WB_PATCH_CTX *ctx)
+{
+    struct wb_patch_rc *rc = &ctx->rc;
+    uint32_t need = ctx->patch_size - ctx->p_off;
+    int c;
+
+    if (need > BLOCK_HDR_SIZE)
+        need = BLOCK_HDR_SIZE;
+    if (ctx->p_off < rc->win_start)
+        return NULL;
+    if (ctx->p_off + need > rc->win_start + rc->win_len) {
+        uint32_t drop = ctx->p_off - rc->win_start;
+        if (drop > rc->win_len)
+            return NULL;
+        memmove(rc->win, rc->win + drop, rc->win_len - drop);
+        rc->win_len -= drop;
+        rc->win_start = ctx->p_off;
+        while ((rc->win_len < WB_RC_WINDOW_SIZE) &&
+                (rc->win_start + rc->win_len < ctx->patch_size)) {
+            c = rc_decode_byte(ctx);
+            if (c < 0)
+                return NULL;
+            rc->win[rc->win_len++] = (uint8_t)c;
+        }
+    }
+    return rc->win + (ctx->p_off - rc->win_start);
+}
+#endif /* WB_PATCH_RC */
+
 int wb_patch(WB_PATCH_CTX *ctx, uint8_t *dst, uint32_t len)
 {
     struct block_hdr *hdr;
@@ -113,7 +322,15 @@ int wb_patch(WB_PATCH_CTX *ctx, uint8_t *dst, uint32_t len)
         return -1;
 
     while ( ( (ctx->matching != 0) || (ctx->p_off < ctx->patch_size)) && (dst_off < len)) {
-        uint8_t *pp = patch_read_cache(ctx);
+        uint8_t *pp;
+#ifdef WB_PATCH_RC
+        if (ctx->coded) {
+            pp = patch_read_coded(ctx);
+            if (pp == NULL)
+                return -1;
+        } else
+#endif
+        pp = patch_read_cache(ctx);
         if (ctx->matching) {
             /* Resume matching block from previous sector */
             resume_sz = ctx->blk_sz;
@@ -186,6 +403,9 @@ int wb_patch(WB_PATCH_CTX *ctx, uint8_t *dst, uint32_t len)
 #include <errno.h>
 #include <limits.h>     /* INT_MAX */
 #include <inttypes.h>   /* PRIu32  */
+#ifdef WB_DIFF_THREADS
+#include <pthread.h>
+#endif
 
 static uint32_t wolfboot_sector_size = 0;
 
@@ -240,23 +460,628 @@ int wb_diff_get_sector_size(void)
     return (int)sec_sz;
 }
 
-int wb_diff_init(WB_DIFF_CTX *ctx, uint8_t *src_a, uint32_t len_a, uint8_t *src_b, uint32_t len_b)
+#define WB_DIFF_NO_POS 0xFFFFFFFFUL
+
+/* Hash of the BLOCK_HDR_SIZE (6) bytes starting at p */
+static uint32_t wb_diff_hash(const uint8_t *p, uint32_t bits)
+{
+    uint64_t v = (uint64_t)p[0] | ((uint64_t)p[1] << 8) |
+        ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+        ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40);
+    return (uint32_t)((v * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+/* Returns the offset of the first occurrence of 'key' in 'src', or
+ * WB_DIFF_NO_POS if the sequence is not present in the index.
+ */
+static uint32_t wb_diff_index_lookup(const struct wb_diff_index *idx,
+        const uint8_t *src, const uint8_t *key)
+{
+    uint32_t k;
+    if (idx->n_pos == 0)
+        return WB_DIFF_NO_POS;
+    k = idx->bucket[wb_diff_hash(key, idx->bits)];
+    while (k != WB_DIFF_NO_POS) {
+        if (memcmp(src + k, key, BLOCK_HDR_SIZE) == 0)
+            break;
+        k = idx->next_key[k];
+    }
+    return k;
+}
+
+static void wb_diff_index_free(struct wb_diff_index *idx)
+{
+    free(idx->bucket);
+    free(idx->next_key);
+    free(idx->next_pos);
+    free(idx->cursor);
+    memset(idx, 0, sizeof(struct wb_diff_index));
+}
+
+/* Index every BLOCK_HDR_SIZE sequence in 'src'. Each distinct sequence
+ * (key) is identified by the offset of its first occurrence, and links
+ * all its other occurrences in ascending order via next_pos.
+ */
+static int wb_diff_index_build(struct wb_diff_index *idx, const uint8_t *src,
+        uint32_t size)
+{
+    uint32_t i, k, h;
+    uint32_t n_buckets;
+
+    memset(idx, 0, sizeof(struct wb_diff_index));
+    if (size < BLOCK_HDR_SIZE)
+        return 0;
+    idx->n_pos = size - BLOCK_HDR_SIZE + 1;
+    idx->bits = 10;
+    while ((idx->bits < 28) && ((1UL << idx->bits) < idx->n_pos))
+        idx->bits++;
+    n_buckets = 1UL << idx->bits;
+
+    idx->bucket = malloc(n_buckets * sizeof(uint32_t));
+    idx->next_key = malloc(idx->n_pos * sizeof(uint32_t));
+    idx->next_pos = malloc(idx->n_pos * sizeof(uint32_t));
+    idx->cursor = malloc(idx->n_pos * sizeof(uint32_t));
+    if (!idx->bucket || !idx->next_key || !idx->next_pos || !idx->cursor) {
+        wb_diff_index_free(idx);
+        return -1;
+    }
+    memset(idx->bucket, 0xFF, n_buckets * sizeof(uint32_t));
+    memset(idx->next_key, 0xFF, idx->n_pos * sizeof(uint32_t));
+    memset(idx->next_pos, 0xFF, idx->n_pos * sizeof(uint32_t));
+    memset(idx->cursor, 0xFF, idx->n_pos * sizeof(uint32_t));
+
+    for (i = 0; i < idx->n_pos; i++) {
+        k = wb_diff_index_lookup(idx, src, src + i);
+        if (k == WB_DIFF_NO_POS) {
+            /* New key. During the build, cursor tracks the tail of the list */
+            h = wb_diff_hash(src + i, idx->bits);
+            idx->next_key[i] = idx->bucket[h];
+            idx->bucket[h] = i;
+            idx->cursor[i] = i;
+        } else {
+            idx->next_pos[idx->cursor[k]] = i;
+            idx->cursor[k] = i;
+        }
+    }
+    /* Rewind all the cursors to the first occurrence */
+    for (i = 0; i < idx->n_pos; i++) {
+        if (idx->cursor[i] != WB_DIFF_NO_POS)
+            idx->cursor[i] = i;
+    }
+    return 0;
+}
+
+int wb_diff_init_ex(WB_DIFF_CTX *ctx, uint8_t *src_a, uint32_t len_a,
+        uint8_t *src_b, uint32_t len_b, int mode)
 {
     if (!ctx || (len_a == 0) || (len_b == 0))
         return -1;
+    if ((mode != WB_DIFF_MODE_LINEAR) && (mode != WB_DIFF_MODE_HASH) &&
+            (mode != WB_DIFF_MODE_OPTIMAL))
+        return -1;
     memset(ctx, 0, sizeof(WB_DIFF_CTX));
     ctx->src_a = src_a;
     ctx->src_b = src_b;
     ctx->size_a = len_a;
     ctx->size_b = len_b;
+    ctx->mode = mode;
     wolfboot_sector_size = wb_diff_get_sector_size();
     printf("WOLFBOOT_SECTOR_SIZE: %u\n", wolfboot_sector_size);
     return 0;
 }
 
-int wb_diff(WB_DIFF_CTX *ctx, uint8_t *patch, uint32_t len)
+int wb_diff_init(WB_DIFF_CTX *ctx, uint8_t *src_a, uint32_t len_a, uint8_t *src_b, uint32_t len_b)
+{
+    return wb_diff_init_ex(ctx, src_a, len_a, src_b, len_b,
+            WB_DIFF_MODE_LINEAR);
+}
+
+void wb_diff_free(WB_DIFF_CTX *ctx)
+{
+    if (!ctx)
+        return;
+    wb_diff_index_free(&ctx->idx_a);
+    wb_diff_index_free(&ctx->idx_b);
+    free(ctx->plan_len);
+    free(ctx->plan_src);
+    ctx->plan_len = NULL;
+    ctx->plan_src = NULL;
+    ctx->index_ready = 0;
+}
+
+/* Find the first match for the BLOCK_HDR_SIZE bytes at off_b in 'A',
+ * starting from pa_start.
+ */
+static uint8_t *wb_diff_find_a(WB_DIFF_CTX *ctx, uintptr_t pa_start)
+{
+    uint8_t *key = ctx->src_b + ctx->off_b;
+    uint8_t *pa;
+
+    if ((ctx->size_b - ctx->off_b) < BLOCK_HDR_SIZE)
+        return NULL;
+    if ((wolfboot_sector_size - (ctx->off_b % wolfboot_sector_size)) < BLOCK_HDR_SIZE)
+        return NULL;
+
+    if (ctx->mode == WB_DIFF_MODE_HASH) {
+        struct wb_diff_index *idx = &ctx->idx_a;
+        uint32_t k, pos;
+        k = wb_diff_index_lookup(idx, ctx->src_a, key);
+        if (k == WB_DIFF_NO_POS)
+            return NULL;
+        /* pa_start never decreases, so candidates below it can be dropped
+         * for good.
+         */
+        pos = idx->cursor[k];
+        while ((pos != WB_DIFF_NO_POS) && (pos < pa_start))
+            pos = idx->next_pos[pos];
+        idx->cursor[k] = pos;
+        if (pos == WB_DIFF_NO_POS)
+            return NULL;
+        return ctx->src_a + pos;
+    }
+
+    pa = ctx->src_a + pa_start;
+    while ((uintptr_t)(pa - ctx->src_a) < (uintptr_t)ctx->size_a) {
+        if ((uintptr_t)(ctx->size_a - (pa - ctx->src_a)) < BLOCK_HDR_SIZE)
+            break;
+        if (memcmp(pa, key, BLOCK_HDR_SIZE) == 0)
+            return pa;
+        pa++;
+    }
+    return NULL;
+}
+
+/* Find the first match for the BLOCK_HDR_SIZE bytes at off_b in the area
+ * of 'B' that is at least one sector below pb_end.
+ */
+static uint8_t *wb_diff_find_b(WB_DIFF_CTX *ctx, uintptr_t pb_end)
+{
+    uint8_t *key = ctx->src_b + ctx->off_b;
+    uint8_t *pb;
+
+    if ((ctx->size_b - ctx->off_b) < BLOCK_HDR_SIZE)
+        return NULL;
+
+    if (ctx->mode == WB_DIFF_MODE_HASH) {
+        uint32_t k;
+        if (pb_end < wolfboot_sector_size)
+            return NULL;
+        k = wb_diff_index_lookup(&ctx->idx_b, ctx->src_b, key);
+        if ((k == WB_DIFF_NO_POS) || (k > pb_end - wolfboot_sector_size))
+            return NULL;
+        return ctx->src_b + k;
+    }
+
+    pb = ctx->src_b;
+    while ((uintptr_t)(pb - ctx->src_b) < pb_end) {
+        /* Check image boundary */
+        if ((uintptr_t)(ctx->size_b - (pb - ctx->src_b)) < BLOCK_HDR_SIZE)
+            break;
+
+        /* Don't try matching backwards if the distance between the two
+         * blocks is smaller than one sector.
+         */
+        if (wolfboot_sector_size > pb_end - (pb - ctx->src_b))
+            break;
+
+        if (memcmp(pb, key, BLOCK_HDR_SIZE) == 0)
+            return pb;
+        pb++;
+    }
+    return NULL;
+}
+
+static void wb_diff_write_hdr(uint8_t *patch, uintptr_t blk_start,
+        uint16_t match_len)
 {
     struct block_hdr hdr;
+    hdr.esc = ESC;
+    hdr.off[0] = ((blk_start >> 16) & 0x000000FF);
+    hdr.off[1] = ((blk_start >> 8) & 0x000000FF);
+    hdr.off[2] = ((blk_start) & 0x000000FF);
+    hdr.sz[0] = ((match_len >> 8) & 0x00FF);
+    hdr.sz[1] = ((match_len) & 0x00FF);
+    memcpy(patch, &hdr, sizeof(hdr));
+}
+
+/* WB_DIFF_MODE_OPTIMAL
+ *
+ * The patch is planned in two passes over 'B' before anything is emitted:
+ *  - forward: find the longest match available at each offset, following
+ *    the same sector-window rules used by the greedy finder
+ *  - backward: pick, for each offset, the literal or match (of any length up
+ *    to the longest found) that minimizes the encoded size of the remaining
+ *    patch, accounting for the escaped ESC literals.
+ */
+#define WB_DIFF_MAX_CHAIN 64    /* Candidates examined per offset and base */
+#define WB_DIFF_MAX_MATCH 0xFFFF /* Limited by block_hdr sz field */
+
+/* Match sources are encoded in 24 bits, and must not start with ESC,
+ * otherwise the header would be decoded as an escaped ESC literal.
+ */
+static int wb_diff_src_valid(uint32_t src)
+{
+    return ((src >> 24) == 0) && (((src >> 16) & 0xFF) != ESC);
+}
+
+/* Extend a match between 'src' and 'dst', of which the first 'known' bytes
+ * are already known to be identical, up to 'max' bytes.
+ */
+static uint32_t wb_diff_extend(const uint8_t *src, const uint8_t *dst,
+        uint32_t known, uint32_t max)
+{
+    uint32_t l = known;
+    if (l > max)
+        return max;
+    while ((l < max) && (src[l] == dst[l]))
+        l++;
+    return l;
+}
+
+/* Iterative segment tree, returning the offset with the lowest cost in a
+ * range. Ties are resolved in favor of the highest offset.
+ */
+static void wb_diff_rmq_set(uint32_t *tree, const uint32_t *cost, uint32_t n,
+        uint32_t pos)
+{
+    uint32_t i = pos + n;
+    tree[i] = pos;
+    for (i >>= 1; i > 0; i >>= 1) {
+        uint32_t l = tree[2 * i], r = tree[2 * i + 1];
+        if (l == WB_DIFF_NO_POS)
+            tree[i] = r;
+        else if (r == WB_DIFF_NO_POS)
+            tree[i] = l;
+        else
+            tree[i] = (cost[l] < cost[r]) ? l : r;
+    }
+}
+
+static uint32_t wb_diff_rmq_get(const uint32_t *tree, const uint32_t *cost,
+        uint32_t n, uint32_t lo, uint32_t hi)
+{
+    uint32_t best = WB_DIFF_NO_POS;
+    uint32_t l = lo + n, r = hi + n + 1;
+    while (l < r) {
+        uint32_t c[2] = { WB_DIFF_NO_POS, WB_DIFF_NO_POS };
+        int k;
+        if (l & 1)
+            c[0] = tree[l++];
+        if (r & 1)
+            c[1] = tree[--r];
+        for (k = 0; k < 2; k++) {
+            if (c[k] == WB_DIFF_NO_POS)
+                continue;
+            if ((best == WB_DIFF_NO_POS) || (cost[c[k]] < cost[best]) ||
+                    ((cost[c[k]] == cost[best]) && (c[k] > best)))
+                best = c[k];
+        }
+        l >>= 1;
+        r >>= 1;
+    }
+    return best;
+}
+
+static int wb_diff_plan(WB_DIFF_CTX *ctx)
+{
+    uint32_t n = ctx->size_b;
+    uint32_t *best_len = NULL, *best_src = NULL;
+    uint32_t *cost = NULL, *tree = NULL;
+    uint32_t n_tree = 1;
+    uint32_t cont_a = WB_DIFF_NO_POS, cont_a_len = 0;
+    uint32_t cont_b = WB_DIFF_NO_POS, cont_b_len = 0;
+    uint32_t i;
+
+    best_len = calloc(n, sizeof(uint32_t));
+    best_src = calloc(n, sizeof(uint32_t));
+    cost = malloc((n + 1) * sizeof(uint32_t));
+    while (n_tree < n + 1)
+        n_tree <<= 1;
+    tree = malloc(2 * n_tree * sizeof(uint32_t));
+    if (!best_len || !best_src || !cost || !tree) {
+        free(best_len);
+        free(best_src);
+        free(cost);
+        free(tree);
+        return -1;
+    }
+
+    /* Forward pass: longest match at each offset */
+    for (i = 0; i + BLOCK_HDR_SIZE <= n; i++) {
+        const uint8_t *key = ctx->src_b + i;
+        uint32_t sec_start = (i / wolfboot_sector_size) * wolfboot_sector_size;
+        uint32_t max_b = n - i;
+        uint32_t max_a;
+        uint32_t blen = 0, bsrc = 0;
+        uint32_t new_a = WB_DIFF_NO_POS, new_a_len = 0;
+        uint32_t new_b = WB_DIFF_NO_POS, new_b_len = 0;
+        uint32_t k, pos, chain, max, l;
+
+        if (max_b > WB_DIFF_MAX_MATCH)
+            max_b = WB_DIFF_MAX_MATCH;
+        /* Matches from 'A' must not cross the end of the sector in 'B' */
+        max_a = sec_start + wolfboot_sector_size - i;
+        if (max_a > max_b)
+            max_a = max_b;
+
+        /* 'A': resume the match found at the previous offset, if any */
+        if ((cont_a != WB_DIFF_NO_POS) && (cont_a_len > BLOCK_HDR_SIZE) &&
+                (cont_a + 1 >= sec_start) && wb_diff_src_valid(cont_a + 1)) {
+            pos = cont_a + 1;
+            max = max_a;
+            if (max > ctx->size_a - pos)
+                max = ctx->size_a - pos;
+            l = wb_diff_extend(ctx->src_a + pos, key, cont_a_len - 1, max);
+            if (l >= BLOCK_HDR_SIZE) {
+                new_a = pos;
+                new_a_len = l;
+            }
+        }
+        /* 'A': candidates from the index, at or after the current sector */
+        k = (max_a >= BLOCK_HDR_SIZE) ?
+            wb_diff_index_lookup(&ctx->idx_a, ctx->src_a, key) : WB_DIFF_NO_POS;
+        if (k != WB_DIFF_NO_POS) {
+            pos = ctx->idx_a.cursor[k];
+            while ((pos != WB_DIFF_NO_POS) && (pos < sec_start))
+                pos = ctx->idx_a.next_pos[pos];
+            ctx->idx_a.cursor[k] = pos;
+            for (chain = 0; (pos != WB_DIFF_NO_POS) &&
+                    (chain < WB_DIFF_MAX_CHAIN) && (new_a_len < max_a);
+                    chain++, pos = ctx->idx_a.next_pos[pos]) {
+                if (!wb_diff_src_valid(pos))
+                    continue;
+                max = max_a;
+                if (max > ctx->size_a - pos)
+                    max = ctx->size_a - pos;
+                if ((max <= new_a_len) ||
+                        (ctx->src_a[pos + new_a_len] != key[new_a_len]))
+                    continue;
+                l = wb_diff_extend(ctx->src_a + pos, key, BLOCK_HDR_SIZE, max);
+                if (l > new_a_len) {
+                    new_a = pos;
+                    new_a_len = l;
+                }
+            }
+        }
+
+        /* 'B': only areas at least one sector below the current one, and
+         * the match must end before the current sector. The patch is applied
+         * in place on top of 'A', so the source can't go past its size.
+         */
+        if (sec_start >= wolfboot_sector_size) {
+            uint32_t pb_max = sec_start - wolfboot_sector_size;
+            if ((cont_b != WB_DIFF_NO_POS) && (cont_b_len > BLOCK_HDR_SIZE) &&
+                    (cont_b + 1 <= pb_max) && (cont_b + 1 < ctx->size_a) &&
+                    wb_diff_src_valid(cont_b + 1)) {
+                pos = cont_b + 1;
+                max = max_b;
+                if (max > sec_start - pos)
+                    max = sec_start - pos;
+                if (max > ctx->size_a - pos)
+                    max = ctx->size_a - pos;
+                l = wb_diff_extend(ctx->src_b + pos, key, cont_b_len - 1, max);
+                if (l >= BLOCK_HDR_SIZE) {
+                    new_b = pos;
+                    new_b_len = l;
+                }
+            }
+            k = wb_diff_index_lookup(&ctx->idx_b, ctx->src_b, key);
+            for (pos = k, chain = 0; (pos != WB_DIFF_NO_POS) &&
+                    (pos <= pb_max) && (chain < WB_DIFF_MAX_CHAIN) &&
+                    (new_b_len < max_b);
+                    chain++, pos = ctx->idx_b.next_pos[pos]) {
+                if (!wb_diff_src_valid(pos) || (pos >= ctx->size_a))
+                    continue;
+                max = max_b;
+                if (max > sec_start - pos)
+                    max = sec_start - pos;
+                if (max > ctx->size_a - pos)
+                    max = ctx->size_a - pos;
+                if ((max <= new_b_len) ||
+                        (ctx->src_b[pos + new_b_len] != key[new_b_len]))
+                    continue;
+                l = wb_diff_extend(ctx->src_b + pos, key, BLOCK_HDR_SIZE, max);
+                if (l > new_b_len) {
+                    new_b = pos;
+                    new_b_len = l;
+                }
+            }
+        }
+
+        if (new_a_len >= new_b_len) {
+            blen = new_a_len;
+            bsrc = new_a;
+        } else {
+            blen = new_b_len;
+            bsrc = new_b;
+        }
+        if (blen >= BLOCK_HDR_SIZE) {
+            best_len[i] = blen;
+            best_src[i] = bsrc;
+        }
+        cont_a = new_a;
+        cont_a_len = new_a_len;
+        cont_b = new_b;
+        cont_b_len = new_b_len;
+    }
+
+    /* Backward pass: cheapest encoding of B[i..n] */
+    memset(tree, 0xFF, 2 * n_tree * sizeof(uint32_t));
+    cost[n] = 0;
+    wb_diff_rmq_set(tree, cost, n_tree, n);
+    i = n;
+    while (i-- > 0) {
+        uint32_t lit = (ctx->src_b[i] == ESC) ? 2 : 1;
+        cost[i] = lit + cost[i + 1];
+        if (best_len[i] >= BLOCK_HDR_SIZE) {
+            uint32_t j = wb_diff_rmq_get(tree, cost, n_tree,
+                    i + BLOCK_HDR_SIZE, i + best_len[i]);
+            if (BLOCK_HDR_SIZE + cost[j] <= cost[i]) {
+                cost[i] = BLOCK_HDR_SIZE + cost[j];
+                best_len[i] = j - i;
+            } else {
+                best_len[i] = 0;
+            }
+        }
+        wb_diff_rmq_set(tree, cost, n_tree, i);
+    }
+    free(cost);
+    free(tree);
+    ctx->plan_len = best_len;
+    ctx->plan_src = best_src;
+    return 0;
+}
+
+/* Emit the patch planned by wb_diff_plan(), keeping the same margins at the
+ * end of the buffer as the greedy encoder.
+ */
+static int wb_diff_emit_plan(WB_DIFF_CTX *ctx, uint8_t *patch, uint32_t len)
+{
+    uintptr_t p_off = 0;
+    while (ctx->off_b < ctx->size_b) {
+        uint32_t mlen = ctx->plan_len[ctx->off_b];
+        if (mlen != 0) {
+            if (p_off + BLOCK_HDR_SIZE >= len)
+                break;
+            wb_diff_write_hdr(patch + p_off, ctx->plan_src[ctx->off_b],
+                    (uint16_t)mlen);
+            p_off += BLOCK_HDR_SIZE;
+            ctx->off_b += mlen;
+        } else if (*(ctx->src_b + ctx->off_b) == ESC) {
+            if ((p_off + 1) >= (len - BLOCK_HDR_SIZE))
+                break;
+            *(patch + p_off++) = ESC;
+            *(patch + p_off++) = ESC;
+            ctx->off_b++;
+        } else {
+            if (p_off >= (len - BLOCK_HDR_SIZE))
+                break;
+            *(patch + p_off++) = *(ctx->src_b + ctx->off_b);
+            ctx->off_b++;
+        }
+    }
+    return (int)p_off;
+}
+
+/* Range coder, encoder side */
+struct rc_enc {
+    uint64_t low;
+    uint32_t range;
+    uint8_t cache;
+    uint32_t cache_size;
+    uint8_t *out;
+    uint32_t out_len;
+    uint32_t out_off;
+    int overflow;
+};
+
+static void rc_enc_shift_low(struct rc_enc *e)
+{
+    if (((uint32_t)e->low < 0xFF000000UL) || ((e->low >> 32) != 0)) {
+        uint8_t carry = (uint8_t)(e->low >> 32);
+        uint8_t c = e->cache;
+        do {
+            if (e->out_off < e->out_len)
+                e->out[e->out_off++] = (uint8_t)(c + carry);
+            else
+                e->overflow = 1;
+            c = 0xFF;
+        } while (--e->cache_size != 0);
+        e->cache = (uint8_t)(e->low >> 24);
+    }
+    e->cache_size++;
+    e->low = (e->low & 0x00FFFFFFUL) << 8;
+}
+
+static void rc_enc_byte(struct rc_enc *e, uint16_t *probs, uint8_t c)
+{
+    uint32_t m = 1;
+    int i;
+    for (i = 7; i >= 0; i--) {
+        uint32_t bit = (c >> i) & 1;
+        uint32_t bound = (e->range >> RC_MODEL_BITS) * probs[m];
+        if (bit == 0) {
+            e->range = bound;
+            probs[m] += ((1 << RC_MODEL_BITS) - probs[m]) >> RC_MOVE_BITS;
+        } else {
+            e->low += bound;
+            e->range -= bound;
+            probs[m] -= probs[m] >> RC_MOVE_BITS;
+        }
+        m = (m << 1) | bit;
+        while (e->range < RC_TOP) {
+            e->range <<= 8;
+            rc_enc_shift_low(e);
+        }
+    }
+}
+
+/* Worst case size of the container: all frames stored */
+uint32_t wb_diff_rc_bound(uint32_t raw_len)
+{
+    return WB_RC_HDR_SIZE + raw_len +
+        2 * ((raw_len + WB_RC_FRAME_SIZE - 1) / WB_RC_FRAME_SIZE);
+}
+
+int wb_diff_rc_encode(const uint8_t *raw, uint32_t raw_len, uint8_t *out,
+        uint32_t out_len)
+{
+    /* On the stack: the sign tool encodes both patches in parallel */
+    uint16_t probs[WB_RC_CONTEXTS][256];
+    uint32_t off = 0, o_off = WB_RC_HDR_SIZE;
+    uint8_t state = 0;
+
+    if (!raw || !out || (raw_len == 0) || (out_len < wb_diff_rc_bound(raw_len)))
+        return -1;
+    out[0] = raw_len & 0xFF;
+    out[1] = (raw_len >> 8) & 0xFF;
+    out[2] = (raw_len >> 16) & 0xFF;
+    out[3] = (raw_len >> 24) & 0xFF;
+    out[4] = WB_RC_FRAME_SIZE & 0xFF;
+    out[5] = (WB_RC_FRAME_SIZE >> 8) & 0xFF;
+    out[6] = WB_RC_VERSION & 0xFF;
+    out[7] = (WB_RC_VERSION >> 8) & 0xFF;
+
+    while (off < raw_len) {
+        struct rc_enc e;
+        uint32_t frame_len = raw_len - off;
+        uint32_t i;
+        int k;
+
+        if (frame_len > WB_RC_FRAME_SIZE)
+            frame_len = WB_RC_FRAME_SIZE;
+        memset(&e, 0, sizeof(e));
+        e.range = 0xFFFFFFFFUL;
+        e.cache_size = 1;
+        e.out = out + o_off + 2;
+        e.out_len = frame_len; /* no point in going past the stored size */
+        rc_reset_models(probs);
+        for (i = 0; i < frame_len; i++) {
+            rc_enc_byte(&e, probs[rc_state_model[state]], raw[off + i]);
+            state = rc_next_state(state, raw[off + i]);
+        }
+        for (k = 0; k < 5; k++)
+            rc_enc_shift_low(&e);
+
+        if (e.overflow || (e.out_off >= frame_len)) {
+            /* Incompressible frame: store it */
+            memcpy(out + o_off + 2, raw + off, frame_len);
+            out[o_off] = frame_len & 0xFF;
+            out[o_off + 1] = ((frame_len >> 8) & 0xFF) |
+                (WB_RC_FRAME_STORED >> 8);
+            o_off += 2 + frame_len;
+        } else {
+            out[o_off] = e.out_off & 0xFF;
+            out[o_off + 1] = (e.out_off >> 8) & 0xFF;
+            o_off += 2 + e.out_off;
+        }
+        off += frame_len;
+    }
+    return (int)o_off;
+}
+
+int wb_diff(WB_DIFF_CTX *ctx, uint8_t *patch, uint32_t len)
+{
     int found;
     uint8_t *pa, *pb;
     uint16_t match_len;
@@ -267,6 +1092,21 @@ int wb_diff(WB_DIFF_CTX *ctx, uint8_t *patch, uint32_t len)
     if (len < BLOCK_HDR_SIZE)
         return -1;
 
+    if ((ctx->mode != WB_DIFF_MODE_LINEAR) && !ctx->index_ready) {
+        if ((wb_diff_index_build(&ctx->idx_a, ctx->src_a, ctx->size_a) < 0) ||
+            (wb_diff_index_build(&ctx->idx_b, ctx->src_b, ctx->size_b) < 0)) {
+            wb_diff_free(ctx);
+            return -1;
+        }
+        if ((ctx->mode == WB_DIFF_MODE_OPTIMAL) && (wb_diff_plan(ctx) < 0)) {
+            wb_diff_free(ctx);
+            return -1;
+        }
+        ctx->index_ready = 1;
+    }
+    if (ctx->mode == WB_DIFF_MODE_OPTIMAL)
+        return wb_diff_emit_plan(ctx, patch, len);
+
     while ((ctx->off_b + BLOCK_HDR_SIZE < ctx->size_b) && (len > p_off + BLOCK_HDR_SIZE)) {
         uintptr_t page_start = ctx->off_b / wolfboot_sector_size;
         uintptr_t pa_start;
@@ -283,115 +1123,77 @@ int wb_diff(WB_DIFF_CTX *ctx, uint8_t *patch, uint32_t len)
          */
 
         pa_start = wolfboot_sector_size  * page_start;
-        pa = ctx->src_a + pa_start;
-        while (((uintptr_t)(pa - ctx->src_a) < (uintptr_t)ctx->size_a) && (p_off < len)) {
-            if ((uintptr_t)(ctx->size_a - (pa - ctx->src_a)) < BLOCK_HDR_SIZE)
-                break;
-            if ((ctx->size_b - ctx->off_b) < BLOCK_HDR_SIZE)
-                break;
-            if ((wolfboot_sector_size - (ctx->off_b % wolfboot_sector_size)) < BLOCK_HDR_SIZE)
-                break;
-            if ((memcmp(pa, (ctx->src_b + ctx->off_b), BLOCK_HDR_SIZE) == 0)) {
-                uintptr_t b_start;
-                uint8_t *pa_limit = ctx->src_a + ctx->size_a;
-                /* Identical areas of BLOCK_HDR_SIZE bytes match between the images.
-                 * initialize match_len; blk_start is the relative offset within
-                 * the src image.
+        pa = wb_diff_find_a(ctx, pa_start);
+        if (pa != NULL) {
+            uintptr_t b_start;
+            uint8_t *pa_limit = ctx->src_a + ctx->size_a;
+            /* Identical areas of BLOCK_HDR_SIZE bytes match between the images.
+             * initialize match_len; blk_start is the relative offset within
+             * the src image.
+             */
+            match_len = BLOCK_HDR_SIZE;
+            blk_start = pa - ctx->src_a;
+            b_start = ctx->off_b;
+            pa+= BLOCK_HDR_SIZE;
+            ctx->off_b += BLOCK_HDR_SIZE;
+            while ((pa < pa_limit) &&
+                    (ctx->off_b < ctx->size_b) &&
+                    (*pa == *(ctx->src_b + ctx->off_b))) {
+                /* Extend matching block if possible, as long as the
+                 * identical sequence continues.
+                 */
+                if ((pa + 1) >= pa_limit) {
+                    /* Stop matching if the source image size limit is hit. */
+                    break;
+                }
+                if ((b_start / wolfboot_sector_size) < ((ctx->off_b + 1) / wolfboot_sector_size)) {
+                    /* Stop matching when the sector bound is hit. */
+                    break;
+                }
+                /* Increase match len, test next byte */
+                pa++;
+                ctx->off_b++;
+                match_len++;
+            }
+            wb_diff_write_hdr(patch + p_off, blk_start, match_len);
+            p_off += BLOCK_HDR_SIZE;
+            found = 1;
+        }
+        if (!found) {
+            /* Try matching an earlier section in the resulting image */
+            uintptr_t pb_end = page_start * wolfboot_sector_size;
+            uint8_t *pb_limit = ctx->src_b + pb_end;
+            pb = wb_diff_find_b(ctx, pb_end);
+            if (pb != NULL) {
+                /* A match was found between the current pointer and a
+                 * previously patched area in the resulting image.
+                 * Initialize match_len and set the blk_start to the beginning
+                 * of the matching area in the image.
                  */
                 match_len = BLOCK_HDR_SIZE;
-                blk_start = pa - ctx->src_a;
-                b_start = ctx->off_b;
-                pa+= BLOCK_HDR_SIZE;
+                blk_start = pb - ctx->src_b;
+                pb+= BLOCK_HDR_SIZE;
                 ctx->off_b += BLOCK_HDR_SIZE;
-                while ((pa < pa_limit) &&
+                while ((pb < pb_limit) &&
                         (ctx->off_b < ctx->size_b) &&
-                        (*pa == *(ctx->src_b + ctx->off_b))) {
-                    /* Extend matching block if possible, as long as the
-                     * identical sequence continues.
+                        (*pb == *(ctx->src_b + ctx->off_b))) {
+                    /* Extend match as long as the areas have the
+                     * same content. Block skipping in this case is
+                     * not a problem since the distance between the patched
+                     * area and the area to patch is always larger than one
+                     * block size.
                      */
-                    if ((pa + 1) >= pa_limit) {
-                        /* Stop matching if the source image size limit is hit. */
-                        break;
-                    }
-                    if ((b_start / wolfboot_sector_size) < ((ctx->off_b + 1) / wolfboot_sector_size)) {
-                        /* Stop matching when the sector bound is hit. */
+                    pb++;
+                    if (pb >= pb_limit) {
+                        pb--;
                         break;
                     }
-                    /* Increase match len, test next byte */
-                    pa++;
-                    ctx->off_b++;
                     match_len++;
+                    ctx->off_b++;
                 }
-                hdr.esc = ESC;
-                hdr.off[0] = ((blk_start >> 16) & 0x000000FF);
-                hdr.off[1] = ((blk_start >> 8) & 0x000000FF);
-                hdr.off[2] = ((blk_start) & 0x000000FF);
-                hdr.sz[0] = ((match_len >> 8) & 0x00FF);
-                hdr.sz[1] = ((match_len) & 0x00FF);
-                memcpy(patch + p_off, &hdr, sizeof(hdr));
+                wb_diff_write_hdr(patch + p_off, blk_start, match_len);
                 p_off += BLOCK_HDR_SIZE;
                 found = 1;
-
-                break;
-            } else pa++;
-        }
-        if (!found) {
-            /* Try matching an earlier section in the resulting image */
-            uintptr_t pb_end = page_start * wolfboot_sector_size;
-            uint8_t *pb_limit = ctx->src_b + pb_end;
-            pb = ctx->src_b;
-            while (((uintptr_t)(pb - ctx->src_b) < pb_end) && (p_off < len)) {
-                /* Check image boundary */
-                if ((ctx->size_b - ctx->off_b) < BLOCK_HDR_SIZE)
-                    break;
-                if ((uintptr_t)(ctx->size_b - (pb - ctx->src_b)) < BLOCK_HDR_SIZE)
-                    break;
-
-                /* Don't try matching backwards if the distance between the two
-                 * blocks is smaller than one sector.
-                 */
-                if (wolfboot_sector_size > (page_start * wolfboot_sector_size)
-                        - (pb - ctx->src_b))
-                    break;
-
-                if ((memcmp(pb, (ctx->src_b + ctx->off_b), BLOCK_HDR_SIZE) == 0)) {
-                    /* A match was found between the current pointer and a
-                     * previously patched area in the resulting image.
-                     * Initialize match_len and set the blk_start to the beginning
-                     * of the matching area in the image.
-                     */
-                    match_len = BLOCK_HDR_SIZE;
-                    blk_start = pb - ctx->src_b;
-                    pb+= BLOCK_HDR_SIZE;
-                    ctx->off_b += BLOCK_HDR_SIZE;
-                    while ((pb < pb_limit) &&
-                            (ctx->off_b < ctx->size_b) &&
-                            (*pb == *(ctx->src_b + ctx->off_b))) {
-                        /* Extend match as long as the areas have the
-                         * same content. Block skipping in this case is
-                         * not a problem since the distance between the patched
-                         * area and the area to patch is always larger than one
-                         * block size.
-                         */
-                        pb++;
-                        if (pb >= pb_limit) {
-                            pb--;
-                            break;
-                        }
-                        match_len++;
-                        ctx->off_b++;
-                    }
-                    hdr.esc = ESC;
-                    hdr.off[0] = ((blk_start >> 16) & 0x000000FF);
-                    hdr.off[1] = ((blk_start >> 8) & 0x000000FF);
-                    hdr.off[2] = ((blk_start) & 0x000000FF);
-                    hdr.sz[0] = ((match_len >> 8) & 0x00FF);
-                    hdr.sz[1] = ((match_len) & 0x00FF);
-                    memcpy(patch + p_off, &hdr, sizeof(hdr));
-                    p_off += BLOCK_HDR_SIZE;
-                    found = 1;
-                    break;
-                } else pb++;
             }
         }
 
@@ -420,6 +1222,301 @@ int wb_diff(WB_DIFF_CTX *ctx, uint8_t *patch, uint32_t len)
     }
     return (int)p_off;
 }
+
+/* Parallel patch generation (wb_diff_generate)
+ *
+ * In WB_DIFF_MODE_LINEAR, the token emitted at any offset of 'B' only depends
+ * on that offset. 'B' is split in segments of whole sectors, and each segment
+ * is diffed independently, as if the serial parse had stopped exactly at its
+ * start. The segments are then stitched: when a match of the previous segment
+ * runs past the start of the next one, the serial parse is resumed from there
+ * until it reaches a token boundary of the next segment. The result is
+ * identical to the output of the serial wb_diff() loop.
+ */
+struct wb_diff_seg {
+    WB_DIFF_CTX ctx;
+    uint32_t start;     /* First offset in 'B' */
+    uint32_t end;       /* The segment is complete once off_b >= end */
+    uint32_t stop;      /* off_b reached at the end of the segment */
+    uint8_t *patch;
+    uint32_t len;
+    uint32_t cap;
+    uint32_t *tok_b;    /* Offset in 'B' of each token in the patch */
+    uint32_t *tok_p;    /* Offset in the patch of each token */
+    uint32_t n_tok;
+    uint32_t tok_cap;
+    int track;          /* Record the token boundaries */
+    int ret;
+};
+
+/* Size of the patch token at 'p' in the patch (returned) and in 'B' */
+static uint32_t wb_diff_token(const uint8_t *p, uint32_t *len_b)
+{
+    if (p[0] != ESC) {
+        *len_b = 1;
+        return 1;
+    }
+    if (p[1] == ESC) {
+        *len_b = 1;
+        return 2;
+    }
+    *len_b = ((uint32_t)p[4] << 8) | p[5];
+    return BLOCK_HDR_SIZE;
+}
+
+static int wb_diff_seg_grow(struct wb_diff_seg *seg, uint32_t len)
+{
+    uint8_t *tmp;
+    if (seg->len + len <= seg->cap)
+        return 0;
+    tmp = realloc(seg->patch, 2 * (seg->cap + len));
+    if (tmp == NULL)
+        return -1;
+    seg->patch = tmp;
+    seg->cap = 2 * (seg->cap + len);
+    return 0;
+}
+
+static int wb_diff_seg_track(struct wb_diff_seg *seg, uint32_t off_b,
+        uint32_t off_p, uint32_t len)
+{
+    uint32_t end = off_p + len;
+    uint32_t len_b;
+    while (off_p < end) {
+        if (seg->n_tok == seg->tok_cap) {
+            uint32_t cap = 2 * seg->tok_cap + 256;
+            uint32_t *tb = realloc(seg->tok_b, cap * sizeof(uint32_t));
+            uint32_t *tp;
+            if (tb == NULL)
+                return -1;
+            seg->tok_b = tb;
+            tp = realloc(seg->tok_p, cap * sizeof(uint32_t));
+            if (tp == NULL)
+                return -1;
+            seg->tok_p = tp;
+            seg->tok_cap = cap;
+        }
+        seg->tok_b[seg->n_tok] = off_b;
+        seg->tok_p[seg->n_tok] = off_p;
+        seg->n_tok++;
+        off_p += wb_diff_token(seg->patch + off_p, &len_b);
+        off_b += len_b;
+    }
+    return 0;
+}
+
+static void wb_diff_seg_run(struct wb_diff_seg *seg)
+{
+    uint32_t chunk = wolfboot_sector_size;
+    uint32_t off_b;
+    int r;
+
+    seg->ctx.off_b = seg->start;
+    seg->ret = 0;
+    while (seg->ctx.off_b < seg->end) {
+        if (wb_diff_seg_grow(seg, chunk) < 0) {
+            seg->ret = -1;
+            break;
+        }
+        off_b = seg->ctx.off_b;
+        r = wb_diff(&seg->ctx, seg->patch + seg->len, chunk);
+        if (r < 0) {
+            seg->ret = -1;
+            break;
+        }
+        if (r == 0)
+            break;
+        if (seg->track &&
+                (wb_diff_seg_track(seg, off_b, seg->len, (uint32_t)r) < 0)) {
+            seg->ret = -1;
+            break;
+        }
+        seg->len += r;
+    }
+    seg->stop = seg->ctx.off_b;
+}
+
+/* Index of the token starting at off_b in the segment, or -1 */
+static int wb_diff_seg_find(const struct wb_diff_seg *seg, uint32_t off_b)
+{
+    uint32_t lo = 0, hi = seg->n_tok;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (seg->tok_b[mid] == off_b)
+            return (int)mid;
+        if (seg->tok_b[mid] < off_b)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return -1;
+}
+
+#ifdef WB_DIFF_THREADS
+struct wb_diff_pool {
+    struct wb_diff_seg *seg;
+    int n_seg;
+    int next;
+    pthread_mutex_t lock;
+};
+
+static void *wb_diff_worker(void *arg)
+{
+    struct wb_diff_pool *pool = (struct wb_diff_pool *)arg;
+    int i;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= pool->n_seg)
+            break;
+        wb_diff_seg_run(&pool->seg[i]);
+    }
+    return NULL;
+}
+#endif
+
+/* Join the segments into the patch held by seg[0] */
+static int wb_diff_stitch(WB_DIFF_CTX *ctx, struct wb_diff_seg *seg,
+        int n_seg)
+{
+    struct wb_diff_seg *out = &seg[0];
+    WB_DIFF_CTX cont;
+    uint32_t off_b = out->stop;
+    uint32_t len_b, len_p;
+    uint8_t tok[2 * BLOCK_HDR_SIZE];
+    int k = 1;
+    int i, r;
+
+    memcpy(&cont, ctx, sizeof(cont));
+    while (off_b < ctx->size_b) {
+        while ((k + 1 < n_seg) && (seg[k + 1].start <= off_b))
+            k++;
+        if (off_b < seg[k].stop) {
+            i = wb_diff_seg_find(&seg[k], off_b);
+            if (i >= 0) {
+                len_p = seg[k].len - seg[k].tok_p[i];
+                if (wb_diff_seg_grow(out, len_p) < 0)
+                    return -1;
+                memcpy(out->patch + out->len, seg[k].patch + seg[k].tok_p[i],
+                        len_p);
+                out->len += len_p;
+                off_b = seg[k].stop;
+                continue;
+            }
+        }
+        /* Not in sync with the next segment yet: resume the serial parse
+         * for one token.
+         */
+        cont.off_b = off_b;
+        r = wb_diff(&cont, tok, sizeof(tok));
+        if (r <= 0)
+            return -1;
+        len_p = wb_diff_token(tok, &len_b);
+        if (wb_diff_seg_grow(out, len_p) < 0)
+            return -1;
+        memcpy(out->patch + out->len, tok, len_p);
+        out->len += len_p;
+        off_b += len_b;
+    }
+    return 0;
+}
+
+int wb_diff_generate(WB_DIFF_CTX *ctx, int jobs, uint8_t **patch,
+        uint32_t *patch_len)
+{
+    struct wb_diff_seg *seg;
+    uint32_t n_sectors;
+    int n_seg = 1;
+    int i;
+    int ret = 0;
+
+    if (!ctx || !patch || !patch_len || (ctx->off_b != 0))
+        return -1;
+    *patch = NULL;
+    *patch_len = 0;
+    n_sectors = (ctx->size_b + wolfboot_sector_size - 1) / wolfboot_sector_size;
+#ifdef WB_DIFF_THREADS
+    /* Hash and optimal modes share their index and plan over the whole
+     * image, so they are always run serially.
+     */
+    if ((ctx->mode == WB_DIFF_MODE_LINEAR) && (jobs > 1)) {
+        n_seg = 4 * jobs;
+        if ((uint32_t)n_seg > n_sectors)
+            n_seg = (int)n_sectors;
+    }
+#else
+    (void)jobs;
+#endif
+    seg = calloc(n_seg, sizeof(struct wb_diff_seg));
+    if (seg == NULL)
+        return -1;
+    for (i = 0; i < n_seg; i++) {
+        memcpy(&seg[i].ctx, ctx, sizeof(WB_DIFF_CTX));
+        seg[i].start = (uint32_t)(((uint64_t)n_sectors * i) / n_seg) *
+            wolfboot_sector_size;
+        seg[i].end = (uint32_t)(((uint64_t)n_sectors * (i + 1)) / n_seg) *
+            wolfboot_sector_size;
+        if ((i == n_seg - 1) || (seg[i].end > ctx->size_b))
+            seg[i].end = ctx->size_b;
+        seg[i].track = (i > 0);
+    }
+
+    if (n_seg == 1) {
+        wb_diff_seg_run(&seg[0]);
+        /* Keep the index and plan in ctx, released by wb_diff_free() */
+        memcpy(ctx, &seg[0].ctx, sizeof(WB_DIFF_CTX));
+    }
+#ifdef WB_DIFF_THREADS
+    else {
+        struct wb_diff_pool pool;
+        pthread_t *th;
+        int n_th = jobs;
+        if (n_th > n_seg)
+            n_th = n_seg;
+        th = calloc(n_th, sizeof(pthread_t));
+        if (th == NULL) {
+            free(seg);
+            return -1;
+        }
+        pool.seg = seg;
+        pool.n_seg = n_seg;
+        pool.next = 0;
+        pthread_mutex_init(&pool.lock, NULL);
+        for (i = 0; i < n_th; i++) {
+            if (pthread_create(&th[i], NULL, wb_diff_worker, &pool) != 0)
+                break;
+        }
+        /* Run in the calling thread if no worker could be started */
+        if (i == 0)
+            wb_diff_worker(&pool);
+        while (i > 0)
+            pthread_join(th[--i], NULL);
+        pthread_mutex_destroy(&pool.lock);
+        free(th);
+    }
+#endif
+
+    for (i = 0; i < n_seg; i++) {
+        if (seg[i].ret < 0)
+            ret = -1;
+    }
+    if ((ret == 0) && (n_seg > 1))
+        ret = wb_diff_stitch(ctx, seg, n_seg);
+    if (ret == 0) {
+        ctx->off_b = ctx->size_b;
+        *patch = seg[0].patch;
+        *patch_len = seg[0].len;
+        seg[0].patch = NULL;
+    }
+    for (i = 0; i < n_seg; i++) {
+        free(seg[i].patch);
+        free(seg[i].tok_b);
+        free(seg[i].tok_p);
+    }
+    free(seg);
+    return ret;
+}
 #endif /* __WOLFBOOT */
 
 #endif /* DELTA_UPDATES */
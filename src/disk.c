@@ -47,6 +47,212 @@
  */
 static struct disk_drive Drives[MAX_DISKS] = {0};
 
+/* Read-ahead limit for reads not bound to a partition */
+#define DISK_CACHE_NO_LIMIT ((uint64_t)-1)
+
+#ifdef WOLFBOOT_DISK_CACHE
+/* Block cache, shared by all the drives, in front of the disk_read() provided
+ * by the backend. Small reads (MBR, GPT, image headers, unaligned head and
+ * tail of larger reads) are served from DISK_CACHE_BLOCK_SIZE blocks, and
+ * when the reads are sequential the following DISK_CACHE_READAHEAD blocks are
+ * fetched with the same request. Whole blocks not in the cache are read
+ * straight into the caller's buffer, adjacent ones with a single request.
+ */
+#ifndef DISK_CACHE_BLOCK_SIZE
+#define DISK_CACHE_BLOCK_SIZE 4096
+#endif
+#ifndef DISK_CACHE_BLOCKS
+#define DISK_CACHE_BLOCKS 8
+#endif
+#ifndef DISK_CACHE_READAHEAD
+#define DISK_CACHE_READAHEAD 3
+#endif
+
+#if (DISK_CACHE_BLOCK_SIZE & (DISK_CACHE_BLOCK_SIZE - 1)) != 0
+#error "DISK_CACHE_BLOCK_SIZE must be a power of two"
+#endif
+#if DISK_CACHE_READAHEAD >= DISK_CACHE_BLOCKS
+#error "DISK_CACHE_READAHEAD must be smaller than DISK_CACHE_BLOCKS"
+#endif
+
+struct disk_cache_block {
+    int valid;
+    int drv;
+    uint64_t addr;
+    uint32_t lru;
+};
+
+static struct disk_cache_block CacheBlk[DISK_CACHE_BLOCKS];
+static uint8_t CacheData[DISK_CACHE_BLOCKS][DISK_CACHE_BLOCK_SIZE] XALIGNED(4);
+static uint64_t CacheNext[MAX_DISKS]; /* End of the last read on each drive */
+static uint32_t CacheTick;
+static struct disk_cache_stats CacheStats;
+
+static int disk_cache_find(int drv, uint64_t addr)
+{
+    int i;
+    for (i = 0; i < DISK_CACHE_BLOCKS; i++) {
+        if (CacheBlk[i].valid && (CacheBlk[i].drv == drv) &&
+                (CacheBlk[i].addr == addr))
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Reads `n` consecutive blocks into the least recently used run of
+ * `n` adjacent cache slots, with a single disk_read().
+ *
+ * @return The slot holding the first block, or -1 on read error.
+ */
+static int disk_cache_fill(int drv, uint64_t addr, uint32_t n)
+{
+    uint32_t i, w, newest;
+    uint32_t best = 0, best_newest = 0;
+
+    for (w = 0; w + n <= DISK_CACHE_BLOCKS; w++) {
+        newest = 0;
+        for (i = w; i < w + n; i++) {
+            if (CacheBlk[i].valid && (CacheBlk[i].lru > newest))
+                newest = CacheBlk[i].lru;
+        }
+        if ((w == 0) || (newest < best_newest)) {
+            best = w;
+            best_newest = newest;
+        }
+    }
+    for (i = best; i < best + n; i++)
+        CacheBlk[i].valid = 0;
+    if (disk_read(drv, addr, n * DISK_CACHE_BLOCK_SIZE, CacheData[best]) < 0)
+        return -1;
+    for (i = 0; i < n; i++) {
+        CacheBlk[best + i].drv = drv;
+        CacheBlk[best + i].addr = addr + (uint64_t)i * DISK_CACHE_BLOCK_SIZE;
+        CacheBlk[best + i].lru = ++CacheTick;
+        CacheBlk[best + i].valid = 1;
+    }
+    return (int)best;
+}
+
+/**
+ * @brief Reads from the disk through the block cache.
+ *
+ * @param[in] drv The drive number.
+ * @param[in] start The address to read from, in bytes.
+ * @param[in] count The number of bytes to read.
+ * @param[out] buf The buffer to store the read data.
+ * @param[in] last The last byte that may be read ahead (e.g. the end of the
+ * partition), or DISK_CACHE_NO_LIMIT.
+ *
+ * @return 0 on success, or -1 if the disk read fails.
+ */
+static int disk_cache_read(int drv, uint64_t start, uint32_t count,
+        uint8_t *buf, uint64_t last)
+{
+    uint64_t blk;
+    uint32_t boff, len, n;
+    int sequential = (start == CacheNext[drv]);
+    int slot;
+
+    while (count > 0) {
+        blk = start & ~((uint64_t)DISK_CACHE_BLOCK_SIZE - 1);
+        boff = (uint32_t)(start - blk);
+        len = DISK_CACHE_BLOCK_SIZE - boff;
+        if (len > count)
+            len = count;
+        slot = disk_cache_find(drv, blk);
+        if (slot >= 0) {
+            CacheStats.hits++;
+        } else if (len == DISK_CACHE_BLOCK_SIZE) {
+            /* Coalesce the following whole blocks missing from the cache */
+            n = 1;
+            while ((count - len >= DISK_CACHE_BLOCK_SIZE) &&
+                    (disk_cache_find(drv, blk + len) < 0)) {
+                len += DISK_CACHE_BLOCK_SIZE;
+                n++;
+            }
+            if (disk_read(drv, start, len, buf) < 0)
+                return -1;
+            CacheStats.direct += n;
+        } else {
+            /* Partial block: cache it, reading ahead on sequential access */
+            n = 1;
+            while (sequential && (n <= DISK_CACHE_READAHEAD) &&
+                    (disk_cache_find(drv,
+                        blk + (uint64_t)n * DISK_CACHE_BLOCK_SIZE) < 0))
+                n++;
+            while ((n > 0) &&
+                    (blk + (uint64_t)n * DISK_CACHE_BLOCK_SIZE - 1 > last))
+                n--;
+            if (n > 0)
+                slot = disk_cache_fill(drv, blk, n);
+            if (slot >= 0) {
+                CacheStats.misses++;
+                CacheStats.prefetched += n - 1;
+            } else if (disk_read(drv, start, len, buf) < 0) {
+                /* Not cacheable, or the block read failed: read as
+                 * requested */
+                return -1;
+            }
+        }
+        if (slot >= 0) {
+            memcpy(buf, CacheData[slot] + boff, len);
+            CacheBlk[slot].lru = ++CacheTick;
+        }
+        start += len;
+        buf += len;
+        count -= len;
+    }
+    CacheNext[drv] = start;
+    return 0;
+}
+
+/* Drops the cached blocks overlapping a write */
+static void disk_cache_discard(int drv, uint64_t start, uint32_t count)
+{
+    int i;
+    for (i = 0; i < DISK_CACHE_BLOCKS; i++) {
+        if (CacheBlk[i].valid && (CacheBlk[i].drv == drv) &&
+                (CacheBlk[i].addr + DISK_CACHE_BLOCK_SIZE > start) &&
+                (CacheBlk[i].addr < start + count))
+            CacheBlk[i].valid = 0;
+    }
+}
+
+/**
+ * @brief Drops all the cached blocks of a drive.
+ *
+ * Must be called if the content of the disk is changed without going
+ * through disk_part_write().
+ *
+ * @param[in] drv The drive number.
+ */
+void disk_cache_invalidate(int drv)
+{
+    int i;
+    for (i = 0; i < DISK_CACHE_BLOCKS; i++) {
+        if (CacheBlk[i].drv == drv)
+            CacheBlk[i].valid = 0;
+    }
+    if ((drv >= 0) && (drv < MAX_DISKS))
+        CacheNext[drv] = DISK_CACHE_NO_LIMIT;
+}
+
+/**
+ * @brief Returns the hit/miss counters of the block cache.
+ *
+ * @param[out] stats The counters, accumulated since boot.
+ */
+void disk_cache_get_stats(struct disk_cache_stats *stats)
+{
+    memcpy(stats, &CacheStats, sizeof(CacheStats));
+}
+#else
+#define disk_cache_read(drv, start, count, buf, last) \
+    disk_read(drv, start, count, buf)
+#define disk_cache_discard(drv, start, count) do {} while(0)
+#endif /* WOLFBOOT_DISK_CACHE */
+
 /**
  * @brief Parse MBR partition table entries.
  *
@@ -127,8 +333,12 @@ int disk_open(int drv)
 
     wolfBoot_printf("Reading MBR...\r\n");
 
+#ifdef WOLFBOOT_DISK_CACHE
+    disk_cache_invalidate(drv);
+#endif
+
     /* Read MBR sector */
-    r = disk_read(drv, 0, GPT_SECTOR_SIZE, sector);
+    r = disk_cache_read(drv, 0, GPT_SECTOR_SIZE, sector, DISK_CACHE_NO_LIMIT);
     if (r < 0) {
         wolfBoot_printf("Failed to read MBR\r\n");
         return -1;
@@ -145,7 +355,8 @@ int disk_open(int drv)
         wolfBoot_printf("Found GPT PTE at sector %u\r\n", gpt_lba);
 
         /* Read GPT header */
-        r = disk_read(drv, GPT_SECTOR_SIZE * gpt_lba, GPT_SECTOR_SIZE, sector);
+        r = disk_cache_read(drv, GPT_SECTOR_SIZE * gpt_lba, GPT_SECTOR_SIZE,
+                sector, DISK_CACHE_NO_LIMIT);
         if (r < 0) {
             wolfBoot_printf("Disk read failed\r\n");
             Drives[drv].is_open = 0;
@@ -176,7 +387,8 @@ int disk_open(int drv)
             if (ptable.array_sz > sizeof(entry_buf))
                 break;
 
-            r = disk_read(drv, address, ptable.array_sz, entry_buf);
+            r = disk_cache_read(drv, address, ptable.array_sz, entry_buf,
+                    DISK_CACHE_NO_LIMIT);
             if (r < 0) {
                 Drives[drv].is_open = 0;
                 return -1;
@@ -294,7 +506,7 @@ int disk_part_read(int drv, int part, uint64_t off, uint64_t sz, uint8_t *buf)
     }
     if ((p->end - start + 1) < sz)
         sz = p->end - start + 1;
-    ret = disk_read(drv, start, (uint32_t)sz, buf);
+    ret = disk_cache_read(drv, start, (uint32_t)sz, buf, p->end);
 #ifdef DEBUG_DISK
     wolfBoot_printf("disk_part_read: drv: %d, part: %d, off: %llu, sz: %llu, "
         "buf: %p, ret %d\r\n", drv, part, p->start + off, (uint32_t)sz, buf,
@@ -340,6 +552,7 @@ int disk_part_write(int drv, int part, uint64_t off, uint64_t sz, const uint8_t
     }
     if ((p->end - start + 1) < sz)
         sz = p->end - start + 1;
+    disk_cache_discard(drv, start, (uint32_t)sz);
     ret = disk_write(drv, start, (uint32_t)sz, buf);
 #ifdef DEBUG_DISK
     wolfBoot_printf("disk_part_write: drv: %d, part: %d, off: %llu, sz: %llu, "
@@ -29,6 +29,9 @@
 #include "printf.h"
 #include "string.h"
 #include <stdint.h>
+#ifdef WOLFBOOT_LZ4
+#include "lz4.h"
+#endif
 
 uint32_t cpu_to_fdt32(uint32_t x)
 {
@@ -203,27 +206,34 @@ static int fdt_next_property_(const void *fdt, int offset)
 static const struct fdt_property *fdt_get_property(const void *fdt, int offset,
     const char *name, int *lenp, int *poffset)
 {
-    int namelen = (int)strlen(name);
-    for (offset = fdt_first_property_offset(fdt, offset);
-         offset >= 0;
-         offset = fdt_next_property_offset(fdt, offset))
-    {
-        int slen, stroffset;
-        const char *p;
-        const struct fdt_property *prop =
-            fdt_get_property_by_offset(fdt, offset, lenp);
-        if (prop == NULL) {
-            offset = -FDT_ERR_INTERNAL;
+    int nextoffset;
+    uint32_t tag;
+
+    /* single pass over the tags of the node */
+    offset = fdt_check_node_offset_(fdt, offset);
+    while (offset >= 0) {
+        tag = fdt_next_tag(fdt, offset, &nextoffset);
+        if (tag == FDT_PROP) {
+            const struct fdt_property *prop = fdt_offset_ptr_(fdt, offset);
+            const char *p = fdt_get_string(fdt,
+                (int)fdt32_to_cpu(prop->nameoff), NULL);
+            if (strcmp(p, name) == 0) {
+                if (lenp)
+                    *lenp = (int)fdt32_to_cpu(prop->len);
+                if (poffset)
+                    *poffset = offset;
+                return prop;
+            }
+        }
+        else if (tag == FDT_END) {
+            offset = (nextoffset >= 0) ? -FDT_ERR_BADSTRUCTURE : nextoffset;
             break;
         }
-        stroffset = fdt32_to_cpu(prop->nameoff);
-
-        p = fdt_get_string(fdt, stroffset, &slen);
-        if (p && (slen == namelen) && (memcmp(p, name, namelen) == 0)) {
-            if (poffset)
-                *poffset = offset;
-            return prop;
+        else if (tag != FDT_NOP) {
+            offset = -FDT_ERR_NOTFOUND;
+            break;
         }
+        offset = nextoffset;
     }
     if (lenp) {
         *lenp = offset;
@@ -237,6 +247,131 @@ static void fdt_del_last_string_(void *fdt, const char *s)
     fdt_set_size_dt_strings(fdt, fdt_size_dt_strings(fdt) - newlen);
 }
 
+/* Active node index, see fdt_index_build() */
+static struct {
+    const void* fdt;
+    struct fdt_index_node* nodes;
+    int max;
+    int count;
+} fdt_idx;
+
+/* FNV-1a */
+static uint32_t fdt_name_hash_(const char *s, int len)
+{
+    uint32_t h = 0x811C9DC5UL;
+    while (len-- > 0) {
+        h ^= (uint8_t)*s++;
+        h *= 0x01000193UL;
+    }
+    return h;
+}
+
+static int fdt_index_active_(const void *fdt)
+{
+    return (fdt_idx.nodes != NULL) && (fdt_idx.fdt == fdt);
+}
+
+static uint32_t fdt_filter_bit_(const char *s, int len)
+{
+    return 1UL << (fdt_name_hash_(s, len) & 31);
+}
+
+/* filter bits of a "compatible" or "device_type" value */
+static uint32_t fdt_filter_(const char *name, const char *val, int len)
+{
+    uint32_t filter = 0;
+    const char *end;
+
+    if ((strcmp(name, "compatible") != 0) &&
+            (strcmp(name, "device_type") != 0))
+        return 0;
+    while ((val != NULL) && (len > 0)) {
+        end = memchr(val, '\0', len);
+        if (end == NULL)
+            end = val + len;
+        filter |= fdt_filter_bit_(val, (int)(end - val));
+        len -= (int)(end - val) + 1;
+        val = end + 1;
+    }
+    return filter;
+}
+
+/* first index entry with a node offset greater than 'offset' */
+static int fdt_index_next_(int offset)
+{
+    int lo = 0, hi = fdt_idx.count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (fdt_idx.nodes[mid].offset <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* a property of an indexed node was set */
+static void fdt_index_setprop_(const void *fdt, int nodeoffset,
+    const char *name, const void *val, int len)
+{
+    int i;
+
+    if (!fdt_index_active_(fdt))
+        return;
+    i = fdt_index_next_(nodeoffset) - 1;
+    if ((i >= 0) && (fdt_idx.nodes[i].offset == nodeoffset))
+        fdt_idx.nodes[i].filter |= fdt_filter_(name, val, len);
+}
+
+/* nodes at or after 'offset' moved by 'delta' bytes */
+static void fdt_index_shift_(const void *fdt, int offset, int delta)
+{
+    int i;
+    if (!fdt_index_active_(fdt) || delta == 0)
+        return;
+    for (i = fdt_index_next_(offset - 1); i < fdt_idx.count; i++) {
+        fdt_idx.nodes[i].offset += delta;
+    }
+}
+
+static void fdt_index_add_(const void *fdt, int parentoff, int offset,
+    const char *name, int namelen)
+{
+    struct fdt_index_node *n;
+    int i, p;
+
+    if (!fdt_index_active_(fdt))
+        return;
+    p = fdt_index_next_(parentoff) - 1;
+    if (p < 0 || fdt_idx.nodes[p].offset != parentoff ||
+            fdt_idx.count >= fdt_idx.max) {
+        fdt_index_clear();
+        return;
+    }
+    i = fdt_index_next_(offset - 1);
+    n = &fdt_idx.nodes[i];
+    memmove(n + 1, n, (fdt_idx.count - i) * sizeof(*n));
+    n->offset = offset;
+    n->depth = fdt_idx.nodes[p].depth + 1;
+    n->hash = fdt_name_hash_(name, namelen);
+    n->phandle = 0;
+    n->filter = 0;
+    fdt_idx.count++;
+}
+
+static void fdt_index_del_(const void *fdt, int offset, int endoffset)
+{
+    int i, j;
+
+    if (!fdt_index_active_(fdt))
+        return;
+    i = fdt_index_next_(offset - 1);
+    j = fdt_index_next_(endoffset - 1);
+    memmove(&fdt_idx.nodes[i], &fdt_idx.nodes[j],
+        (fdt_idx.count - j) * sizeof(fdt_idx.nodes[0]));
+    fdt_idx.count -= j - i;
+}
+
 static int fdt_splice_(void *fdt, void *splicepoint, int oldlen, int newlen)
 {
     char *p, *end;
@@ -264,6 +399,8 @@ static int fdt_splice_struct_(void *fdt, void *p, int oldlen, int newlen)
     if (err == 0) {
         fdt_set_size_dt_struct(fdt, fdt_size_dt_struct(fdt) + delta);
         fdt_set_off_dt_strings(fdt, fdt_off_dt_strings(fdt) + delta);
+        fdt_index_shift_(fdt, (int)((char*)p - (char*)fdt_offset_ptr_(fdt, 0))
+            + oldlen, delta);
     }
     return err;
 }
@@ -402,6 +539,61 @@ static int fdt_subnode_offset_namelen(const void *fdt, int offset,
     return offset; /* error */
 }
 
+static int fdt_subnode_offset_idx_(const void *fdt, int offset,
+    const char *name, int namelen)
+{
+    uint32_t h;
+    int i, depth, exact;
+
+    if (!fdt_index_active_(fdt))
+        return fdt_subnode_offset_namelen(fdt, offset, name, namelen);
+
+    i = fdt_index_next_(offset) - 1;
+    if (i < 0 || fdt_idx.nodes[i].offset != offset)
+        return -FDT_ERR_BADOFFSET;
+    depth = fdt_idx.nodes[i].depth;
+    /* without a unit address, "name" also matches "name@..." */
+    exact = (memchr(name, '@', namelen) != NULL);
+    h = fdt_name_hash_(name, namelen);
+    for (i++; (i < fdt_idx.count) && (fdt_idx.nodes[i].depth > depth); i++) {
+        if (fdt_idx.nodes[i].depth != depth + 1)
+            continue;
+        if (exact && fdt_idx.nodes[i].hash != h)
+            continue;
+        if (fdt_nodename_eq_(fdt, fdt_idx.nodes[i].offset, name, namelen))
+            return fdt_idx.nodes[i].offset;
+    }
+    return -FDT_ERR_NOTFOUND;
+}
+
+/* next node after 'offset', from the index when one is active, skipping
+ * the nodes without all the bits of 'filter' */
+static int fdt_next_node_idx_(const void *fdt, int offset, uint32_t filter)
+{
+    if (fdt_index_active_(fdt)) {
+        int i;
+        for (i = fdt_index_next_(offset); i < fdt_idx.count; i++) {
+            if ((fdt_idx.nodes[i].filter & filter) == filter)
+                return fdt_idx.nodes[i].offset;
+        }
+        return -FDT_ERR_NOTFOUND;
+    }
+    return fdt_next_node(fdt, offset, NULL);
+}
+
+static uint32_t fdt_get_phandle_(const void *fdt, int nodeoffset)
+{
+    const uint32_t *ph;
+    int len;
+
+    ph = fdt_getprop(fdt, nodeoffset, "phandle", &len);
+    if (ph == NULL)
+        ph = fdt_getprop(fdt, nodeoffset, "linux,phandle", &len);
+    if (ph == NULL || len != sizeof(*ph))
+        return 0;
+    return fdt32_to_cpu(*ph);
+}
+
 
 
 /* Public Functions */
@@ -552,6 +744,8 @@ int fdt_setprop(void *fdt, int nodeoffset, const char *name, const void *val,
         if (len > 0) {
             memcpy(prop_data, val, len);
         }
+        memset((char*)prop_data + len, 0, FDT_TAGALIGN(len) - len);
+        fdt_index_setprop_(fdt, nodeoffset, name, val, len);
     }
     if (err != 0) {
         wolfBoot_printf("FDT: Set prop failed! %d (name %s, off %d)\n",
@@ -604,6 +798,20 @@ int fdt_find_node_offset(void* fdt, int startoff, const char* nodename)
         return -1;
 
     fnlen = (int)strlen(nodename);
+    if (fdt_index_active_(fdt)) {
+        uint32_t h = fdt_name_hash_(nodename, fnlen);
+        int i;
+        for (i = fdt_index_next_(startoff); i < fdt_idx.count; i++) {
+            off = fdt_idx.nodes[i].offset;
+            nstr = fdt_offset_ptr(fdt, off + FDT_TAGSIZE, fnlen + 1);
+            if ((fdt_idx.nodes[i].hash == h) && (nstr != NULL) &&
+                    (memcmp(nstr, nodename, fnlen) == 0) &&
+                    (nstr[fnlen] == '\0')) {
+                return off;
+            }
+        }
+        return -FDT_ERR_NOTFOUND;
+    }
     for (off = fdt_next_node(fdt, startoff, NULL);
          off >= 0;
          off = fdt_next_node(fdt, off, NULL))
@@ -621,14 +829,17 @@ int fdt_find_prop_offset(void* fdt, int startoff, const char* propname,
 {
     int len, off, pvallen;
     const void* val;
+    uint32_t filter;
 
     if (propname == NULL || propval == NULL)
         return -1;
 
     pvallen = (int)strlen(propval)+1;
-    for (off = fdt_next_node(fdt, startoff, NULL);
+    /* a matching value starts with the first string of propval */
+    filter = fdt_filter_(propname, propval, pvallen);
+    for (off = fdt_next_node_idx_(fdt, startoff, filter);
          off >= 0;
-         off = fdt_next_node(fdt, off, NULL))
+         off = fdt_next_node_idx_(fdt, off, filter))
     {
         val = fdt_getprop(fdt, off, propname, &len);
         if (val && (len == pvallen) && (memcmp(val, propval, len) == 0)) {
@@ -648,9 +859,10 @@ int fdt_node_offset_by_compatible(const void *fdt, int startoffset,
 {
     int offset;
     int complen = (int)strlen(compatible);
-    for (offset = fdt_next_node(fdt, startoffset, NULL);
+    uint32_t filter = fdt_filter_bit_(compatible, complen);
+    for (offset = fdt_next_node_idx_(fdt, startoffset, filter);
          offset >= 0;
-         offset = fdt_next_node(fdt, offset, NULL))
+         offset = fdt_next_node_idx_(fdt, offset, filter))
     {
         int len;
         const char *prop = (const char*)fdt_getprop(fdt, offset, "compatible",
@@ -671,6 +883,121 @@ int fdt_node_offset_by_compatible(const void *fdt, int startoffset,
     return offset;
 }
 
+int fdt_node_offset_by_phandle(const void* fdt, uint32_t phandle)
+{
+    int off, i;
+
+    if ((phandle == 0) || (phandle == 0xFFFFFFFFUL))
+        return -FDT_ERR_NOTFOUND;
+    if (fdt_index_active_(fdt)) {
+        for (i = 0; i < fdt_idx.count; i++) {
+            if (fdt_idx.nodes[i].phandle == phandle)
+                return fdt_idx.nodes[i].offset;
+        }
+        return -FDT_ERR_NOTFOUND;
+    }
+    for (off = fdt_next_node(fdt, -1, NULL);
+         off >= 0;
+         off = fdt_next_node(fdt, off, NULL))
+    {
+        if (fdt_get_phandle_(fdt, off) == phandle)
+            break;
+    }
+    return off;
+}
+
+/* absolute path, such as "/soc/serial@11c500". The unit address can be
+ * omitted when it is not needed to tell the nodes apart */
+int fdt_path_offset(const void* fdt, const char* path)
+{
+    const char *p, *end;
+    int off = 0, len;
+
+    if ((path == NULL) || (*path != '/'))
+        return -FDT_ERR_BADOFFSET;
+    p = path;
+    end = path + strlen(path);
+    while (p < end) {
+        const char *q;
+        while (*p == '/')
+            p++;
+        if (p == end)
+            break;
+        q = memchr(p, '/', end - p);
+        len = (q != NULL) ? (int)(q - p) : (int)(end - p);
+        off = fdt_subnode_offset_idx_(fdt, off, p, len);
+        if (off < 0)
+            return off;
+        p += len;
+    }
+    return off;
+}
+
+/* One pass over the tree. Returns the number of nodes indexed, or a negative
+ * error (-FDT_ERR_NOSPACE if the tree has more than 'max' nodes), in which
+ * case the lookups keep walking the tree. */
+int fdt_index_build(const void* fdt, struct fdt_index_node* nodes, int max)
+{
+    const struct fdt_node_header *nh;
+    const struct fdt_property *prop;
+    struct fdt_index_node *n = NULL;
+    const char *name;
+    int off, nextoffset, len, depth = 0, count = 0;
+    uint32_t tag;
+
+    fdt_index_clear();
+    off = fdt_check_header(fdt);
+    if (off != 0)
+        return off;
+    for (off = 0; ; off = nextoffset) {
+        tag = fdt_next_tag(fdt, off, &nextoffset);
+        if (tag == FDT_BEGIN_NODE) {
+            if (count >= max)
+                return -FDT_ERR_NOSPACE;
+            nh = fdt_offset_ptr_(fdt, off);
+            n = &nodes[count++];
+            n->offset = off;
+            n->depth = ++depth;
+            n->hash = fdt_name_hash_(nh->name, (int)strlen(nh->name));
+            n->phandle = 0;
+            n->filter = 0;
+        }
+        else if (tag == FDT_PROP) {
+            if (n == NULL)
+                return -FDT_ERR_BADSTRUCTURE;
+            prop = fdt_offset_ptr_(fdt, off);
+            name = fdt_get_string(fdt, (int)fdt32_to_cpu(prop->nameoff), NULL);
+            len = (int)fdt32_to_cpu(prop->len);
+            if ((len == sizeof(uint32_t)) && ((strcmp(name, "phandle") == 0) ||
+                    ((n->phandle == 0) &&
+                     (strcmp(name, "linux,phandle") == 0)))) {
+                n->phandle = fdt32_to_cpu(*(const uint32_t*)prop->data);
+            }
+            n->filter |= fdt_filter_(name, prop->data, len);
+        }
+        else if (tag == FDT_END_NODE) {
+            if (--depth < 0)
+                return -FDT_ERR_BADSTRUCTURE;
+        }
+        else if (tag == FDT_END) {
+            if (nextoffset < 0)
+                return nextoffset;
+            break;
+        }
+    }
+
+    fdt_idx.fdt = fdt;
+    fdt_idx.nodes = nodes;
+    fdt_idx.max = max;
+    fdt_idx.count = count;
+    return count;
+}
+
+void fdt_index_clear(void)
+{
+    memset(&fdt_idx, 0, sizeof(fdt_idx));
+}
+
 int fdt_add_subnode(void* fdt, int parentoff, const char *name)
 {
     int err;
@@ -684,7 +1011,7 @@ int fdt_add_subnode(void* fdt, int parentoff, const char *name)
     if (err != 0)
         return err;
 
-    offset = fdt_subnode_offset_namelen(fdt, parentoff, name, namelen);
+    offset = fdt_subnode_offset_idx_(fdt, parentoff, name, namelen);
     if (offset >= 0)
         return -FDT_ERR_EXISTS;
     else if (offset != -FDT_ERR_NOTFOUND)
@@ -708,6 +1035,7 @@ int fdt_add_subnode(void* fdt, int parentoff, const char *name)
         memcpy(nh->name, name, namelen);
         endtag = (uint32_t*)((char *)nh + nodelen - FDT_TAGSIZE);
         *endtag = cpu_to_fdt32(FDT_END_NODE);
+        fdt_index_add_(fdt, parentoff, offset, name, namelen);
         err = offset;
     }
     return err;
@@ -731,8 +1059,12 @@ int fdt_del_node(void *fdt, int nodeoffset)
     if (endoffset < 0)
         return endoffset;
 
-    return fdt_splice_struct_(fdt, fdt_offset_ptr_w_(fdt, nodeoffset),
+    fdt_index_del_(fdt, nodeoffset, endoffset);
+    err = fdt_splice_struct_(fdt, fdt_offset_ptr_w_(fdt, nodeoffset),
                   endoffset - nodeoffset, 0);
+    if (err != 0)
+        fdt_index_clear();
+    return err;
 }
 
 
@@ -769,6 +1101,277 @@ int fdt_fixup_val64(void* fdt, int off, const char* node, const char* name,
 }
 
 
+/* Fixup transactions */
+void fdt_tx_begin(struct fdt_tx* tx, void* fdt, struct fdt_tx_prop* props,
+    int max)
+{
+    tx->fdt = fdt;
+    tx->props = props;
+    tx->max = max;
+    tx->count = 0;
+    tx->err = fdt_check_header(fdt);
+}
+
+int fdt_tx_setprop(struct fdt_tx* tx, int nodeoffset, const char* name,
+    const void* val, int len)
+{
+    const struct fdt_property *prop;
+    struct fdt_tx_prop *e = NULL;
+    int i, nextoffset, oldlen, poffset;
+
+    if (tx->err != 0)
+        return tx->err;
+    if ((name == NULL) || (len < 0) || ((len > 0) && (val == NULL))) {
+        tx->err = -FDT_ERR_BADSTATE;
+        return tx->err;
+    }
+    nextoffset = fdt_check_node_offset_(tx->fdt, nodeoffset);
+    if (nextoffset < 0) {
+        tx->err = nextoffset;
+        return tx->err;
+    }
+    /* the last value set wins */
+    for (i = 0; i < tx->count; i++) {
+        if ((tx->props[i].nodeoff == nodeoffset) &&
+                (strcmp(tx->props[i].name, name) == 0)) {
+            e = &tx->props[i];
+            break;
+        }
+    }
+    if (e == NULL) {
+        if (tx->count >= tx->max) {
+            tx->err = -FDT_ERR_NOSPACE;
+            return tx->err;
+        }
+        e = &tx->props[tx->count];
+        e->name = name;
+        e->nodeoff = nodeoffset;
+        e->seq = tx->count;
+        prop = fdt_get_property(tx->fdt, nodeoffset, name, &oldlen, &poffset);
+        if (prop != NULL) {
+            e->pos = poffset;
+            e->oldlen = sizeof(*prop) + FDT_TAGALIGN(oldlen);
+            e->nameoff = (int)fdt32_to_cpu(prop->nameoff);
+        }
+        else if (oldlen == -FDT_ERR_NOTFOUND) {
+            /* added at the start of the node, as fdt_setprop() does */
+            e->pos = nextoffset;
+            e->oldlen = 0;
+            e->nameoff = -1;
+        }
+        else {
+            tx->err = oldlen;
+            return tx->err;
+        }
+        tx->count++;
+    }
+    e->len = len;
+    if (len <= (int)sizeof(e->buf)) {
+        if (len > 0)
+            memcpy(e->buf, val, len);
+        e->val = NULL;
+    }
+    else {
+        e->val = val;
+    }
+    return 0;
+}
+
+/* region order; new properties of a node go before its first property, the
+ * last one added first */
+static int fdt_tx_before_(const struct fdt_tx_prop *a,
+    const struct fdt_tx_prop *b)
+{
+    if (a->pos != b->pos)
+        return a->pos < b->pos;
+    if ((a->oldlen == 0) != (b->oldlen == 0))
+        return a->oldlen == 0;
+    return a->seq > b->seq;
+}
+
+static int fdt_tx_reclen_(const struct fdt_tx_prop *e)
+{
+    return (int)sizeof(struct fdt_property) + FDT_TAGALIGN(e->len);
+}
+
+int fdt_tx_commit(struct fdt_tx* tx)
+{
+    void *fdt = tx->fdt;
+    char *base, *strtab;
+    struct fdt_tx_prop *e, tmp;
+    int i, j, n = tx->count, delta, shift, strsize, newstr, end;
+
+    if (tx->err != 0)
+        return tx->err;
+    if (n == 0)
+        return 0;
+
+    /* names missing from the strings block are appended in the order they
+     * were first used */
+    strtab = (char*)fdt + fdt_off_dt_strings(fdt);
+    strsize = fdt_size_dt_strings(fdt);
+    newstr = 0;
+    for (i = 0; i < n; i++) {
+        const char *p;
+        e = &tx->props[i];
+        if (e->nameoff >= 0)
+            continue;
+        p = fdt_find_string_(strtab, strsize, e->name);
+        if (p != NULL) {
+            e->nameoff = (int)(p - strtab);
+            continue;
+        }
+        for (j = 0; j < i; j++) {
+            if ((tx->props[j].nameoff >= strsize) &&
+                    (strcmp(tx->props[j].name, e->name) == 0)) {
+                e->nameoff = tx->props[j].nameoff;
+                break;
+            }
+        }
+        if (j == i) {
+            e->nameoff = strsize + newstr;
+            newstr += (int)strlen(e->name) + 1;
+        }
+    }
+
+    delta = 0;
+    for (i = 0; i < n; i++) {
+        delta += fdt_tx_reclen_(&tx->props[i]) - tx->props[i].oldlen;
+    }
+    end = fdt_data_size_(fdt);
+    if (end + delta + newstr > (int)fdt_totalsize(fdt))
+        return -FDT_ERR_NOSPACE;
+
+    for (i = 1; i < n; i++) {
+        tmp = tx->props[i];
+        for (j = i; (j > 0) && fdt_tx_before_(&tmp, &tx->props[j - 1]); j--) {
+            tx->props[j] = tx->props[j - 1];
+        }
+        tx->props[j] = tmp;
+    }
+
+    /* Move what lies after each edited region to its final place, once.
+     * Parts moving down are moved first, in order, then the parts moving
+     * up, last first, so no part is overwritten before it is moved. */
+    base = (char*)fdt_offset_ptr_w_(fdt, 0);
+    end -= fdt_off_dt_struct(fdt);
+    shift = 0;
+    for (i = 0; i < n; i++) {
+        e = &tx->props[i];
+        shift += fdt_tx_reclen_(e) - e->oldlen;
+        if (shift < 0) {
+            int from = e->pos + e->oldlen;
+            int to = (i + 1 < n) ? tx->props[i + 1].pos : end;
+            memmove(base + from + shift, base + from, to - from);
+        }
+    }
+    for (i = n - 1; i >= 0; i--) {
+        e = &tx->props[i];
+        if (shift > 0) {
+            int from = e->pos + e->oldlen;
+            int to = (i + 1 < n) ? tx->props[i + 1].pos : end;
+            memmove(base + from + shift, base + from, to - from);
+        }
+        shift -= fdt_tx_reclen_(e) - e->oldlen;
+    }
+
+    /* write the properties */
+    for (i = 0; i < n; i++) {
+        struct fdt_property *prop;
+        e = &tx->props[i];
+        prop = (struct fdt_property*)(base + e->pos + shift);
+        prop->tag = cpu_to_fdt32(FDT_PROP);
+        prop->len = cpu_to_fdt32(e->len);
+        prop->nameoff = cpu_to_fdt32(e->nameoff);
+        if (e->len > 0)
+            memcpy(prop->data, (e->val != NULL) ? e->val : e->buf, e->len);
+        memset(prop->data + e->len, 0, FDT_TAGALIGN(e->len) - e->len);
+        shift += fdt_tx_reclen_(e) - e->oldlen;
+    }
+    fdt_set_size_dt_struct(fdt, fdt_size_dt_struct(fdt) + delta);
+    fdt_set_off_dt_strings(fdt, fdt_off_dt_strings(fdt) + delta);
+
+    strtab = (char*)fdt + fdt_off_dt_strings(fdt);
+    for (i = 0; i < n; i++) {
+        e = &tx->props[i];
+        if (e->nameoff >= strsize)
+            memcpy(strtab + e->nameoff, e->name, strlen(e->name) + 1);
+    }
+    fdt_set_size_dt_strings(fdt, strsize + newstr);
+
+    /* nodes after each edited region moved with it */
+    if (fdt_index_active_(fdt)) {
+        for (i = 0; i < n; i++) {
+            e = &tx->props[i];
+            fdt_index_setprop_(fdt, e->nodeoff, e->name,
+                (e->val != NULL) ? e->val : e->buf, e->len);
+        }
+        shift = 0;
+        for (i = 0, j = 0; i < fdt_idx.count; i++) {
+            while ((j < n) && (tx->props[j].pos + tx->props[j].oldlen <=
+                    fdt_idx.nodes[i].offset)) {
+                shift += fdt_tx_reclen_(&tx->props[j]) - tx->props[j].oldlen;
+                j++;
+            }
+            fdt_idx.nodes[i].offset += shift;
+        }
+    }
+    tx->count = 0;
+    return 0;
+}
+
+/* Fallback for a failed commit: the recorded edits are applied one at a
+ * time with fdt_setprop(), from the end of the tree so that the recorded
+ * node offsets stay valid. Returns the first error, including an edit that
+ * could not be recorded. */
+int fdt_tx_apply(struct fdt_tx* tx)
+{
+    struct fdt_tx_prop *e, tmp;
+    int i, j, n = tx->count, ret, err = tx->err;
+
+    for (i = 1; i < n; i++) {
+        tmp = tx->props[i];
+        for (j = i; (j > 0) && fdt_tx_before_(&tmp, &tx->props[j - 1]); j--) {
+            tx->props[j] = tx->props[j - 1];
+        }
+        tx->props[j] = tmp;
+    }
+    for (i = n - 1; i >= 0; i--) {
+        e = &tx->props[i];
+        ret = fdt_setprop(tx->fdt, e->nodeoff, e->name,
+            (e->val != NULL) ? e->val : e->buf, e->len);
+        if ((ret != 0) && (err == 0))
+            err = ret;
+    }
+    tx->count = 0;
+    return err;
+}
+
+int fdt_tx_fixup_str(struct fdt_tx* tx, int off, const char* node,
+    const char* name, const char* str)
+{
+    wolfBoot_printf("FDT: Set %s (%d), %s=%s\n", node, off, name, str);
+    return fdt_tx_setprop(tx, off, name, str, strlen(str)+1);
+}
+
+int fdt_tx_fixup_val(struct fdt_tx* tx, int off, const char* node,
+    const char* name, uint32_t val)
+{
+    wolfBoot_printf("FDT: Set %s (%d), %s=%u\n", node, off, name, val);
+    val = cpu_to_fdt32(val);
+    return fdt_tx_setprop(tx, off, name, &val, sizeof(val));
+}
+
+int fdt_tx_fixup_val64(struct fdt_tx* tx, int off, const char* node,
+    const char* name, uint64_t val)
+{
+    wolfBoot_printf("FDT: Set %s (%d), %s=%llu\n",
+        node, off, name, (unsigned long long)val);
+    val = cpu_to_fdt64(val);
+    return fdt_tx_setprop(tx, off, name, &val, sizeof(val));
+}
+
+
 /* FIT Specific */
 const char* fit_find_images(void* fdt, const char** pkernel, const char** pflat_dt)
 {
@@ -820,10 +1423,34 @@ const char* fit_find_images(void* fdt, const char** pkernel, const char** pflat_
     return conf;
 }
 
+#ifdef WOLFBOOT_LZ4
+/* Inflate an LZ4 frame to the load address. The output must not run into
+ * the compressed data, which is part of the FIT image. Returns the
+ * decompressed size, or -1 on error. */
+static int fit_inflate_image(const char* image, uint8_t* data, int len,
+    uint8_t* load)
+{
+    uintptr_t room = WOLFBOOT_LZ4_MAX_SIZE;
+
+    if (load < data) {
+        if ((uintptr_t)(data - load) < room)
+            room = (uintptr_t)(data - load);
+    }
+    else if (load < data + len) {
+        wolfBoot_printf("Image %s: load address overlaps its data\n", image);
+        return -1;
+    }
+    wolfBoot_printf("Inflating Image %s: %p -> %p (%d bytes)\n",
+        image, data, load, len);
+    return lz4_decompress(data, (uint32_t)len, load, (uint32_t)room);
+}
+#endif
+
 void* fit_load_image(void* fdt, const char* image, int* lenp)
 {
     void *load, *entry, *data = NULL;
-    int off, len = 0;
+    const char *comp;
+    int off, len = 0, comp_len = 0;
 
     off = fdt_find_node_offset(fdt, -1, image);
     if (off > 0) {
@@ -831,7 +1458,26 @@ void* fit_load_image(void* fdt, const char* image, int* lenp)
         data = (void*)fdt_getprop(fdt, off, "data", &len);
         load = fdt_getprop_address(fdt, off, "load");
         entry = fdt_getprop_address(fdt, off, "entry");
-        if (data != NULL && load != NULL && data != load) {
+        comp = (const char*)fdt_getprop(fdt, off, "compression", &comp_len);
+        if (comp != NULL &&
+                !(comp_len == 5 && memcmp(comp, "none", 5) == 0)) {
+        #ifdef WOLFBOOT_LZ4
+            if (data != NULL && load != NULL &&
+                    comp_len == 4 && memcmp(comp, "lz4", 4) == 0) {
+                len = fit_inflate_image(image, data, len, load);
+                data = (len < 0) ? NULL : ((entry != NULL) ? entry : load);
+            }
+            else
+        #endif
+            {
+                wolfBoot_printf("Image %s: cannot load %s compressed data\n",
+                    image, comp);
+                data = NULL;
+            }
+            if (data == NULL)
+                len = 0;
+        }
+        else if (data != NULL && load != NULL && data != load) {
             wolfBoot_printf("Loading Image %s: %p -> %p (%d bytes)\n",
                 image, data, load, len);
             memcpy(load, data, len);
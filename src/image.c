@@ -45,6 +45,9 @@
 #ifdef WOLFBOOT_TPM
 #include "tpm.h"
 #endif
+#if defined(WOLFBOOT_MERKLE) && defined(EXT_ENCRYPTED)
+#include "encrypt.h"
+#endif
 #ifdef WOLFBOOT_HASH_SHA256
 #include <wolfssl/wolfcrypt/sha256.h>
 #endif
@@ -890,9 +893,74 @@ uint16_t wolfBoot_get_header(struct wolfBoot_image *img, uint16_t type,
         return wolfBoot_find_header(img->hdr + IMAGE_HEADER_OFFSET, type, ptr);
 }
 
-#ifdef EXT_FLASH
-static uint8_t ext_hash_block[WOLFBOOT_SHA_BLOCK_SIZE] XALIGNED(4);
+/* Size of the reads issued to compute the hash of the firmware. Larger
+ * chunks reduce the number of transactions on external flash.
+ */
+#ifndef WOLFBOOT_HASH_CHUNK_SIZE
+#define WOLFBOOT_HASH_CHUNK_SIZE WOLFBOOT_SHA_BLOCK_SIZE
 #endif
+#if (WOLFBOOT_HASH_CHUNK_SIZE < WOLFBOOT_SHA_BLOCK_SIZE)
+#error "WOLFBOOT_HASH_CHUNK_SIZE must be at least WOLFBOOT_SHA_BLOCK_SIZE"
+#endif
+
+#ifdef EXT_FLASH
+static uint8_t ext_hash_block[WOLFBOOT_HASH_CHUNK_SIZE] XALIGNED(4);
+
+/* Encrypted partitions are decrypted by ext_flash_decrypt_read(), so the
+ * next chunk can only be fetched ahead when the flash is read directly.
+ */
+#ifndef EXT_ENCRYPTED
+#define EXT_HASH_PREFETCH
+static uint8_t ext_hash_block_next[WOLFBOOT_HASH_CHUNK_SIZE] XALIGNED(4);
+static uintptr_t ext_hash_next_addr = (uintptr_t)-1;
+static uint8_t *ext_hash_next_buf = NULL;
+static int ext_hash_pending = 0;
+static int ext_hash_read_ret = 0;
+
+/**
+ * @brief Start reading from external flash. The read can complete in the
+ * background; the buffer is not accessed until ext_flash_read_wait()
+ * returns.
+ *
+ * This default implementation completes the read before returning. Targets
+ * with a DMA-capable flash controller can override it.
+ *
+ * @return 0 if the read was started, -1 otherwise.
+ */
+int WEAKFUNCTION ext_flash_read_start(uintptr_t address, uint8_t *data,
+        int len)
+{
+    ext_hash_read_ret = ext_flash_read(address, data, len);
+    return 0;
+}
+
+/**
+ * @brief Wait for the read started by ext_flash_read_start() to complete.
+ *
+ * @return the result of the read, as returned by ext_flash_read().
+ */
+int WEAKFUNCTION ext_flash_read_wait(void)
+{
+    return ext_hash_read_ret;
+}
+#endif /* !EXT_ENCRYPTED */
+
+/**
+ * @brief Map a range of external flash in the CPU address space.
+ *
+ * This default implementation has no memory-mapped access, so reads go
+ * through ext_flash_read(). Drivers supporting XIP reads (QSPI_FLASH_MMAP)
+ * override it.
+ *
+ * @return a pointer to the data, or NULL if the range is not mapped.
+ */
+const uint8_t* WEAKFUNCTION ext_flash_mmap(uintptr_t address, int len)
+{
+    (void)address;
+    (void)len;
+    return NULL;
+}
+#endif /* EXT_FLASH */
 /**
  * @brief Get a block of data to be hashed.
  *
@@ -906,6 +974,12 @@ static uint8_t *get_sha_block(struct wolfBoot_image *img, uint32_t offset)
         return NULL;
 #ifdef EXT_FLASH
     if (PART_IS_EXT(img)) {
+#ifndef EXT_ENCRYPTED
+        const uint8_t *mapped = ext_flash_mmap(
+                (uintptr_t)(img->fw_base) + offset, WOLFBOOT_SHA_BLOCK_SIZE);
+        if (mapped != NULL)
+            return (uint8_t *)mapped;
+#endif
         ext_flash_check_read((uintptr_t)(img->fw_base) + offset, ext_hash_block,
                 WOLFBOOT_SHA_BLOCK_SIZE);
         return ext_hash_block;
@@ -914,6 +988,112 @@ static uint8_t *get_sha_block(struct wolfBoot_image *img, uint32_t offset)
         return (uint8_t *)(img->fw_base + offset);
 }
 
+#ifdef WOLFBOOT_TPM_INIT_ASYNC
+/* Advance the TPM bring-up between two chunks of the hash. The TPM may sit
+ * on the same bus as the external flash: never while a read ahead is
+ * pending. */
+static void hash_tpm_init_poll(void)
+{
+#ifdef EXT_HASH_PREFETCH
+    if (ext_hash_pending)
+        return;
+#endif
+    (void)wolfBoot_tpm2_init_poll();
+}
+#else
+#define hash_tpm_init_poll() do {} while(0)
+#endif
+
+/**
+ * @brief Get the next chunk of firmware to be hashed.
+ *
+ * Chunks of up to WOLFBOOT_HASH_CHUNK_SIZE bytes are returned in order. On
+ * external flash, the read of the following chunk is started before
+ * returning, so it runs while the current chunk is being hashed.
+ *
+ * @param img The image to retrieve the data from.
+ * @param offset The offset of the chunk in the firmware.
+ * @param len A pointer to store the size of the chunk.
+ * @return A pointer to the data, or NULL at the end of the image or on error.
+ */
+static uint8_t *get_hash_chunk(struct wolfBoot_image *img, uint32_t offset,
+        uint32_t *len)
+{
+    uint32_t sz;
+
+    if (offset >= img->fw_size)
+        return NULL;
+    hash_tpm_init_poll();
+    sz = img->fw_size - offset;
+    if (sz > WOLFBOOT_HASH_CHUNK_SIZE)
+        sz = WOLFBOOT_HASH_CHUNK_SIZE;
+    *len = sz;
+#ifdef EXT_FLASH
+    if (PART_IS_EXT(img)) {
+        uintptr_t addr = (uintptr_t)(img->fw_base) + offset;
+        uint8_t *buf = NULL;
+#ifdef EXT_HASH_PREFETCH
+        int ret = 0;
+        /* Hash straight from the memory-mapped flash when available */
+        if (!ext_hash_pending) {
+            buf = (uint8_t *)ext_flash_mmap(addr, sz);
+            if (buf != NULL)
+                return buf;
+        }
+        if (ext_hash_pending) {
+            ret = ext_flash_read_wait();
+            ext_hash_pending = 0;
+            /* the bus is free until the next read ahead is started */
+            hash_tpm_init_poll();
+        }
+        /* Never reuse data fetched for a previous pass */
+        if ((offset != 0) && (ret >= 0) && (addr == ext_hash_next_addr))
+            buf = ext_hash_next_buf;
+        ext_hash_next_addr = (uintptr_t)-1;
+        if (buf == NULL) {
+            buf = ext_hash_block;
+            if (ext_flash_read(addr, buf, sz) < 0)
+                return NULL;
+        }
+        if (offset + sz < img->fw_size) {
+            uint32_t next_sz = img->fw_size - (offset + sz);
+            uint8_t *next_buf = (buf == ext_hash_block) ?
+                ext_hash_block_next : ext_hash_block;
+            if (next_sz > WOLFBOOT_HASH_CHUNK_SIZE)
+                next_sz = WOLFBOOT_HASH_CHUNK_SIZE;
+            if (ext_flash_read_start(addr + sz, next_buf, next_sz) == 0) {
+                ext_hash_pending = 1;
+                ext_hash_next_addr = addr + sz;
+                ext_hash_next_buf = next_buf;
+            }
+        }
+#else
+        buf = ext_hash_block;
+        if (ext_flash_check_read(addr, buf, sz) < 0)
+            return NULL;
+#endif
+        return buf;
+    } else
+#endif
+        return (uint8_t *)(img->fw_base + offset);
+}
+
+#ifdef EXT_HASH_PREFETCH
+/* End of a hashing pass: complete the read ahead started by
+ * get_hash_chunk() and drop its data. The flash may be erased or written
+ * before the next pass, which reads it again. */
+static void ext_hash_prefetch_end(void)
+{
+    if (ext_hash_pending) {
+        (void)ext_flash_read_wait();
+        ext_hash_pending = 0;
+    }
+    ext_hash_next_addr = (uintptr_t)-1;
+}
+#else
+#define ext_hash_prefetch_end() do {} while(0)
+#endif
+
 #ifdef EXT_FLASH
 #ifdef UNIT_TEST
 static uint8_t hdr_cpy[IMAGE_HEADER_SIZE] XALIGNED(4);
@@ -1010,21 +1190,19 @@ static int image_sha256(struct wolfBoot_image *img, uint8_t *hash)
 {
     uint32_t position = 0;
     uint8_t *p;
-    int blksz;
+    uint32_t blksz;
     wc_Sha256 sha256_ctx;
 
     if (header_sha256(&sha256_ctx, img) != 0)
         return -1;
     do {
-        p = get_sha_block(img, position);
+        p = get_hash_chunk(img, position, &blksz);
         if (p == NULL)
             break;
-        blksz = WOLFBOOT_SHA_BLOCK_SIZE;
-        if (position + blksz > img->fw_size)
-            blksz = img->fw_size - position;
         wc_Sha256Update(&sha256_ctx, p, blksz);
         position += blksz;
     } while(position < img->fw_size);
+    ext_hash_prefetch_end();
 
     wc_Sha256Final(&sha256_ctx, hash);
     wc_Sha256Free(&sha256_ctx);
@@ -1104,21 +1282,19 @@ static int image_sha384(struct wolfBoot_image *img, uint8_t *hash)
 {
     uint32_t position = 0;
     uint8_t *p;
-    int blksz;
+    uint32_t blksz;
     wc_Sha384 sha384_ctx;
 
     if (header_sha384(&sha384_ctx, img) != 0)
         return -1;
     do {
-        p = get_sha_block(img, position);
+        p = get_hash_chunk(img, position, &blksz);
         if (p == NULL)
             break;
-        blksz = WOLFBOOT_SHA_BLOCK_SIZE;
-        if (position + blksz > img->fw_size)
-            blksz = img->fw_size - position;
         wc_Sha384Update(&sha384_ctx, p, blksz);
         position += blksz;
     } while(position < img->fw_size);
+    ext_hash_prefetch_end();
 
     wc_Sha384Final(&sha384_ctx, hash);
     wc_Sha384Free(&sha384_ctx);
@@ -1199,22 +1375,20 @@ static int header_sha3_384(wc_Sha3 *sha3_ctx, struct wolfBoot_image *img)
 static int image_sha3_384(struct wolfBoot_image *img, uint8_t *hash)
 {
     uint8_t *p;
-    int blksz;
+    uint32_t blksz;
     uint32_t position = 0;
     wc_Sha3 sha3_ctx;
 
     if (header_sha3_384(&sha3_ctx, img) != 0)
         return -1;
     do {
-        p = get_sha_block(img, position);
+        p = get_hash_chunk(img, position, &blksz);
         if (p == NULL)
             break;
-        blksz = WOLFBOOT_SHA_BLOCK_SIZE;
-        if (position + blksz > img->fw_size)
-            blksz = img->fw_size - position;
         wc_Sha3_384_Update(&sha3_ctx, p, blksz);
         position += blksz;
     } while(position < img->fw_size);
+    ext_hash_prefetch_end();
 
     wc_Sha3_384_Final(&sha3_ctx, hash);
     wc_Sha3_384_Free(&sha3_ctx);
@@ -1250,6 +1424,21 @@ static void key_sha3_384(uint8_t key_slot, uint8_t *hash)
 #endif /* WOLFBOOT_NO_SIGN */
 #endif /* SHA3-384 */
 
+#if defined(WOLFBOOT_VERIFY_TICKET) || defined(WOLFBOOT_MERKLE) || \
+    defined(WOLFBOOT_UPDATE_DISK) || defined(WOLFBOOT_LZ4)
+/* Hash context setup for a wolfBoot_hash_t, with the configured algorithm */
+#if defined(WOLFBOOT_HASH_SHA256)
+#   define init_hash(c) wc_InitSha256(c)
+#   define free_hash(c) wc_Sha256Free(c)
+#elif defined(WOLFBOOT_HASH_SHA384)
+#   define init_hash(c) wc_InitSha384(c)
+#   define free_hash(c) wc_Sha384Free(c)
+#elif defined(WOLFBOOT_HASH_SHA3_384)
+#   define init_hash(c) wc_InitSha3_384(c, NULL, INVALID_DEVID)
+#   define free_hash(c) wc_Sha3_384_Free(c)
+#endif
+#endif
+
 /**
  * @brief Convert a 32-bit integer from little-endian to native byte order.
  *
@@ -1533,6 +1722,304 @@ int wolfBoot_open_self_address(struct wolfBoot_image* img, uint8_t* hdr,
 }
 #endif
 
+#ifdef WOLFBOOT_MERKLE
+#define MERKLE_TLV_LEN (2 * sizeof(uint32_t) + WOLFBOOT_SHA_DIGEST_SIZE)
+
+/**
+ * @brief Parse the HDR_MERKLE_ROOT TLV of an image.
+ *
+ * @param img The pointer to the wolfBoot_image structure representing the image.
+ * @param m The Merkle tree parameters, filled in if the TLV is found.
+ * @return 1 if the image has a valid Merkle tree, 0 if it has none, -1 if
+ * the TLV is not consistent with the image.
+ */
+int wolfBoot_merkle_open(struct wolfBoot_image *img, struct wolfBoot_merkle *m)
+{
+    uint8_t *tlv;
+    uint16_t len;
+    uint32_t end;
+
+    len = get_header(img, HDR_MERKLE_ROOT, &tlv);
+    if (len == 0)
+        return 0;
+    if (len != MERKLE_TLV_LEN)
+        return -1;
+    memcpy(&m->leaf_size, tlv, sizeof(uint32_t));
+    memcpy(&m->table_off, tlv + sizeof(uint32_t), sizeof(uint32_t));
+    m->leaf_size = im2n(m->leaf_size);
+    m->table_off = im2n(m->table_off);
+    memcpy(m->root, tlv + 2 * sizeof(uint32_t), WOLFBOOT_SHA_DIGEST_SIZE);
+    if ((m->leaf_size == 0) || (m->table_off == 0) ||
+            (m->table_off >= img->fw_size))
+        return -1;
+    m->first = IMAGE_HEADER_SIZE / m->leaf_size;
+    end = IMAGE_HEADER_SIZE + m->table_off;
+    m->n_leaves = ((end + m->leaf_size - 1) / m->leaf_size) - m->first;
+    if ((img->fw_size - m->table_off) / WOLFBOOT_SHA_DIGEST_SIZE != m->n_leaves
+            || (img->fw_size - m->table_off) % WOLFBOOT_SHA_DIGEST_SIZE != 0)
+        return -1;
+    return 1;
+}
+
+/* Range of the firmware covered by a leaf. Leaves are aligned to the sectors
+ * of the partition, so the first one starts right after the header. */
+static void merkle_leaf_range(const struct wolfBoot_merkle *m, uint32_t leaf,
+    uint32_t *start, uint32_t *end)
+{
+    uint32_t s = (m->first + leaf) * m->leaf_size;
+    uint32_t e = s + m->leaf_size - IMAGE_HEADER_SIZE;
+
+    *start = (s > IMAGE_HEADER_SIZE) ? (s - IMAGE_HEADER_SIZE) : 0;
+    *end = (e > m->table_off) ? m->table_off : e;
+}
+
+static int merkle_hash_range(struct wolfBoot_image *img, uint32_t start,
+    uint32_t end, uint8_t *hash)
+{
+    wolfBoot_hash_t ctx;
+    uint8_t *p;
+    uint32_t len;
+
+    init_hash(&ctx);
+    while (start < end) {
+        p = get_hash_chunk(img, start, &len);
+        if (p == NULL) {
+            ext_hash_prefetch_end();
+            free_hash(&ctx);
+            return -1;
+        }
+        if (len > end - start)
+            len = end - start;
+        update_hash(&ctx, p, len);
+        start += len;
+    }
+    ext_hash_prefetch_end();
+    final_hash(&ctx, hash);
+    free_hash(&ctx);
+    return 0;
+}
+
+static int merkle_read_leaf(struct wolfBoot_image *img,
+    const struct wolfBoot_merkle *m, uint32_t leaf, uint8_t *out)
+{
+    uint32_t off = m->table_off + leaf * WOLFBOOT_SHA_DIGEST_SIZE;
+#ifdef EXT_FLASH
+    if (PART_IS_EXT(img)) {
+        if (ext_flash_check_read((uintptr_t)img->fw_base + off, out,
+                    WOLFBOOT_SHA_DIGEST_SIZE) < 0)
+            return -1;
+        return 0;
+    }
+#endif
+    memcpy(out, img->fw_base + off, WOLFBOOT_SHA_DIGEST_SIZE);
+    return 0;
+}
+
+/**
+ * @brief Check one leaf of the Merkle tree against the firmware.
+ *
+ * The table of leaf hashes must have been checked against the root first.
+ * On external flash this uses the shared hash buffers, so it must not be
+ * called concurrently.
+ *
+ * @return 0 if the leaf matches, -1 otherwise.
+ */
+int wolfBoot_merkle_check_leaf(struct wolfBoot_image *img,
+    const struct wolfBoot_merkle *m, uint32_t leaf)
+{
+    uint8_t hash[WOLFBOOT_SHA_DIGEST_SIZE];
+    uint8_t stored[WOLFBOOT_SHA_DIGEST_SIZE];
+    uint32_t start, end;
+
+    if (leaf >= m->n_leaves)
+        return -1;
+    merkle_leaf_range(m, leaf, &start, &end);
+    if (merkle_hash_range(img, start, end, hash) != 0)
+        return -1;
+    if (merkle_read_leaf(img, m, leaf, stored) != 0)
+        return -1;
+    return image_CT_compare(hash, stored, WOLFBOOT_SHA_DIGEST_SIZE) ? 0 : -1;
+}
+
+/**
+ * @brief Check all the leaves of the Merkle tree.
+ *
+ * The default implementation checks the leaves in order. Targets with more
+ * than one core can override it to spread the calls to
+ * wolfBoot_merkle_check_leaf() across the cores, as long as the image is
+ * memory-mapped.
+ *
+ * @return 0 if all the leaves match, -1 otherwise.
+ */
+int WEAKFUNCTION wolfBoot_merkle_verify_leaves(struct wolfBoot_image *img,
+    const struct wolfBoot_merkle *m)
+{
+    uint32_t i;
+
+    for (i = 0; i < m->n_leaves; i++) {
+        if (wolfBoot_merkle_check_leaf(img, m, i) != 0) {
+            wolfBoot_printf("Merkle: sector %u corrupted\n", m->first + i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Integrity check of an image with a Merkle tree: the stored digest covers
+ * the header (including the root), the root covers the table of leaf
+ * hashes, and each leaf covers one sector of the firmware. */
+static int merkle_verify(struct wolfBoot_image *img,
+    const struct wolfBoot_merkle *m, const uint8_t *stored_sha)
+{
+    wolfBoot_hash_t ctx;
+
+    if (header_hash(&ctx, img) != 0)
+        return -1;
+    final_hash(&ctx, digest);
+    free_hash(&ctx);
+    if (!image_CT_compare(digest, stored_sha, WOLFBOOT_SHA_DIGEST_SIZE))
+        return -1;
+    if (merkle_hash_range(img, m->table_off, img->fw_size, digest) != 0)
+        return -1;
+    if (!image_CT_compare(digest, m->root, WOLFBOOT_SHA_DIGEST_SIZE))
+        return -1;
+    return wolfBoot_merkle_verify_leaves(img, m);
+}
+
+#if defined(EXT_ENCRYPTED) && defined(EXT_FLASH)
+/* The copy of a sector in an external SWAP is encrypted with the IV of the
+ * same offset in UPDATE, see wolfBoot_copy_sector() */
+static int merkle_swap_set_iv(uint32_t off)
+{
+    uint8_t key[ENCRYPT_KEY_SIZE];
+    uint8_t nonce[ENCRYPT_NONCE_SIZE];
+    volatile uint8_t *p;
+    uint32_t i;
+
+    if (wolfBoot_initialize_encryption() < 0)
+        return -1;
+    wolfBoot_get_encrypt_key(key, nonce);
+    wolfBoot_crypto_set_iv(nonce, off / ENCRYPT_BLOCK_SIZE);
+    p = (volatile uint8_t *)key;
+    for (i = 0; i < sizeof(key); i++)
+        p[i] = 0;
+    p = (volatile uint8_t *)nonce;
+    for (i = 0; i < sizeof(nonce); i++)
+        p[i] = 0;
+    return 0;
+}
+#endif
+
+/* Read from the partitions while a swap is in progress: sectors before
+ * 'sector' have already been installed in BOOT, the following ones are still
+ * in UPDATE, and 'sector' itself is read from 'part' (BOOT or SWAP). */
+static int merkle_swap_read(uint32_t off, uint8_t *buf, uint32_t len,
+    uint32_t sector, uint8_t part)
+{
+    while (len > 0) {
+        uint32_t s = off / WOLFBOOT_SECTOR_SIZE;
+        uint8_t p = (s < sector) ? PART_BOOT :
+            ((s > sector) ? PART_UPDATE : part);
+        uintptr_t addr;
+        uint32_t n = WOLFBOOT_SECTOR_SIZE - (off % WOLFBOOT_SECTOR_SIZE);
+        if (n > len)
+            n = len;
+        if (p == PART_SWAP)
+            addr = (uintptr_t)WOLFBOOT_PARTITION_SWAP_ADDRESS +
+                (off % WOLFBOOT_SECTOR_SIZE);
+        else if (p == PART_BOOT)
+            addr = (uintptr_t)WOLFBOOT_PARTITION_BOOT_ADDRESS + off;
+        else
+            addr = (uintptr_t)WOLFBOOT_PARTITION_UPDATE_ADDRESS + off;
+#ifdef EXT_FLASH
+        if (PARTN_IS_EXT(p)) {
+    #ifdef EXT_ENCRYPTED
+            if ((p == PART_SWAP) && (merkle_swap_set_iv(off) != 0))
+                return -1;
+    #endif
+            if (ext_flash_check_read(addr, buf, n) < 0)
+                return -1;
+        } else
+#endif
+            memcpy(buf, (void *)addr, n);
+        off += n;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Check a sector of the image being installed by a swap.
+ *
+ * With PART_SWAP, checks the copy of the sector in the swap partition,
+ * before it is written to BOOT. With PART_BOOT, checks the sector once it
+ * has been installed in BOOT.
+ *
+ * @param m The Merkle tree of the image being installed.
+ * @param sector The sector being swapped.
+ * @param part The partition holding the copy of the sector to check.
+ * @return 0 if the sector matches its leaf (or has none), -1 otherwise.
+ */
+int wolfBoot_merkle_check_sector(const struct wolfBoot_merkle *m,
+    uint32_t sector, uint8_t part)
+{
+    uint8_t buf[WOLFBOOT_SHA_BLOCK_SIZE];
+    uint8_t hash[WOLFBOOT_SHA_DIGEST_SIZE];
+    wolfBoot_hash_t ctx;
+    uint32_t start, end, len, leaf;
+
+    if (m->leaf_size != WOLFBOOT_SECTOR_SIZE)
+        return -1;
+    if ((part != PART_BOOT) && (part != PART_SWAP))
+        return -1;
+    if ((sector < m->first) || (sector - m->first >= m->n_leaves))
+        return 0;
+    leaf = sector - m->first;
+    merkle_leaf_range(m, leaf, &start, &end);
+    init_hash(&ctx);
+    while (start < end) {
+        len = end - start;
+        if (len > sizeof(buf))
+            len = sizeof(buf);
+        if (merkle_swap_read(IMAGE_HEADER_SIZE + start, buf, len,
+                    sector, part) != 0) {
+            free_hash(&ctx);
+            return -1;
+        }
+        update_hash(&ctx, buf, len);
+        start += len;
+    }
+    final_hash(&ctx, hash);
+    free_hash(&ctx);
+    if (merkle_swap_read(IMAGE_HEADER_SIZE + m->table_off +
+                leaf * WOLFBOOT_SHA_DIGEST_SIZE, buf,
+                WOLFBOOT_SHA_DIGEST_SIZE, sector, part) != 0)
+        return -1;
+    return image_CT_compare(hash, buf, WOLFBOOT_SHA_DIGEST_SIZE) ? 0 : -1;
+}
+#endif /* WOLFBOOT_MERKLE */
+
+#ifndef WOLFBOOT_LZ4
+/* Without LZ4=1 there is no way to inflate a compressed payload: such an
+ * image would be executed as-is, so it never passes the integrity check. */
+static int image_compressed_unsupported(struct wolfBoot_image *img)
+{
+    uint8_t *p;
+    uint16_t image_type;
+
+    if (get_header(img, HDR_IMG_TYPE, &p) != sizeof(uint16_t))
+        return 0;
+    image_type = (uint16_t)(p[0] + (p[1] << 8));
+    if ((image_type & 0x00F0) != HDR_IMG_TYPE_LZ4)
+        return 0;
+    wolfBoot_printf("Compressed image, LZ4 support not enabled\n");
+    return 1;
+}
+#else
+#define image_compressed_unsupported(img) (0)
+#endif
+
 /**
  * @brief Verify the integrity of the image using the stored SHA hash.
  *
@@ -1546,17 +2033,297 @@ int wolfBoot_verify_integrity(struct wolfBoot_image *img)
 {
     uint8_t *stored_sha;
     uint16_t stored_sha_len;
+#ifdef BOOT_BENCHMARK
+    BENCHMARK_DECLARE();
+#endif
+    if (image_compressed_unsupported(img))
+        return -1;
     stored_sha_len = get_header(img, WOLFBOOT_SHA_HDR, &stored_sha);
     if (stored_sha_len != WOLFBOOT_SHA_DIGEST_SIZE)
         return -1;
+#ifdef WOLFBOOT_MERKLE
+    {
+        struct wolfBoot_merkle m;
+        int ret = wolfBoot_merkle_open(img, &m);
+        if (ret < 0)
+            return -1;
+        if (ret > 0) {
+            if (merkle_verify(img, &m, stored_sha) != 0)
+                return -1;
+            img->sha_ok = 1;
+            img->sha_hash = stored_sha;
+            return 0;
+        }
+    }
+#endif
+#ifdef BOOT_BENCHMARK
+    wolfBoot_printf("Hashing %u bytes, chunk size %u...", img->fw_size,
+        (unsigned)WOLFBOOT_HASH_CHUNK_SIZE);
+    BENCHMARK_START();
+#endif
     if (image_hash(img, digest) != 0)
         return -1;
+#ifdef BOOT_BENCHMARK
+    BENCHMARK_END("done");
+#endif
+    if (!image_CT_compare(digest, stored_sha, stored_sha_len))
+        return -1;
+    img->sha_ok = 1;
+    img->sha_hash = stored_sha;
+    return 0;
+}
+
+#if defined(WOLFBOOT_UPDATE_DISK) || defined(WOLFBOOT_LZ4)
+/* Hash context of the streaming integrity check */
+static wolfBoot_hash_t stream_hash_ctx;
+
+/**
+ * @brief Start a streaming integrity check of the image.
+ *
+ * For loaders that copy the firmware to RAM: the manifest header is hashed
+ * here, then each part of the firmware is passed in order to
+ * wolfBoot_hash_stream_update() as soon as it is loaded, while it is still in
+ * the cache. wolfBoot_verify_integrity_stream() completes the check.
+ *
+ * @param img The image, opened from its manifest header.
+ * @return 0 on success, -1 on error.
+ */
+int wolfBoot_hash_stream_init(struct wolfBoot_image *img)
+{
+    return header_hash(&stream_hash_ctx, img);
+}
+
+void wolfBoot_hash_stream_update(const uint8_t *data, uint32_t len)
+{
+    update_hash(&stream_hash_ctx, data, len);
+}
+
+/**
+ * @brief Complete a streaming integrity check.
+ *
+ * Same as wolfBoot_verify_integrity(), with the digest of the firmware
+ * computed by the wolfBoot_hash_stream_*() calls. Images with a Merkle tree
+ * are checked by wolfBoot_verify_integrity() on img->fw_base instead.
+ *
+ * @param img The image, with fw_base pointing to the loaded firmware.
+ * @return 0 on success, -1 on error.
+ */
+int wolfBoot_verify_integrity_stream(struct wolfBoot_image *img)
+{
+    uint8_t *stored_sha;
+    uint16_t stored_sha_len;
+
+    final_hash(&stream_hash_ctx, digest);
+    free_hash(&stream_hash_ctx);
+    if (image_compressed_unsupported(img))
+        return -1;
+#ifdef WOLFBOOT_MERKLE
+    {
+        struct wolfBoot_merkle m;
+        /* Merkle tree present (or invalid): digest covers the header only */
+        if (wolfBoot_merkle_open(img, &m) != 0)
+            return wolfBoot_verify_integrity(img);
+    }
+#endif
+    stored_sha_len = get_header(img, WOLFBOOT_SHA_HDR, &stored_sha);
+    if (stored_sha_len != WOLFBOOT_SHA_DIGEST_SIZE)
+        return -1;
     if (!image_CT_compare(digest, stored_sha, stored_sha_len))
         return -1;
     img->sha_ok = 1;
     img->sha_hash = stored_sha;
     return 0;
 }
+#endif /* WOLFBOOT_UPDATE_DISK || WOLFBOOT_LZ4 */
+
+#ifdef WOLFBOOT_LZ4
+/**
+ * @brief Check if the firmware of the image is compressed.
+ *
+ * The digest and the signature of a compressed image cover the LZ4 frame
+ * as stored; HDR_IMG_RAW_SIZE gives the size of the firmware once
+ * decompressed.
+ *
+ * @param img The image, opened from its manifest header.
+ * @param raw_size Set to the size of the decompressed firmware.
+ * @return 1 if the firmware is compressed, 0 if not, -1 if the manifest
+ * header is invalid.
+ */
+int wolfBoot_image_compressed(struct wolfBoot_image *img, uint32_t *raw_size)
+{
+    uint8_t *p;
+    uint16_t image_type;
+
+    if (get_header(img, HDR_IMG_TYPE, &p) != sizeof(uint16_t))
+        return -1;
+    image_type = (uint16_t)(p[0] + (p[1] << 8));
+    if ((image_type & 0x00F0) != HDR_IMG_TYPE_LZ4)
+        return 0;
+    if (get_header(img, HDR_IMG_RAW_SIZE, &p) != sizeof(uint32_t))
+        return -1;
+    *raw_size = (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+        ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    return 1;
+}
+#endif /* WOLFBOOT_LZ4 */
+
+#ifdef WOLFBOOT_VERIFY_TICKET
+#ifdef WOLFBOOT_ARMORED
+#error "WOLFBOOT_VERIFY_TICKET cannot be used with WOLFBOOT_ARMORED"
+#endif
+
+#define VERIFY_TICKET_MAGIC 0x4B544257UL /* "WBTK" */
+
+#if defined(WOLFBOOT_HASH_SHA256)
+#   define TICKET_HMAC_BLOCK_SIZE WC_SHA256_BLOCK_SIZE
+#elif defined(WOLFBOOT_HASH_SHA384)
+#   define TICKET_HMAC_BLOCK_SIZE WC_SHA384_BLOCK_SIZE
+#elif defined(WOLFBOOT_HASH_SHA3_384)
+#   define TICKET_HMAC_BLOCK_SIZE (WC_SHA3_384_COUNT * 8)
+#endif
+
+/* Verification ticket, as stored by hal_verify_ticket_write() */
+struct wolfBoot_verify_ticket {
+    uint32_t magic;
+    uint32_t counter;
+    uint32_t fw_size;
+    uint32_t reserved;
+    uint8_t  mac[WOLFBOOT_SHA_DIGEST_SIZE];
+};
+
+static const char ticket_key_label[] = "wolfBoot verify ticket";
+
+static void ticket_zeroize(void *p, uint32_t len)
+{
+    volatile uint8_t *v = (volatile uint8_t *)p;
+    while (len--)
+        *v++ = 0;
+}
+
+/* HMAC (RFC 2104) with the image hash. 'key' is WOLFBOOT_SHA_DIGEST_SIZE
+ * bytes long, so it never needs to be hashed first. The message is passed as
+ * two parts so the header can be MAC'd in place. */
+static void ticket_hmac(const uint8_t *key, const uint8_t *m1, uint32_t m1_len,
+    const uint8_t *m2, uint32_t m2_len, uint8_t *mac)
+{
+    uint8_t pad[TICKET_HMAC_BLOCK_SIZE];
+    wolfBoot_hash_t ctx;
+    uint32_t i;
+
+    for (i = 0; i < TICKET_HMAC_BLOCK_SIZE; i++)
+        pad[i] = ((i < WOLFBOOT_SHA_DIGEST_SIZE) ? key[i] : 0) ^ 0x36;
+    init_hash(&ctx);
+    update_hash(&ctx, pad, TICKET_HMAC_BLOCK_SIZE);
+    update_hash(&ctx, m1, m1_len);
+    if (m2_len > 0)
+        update_hash(&ctx, m2, m2_len);
+    final_hash(&ctx, mac);
+    free_hash(&ctx);
+
+    for (i = 0; i < TICKET_HMAC_BLOCK_SIZE; i++)
+        pad[i] ^= (0x36 ^ 0x5C);
+    init_hash(&ctx);
+    update_hash(&ctx, pad, TICKET_HMAC_BLOCK_SIZE);
+    update_hash(&ctx, mac, WOLFBOOT_SHA_DIGEST_SIZE);
+    final_hash(&ctx, mac);
+    free_hash(&ctx);
+    ticket_zeroize(pad, sizeof(pad));
+}
+
+/* Compute the ticket MAC over magic, counter, fw_size and the whole manifest
+ * header, keyed with a secret derived from the device unique secret. */
+static int ticket_mac(struct wolfBoot_image *img,
+    const struct wolfBoot_verify_ticket *t, uint8_t *mac)
+{
+    uint8_t uds[WOLFBOOT_SHA_DIGEST_SIZE];
+    uint8_t key[WOLFBOOT_SHA_DIGEST_SIZE];
+    uint8_t *hdr = get_img_hdr(img);
+
+    if (hdr == NULL)
+        return -1;
+    if (hal_uds_derive_key(uds, sizeof(uds)) != 0) {
+        ticket_zeroize(uds, sizeof(uds));
+        return -1;
+    }
+    ticket_hmac(uds, (const uint8_t *)ticket_key_label,
+        sizeof(ticket_key_label) - 1, NULL, 0, key);
+    ticket_zeroize(uds, sizeof(uds));
+    ticket_hmac(key, (const uint8_t *)t, offsetof(struct wolfBoot_verify_ticket,
+        mac), hdr, IMAGE_HEADER_SIZE, mac);
+    ticket_zeroize(key, sizeof(key));
+    return 0;
+}
+
+/**
+ * @brief Accept the image through a previously issued verification ticket.
+ *
+ * The ticket is only accepted if it was issued for exactly the same manifest
+ * header and firmware size, and if its counter matches the current value of
+ * the monotonic counter. On success the image is marked as verified
+ * without hashing the firmware or checking the signature again.
+ *
+ * @param img The pointer to the wolfBoot_image structure representing the image.
+ * @return 0 if the ticket is valid, -1 otherwise.
+ */
+int wolfBoot_check_verify_ticket(struct wolfBoot_image *img)
+{
+    struct wolfBoot_verify_ticket t;
+    uint8_t *stored_sha;
+    uint32_t counter;
+    int ok;
+
+    if (img == NULL || img->hdr_ok != 1)
+        return -1;
+    if (get_header(img, WOLFBOOT_SHA_HDR, &stored_sha) !=
+            WOLFBOOT_SHA_DIGEST_SIZE)
+        return -1;
+    if (hal_verify_ticket_read((uint8_t *)&t, sizeof(t)) != 0)
+        return -1;
+    if (hal_monotonic_counter_read(&counter) != 0)
+        return -1;
+    if ((t.magic != VERIFY_TICKET_MAGIC) || (t.counter != counter) ||
+            (t.fw_size != img->fw_size))
+        return -1;
+    if (ticket_mac(img, &t, digest) != 0)
+        return -1;
+    ok = image_CT_compare(digest, t.mac, WOLFBOOT_SHA_DIGEST_SIZE);
+    ticket_zeroize(digest, sizeof(digest));
+    if (!ok)
+        return -1;
+    img->sha_ok = 1;
+    img->sha_hash = stored_sha;
+    wolfBoot_image_confirm_signature_ok(img);
+    return 0;
+}
+
+/**
+ * @brief Issue a verification ticket for a fully verified image.
+ *
+ * The monotonic counter is incremented first, so that any ticket issued
+ * before, including copies of it, can no longer be accepted.
+ *
+ * @param img The pointer to the wolfBoot_image structure representing the image.
+ * @return 0 on success, -1 on error.
+ */
+int wolfBoot_store_verify_ticket(struct wolfBoot_image *img)
+{
+    struct wolfBoot_verify_ticket t;
+    int ret;
+
+    if (img == NULL || img->sha_ok != 1 || img->signature_ok != 1)
+        return -1;
+    memset(&t, 0, sizeof(t));
+    t.magic = VERIFY_TICKET_MAGIC;
+    t.fw_size = img->fw_size;
+    if (hal_monotonic_counter_increment(&t.counter) != 0)
+        return -1;
+    if (ticket_mac(img, &t, t.mac) != 0)
+        return -1;
+    ret = hal_verify_ticket_write((const uint8_t *)&t, sizeof(t));
+    ticket_zeroize(&t, sizeof(t));
+    return (ret == 0) ? 0 : -1;
+}
+#endif /* WOLFBOOT_VERIFY_TICKET */
 
 #ifdef WOLFBOOT_ELF_FLASH_SCATTER
 #include "elf.h"
@@ -1575,13 +2342,15 @@ typedef union {
 
 /*
  * Copies an arbitrary amount of data between two flash memory locations
- * (internal or external) using an intermediate RAM buffer.
+ * (internal or external) using an intermediate RAM buffer. If ctx is not
+ * NULL, the copied bytes are also fed to the hash.
  */
-static int copy_flash_buffered(uintptr_t src_addr, uintptr_t dst_addr,
-                               size_t total_size, int is_src_ext,
-                               int is_dst_ext)
+static int copy_flash_buffered(wolfBoot_hash_t* ctx, uintptr_t src_addr,
+                               uintptr_t dst_addr, size_t total_size,
+                               int is_src_ext, int is_dst_ext)
 {
     size_t  bytes_copied = 0;
+    int     ret          = 0;
 
 #ifndef BUFFER_DECLARED
 #define BUFFER_DECLARED
@@ -1625,6 +2394,9 @@ static int copy_flash_buffered(uintptr_t src_addr, uintptr_t dst_addr,
         {
             memcpy(buffer, (const void*)(src_addr + bytes_copied), chunk_size);
         }
+        if (ctx != NULL) {
+            update_hash(ctx, buffer, chunk_size);
+        }
 
         /* Write the chunk from the RAM buffer to the destination flash */
 #ifdef EXT_FLASH
@@ -1633,7 +2405,10 @@ static int copy_flash_buffered(uintptr_t src_addr, uintptr_t dst_addr,
 #ifndef WOLFBOOT_FLASH_MULTI_SECTOR_ERASE
             ext_flash_erase(dst_addr + bytes_copied, chunk_size);
 #endif
-            ext_flash_write(dst_addr + bytes_copied, buffer, chunk_size);
+            if (ext_flash_write(dst_addr + bytes_copied, buffer,
+                                chunk_size) < 0) {
+                ret = -1;
+            }
             ext_flash_lock();
         }
         else
@@ -1643,9 +2418,12 @@ static int copy_flash_buffered(uintptr_t src_addr, uintptr_t dst_addr,
 #ifndef WOLFBOOT_FLASH_MULTI_SECTOR_ERASE
             hal_flash_erase(dst_addr + bytes_copied, chunk_size);
 #endif
-            hal_flash_write(dst_addr + bytes_copied, buffer, chunk_size);
+            ret = hal_flash_write(dst_addr + bytes_copied, buffer, chunk_size);
             hal_flash_lock();
         }
+        if (ret != 0) {
+            return -1;
+        }
 
         /* Update the count of bytes successfully copied */
         bytes_copied += chunk_size;
@@ -1786,7 +2564,17 @@ static int update_hash_flash_addr(wolfBoot_hash_t* ctx, uintptr_t addr,
     return 0;
 }
 
-int wolfBoot_check_flash_image_elf(uint8_t part, unsigned long* entry_out)
+/*
+ * Walks the scattered ELF image in file order and computes its digest.
+ * With load == 0, each PT_LOAD segment is hashed from its load address.
+ * With load != 0, each segment is copied from the partition to its load
+ * address and the same bytes are hashed on the way, so the image crosses
+ * the flash bus once.
+ * Returns 0 if the digest matches the one in the manifest header, -2 on
+ * mismatch, -1 on other errors.
+ */
+static int elf_flash_scatter(uint8_t part, unsigned long* entry_out,
+                             int load, int ext_flash)
 {
     /* Open the partition containing the image */
     int                   is_elf32;
@@ -1921,14 +2709,38 @@ int wolfBoot_check_flash_image_elf(uint8_t part, unsigned long* entry_out)
         /* Handle loadable segments */
         if (type == ELF_PT_LOAD) {
             uintptr_t load_addr = (uintptr_t)(paddr + BASE_OFF);
-            /* Feed the loadable parts to the hash function */
-            wolfBoot_printf("ELF: [CHECK] Hashing loadable segment: "
-                            "paddr = 0x%08lx, loadaddr = 0x%08lx, "
-                            "offset = 0x%08lx, size = %lu\n",
-                            (unsigned long)paddr, (unsigned long)load_addr,
-                            (unsigned long)offset, (unsigned long)filesz);
-            update_hash_flash_addr(&ctx, load_addr, (uint32_t)filesz,
-                                   PART_IS_EXT(&boot));
+            int ret;
+            if (load) {
+                /* Store the segment, hashing the bytes being copied */
+                if (offset + filesz > boot.fw_size) {
+                    wolfBoot_printf("ELF: [STORE] ERROR: segment outside "
+                                    "the image\n");
+                    return -1;
+                }
+                wolfBoot_printf("ELF: [STORE] Writing loadable segment: "
+                                "loadaddr=0x%08lx, offset=0x%08lx, "
+                                "size=%lu\n",
+                                (unsigned long)load_addr,
+                                (unsigned long)offset, (unsigned long)filesz);
+                ret = copy_flash_buffered(&ctx,
+                                          (uintptr_t)boot.fw_base + offset,
+                                          load_addr, (size_t)filesz,
+                                          ext_flash, ext_flash);
+            }
+            else {
+                /* Feed the loadable parts to the hash function */
+                wolfBoot_printf("ELF: [CHECK] Hashing loadable segment: "
+                                "paddr = 0x%08lx, loadaddr = 0x%08lx, "
+                                "offset = 0x%08lx, size = %lu\n",
+                                (unsigned long)paddr, (unsigned long)load_addr,
+                                (unsigned long)offset, (unsigned long)filesz);
+                ret = update_hash_flash_addr(&ctx, load_addr,
+                                             (uint32_t)filesz,
+                                             PART_IS_EXT(&boot));
+            }
+            if (ret != 0) {
+                return -1;
+            }
         }
         else {
             wolfBoot_printf("ELF: [CHECK] ERROR: non-loadable segment\n");
@@ -2006,98 +2818,24 @@ int wolfBoot_check_flash_image_elf(uint8_t part, unsigned long* entry_out)
     return 0;
 }
 
-int wolfBoot_load_flash_image_elf(int part, unsigned long* entry_out, int ext_flash)
+int wolfBoot_check_flash_image_elf(uint8_t part, unsigned long* entry_out)
 {
-    const unsigned char*  image;
-    int                   is_elf32;
-    uint16_t              entry_count;
-    size_t                entry_off;
-    size_t                ph_size;
-    int                   i;
-    const void*           eh;
-    struct wolfBoot_image boot;
-    uint8_t               elfHdrBuf[sizeof(elfHeaderMaxBuf)];
-
-    if (wolfBoot_open_image(&boot, part) < 0) {
-        return -1;
-    }
-    image = boot.fw_base;
-
-    /* Get the elf header from the image into a local buffer. We may overread
-     * the buffer depending on architecture */
-    memset(elfHdrBuf, 0, sizeof(elfHdrBuf));
-    read_flash_fwimage(&boot, 0, elfHdrBuf, sizeof(elfHeaderMaxBuf));
-    if (elf_open(elfHdrBuf, &is_elf32) != 0) {
-        return -1;
-    }
-
-    /* Set up header pointers based on ELF type */
-    if (is_elf32) {
-        eh          = (const elf32_header*)elfHdrBuf;
-        entry_count = ((const elf32_header*)eh)->ph_entry_count;
-        entry_off   = ((const elf32_header*)eh)->ph_offset;
-        *entry_out  = (unsigned long)((const elf32_header*)eh)->entry;
-
-        wolfBoot_printf("ELF: [STORE] 32-bit, entry=0x%08lx, "
-                        "ph_offset=0x%08lx, ph_count=%d\n",
-                        (unsigned long)((const elf32_header*)eh)->entry,
-                        (unsigned long)entry_off, entry_count);
-    }
-    else {
-        eh          = (const elf64_header*)elfHdrBuf;
-        entry_count = ((const elf64_header*)eh)->ph_entry_count;
-        entry_off   = ((const elf64_header*)eh)->ph_offset;
-        *entry_out  = (unsigned long)((const elf64_header*)eh)->entry;
-
-        wolfBoot_printf("ELF: [STORE] 64-bit, entry=0x%08lx, "
-                        "ph_offset=0x%08lx, ph_count=%d\n",
-                        (unsigned long)((const elf64_header*)eh)->entry,
-                        (unsigned long)entry_off, entry_count);
-    }
-
-    /* Walk the program header table and store each loadable segment */
-    for (i = 0; i < entry_count; ++i) {
-        unsigned long paddr, filesz, offset;
-        int           is_loadable;
-        uintptr_t     load_addr;
-
-        /* Read the current program header into a local buffer */
-        if (is_elf32) {
-            elf32_program_header p32;
-            read_flash_fwimage(&boot, entry_off, &p32, sizeof(p32));
-            is_loadable = (p32.type == ELF_PT_LOAD);
-            paddr       = (unsigned long)p32.paddr;
-            offset      = (unsigned long)p32.offset;
-            filesz      = (unsigned long)p32.file_size;
-            ph_size     = sizeof(p32);
-        }
-        else {
-            elf64_program_header p64;
-            read_flash_fwimage(&boot, entry_off, &p64, sizeof(p64));
-            is_loadable = (p64.type == ELF_PT_LOAD);
-            paddr       = (unsigned long)p64.paddr;
-            offset      = (unsigned long)p64.offset;
-            filesz      = (unsigned long)p64.file_size;
-            ph_size     = sizeof(p64);
-        }
-        /* Skip non-loadable segments */
-        if (!is_loadable) {
-            wolfBoot_printf("ELF: [STORE] ERROR: non-loadable segment\n");
-            return -1;
-        }
-
-        load_addr = (uintptr_t)(paddr + BASE_OFF);
-        wolfBoot_printf("ELF: [STORE] Writing loadable segment: "
-                        "loadaddr=0x%08lx, offset=0x%08lx, size=%lu\n",
-                        (unsigned long)load_addr, offset, filesz);
-        copy_flash_buffered((uintptr_t)(image + offset), load_addr, filesz,
-                            ext_flash, ext_flash);
+    return elf_flash_scatter(part, entry_out, 0, 0);
+}
 
-        entry_off += ph_size;
+/*
+ * Stores each loadable segment of the scattered ELF image at its load
+ * address and verifies the image digest in the same pass. Returns 0 on
+ * success, -2 if the digest of the copied image does not match, in which
+ * case the image must not be started.
+ */
+int wolfBoot_load_flash_image_elf(int part, unsigned long* entry_out, int ext_flash)
+{
+    int ret = elf_flash_scatter((uint8_t)part, entry_out, 1, ext_flash);
+    if (ret == 0) {
+        wolfBoot_printf("ELF: [STORE] Image loading complete\n");
     }
-
-    wolfBoot_printf("ELF: [STORE] Image loading complete\n");
-    return 0;
+    return ret;
 }
 
 #undef BASE_OFF
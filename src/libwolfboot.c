@@ -208,6 +208,376 @@ static const uint32_t wolfboot_magic_trail = WOLFBOOT_MAGIC_TRAIL;
 
 #include <stddef.h>
 #include <string.h>
+
+void WEAKFUNCTION hal_cache_invalidate(void)
+{
+    /* if cache flushing is required implement in hal */
+}
+
+#ifdef NVM_FLASH_JOURNAL
+/* NVM_FLASH_JOURNAL replaces the two-sector copy with an append-only
+ * journal spread over the last NVM_JOURNAL_SECTORS sectors of the partition.
+ *
+ * Each flag update appends one record (sequence number, offset, new bytes)
+ * to the active sector. The current trailer is kept in a RAM image, rebuilt
+ * from the journal once, so reading a flag is a plain memory access.
+ * When the active sector is full, the image is compacted into the next
+ * sector of the ring: that is the only time a sector is erased.
+ *
+ * Sector 0 is the last sector of the partition, sector 1 the one before it,
+ * and so on.
+ */
+
+#ifndef NVM_JOURNAL_RECORD_SIZE
+/* Must be a multiple of the flash write unit */
+#define NVM_JOURNAL_RECORD_SIZE 16
+#endif
+#if (NVM_JOURNAL_RECORD_SIZE < 16) || (NVM_JOURNAL_RECORD_SIZE % 8)
+#error "NVM_JOURNAL_RECORD_SIZE must be a multiple of 8, at least 16"
+#endif
+
+#ifndef NVM_JOURNAL_SPAN
+/* Bytes at the end of the partition covered by the journal: key + nonce,
+ * then magic, state and sector flags (twice with FLAGS_HOME) */
+#define NVM_JOURNAL_SPAN (((WOLFBOOT_PARTITION_SIZE - \
+    ENCRYPT_TMP_SECRET_OFFSET) + 2 * (8 + WOLFBOOT_PARTITION_SIZE / \
+    (2 * WOLFBOOT_SECTOR_SIZE)) + 3) & ~3)
+#endif
+
+#ifdef FLAGS_HOME
+#define NVM_JOURNAL_REGIONS 1
+#else
+#define NVM_JOURNAL_REGIONS 2
+#endif
+
+#define NVM_JOURNAL_PAYLOAD (NVM_JOURNAL_RECORD_SIZE - 8)
+#define NVM_JOURNAL_SLOTS (WOLFBOOT_SECTOR_SIZE / NVM_JOURNAL_RECORD_SIZE)
+#define NVM_JOURNAL_MORE   0x8000 /* 'off' flag: record group continues */
+#define NVM_JOURNAL_COMMIT 0x7FFF /* 'off' of the snapshot commit record */
+
+struct nvm_journal_rec {
+    uint32_t seq;   /* never FLASH_WORD_ERASED */
+    uint16_t off;   /* offset in the trailer image, | NVM_JOURNAL_MORE */
+    uint8_t len;    /* payload bytes in use */
+    uint8_t chk;    /* inverted sum of all other bytes */
+    uint8_t data[NVM_JOURNAL_PAYLOAD];
+};
+
+struct nvm_journal {
+    uint8_t img[NVM_JOURNAL_SPAN];
+    uint32_t seq;        /* sequence number of the next record */
+    uint32_t commit_seq; /* sequence number of the head commit record */
+    uint16_t head;       /* sector holding the current snapshot */
+    uint16_t commit;     /* slot of the head commit record */
+    uint16_t slot;       /* next free slot in 'head' */
+    uint8_t mounted;
+    uint8_t has_head;
+    uint8_t open;        /* 'head' ends with an unterminated record group */
+};
+
+static struct nvm_journal nvm_journal[NVM_JOURNAL_REGIONS] XALIGNED(16);
+
+#ifdef __CCRX__
+#pragma section FRAM
+#endif
+static int RAMFUNCTION nvm_journal_region(int part)
+{
+#ifdef FLAGS_HOME
+    (void)part;
+    return 0;
+#else
+    return (part == PART_BOOT) ? 0 : 1;
+#endif
+}
+
+static uintptr_t RAMFUNCTION nvm_journal_end(int part)
+{
+#ifndef FLAGS_HOME
+    if (part != PART_BOOT)
+        return WOLFBOOT_PARTITION_UPDATE_ADDRESS + WOLFBOOT_PARTITION_SIZE;
+#endif
+    (void)part;
+    return WOLFBOOT_PARTITION_BOOT_ADDRESS + WOLFBOOT_PARTITION_SIZE;
+}
+
+static struct nvm_journal_rec* RAMFUNCTION nvm_journal_slot(int part,
+    int sector, int slot)
+{
+    uintptr_t last = ((nvm_journal_end(part) - 1) / WOLFBOOT_SECTOR_SIZE) *
+        WOLFBOOT_SECTOR_SIZE;
+    return (struct nvm_journal_rec *)(last - sector * WOLFBOOT_SECTOR_SIZE +
+        slot * NVM_JOURNAL_RECORD_SIZE);
+}
+
+static uint8_t RAMFUNCTION nvm_journal_chk(const struct nvm_journal_rec *rec)
+{
+    const uint8_t *p = (const uint8_t *)rec;
+    uint8_t sum = 0;
+    unsigned int i;
+    for (i = 0; i < sizeof(*rec); i++) {
+        if (i != offsetof(struct nvm_journal_rec, chk))
+            sum += p[i];
+    }
+    return (uint8_t)~sum;
+}
+
+static int RAMFUNCTION nvm_journal_rec_erased(const struct nvm_journal_rec *rec)
+{
+    const uint8_t *p = (const uint8_t *)rec;
+    unsigned int i;
+    for (i = 0; i < sizeof(*rec); i++) {
+        if (p[i] != FLASH_BYTE_ERASED)
+            return 0;
+    }
+    return 1;
+}
+
+static int RAMFUNCTION nvm_journal_rec_valid(const struct nvm_journal_rec *rec)
+{
+    uint16_t off = rec->off & ~NVM_JOURNAL_MORE;
+    if ((rec->seq == FLASH_WORD_ERASED) || (rec->chk != nvm_journal_chk(rec)))
+        return 0;
+    if (off == NVM_JOURNAL_COMMIT)
+        return (rec->len == 0);
+    return (rec->len <= NVM_JOURNAL_PAYLOAD) &&
+        ((uint32_t)off + rec->len <= NVM_JOURNAL_SPAN);
+}
+
+/* Rebuild the trailer image from the sector holding the most recent
+ * committed snapshot. Record groups are applied only once their last
+ * record is in flash, so an interrupted update is dropped as a whole.
+ * A group left open at the end of the sector is closed by the next write,
+ * which compacts the image instead of appending to it. */
+static void RAMFUNCTION nvm_journal_mount(int part)
+{
+    struct nvm_journal *j = &nvm_journal[nvm_journal_region(part)];
+    struct nvm_journal_rec *rec;
+    uint32_t max_seq = 0;
+    int sector, slot, first, i;
+
+    hal_cache_invalidate();
+    j->has_head = 0;
+    j->open = 0;
+    j->slot = 0;
+    for (sector = 0; sector < NVM_JOURNAL_SECTORS; sector++) {
+        for (slot = 0; slot < NVM_JOURNAL_SLOTS; slot++) {
+            rec = nvm_journal_slot(part, sector, slot);
+            if (nvm_journal_rec_erased(rec))
+                break;
+            if (!nvm_journal_rec_valid(rec))
+                continue;
+            if (rec->seq > max_seq)
+                max_seq = rec->seq;
+            if ((rec->off == NVM_JOURNAL_COMMIT) &&
+                    (!j->has_head || (rec->seq > j->commit_seq))) {
+                j->has_head = 1;
+                j->head = sector;
+                j->commit = slot;
+                j->commit_seq = rec->seq;
+            }
+        }
+    }
+    j->seq = max_seq + 1;
+    if (j->seq == FLASH_WORD_ERASED)
+        j->seq++;
+
+    XMEMSET(j->img, FLASH_BYTE_ERASED, NVM_JOURNAL_SPAN);
+    if (j->has_head) {
+        first = 0;
+        for (slot = 0; slot < NVM_JOURNAL_SLOTS; slot++) {
+            rec = nvm_journal_slot(part, j->head, slot);
+            if (nvm_journal_rec_erased(rec))
+                break;
+            j->slot = slot + 1;
+            if (!nvm_journal_rec_valid(rec)) {
+                first = slot + 1; /* torn record: drop its group */
+                continue;
+            }
+            if (rec->off & NVM_JOURNAL_MORE)
+                continue;
+            for (i = first; i <= slot; i++) {
+                struct nvm_journal_rec *r = nvm_journal_slot(part, j->head, i);
+                uint16_t off = r->off & ~NVM_JOURNAL_MORE;
+                if (nvm_journal_rec_valid(r) && (off != NVM_JOURNAL_COMMIT))
+                    XMEMCPY(j->img + off, r->data, r->len);
+            }
+            first = slot + 1;
+        }
+        j->open = (first < j->slot);
+    }
+    j->mounted = 1;
+}
+
+/* Return the RAM image of the trailer, mounting the journal on first use or
+ * after the trailer sectors were erased underneath it. */
+static struct nvm_journal* RAMFUNCTION nvm_journal_get(int part)
+{
+    struct nvm_journal *j = &nvm_journal[nvm_journal_region(part)];
+    if (j->mounted && j->has_head) {
+        struct nvm_journal_rec *rec = nvm_journal_slot(part, j->head,
+            j->commit);
+        if ((rec->seq != j->commit_seq) || (rec->off != NVM_JOURNAL_COMMIT))
+            j->mounted = 0;
+    }
+    if (!j->mounted)
+        nvm_journal_mount(part);
+    return j;
+}
+
+static int RAMFUNCTION nvm_journal_put(int part, struct nvm_journal *j,
+    int sector, uint16_t off, const uint8_t *data, uint8_t len)
+{
+    struct nvm_journal_rec rec XALIGNED_STACK(8);
+    int ret;
+
+    XMEMSET(&rec, FLASH_BYTE_ERASED, sizeof(rec));
+    rec.seq = j->seq;
+    rec.off = off;
+    rec.len = len;
+    if (len > 0)
+        XMEMCPY(rec.data, data, len);
+    rec.chk = nvm_journal_chk(&rec);
+    ret = hal_flash_write((uintptr_t)nvm_journal_slot(part, sector, j->slot),
+        (void *)&rec, sizeof(rec));
+    if (ret == 0) {
+        j->seq++;
+        if (j->seq == FLASH_WORD_ERASED)
+            j->seq++;
+        j->slot++;
+    }
+    return ret;
+}
+
+/* Write the whole image to the next sector of the ring, followed by a
+ * commit record. The previous snapshot stays valid until the commit lands. */
+static int RAMFUNCTION nvm_journal_compact(int part, struct nvm_journal *j)
+{
+    int sector = j->has_head ? ((j->head + 1) % NVM_JOURNAL_SECTORS) : 0;
+    uint8_t *p = (uint8_t *)nvm_journal_slot(part, sector, 0);
+    uint32_t off;
+    uint8_t len;
+    int i, ret;
+
+    for (i = 0; i < WOLFBOOT_SECTOR_SIZE; i++) {
+        if (p[i] != FLASH_BYTE_ERASED) {
+            ret = hal_flash_erase((uintptr_t)p, WOLFBOOT_SECTOR_SIZE);
+            if (ret != 0)
+                return ret;
+            break;
+        }
+    }
+    j->slot = 0;
+    for (off = 0; off < NVM_JOURNAL_SPAN; off += len) {
+        len = NVM_JOURNAL_PAYLOAD;
+        if (off + len > NVM_JOURNAL_SPAN)
+            len = NVM_JOURNAL_SPAN - off;
+        for (i = 0; i < len; i++) {
+            if (j->img[off + i] != FLASH_BYTE_ERASED)
+                break;
+        }
+        if (i == len)
+            continue;
+        if (j->slot >= NVM_JOURNAL_SLOTS - 1)
+            return -1;
+        ret = nvm_journal_put(part, j, sector, off | NVM_JOURNAL_MORE,
+            j->img + off, len);
+        if (ret != 0)
+            return ret;
+    }
+    j->commit_seq = j->seq;
+    j->commit = j->slot;
+    ret = nvm_journal_put(part, j, sector, NVM_JOURNAL_COMMIT, NULL, 0);
+    if (ret != 0)
+        return ret;
+    j->head = sector;
+    j->has_head = 1;
+    j->open = 0;
+    return 0;
+}
+
+/**
+ * @brief Return the current copy of a trailer byte.
+ *
+ * @param[in] part Partition number.
+ * @param[in] addr Address of the byte in the trailer.
+ * @return Pointer into the RAM image of the trailer, NULL if out of range.
+ */
+static uint8_t* RAMFUNCTION nvm_journal_ptr(int part, uintptr_t addr)
+{
+    struct nvm_journal *j = nvm_journal_get(part);
+    uintptr_t start = nvm_journal_end(part) - NVM_JOURNAL_SPAN;
+    if ((addr < start) || (addr >= start + NVM_JOURNAL_SPAN))
+        return NULL;
+    return j->img + (addr - start);
+}
+
+/**
+ * @brief Update trailer bytes by appending records to the journal.
+ *
+ * All records of one call are applied together on the next mount.
+ * Requires unlocked flash.
+ *
+ * @param[in] part Partition number.
+ * @param[in] addr Address of the first byte in the trailer.
+ * @param[in] data New contents.
+ * @param[in] len Number of bytes.
+ * @return 0 on success, -1 on failure.
+ */
+static int RAMFUNCTION nvm_journal_write(int part, uintptr_t addr,
+    const uint8_t *data, int len)
+{
+    struct nvm_journal *j = nvm_journal_get(part);
+    uintptr_t start = nvm_journal_end(part) - NVM_JOURNAL_SPAN;
+    uint32_t off = addr - start;
+    int nrec = (len + NVM_JOURNAL_PAYLOAD - 1) / NVM_JOURNAL_PAYLOAD;
+    int ret = 0;
+    int i;
+
+    if ((addr < start) || (len <= 0) || (off + len > NVM_JOURNAL_SPAN))
+        return -1;
+    if (XMEMCMP(j->img + off, data, len) == 0)
+        return 0;
+    XMEMCPY(j->img + off, data, len);
+
+    if (!j->has_head || j->open || (j->slot + nrec > NVM_JOURNAL_SLOTS)) {
+        /* sector full, or records of an interrupted group that the next
+         * mount would apply with ours: the snapshot already carries the
+         * new bytes */
+        ret = nvm_journal_compact(part, j);
+    }
+    else {
+        for (i = 0; (i < len) && (ret == 0); i += NVM_JOURNAL_PAYLOAD) {
+            uint8_t sz = NVM_JOURNAL_PAYLOAD;
+            uint16_t flag = NVM_JOURNAL_MORE;
+            if (i + sz >= len) {
+                sz = len - i;
+                flag = 0;
+            }
+            ret = nvm_journal_put(part, j, j->head, (off + i) | flag,
+                data + i, sz);
+        }
+    }
+    if (ret != 0)
+        j->mounted = 0; /* image no longer matches flash */
+    return ret;
+}
+
+static uint8_t* RAMFUNCTION nvm_trailer_addr(int part, uintptr_t addr)
+{
+    return nvm_journal_ptr(part, addr);
+}
+
+#define trailer_write(part, addr, val) \
+    nvm_journal_write(part, addr, &(val), 1)
+#define partition_magic_write(part, addr) \
+    nvm_journal_write(part, addr, (const uint8_t *)&wolfboot_magic_trail, \
+        sizeof(uint32_t))
+#ifdef __CCRX__
+#pragma section
+#endif
+
+#else /* !NVM_FLASH_JOURNAL */
+
 static uint8_t NVM_CACHE[NVM_CACHE_SIZE] XALIGNED(16);
 static int nvm_cached_sector = 0;
 static uint8_t get_base_offset(uint8_t *base, uintptr_t off)
@@ -215,10 +585,6 @@ static uint8_t get_base_offset(uint8_t *base, uintptr_t off)
     return *(uint8_t*)((uintptr_t)base - off); /* ignore array bounds error */
 }
 
-void WEAKFUNCTION hal_cache_invalidate(void)
-{
-    /* if cache flushing is required implement in hal */
-}
 #ifdef __CCRX__
 #pragma section FRAM
 #endif
@@ -382,9 +748,17 @@ static int RAMFUNCTION partition_magic_write(uint8_t part, uintptr_t addr)
     ret = hal_flash_erase(addr_read, WOLFBOOT_SECTOR_SIZE);
     return ret;
 }
+
+/* Current copy of the trailer byte at 'addr' */
+static uint8_t* RAMFUNCTION nvm_trailer_addr(int part, uintptr_t addr)
+{
+    return (uint8_t *)(addr - WOLFBOOT_SECTOR_SIZE *
+        nvm_select_fresh_sector(part));
+}
 #ifdef __CCRX__
 #pragma section
 #endif
+#endif /* NVM_FLASH_JOURNAL */
 #else
 #   define trailer_write(part,addr, val) hal_flash_write(addr, (void *)&val, 1)
 #   define partition_magic_write(part,addr) hal_flash_write(addr, \
@@ -443,7 +817,6 @@ static void RAMFUNCTION set_partition_magic(uint8_t part)
 static uint8_t* RAMFUNCTION get_trailer_at(uint8_t part, uint32_t at)
 {
     uint8_t *ret = NULL;
-    uint32_t sel_sec = 0;
 
     if (part == PART_BOOT) {
     #ifdef EXT_FLASH
@@ -457,10 +830,11 @@ static uint8_t* RAMFUNCTION get_trailer_at(uint8_t part, uint32_t at)
         {
             /* only internal flash should be writeonce */
         #ifdef NVM_FLASH_WRITEONCE
-            sel_sec = nvm_select_fresh_sector(part);
+            ret = nvm_trailer_addr(part,
+                    PART_BOOT_ENDFLAGS - (sizeof(uint32_t) + at));
+        #else
+            ret = (void *)(PART_BOOT_ENDFLAGS - (sizeof(uint32_t) + at));
         #endif
-            ret = (void *)(PART_BOOT_ENDFLAGS -
-                    (WOLFBOOT_SECTOR_SIZE * sel_sec + (sizeof(uint32_t) + at)));
         }
     }
     else if (part == PART_UPDATE) {
@@ -475,10 +849,11 @@ static uint8_t* RAMFUNCTION get_trailer_at(uint8_t part, uint32_t at)
         {
             /* only internal flash should be writeonce */
         #ifdef NVM_FLASH_WRITEONCE
-            sel_sec = nvm_select_fresh_sector(part);
+            ret = nvm_trailer_addr(part,
+                    PART_UPDATE_ENDFLAGS - (sizeof(uint32_t) + at));
+        #else
+            ret = (void *)(PART_UPDATE_ENDFLAGS - (sizeof(uint32_t) + at));
         #endif
-            ret = (void *)(PART_UPDATE_ENDFLAGS -
-                    (WOLFBOOT_SECTOR_SIZE * sel_sec + (sizeof(uint32_t) + at)));
         }
     }
     return ret;
@@ -786,7 +1161,7 @@ void RAMFUNCTION wolfBoot_update_trigger(void)
 {
     uint8_t st = IMG_STATE_UPDATING;
     uintptr_t lastSector = ((PART_UPDATE_ENDFLAGS - 1) / WOLFBOOT_SECTOR_SIZE) * WOLFBOOT_SECTOR_SIZE;
-#ifdef NVM_FLASH_WRITEONCE
+#if defined(NVM_FLASH_WRITEONCE) && !defined(NVM_FLASH_JOURNAL)
     uint8_t selSec = 0;
 #endif
 
@@ -808,6 +1183,14 @@ void RAMFUNCTION wolfBoot_update_trigger(void)
 #ifndef NVM_FLASH_WRITEONCE
         hal_flash_erase(lastSector, WOLFBOOT_SECTOR_SIZE);
         wolfBoot_set_partition_state(PART_UPDATE, st);
+#elif defined(NVM_FLASH_JOURNAL)
+        /* state and magic in a single journal update */
+        uint8_t trailer[1 + sizeof(uint32_t)];
+        (void)lastSector;
+        trailer[0] = st;
+        XMEMCPY(trailer + 1, &wolfboot_magic_trail, sizeof(uint32_t));
+        nvm_journal_write(PART_UPDATE, PART_UPDATE_ENDFLAGS - sizeof(trailer),
+            trailer, sizeof(trailer));
 #else
         uint32_t magic = WOLFBOOT_MAGIC_TRAIL;
         uint32_t offset = SECTOR_FLAGS_SIZE;
@@ -1449,10 +1832,10 @@ int wolfBoot_fallback_is_possible(void)
 #endif
 
 #ifndef WOLFBOOT_ENCRYPT_CACHE
-    #ifdef NVM_FLASH_WRITEONCE
+    #if defined(NVM_FLASH_WRITEONCE) && !defined(NVM_FLASH_JOURNAL)
         #define ENCRYPT_CACHE NVM_CACHE
     #else
-        #ifdef WOLFBOOT_SMALL_STACK
+        #if defined(WOLFBOOT_SMALL_STACK) || defined(NVM_FLASH_JOURNAL)
         static uint8_t ENCRYPT_CACHE[NVM_CACHE_SIZE] XALIGNED(32);
         #endif
     #endif
@@ -1516,6 +1899,27 @@ static int RAMFUNCTION hal_set_key(const uint8_t *k, const uint8_t *nonce)
     XMEMCPY(ENCRYPT_KEY, k, ENCRYPT_KEY_SIZE);
     XMEMCPY(ENCRYPT_KEY + ENCRYPT_KEY_SIZE, nonce, ENCRYPT_NONCE_SIZE);
     return 0;
+#elif defined(NVM_FLASH_JOURNAL)
+    /* magic + key + nonce, appended as one journal update */
+    uint8_t buf[sizeof(uint32_t) + ENCRYPT_KEY_SIZE + ENCRYPT_NONCE_SIZE];
+    uintptr_t addr = ENCRYPT_TMP_SECRET_OFFSET +
+        WOLFBOOT_PARTITION_BOOT_ADDRESS - sizeof(uint32_t);
+    int ret;
+
+    XMEMCPY(buf, &wolfboot_magic_trail, sizeof(uint32_t));
+    XMEMCPY(buf + sizeof(uint32_t), k, ENCRYPT_KEY_SIZE);
+    XMEMCPY(buf + sizeof(uint32_t) + ENCRYPT_KEY_SIZE, nonce,
+        ENCRYPT_NONCE_SIZE);
+    hal_flash_unlock();
+    ret = nvm_journal_write(PART_BOOT, addr, buf, sizeof(buf));
+#ifdef FLAGS_HOME
+    if (ret == 0) {
+        ret = partition_magic_write(PART_BOOT, addr -
+            (PART_BOOT_ENDFLAGS - PART_UPDATE_ENDFLAGS));
+    }
+#endif
+    hal_flash_lock();
+    return ret;
 #else
     uintptr_t addr, addr_align, addr_off;
     int ret = 0;
@@ -1632,9 +2036,7 @@ int RAMFUNCTION wolfBoot_get_encrypt_key(uint8_t *k, uint8_t *nonce)
     uint8_t *mem = (uint8_t *)(ENCRYPT_TMP_SECRET_OFFSET +
         WOLFBOOT_PARTITION_BOOT_ADDRESS);
     #ifdef NVM_FLASH_WRITEONCE
-    int sel_sec = 0;
-    sel_sec = nvm_select_fresh_sector(PART_BOOT);
-    mem -= (sel_sec * WOLFBOOT_SECTOR_SIZE);
+    mem = nvm_trailer_addr(PART_BOOT, (uintptr_t)mem);
     #endif
     XMEMCPY(k, mem, ENCRYPT_KEY_SIZE);
     XMEMCPY(nonce, mem + ENCRYPT_KEY_SIZE, ENCRYPT_NONCE_SIZE);
@@ -1663,8 +2065,7 @@ int RAMFUNCTION wolfBoot_erase_encrypt_key(void)
     uint8_t *mem = (uint8_t *)ENCRYPT_TMP_SECRET_OFFSET +
         WOLFBOOT_PARTITION_BOOT_ADDRESS;
 #ifdef NVM_FLASH_WRITEONCE
-    int sel_sec = nvm_select_fresh_sector(PART_BOOT);
-    mem -= (sel_sec * WOLFBOOT_SECTOR_SIZE);
+    mem = nvm_trailer_addr(PART_BOOT, (uintptr_t)mem);
 #endif
     XMEMSET(ff, FLASH_BYTE_ERASED, ENCRYPT_KEY_SIZE + ENCRYPT_NONCE_SIZE);
     if (XMEMCMP(mem, ff, ENCRYPT_KEY_SIZE + ENCRYPT_NONCE_SIZE) != 0)
@@ -1704,7 +2105,7 @@ int RAMFUNCTION chacha_init(void)
             ENCRYPT_TMP_SECRET_OFFSET);
     #endif
     #ifdef NVM_FLASH_WRITEONCE
-        key -= WOLFBOOT_SECTOR_SIZE * nvm_select_fresh_sector(PART_BOOT);
+        key = nvm_trailer_addr(PART_BOOT, (uintptr_t)key);
     #endif
     stored_nonce = key + ENCRYPT_KEY_SIZE;
 #endif
@@ -1769,7 +2170,7 @@ int aes_init(void)
             ENCRYPT_TMP_SECRET_OFFSET);
     #endif
     #ifdef NVM_FLASH_WRITEONCE
-        key -= WOLFBOOT_SECTOR_SIZE * nvm_select_fresh_sector(PART_BOOT);
+        key = nvm_trailer_addr(PART_BOOT, (uintptr_t)key);
     #endif
         stored_nonce = key + ENCRYPT_KEY_SIZE;
 #endif /* non TSIP */
@@ -1899,7 +2300,7 @@ int pkcs11_crypto_init(void)
 #endif
 
 #ifdef NVM_FLASH_WRITEONCE
-        key_id -= WOLFBOOT_SECTOR_SIZE * nvm_select_fresh_sector(PART_BOOT);
+        key_id = nvm_trailer_addr(PART_BOOT, (uintptr_t)key_id);
 #endif
         stored_nonce = key_id + ENCRYPT_KEY_SIZE;
 
@@ -2154,7 +2555,7 @@ int RAMFUNCTION ext_flash_encrypt_write(uintptr_t address, const uint8_t *data,
     uint8_t block[ENCRYPT_BLOCK_SIZE];
     uint8_t enc_block[ENCRYPT_BLOCK_SIZE];
     uint32_t row_address = address, row_offset;
-    int sz = len, i, step;
+    int sz = len, step;
     uint8_t part;
     uint32_t iv_counter = 0;
 #if defined(EXT_ENCRYPTED) && !defined(WOLFBOOT_SMALL_STACK) && \
@@ -2206,12 +2607,12 @@ int RAMFUNCTION ext_flash_encrypt_write(uintptr_t address, const uint8_t *data,
         sz = len - step;
     }
 
-    /* encrypt remainder */
+    /* encrypt remainder: the cipher is a stream (CTR), so all the aligned
+     * blocks are processed in one call */
     step = sz & ~(ENCRYPT_BLOCK_SIZE - 1);
-    for (i = 0; i < step / ENCRYPT_BLOCK_SIZE; i++) {
-        XMEMCPY(block, data + (ENCRYPT_BLOCK_SIZE * i), ENCRYPT_BLOCK_SIZE);
-        crypto_encrypt(ENCRYPT_CACHE + (ENCRYPT_BLOCK_SIZE * i), block,
-            ENCRYPT_BLOCK_SIZE);
+    if (step > 0) {
+        if (crypto_encrypt(ENCRYPT_CACHE, (uint8_t *)data, step) != 0)
+            return -1;
     }
 
     return ext_flash_write(address, ENCRYPT_CACHE, step);
@@ -2236,7 +2637,6 @@ int RAMFUNCTION ext_flash_decrypt_read(uintptr_t address, uint8_t *data, int len
     uint8_t  block[ENCRYPT_BLOCK_SIZE] XALIGNED_STACK(4);
     uint8_t  dec_block[ENCRYPT_BLOCK_SIZE] XALIGNED_STACK(4);
     uint32_t row_address = address, row_offset, iv_counter = 0;
-    int i;
     int flash_read_size;
     int read_remaining = len;
     int unaligned_head_size, unaligned_trailer_size;
@@ -2298,12 +2698,11 @@ int RAMFUNCTION ext_flash_decrypt_read(uintptr_t address, uint8_t *data, int len
     flash_read_size = read_remaining & ~(ENCRYPT_BLOCK_SIZE - 1);
     if (ext_flash_read(address, data, flash_read_size) != flash_read_size)
         return -1;
-    for (i = 0; i < flash_read_size / ENCRYPT_BLOCK_SIZE; i++)
-    {
-        XMEMCPY(block, data + (ENCRYPT_BLOCK_SIZE * i), ENCRYPT_BLOCK_SIZE);
-        crypto_decrypt(data + (ENCRYPT_BLOCK_SIZE * i), block,
-                ENCRYPT_BLOCK_SIZE);
-        iv_counter++;
+    /* Decrypt all the aligned blocks in place, in one call */
+    if (flash_read_size > 0) {
+        if (crypto_decrypt(data, data, flash_read_size) != 0)
+            return -1;
+        iv_counter += flash_read_size / ENCRYPT_BLOCK_SIZE;
     }
 
     address += flash_read_size;
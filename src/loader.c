@@ -123,7 +123,10 @@ int main(void)
     uart_init(UART_FLASH_BITRATE, 8, 'N', 1);
     uart_send_current_version();
 #endif
-#ifdef WOLFBOOT_TPM
+#if defined(WOLFBOOT_TPM) && defined(WOLFBOOT_TPM_INIT_ASYNC)
+    /* completed while the boot image is hashed, see get_hash_chunk() */
+    wolfBoot_tpm2_init_start();
+#elif defined(WOLFBOOT_TPM)
     wolfBoot_tpm2_init();
 #endif
 #ifdef WOLFCRYPT_SECURE_MODE
@@ -0,0 +1,533 @@
+/* lz4.c
+ *
+ * LZ4 frame decoder for compressed firmware payloads, and the matching
+ * encoder used by the host tools.
+ *
+ *
+ * Copyright (C) 2025 wolfSSL Inc.
+ *
+ * This file is part of wolfBoot.
+ *
+ * wolfBoot is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfBoot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335, USA
+ */
+#if defined(WOLFBOOT_LZ4) || !defined(__WOLFBOOT)
+
+#include <stdint.h>
+#include <string.h>
+#include "lz4.h"
+
+/* Decoder states */
+#define LZ4_ST_FRAME_HDR    0
+#define LZ4_ST_BLOCK_SIZE   1
+#define LZ4_ST_SKIP         2
+#define LZ4_ST_RAW          3
+#define LZ4_ST_DONE         4
+/* States inside a compressed block: 'left' counts the input bytes */
+#define LZ4_ST_TOKEN        5
+#define LZ4_ST_LIT_LEN      6
+#define LZ4_ST_LITERALS     7
+#define LZ4_ST_OFF_LO       8
+#define LZ4_ST_OFF_HI       9
+#define LZ4_ST_MATCH_LEN    10
+#define LZ4_ST_ERROR        0xFF
+
+static uint32_t lz4_read32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+        ((uint32_t)p[3] << 24);
+}
+
+void lz4_stream_init(struct lz4_stream *s, uint8_t *dst, uint32_t dst_size)
+{
+    memset(s, 0, sizeof(*s));
+    s->dst = dst;
+    s->dst_size = dst_size;
+    s->hdr_need = 6; /* magic, FLG, BD */
+    s->state = LZ4_ST_FRAME_HDR;
+}
+
+/* Parse the frame header collected so far. Returns 1 when it is complete. */
+static int lz4_frame_hdr(struct lz4_stream *s)
+{
+    int i;
+
+    if (s->hdr_len == 6) {
+        s->flg = s->hdr[4];
+        if ((lz4_read32(s->hdr) != LZ4_FRAME_MAGIC) ||
+            ((s->flg & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION) ||
+            ((s->flg & LZ4_FLG_DICT_ID) != 0)) {
+            return -1;
+        }
+        s->hdr_need = 7;
+        if (s->flg & LZ4_FLG_CONTENT_SIZE)
+            s->hdr_need += 8;
+        return 0;
+    }
+    if (s->hdr_len < s->hdr_need)
+        return 0;
+    if (s->flg & LZ4_FLG_CONTENT_SIZE) {
+        for (i = 7; i >= 0; i--)
+            s->content_size = (s->content_size << 8) | s->hdr[6 + i];
+        if (s->content_size > s->dst_size)
+            return -1;
+    }
+    return 1;
+}
+
+static void lz4_block_end(struct lz4_stream *s)
+{
+    s->hdr_len = 0;
+    if (s->flg & LZ4_FLG_BLOCK_CHECKSUM) {
+        s->left = 4;
+        s->next = LZ4_ST_BLOCK_SIZE;
+        s->state = LZ4_ST_SKIP;
+    } else {
+        s->state = LZ4_ST_BLOCK_SIZE;
+    }
+}
+
+/* Copy a match from the output already produced */
+static int lz4_match(struct lz4_stream *s)
+{
+    uint8_t *d;
+    const uint8_t *m;
+    uint32_t i;
+
+    if (s->len > s->dst_size - s->out)
+        return -1;
+    d = s->dst + s->out;
+    m = d - s->offset;
+    if (s->offset >= s->len) {
+        memcpy(d, m, s->len);
+    } else {
+        /* Overlapping: repeats the last 'offset' bytes */
+        for (i = 0; i < s->len; i++)
+            d[i] = m[i];
+    }
+    s->out += s->len;
+    s->state = LZ4_ST_TOKEN;
+    return 0;
+}
+
+/**
+ * @brief Decompress the next part of an LZ4 frame.
+ *
+ * @param s The stream, set up by lz4_stream_init().
+ * @param in The next bytes of the compressed stream.
+ * @param len The number of bytes at in.
+ * @return 0 on success, -1 if the stream is invalid or does not fit in the
+ * output buffer.
+ */
+int lz4_stream_update(struct lz4_stream *s, const uint8_t *in, uint32_t len)
+{
+    uint32_t n;
+    uint8_t b;
+    int ret;
+
+    while (len > 0) {
+        if (s->state == LZ4_ST_ERROR)
+            return -1;
+        if ((s->state >= LZ4_ST_TOKEN) && (s->left == 0)) {
+            /* A block may only end between two sequences */
+            if (s->state != LZ4_ST_TOKEN)
+                goto error;
+            lz4_block_end(s);
+            continue;
+        }
+        if ((s->state == LZ4_ST_RAW) || (s->state == LZ4_ST_LITERALS)) {
+            n = (s->state == LZ4_ST_RAW) ? s->left : s->len;
+            if (n > s->left)
+                goto error;
+            if (n > len)
+                n = len;
+            if (n > s->dst_size - s->out)
+                goto error;
+            memcpy(s->dst + s->out, in, n);
+            s->out += n;
+            s->left -= n;
+            in += n;
+            len -= n;
+            if (s->state == LZ4_ST_RAW) {
+                if (s->left == 0)
+                    lz4_block_end(s);
+            } else {
+                s->len -= n;
+                if (s->len == 0) {
+                    if (s->left == 0)
+                        lz4_block_end(s); /* last sequence of the block */
+                    else
+                        s->state = LZ4_ST_OFF_LO;
+                }
+            }
+            continue;
+        }
+        b = *in++;
+        len--;
+        if (s->state >= LZ4_ST_TOKEN)
+            s->left--;
+        switch (s->state) {
+            case LZ4_ST_FRAME_HDR:
+                s->hdr[s->hdr_len++] = b;
+                ret = lz4_frame_hdr(s);
+                if (ret < 0)
+                    goto error;
+                if (ret > 0) {
+                    s->hdr_len = 0;
+                    s->state = LZ4_ST_BLOCK_SIZE;
+                }
+                break;
+            case LZ4_ST_BLOCK_SIZE:
+                s->hdr[s->hdr_len++] = b;
+                if (s->hdr_len < 4)
+                    break;
+                s->left = lz4_read32(s->hdr);
+                if (s->left == 0) {
+                    /* End mark */
+                    s->next = LZ4_ST_DONE;
+                    s->state = LZ4_ST_DONE;
+                    if (s->flg & LZ4_FLG_CONTENT_CHECKSUM) {
+                        s->left = 4;
+                        s->state = LZ4_ST_SKIP;
+                    }
+                } else if (s->left & LZ4_BLOCK_STORED) {
+                    s->left &= ~LZ4_BLOCK_STORED;
+                    s->state = LZ4_ST_RAW;
+                } else {
+                    s->state = LZ4_ST_TOKEN;
+                }
+                break;
+            case LZ4_ST_SKIP:
+                if (--s->left == 0)
+                    s->state = s->next;
+                break;
+            case LZ4_ST_TOKEN:
+                s->token = b;
+                s->len = b >> 4;
+                if (s->len == 15)
+                    s->state = LZ4_ST_LIT_LEN;
+                else if (s->len > 0)
+                    s->state = LZ4_ST_LITERALS;
+                else
+                    s->state = LZ4_ST_OFF_LO;
+                break;
+            case LZ4_ST_LIT_LEN:
+                s->len += b;
+                if (b != 255)
+                    s->state = LZ4_ST_LITERALS;
+                break;
+            case LZ4_ST_OFF_LO:
+                s->offset = b;
+                s->state = LZ4_ST_OFF_HI;
+                break;
+            case LZ4_ST_OFF_HI:
+                s->offset |= (uint32_t)b << 8;
+                if ((s->offset == 0) || (s->offset > s->out))
+                    goto error;
+                s->len = (s->token & 0x0F) + LZ4_MIN_MATCH;
+                if ((s->token & 0x0F) == 0x0F)
+                    s->state = LZ4_ST_MATCH_LEN;
+                else if (lz4_match(s) != 0)
+                    goto error;
+                break;
+            case LZ4_ST_MATCH_LEN:
+                s->len += b;
+                if ((b != 255) && (lz4_match(s) != 0))
+                    goto error;
+                break;
+            default:
+                /* Data after the end of the frame */
+                goto error;
+        }
+    }
+    return 0;
+error:
+    s->state = LZ4_ST_ERROR;
+    return -1;
+}
+
+/**
+ * @brief Check that the whole frame was decompressed.
+ *
+ * @param s The stream.
+ * @return The size of the decompressed payload, or -1 if the frame is
+ * incomplete or invalid.
+ */
+int lz4_stream_final(struct lz4_stream *s)
+{
+    if (s->state != LZ4_ST_DONE)
+        return -1;
+    if ((s->flg & LZ4_FLG_CONTENT_SIZE) && (s->content_size != s->out))
+        return -1;
+    return (int)s->out;
+}
+
+int lz4_decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst,
+        uint32_t dst_size)
+{
+    struct lz4_stream s;
+
+    lz4_stream_init(&s, dst, dst_size);
+    if (lz4_stream_update(&s, src, src_len) != 0)
+        return -1;
+    return lz4_stream_final(&s);
+}
+
+#ifndef __WOLFBOOT
+#include <stdlib.h>
+
+#define LZ4_BLOCK_MAX       (4 * 1024 * 1024) /* BD = 7 */
+#define LZ4_BD_4MB          0x70
+#define LZ4_MAX_OFFSET      65535
+#define LZ4_LAST_LITERALS   5   /* The block always ends with literals */
+#define LZ4_MFLIMIT         12  /* No match starts in the last bytes */
+#define LZ4_HASH_BITS       16
+#define LZ4_CHAIN_SIZE      65536
+#define LZ4_CHAIN_DEPTH     256
+
+#define XXH_PRIME32_1 2654435761U
+#define XXH_PRIME32_2 2246822519U
+#define XXH_PRIME32_3 3266489917U
+#define XXH_PRIME32_4  668265263U
+#define XXH_PRIME32_5  374761393U
+
+static uint32_t xxh_rotl(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+static uint32_t xxh_round(uint32_t acc, uint32_t in)
+{
+    acc += in * XXH_PRIME32_2;
+    return xxh_rotl(acc, 13) * XXH_PRIME32_1;
+}
+
+/* xxHash32, for the header checksum of the frame */
+static uint32_t lz4_xxh32(const uint8_t *p, uint32_t len, uint32_t seed)
+{
+    const uint8_t *end = p + len;
+    uint32_t h;
+
+    if (len >= 16) {
+        uint32_t v1 = seed + XXH_PRIME32_1 + XXH_PRIME32_2;
+        uint32_t v2 = seed + XXH_PRIME32_2;
+        uint32_t v3 = seed;
+        uint32_t v4 = seed - XXH_PRIME32_1;
+        while (end - p >= 16) {
+            v1 = xxh_round(v1, lz4_read32(p));
+            v2 = xxh_round(v2, lz4_read32(p + 4));
+            v3 = xxh_round(v3, lz4_read32(p + 8));
+            v4 = xxh_round(v4, lz4_read32(p + 12));
+            p += 16;
+        }
+        h = xxh_rotl(v1, 1) + xxh_rotl(v2, 7) + xxh_rotl(v3, 12) +
+            xxh_rotl(v4, 18);
+    } else {
+        h = seed + XXH_PRIME32_5;
+    }
+    h += len;
+    while (end - p >= 4) {
+        h += lz4_read32(p) * XXH_PRIME32_3;
+        h = xxh_rotl(h, 17) * XXH_PRIME32_4;
+        p += 4;
+    }
+    while (p < end) {
+        h += (*p++) * XXH_PRIME32_5;
+        h = xxh_rotl(h, 11) * XXH_PRIME32_1;
+    }
+    h ^= h >> 15;
+    h *= XXH_PRIME32_2;
+    h ^= h >> 13;
+    h *= XXH_PRIME32_3;
+    h ^= h >> 16;
+    return h;
+}
+
+static void lz4_write32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t lz4_hash(const uint8_t *p)
+{
+    return (lz4_read32(p) * XXH_PRIME32_1) >> (32 - LZ4_HASH_BITS);
+}
+
+static uint32_t lz4_put_len(uint8_t *dst, uint32_t len)
+{
+    uint32_t o = 0;
+    while (len >= 255) {
+        dst[o++] = 255;
+        len -= 255;
+    }
+    dst[o++] = (uint8_t)len;
+    return o;
+}
+
+/* Append a sequence. Without a match (last literals), ml is 0. */
+static int lz4_put_seq(uint8_t *dst, uint32_t *o, uint32_t cap,
+        const uint8_t *lit, uint32_t lit_len, uint32_t off, uint32_t ml)
+{
+    uint32_t p = *o;
+    uint8_t *token;
+
+    if (p + 1 + lit_len + lit_len / 255 + 1 + 2 + ml / 255 + 1 > cap)
+        return -1;
+    token = dst + p++;
+    *token = (uint8_t)(((lit_len < 15) ? lit_len : 15) << 4);
+    if (lit_len >= 15)
+        p += lz4_put_len(dst + p, lit_len - 15);
+    memcpy(dst + p, lit, lit_len);
+    p += lit_len;
+    if (ml > 0) {
+        ml -= LZ4_MIN_MATCH;
+        *token |= (uint8_t)((ml < 15) ? ml : 15);
+        dst[p++] = (uint8_t)off;
+        dst[p++] = (uint8_t)(off >> 8);
+        if (ml >= 15)
+            p += lz4_put_len(dst + p, ml - 15);
+    }
+    *o = p;
+    return 0;
+}
+
+/* Compress one independent block, using hash chains to find the longest
+ * match in the 64KB window. Returns the compressed size, or -1 if it does
+ * not fit in 'cap' bytes. */
+static int lz4_compress_block(const uint8_t *src, uint32_t len, uint8_t *dst,
+        uint32_t cap, int32_t *head, int32_t *chain)
+{
+    uint32_t ip = 0, anchor = 0, o = 0;
+    uint32_t limit = (len > LZ4_MFLIMIT) ? len - LZ4_MFLIMIT : 0;
+    uint32_t i;
+
+    for (i = 0; i < (1U << LZ4_HASH_BITS); i++)
+        head[i] = -1;
+
+    while (ip < limit) {
+        uint32_t h = lz4_hash(src + ip);
+        uint32_t max = len - LZ4_LAST_LITERALS - ip;
+        uint32_t best_len = 0, best_off = 0;
+        int32_t cand = head[h];
+        int depth = LZ4_CHAIN_DEPTH;
+
+        while ((cand >= 0) && (ip - (uint32_t)cand <= LZ4_MAX_OFFSET) &&
+                (depth-- > 0)) {
+            int32_t prev;
+            if (lz4_read32(src + cand) == lz4_read32(src + ip)) {
+                uint32_t l = LZ4_MIN_MATCH;
+                while ((l < max) && (src[cand + l] == src[ip + l]))
+                    l++;
+                if (l > best_len) {
+                    best_len = l;
+                    best_off = ip - (uint32_t)cand;
+                    if (l == max)
+                        break;
+                }
+            }
+            prev = chain[cand % LZ4_CHAIN_SIZE];
+            if (prev >= cand)
+                break;
+            cand = prev;
+        }
+        chain[ip % LZ4_CHAIN_SIZE] = head[h];
+        head[h] = (int32_t)ip;
+        if (best_len < LZ4_MIN_MATCH) {
+            ip++;
+            continue;
+        }
+        if (lz4_put_seq(dst, &o, cap, src + anchor, ip - anchor, best_off,
+                    best_len) != 0) {
+            return -1;
+        }
+        for (i = 1; i < best_len; i++) {
+            h = lz4_hash(src + ip + i);
+            chain[(ip + i) % LZ4_CHAIN_SIZE] = head[h];
+            head[h] = (int32_t)(ip + i);
+        }
+        ip += best_len;
+        anchor = ip;
+    }
+    if (lz4_put_seq(dst, &o, cap, src + anchor, len - anchor, 0, 0) != 0)
+        return -1;
+    return (int)o;
+}
+
+uint32_t lz4_compress_bound(uint32_t len)
+{
+    return len + 4 * (len / LZ4_BLOCK_MAX + 1) + LZ4_FRAME_HDR_MAX + 4;
+}
+
+/**
+ * @brief Compress a buffer into a single LZ4 frame.
+ *
+ * Blocks are independent and carry no checksum. The frame header records
+ * the content size, so the decoder can check the size of the output.
+ *
+ * @return The size of the frame, or -1 on error.
+ */
+int lz4_compress(const uint8_t *src, uint32_t len, uint8_t *dst,
+        uint32_t dst_size)
+{
+    int32_t *head, *chain;
+    uint32_t o = 0, off = 0;
+    int ret = -1;
+
+    if (dst_size < lz4_compress_bound(len))
+        return -1;
+    head = malloc(sizeof(int32_t) << LZ4_HASH_BITS);
+    chain = malloc(sizeof(int32_t) * LZ4_CHAIN_SIZE);
+    if ((head == NULL) || (chain == NULL))
+        goto out;
+
+    lz4_write32(dst, LZ4_FRAME_MAGIC);
+    dst[4] = LZ4_FLG_VERSION | LZ4_FLG_BLOCK_INDEP | LZ4_FLG_CONTENT_SIZE;
+    dst[5] = LZ4_BD_4MB;
+    lz4_write32(dst + 6, len);
+    lz4_write32(dst + 10, 0);
+    dst[14] = (uint8_t)(lz4_xxh32(dst + 4, 10, 0) >> 8);
+    o = 15;
+
+    while (off < len) {
+        uint32_t blk = len - off;
+        int c;
+        if (blk > LZ4_BLOCK_MAX)
+            blk = LZ4_BLOCK_MAX;
+        /* Store the block if compressing does not make it smaller */
+        c = lz4_compress_block(src + off, blk, dst + o + 4, blk - 1, head,
+                chain);
+        if (c > 0) {
+            lz4_write32(dst + o, (uint32_t)c);
+        } else {
+            lz4_write32(dst + o, blk | LZ4_BLOCK_STORED);
+            memcpy(dst + o + 4, src + off, blk);
+            c = (int)blk;
+        }
+        o += 4 + (uint32_t)c;
+        off += blk;
+    }
+    lz4_write32(dst + o, 0); /* End mark */
+    o += 4;
+    ret = (int)o;
+out:
+    free(head);
+    free(chain);
+    return ret;
+}
+#endif /* !__WOLFBOOT */
+
+#endif /* WOLFBOOT_LZ4 || !__WOLFBOOT */
@@ -112,6 +112,17 @@
     #define FLASH_READ_CMD FAST_READ_CMD
 #endif
 
+/* Read Alternate Bytes */
+#if QSPI_DATA_MODE == QSPI_DATA_MODE_QSPI
+    #define FLASH_READ_ALT      0xF0 /* enable continuous read */
+    #define FLASH_READ_ALT_SZ   1
+    #define FLASH_READ_ALT_MODE QSPI_ADDR_MODE
+#else
+    #define FLASH_READ_ALT      0x00
+    #define FLASH_READ_ALT_SZ   0
+    #define FLASH_READ_ALT_MODE QSPI_DATA_MODE_NONE
+#endif
+
 /* Write Command */
 #if QSPI_DATA_MODE == QSPI_DATA_MODE_QSPI
 #define FLASH_WRITE_CMD QUAD_PROG_CMD
@@ -129,6 +140,47 @@ static int qspi_status(uint8_t* status);
 static int test_ext_flash(void);
 #endif
 
+#ifdef QSPI_FLASH_MMAP
+/* Base of the memory-mapped window, NULL while in indirect mode */
+static uint8_t* qspi_mmap_base = NULL;
+
+static int qspi_mmap_start(void)
+{
+    if (qspi_mmap_base == NULL) {
+        qspi_mmap_base = (uint8_t*)qspi_mmap_enable(FLASH_READ_CMD,
+            QSPI_ADDR_SZ, QSPI_ADDR_MODE,
+            FLASH_READ_ALT, FLASH_READ_ALT_SZ, FLASH_READ_ALT_MODE,
+            QSPI_DUMMY_READ, QSPI_DATA_MODE);
+    #ifdef DEBUG_QSPI
+        wolfBoot_printf("QSPI Flash Memory-mapped: %p\n", qspi_mmap_base);
+    #endif
+    }
+    return (qspi_mmap_base != NULL) ? 0 : -1;
+}
+
+/* Program and erase need indirect mode */
+static void qspi_mmap_stop(void)
+{
+    if (qspi_mmap_base != NULL) {
+        qspi_mmap_disable();
+        qspi_mmap_base = NULL;
+    }
+}
+
+/* Direct read access to the flash, see ext_flash_mmap() in hal.h. The
+ * returned pointer is valid until the next write or erase. */
+const uint8_t* ext_flash_mmap(uintptr_t address, int len)
+{
+    if (len < 0 || address + (uint32_t)len > FLASH_DEVICE_SIZE)
+        return NULL;
+    if (qspi_mmap_start() != 0)
+        return NULL;
+    return qspi_mmap_base + address;
+}
+#else
+#define qspi_mmap_stop() do{}while(0)
+#endif /* QSPI_FLASH_MMAP */
+
 static inline int qspi_command_simple(uint8_t fmode, uint8_t cmd,
     uint8_t* data, uint32_t dataSz)
 {
@@ -356,6 +408,7 @@ int spi_flash_sector_erase(uint32_t address)
 {
     int ret;
 
+    qspi_mmap_stop();
     ret = qspi_write_enable();
     if (ret == 0) {
         /* ------ Erase Flash ------ */
@@ -379,15 +432,6 @@ int spi_flash_sector_erase(uint32_t address)
 int spi_flash_read(uint32_t address, void *data, int len)
 {
     int ret;
-#if QSPI_DATA_MODE == QSPI_DATA_MODE_QSPI
-    const uint32_t altByte = 0xF0; /* enable continuous read */
-    uint32_t altSz = 1;
-    uint32_t altMode = QSPI_ADDR_MODE;
-#else
-    const uint32_t altByte = 0x00;
-    uint32_t altSz = 0;
-    uint32_t altMode = QSPI_DATA_MODE_NONE;
-#endif
 
     if (address > FLASH_DEVICE_SIZE) {
 #ifdef DEBUG_QSPI
@@ -397,10 +441,19 @@ int spi_flash_read(uint32_t address, void *data, int len)
         return -1;
     }
 
+#ifdef QSPI_FLASH_MMAP
+    /* Copy from the memory-mapped window, no indirect command needed */
+    if (len >= 0 && address + (uint32_t)len <= FLASH_DEVICE_SIZE &&
+            qspi_mmap_start() == 0) {
+        memcpy(data, qspi_mmap_base + address, len);
+        return len;
+    }
+#endif
+
     /* ------ Read Flash ------ */
     ret = qspi_transfer(QSPI_MODE_READ, FLASH_READ_CMD,
         address, QSPI_ADDR_SZ, QSPI_ADDR_MODE,             /* Address */
-        altByte, altSz, altMode,                           /* Alternate Bytes */
+        FLASH_READ_ALT, FLASH_READ_ALT_SZ, FLASH_READ_ALT_MODE, /* Alternate Bytes */
         QSPI_DUMMY_READ,                                   /* Dummy */
         data, len, QSPI_DATA_MODE                          /* Data */
     );
@@ -427,6 +480,8 @@ int spi_flash_write(uint32_t address, const void *data, int len)
         len, data, address);
 #endif
 
+    qspi_mmap_stop();
+
     /* write by page */
     pages = ((len + (FLASH_PAGE_SIZE-1)) / FLASH_PAGE_SIZE);
     for (page = 0; page < pages; page++) {
@@ -470,6 +525,7 @@ int spi_flash_write(uint32_t address, const void *data, int len)
 
 void spi_flash_release(void)
 {
+    qspi_mmap_stop();
 #if QSPI_ADDR_SZ == 4
     qspi_exit_4byte_addr();
 #endif
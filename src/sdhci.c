@@ -34,10 +34,18 @@
 #include "hal.h"
 #include "disk.h"
 
+#if !defined(SDHCI_SDMA_DISABLED) || !defined(SDHCI_ADMA2_DISABLED)
+#define SDHCI_DMA_ENABLED
+#endif
+
+#if !defined(SDHCI_ADMA2_DISABLED) && (SDHCI_ADMA2_DESC_MAX_LEN > 65536U)
+#error "SDHCI_ADMA2_DESC_MAX_LEN exceeds the 16-bit ADMA2 length field"
+#endif
+
 /* ============================================================================
  * Platform DMA cache maintenance (weak defaults - override in HAL)
  * ============================================================================ */
-#ifndef SDHCI_SDMA_DISABLED
+#ifdef SDHCI_DMA_ENABLED
 void __attribute__((weak)) sdhci_platform_dma_prepare(
     void *buf, uint32_t sz, int is_write)
 {
@@ -63,6 +71,16 @@ static uint32_t g_rca = 0; /* SD Card Relative Address */
 static volatile uint32_t g_mmc_irq_status = 0;
 static volatile int g_mmc_irq_pending = 0;
 
+#ifndef SDHCI_ADMA2_DISABLED
+/* ADMA2 addressing selected by sdhci_init(): 0 (unsupported), 32 or 64 */
+static int g_adma2_bits = 0;
+
+/* ADMA2 descriptor table. 32-bit addressing uses 64-bit descriptors, 64-bit
+ * addressing (Host Version 4) uses 128-bit descriptors. */
+static uint32_t g_adma2_desc[SDHCI_ADMA2_DESC_COUNT * 4]
+    __attribute__((aligned(16)));
+#endif
+
 /* Microsecond delay using hardware timer */
 static void udelay(uint32_t us)
 {
@@ -571,6 +589,79 @@ static uint32_t sdhci_get_response_bits(int from, int count)
     return ret & mask;
 }
 
+/* ============================================================================
+ * UHS-I / HS200 Bus Modes
+ * ============================================================================ */
+
+#ifdef SDHCI_UHS_MODES
+
+/* Select host UHS mode (SRS15) and, for eMMC, the Cadence HRS06 bus mode */
+static void sdhci_set_uhs_mode(uint32_t ums, uint32_t emm)
+{
+    uint32_t reg = SDHCI_REG(SDHCI_SRS15);
+    reg &= ~SDHCI_SRS15_UMS_MASK;
+    reg |= ums;
+    SDHCI_REG_SET(SDHCI_SRS15, reg);
+#ifdef DISK_EMMC
+    reg = SDHCI_REG(SDHCI_HRS06);
+    reg &= ~SDHCI_HRS06_EMM_MASK;
+    reg |= emm;
+    SDHCI_REG_SET(SDHCI_HRS06, reg);
+#else
+    (void)emm;
+#endif
+}
+
+/* Run the sampling clock tuning procedure using CMD19 (SD) or CMD21 (eMMC).
+ * blk_sz: tuning block size (64 bytes, or 128 bytes for 8-bit eMMC)
+ * Returns 0 once the controller selected a sampling point */
+static int sdhci_execute_tuning(uint32_t cmd_index, uint32_t blk_sz)
+{
+    int i;
+    uint32_t reg = 0, timeout;
+
+    sdhci_reg_and(SDHCI_SRS15, ~SDHCI_SRS15_SCS);
+    sdhci_reg_or(SDHCI_SRS15, SDHCI_SRS15_EXTNG);
+
+    for (i = 0; i < SDHCI_TUNING_LOOPS; i++) {
+        while ((SDHCI_REG(SDHCI_SRS09) &
+            (SDHCI_SRS09_CICMD | SDHCI_SRS09_CIDAT)) != 0);
+
+        SDHCI_REG_SET(SDHCI_SRS01, (1U << SDHCI_SRS01_BCCT_SHIFT) | blk_sz);
+        SDHCI_REG_SET(SDHCI_SRS02, 0);
+        SDHCI_REG_SET(SDHCI_SRS03,
+            ((cmd_index << SDHCI_SRS03_CIDX_SHIFT) & SDHCI_SRS03_CIDX_MASK) |
+            SDHCI_SRS03_DPS | SDHCI_SRS03_DTDS |
+            SDHCI_SRS03_RESP_48 | SDHCI_SRS03_CRCCE | SDHCI_SRS03_CICE);
+
+        /* tuning blocks are consumed by the controller, only BRR is raised */
+        timeout = 0x000FFFFF;
+        while ((SDHCI_REG(SDHCI_SRS12) & SDHCI_SRS12_BRR) == 0 &&
+            --timeout > 0);
+        SDHCI_REG_SET(SDHCI_SRS12, ~(SDHCI_SRS12_ECL | SDHCI_SRS12_CINT |
+                          SDHCI_SRS12_CR | SDHCI_SRS12_CIN));
+
+        reg = SDHCI_REG(SDHCI_SRS15);
+        if ((reg & SDHCI_SRS15_EXTNG) == 0) {
+            break;
+        }
+    }
+    sdhci_reset_lines();
+
+    if ((reg & (SDHCI_SRS15_EXTNG | SDHCI_SRS15_SCS)) != SDHCI_SRS15_SCS) {
+        sdhci_reg_and(SDHCI_SRS15, ~(SDHCI_SRS15_EXTNG | SDHCI_SRS15_SCS));
+        wolfBoot_printf("sdhci: CMD%d tuning failed\n", cmd_index);
+        return -1;
+    }
+#ifdef DEBUG_SDHCI
+    wolfBoot_printf("sdhci: CMD%d tuning done after %d loops\n",
+        cmd_index, i + 1);
+#endif
+    return 0;
+}
+
+#endif /* SDHCI_UHS_MODES */
+
 /* ============================================================================
  * SD Card Specific Functions
  * ============================================================================ */
@@ -623,6 +714,102 @@ static int sdcard_card_init(uint32_t acmd41_arg, uint32_t *ocr_reg)
 static int sdcard_set_bus_width(uint32_t bus_width);
 static int sdcard_set_function(uint32_t function_number, uint32_t group_number);
 
+#ifdef SDHCI_UHS_MODES
+/* Switch the card and host to 1.8V signaling with CMD11.
+ * Returns 0 on success, on error the card must be power cycled */
+static int sdcard_voltage_switch(void)
+{
+    /* card answers from the ready state, READY_FOR_DATA is not meaningful */
+    int status = sdhci_cmd(SD_CMD11_VOLTAGE_SWITCH, 0, SDHCI_RESP_R1);
+    if (status == DEVICE_BUSY) {
+        status = 0;
+    }
+    if (status == 0) {
+        /* stop SD clock, card drives DAT[3:0] low while switching */
+        sdhci_reg_and(SDHCI_SRS11, ~SDHCI_SRS11_SDCE);
+        if ((SDHCI_REG(SDHCI_SRS09) & SDHCI_SRS09_DATSL_MASK) != 0) {
+            status = -1;
+        }
+    }
+    if (status == 0) {
+        sdhci_reg_or(SDHCI_SRS15, SDHCI_SRS15_V18SE);
+        udelay(5000);
+        if ((SDHCI_REG(SDHCI_SRS15) & SDHCI_SRS15_V18SE) == 0) {
+            status = -1; /* regulator did not switch */
+        }
+    }
+    if (status == 0) {
+        sdhci_reg_or(SDHCI_SRS11, SDHCI_SRS11_SDCE);
+        udelay(1000);
+        /* card releases DAT[3:0] high when the switch completed */
+        if ((SDHCI_REG(SDHCI_SRS09) & SDHCI_SRS09_DATSL_MASK) !=
+                SDHCI_SRS09_DATSL_MASK) {
+            status = -1;
+        }
+    }
+    if (status != 0) {
+        sdhci_reg_and(SDHCI_SRS15, ~SDHCI_SRS15_V18SE);
+        sdhci_reg_or(SDHCI_SRS11, SDHCI_SRS11_SDCE);
+    }
+#ifdef DEBUG_SDHCI
+    wolfBoot_printf("sdcard_voltage_switch: status %d\n", status);
+#endif
+    return status;
+}
+
+/* UHS-I bus modes, fastest first */
+static const struct {
+    uint32_t access_mode;   /* CMD6 group 1 function */
+    uint32_t cap;           /* SRS17 capability bit */
+    uint32_t ums;           /* SRS15 UHS mode select */
+    uint32_t clock_khz;
+} sdcard_uhs_modes[] = {
+    { SDCARD_SWITCH_ACCESS_MODE_SDR104, SDHCI_SRS17_SDR104,
+      SDHCI_SRS15_UMS_SDR104, SDHCI_CLK_208MHZ },
+    { SDCARD_SWITCH_ACCESS_MODE_SDR50, SDHCI_SRS17_SDR50,
+      SDHCI_SRS15_UMS_SDR50, SDHCI_CLK_100MHZ },
+};
+
+/* Select the fastest UHS-I mode supported by the controller and the card.
+ * Requires 1.8V signaling and a 4-bit bus. Returns 0 on success */
+static int sdcard_set_uhs_mode(void)
+{
+    uint32_t i, reg, caps = SDHCI_REG(SDHCI_SRS17);
+
+    for (i = 0; i < sizeof(sdcard_uhs_modes)/sizeof(sdcard_uhs_modes[0]); i++) {
+        if ((caps & sdcard_uhs_modes[i].cap) == 0 ||
+            sdcard_set_function(sdcard_uhs_modes[i].access_mode, 1) != 0) {
+            continue;
+        }
+        /* set driver strength */
+        reg = SDHCI_REG(SDHCI_SRS15);
+        reg &= ~SDHCI_SRS15_DSS_MASK;
+        reg |= SDHCI_SRS15_DSS_TYPE_B;
+        SDHCI_REG_SET(SDHCI_SRS15, reg);
+
+        sdhci_reg_or(SDHCI_SRS10, SDHCI_SRS10_HSE);
+        sdhci_set_uhs_mode(sdcard_uhs_modes[i].ums, 0);
+        sdhci_set_clock(sdcard_uhs_modes[i].clock_khz);
+
+        /* SDR104 always needs tuning, SDR50 only if the controller says so */
+        if ((sdcard_uhs_modes[i].access_mode ==
+                SDCARD_SWITCH_ACCESS_MODE_SDR104 ||
+             (caps & SDHCI_SRS17_TSDR50)) &&
+            sdhci_execute_tuning(SD_CMD19_SEND_TUNING,
+                SDCARD_TUNING_BLOCK_SIZE) != 0) {
+            sdhci_set_clock(SDHCI_CLK_25MHZ);
+            continue;
+        }
+    #ifdef DEBUG_SDHCI
+        wolfBoot_printf("sdcard_init: UHS-I access mode %d\n",
+            sdcard_uhs_modes[i].access_mode);
+    #endif
+        return 0;
+    }
+    return -1;
+}
+#endif /* SDHCI_UHS_MODES */
+
 /* Full SD card initialization sequence
  * Returns 0 on success */
 static int sdcard_card_full_init(void)
@@ -631,7 +818,8 @@ static int sdcard_card_full_init(void)
     uint32_t reg;
     uint32_t ctrl_volts, card_volts;
     uint32_t irq_restore;
-    int xpc, si8r;
+    uint32_t cmd_arg = 0;
+    int xpc, si8r, uhs = 0;
 
     /* Set power to 3.3v and send init commands */
     ctrl_volts = SDHCI_SRS10_BVS_3_3V; /* default to 3.3v */
@@ -693,7 +881,7 @@ static int sdcard_card_full_init(void)
 
     if (status == 0) {
         /* configure operating conditions */
-        uint32_t cmd_arg = SDCARD_ACMD41_HCS;
+        cmd_arg = SDCARD_ACMD41_HCS;
         cmd_arg |= card_volts;
         if (si8r) {
             cmd_arg |= SDCARD_REG_OCR_S18RA;
@@ -711,6 +899,27 @@ static int sdcard_card_full_init(void)
         } while (status == 0 && (reg & SDCARD_REG_OCR_READY) == 0);
     }
 
+#ifdef SDHCI_UHS_MODES
+    if (status == 0 && (cmd_arg & SDCARD_REG_OCR_S18RA) &&
+            (reg & SDCARD_REG_OCR_S18RA)) {
+        /* card accepted 1.8V signaling: switch before CMD2 */
+        uhs = (sdcard_voltage_switch() == 0);
+        if (!uhs) {
+            wolfBoot_printf("SD Card: 1.8V switch failed, using 3.3V\n");
+            /* power cycle and re-init without requesting 1.8V */
+            (void)sdhci_set_power(0);
+            udelay(1000);
+            cmd_arg &= ~SDCARD_REG_OCR_S18RA;
+            status = sdcard_power_init_seq(ctrl_volts);
+            if (status == 0) {
+                do {
+                    status = sdcard_card_init(cmd_arg, &reg);
+                } while (status == 0 && (reg & SDCARD_REG_OCR_READY) == 0);
+            }
+        }
+    }
+#endif
+
     if (status == 0) {
         /* Get card identification */
         status = sdhci_cmd(MMC_CMD2_ALL_SEND_CID, 0, SDHCI_RESP_R2);
@@ -787,7 +996,14 @@ static int sdcard_card_full_init(void)
             sizeof(scr_reg));
     }
 
-    if (status == 0) {
+#ifdef SDHCI_UHS_MODES
+    if (status == 0 && uhs) {
+        /* falls back to SDR25 below if no UHS-I mode could be tuned */
+        uhs = (sdcard_set_uhs_mode() == 0);
+    }
+#endif
+
+    if (status == 0 && !uhs) {
         /* set UHS mode to SDR25 and driver strength to Type B */
         uint32_t card_access_mode = SDCARD_SWITCH_ACCESS_MODE_SDR25;
         status = sdcard_set_function(card_access_mode, 1);
@@ -809,7 +1025,7 @@ static int sdcard_card_full_init(void)
         }
     }
 
-    if (status == 0) {
+    if (status == 0 && !uhs) {
         sdhci_set_clock(SDHCI_CLK_50MHZ);
     }
 
@@ -1016,6 +1232,100 @@ static int emmc_set_bus_width(uint32_t width)
     return 0;
 }
 
+#ifdef SDHCI_UHS_MODES
+/* Write a single EXT_CSD byte using CMD6 SWITCH */
+static int emmc_switch(uint32_t index, uint32_t value)
+{
+    int status = sdhci_cmd(MMC_CMD6_SWITCH,
+        MMC_SWITCH_WRITE_BYTE | (index << 16) | (value << 8), SDHCI_RESP_R1B);
+    if (status == DEVICE_BUSY) {
+        status = sdhci_wait_busy(1);
+    }
+    return status;
+}
+
+/* Return host and device to legacy timing after a failed HS200/HS400 switch */
+static void emmc_timing_revert(void)
+{
+    sdhci_reg_and(SDHCI_SRS15, ~(SDHCI_SRS15_EXTNG | SDHCI_SRS15_SCS |
+        SDHCI_SRS15_V18SE));
+    sdhci_set_clock(SDHCI_CLK_400KHZ);
+    sdhci_set_uhs_mode(SDHCI_SRS15_UMS_SDR12, SDHCI_HRS06_MODE_LEGACY);
+    (void)emmc_switch(MMC_EXT_CSD_HS_TIMING, MMC_EXT_CSD_TIMING_LEGACY);
+    (void)emmc_set_bus_width(SDHCI_EMMC_BUS_WIDTH);
+}
+
+/* Switch to HS200, then to HS400 on an 8-bit bus, when both the controller
+ * (1.8V and SDR104/HS200 capable) and the device support it.
+ * Returns 0 on success, legacy timing is restored on error */
+static int emmc_set_hs_mode(void)
+{
+    int status;
+    uint32_t ext_csd[MMC_EXT_CSD_SIZE/sizeof(uint32_t)];
+    uint8_t* p_ext_csd = (uint8_t*)ext_csd;
+    uint8_t dev_type;
+
+    if (g_bus_width == 1 ||
+        (SDHCI_REG(SDHCI_SRS16) & SDHCI_SRS16_VS18) == 0 ||
+        (SDHCI_REG(SDHCI_SRS17) & SDHCI_SRS17_SDR104) == 0) {
+        return -1;
+    }
+
+    status = sdhci_read(MMC_CMD8_SEND_EXT_CSD, 0, ext_csd, sizeof(ext_csd));
+    if (status != 0) {
+        return status;
+    }
+    if (g_sector_count == 0) {
+        g_sector_count =
+            ((uint32_t)p_ext_csd[MMC_EXT_CSD_SEC_COUNT]) |
+            ((uint32_t)p_ext_csd[MMC_EXT_CSD_SEC_COUNT + 1] << 8) |
+            ((uint32_t)p_ext_csd[MMC_EXT_CSD_SEC_COUNT + 2] << 16) |
+            ((uint32_t)p_ext_csd[MMC_EXT_CSD_SEC_COUNT + 3] << 24);
+    }
+    dev_type = p_ext_csd[MMC_EXT_CSD_DEVICE_TYPE];
+    if ((dev_type & MMC_EXT_CSD_TYPE_HS200_1_8V) == 0) {
+        return -1;
+    }
+
+    status = emmc_switch(MMC_EXT_CSD_HS_TIMING, MMC_EXT_CSD_TIMING_HS200);
+    if (status == 0) {
+        sdhci_reg_or(SDHCI_SRS15, SDHCI_SRS15_V18SE);
+        sdhci_reg_or(SDHCI_SRS10, SDHCI_SRS10_HSE);
+        sdhci_set_uhs_mode(SDHCI_SRS15_UMS_SDR104, SDHCI_HRS06_MODE_HS200);
+        sdhci_set_clock(SDHCI_CLK_200MHZ);
+        status = sdhci_execute_tuning(MMC_CMD21_SEND_TUNING,
+            (g_bus_width == 8) ? 128 : 64);
+    }
+
+    if (status == 0 && g_bus_width == 8 &&
+            (dev_type & MMC_EXT_CSD_TYPE_HS400_1_8V)) {
+        /* HS400 is entered from HS timing with the HS200 tuning result:
+         * HS timing at 50MHz, 8-bit DDR bus, then HS400 timing */
+        sdhci_set_clock(SDHCI_CLK_50MHZ);
+        sdhci_set_uhs_mode(SDHCI_SRS15_UMS_SDR25, SDHCI_HRS06_MODE_HS);
+        status = emmc_switch(MMC_EXT_CSD_HS_TIMING, MMC_EXT_CSD_TIMING_HS);
+        if (status == 0) {
+            status = emmc_switch(MMC_EXT_CSD_BUS_WIDTH,
+                MMC_EXT_CSD_WIDTH_8BIT_DDR);
+        }
+        if (status == 0) {
+            status = emmc_switch(MMC_EXT_CSD_HS_TIMING,
+                MMC_EXT_CSD_TIMING_HS400);
+        }
+        if (status == 0) {
+            sdhci_set_uhs_mode(SDHCI_SRS15_UMS_HS400, SDHCI_HRS06_MODE_HS400);
+            sdhci_set_clock(SDHCI_CLK_200MHZ);
+        }
+    }
+
+    if (status != 0) {
+        wolfBoot_printf("eMMC: HS200/HS400 switch failed, using legacy\n");
+        emmc_timing_revert();
+    }
+    return status;
+}
+#endif /* SDHCI_UHS_MODES */
+
 /* Full eMMC card initialization sequence
  * Returns 0 on success */
 static int emmc_card_full_init(void)
@@ -1110,13 +1420,19 @@ static int emmc_card_full_init(void)
         return status;
     }
 
-    /* Set bus width to 4-bit */
-    status = emmc_set_bus_width(MMC_EXT_CSD_WIDTH_4BIT);
+    /* Set bus width (4-bit by default) */
+    status = emmc_set_bus_width(SDHCI_EMMC_BUS_WIDTH);
     if (status != 0) {
         wolfBoot_printf("eMMC: Set bus width failed, continuing with 1-bit\n");
         /* Non-fatal, continue with 1-bit */
     }
 
+#ifdef SDHCI_UHS_MODES
+    if (emmc_set_hs_mode() == 0) {
+        return 0;
+    }
+#endif
+
     /* Set clock to 25MHz for legacy mode */
     sdhci_set_clock(SDHCI_CLK_25MHZ);
 
@@ -1136,6 +1452,73 @@ static int emmc_card_full_init(void)
 #define SDHCI_DIR_READ  1
 #define SDHCI_DIR_WRITE 0
 
+/* Largest CMD18/CMD25 transfer: 16-bit block count, and with ADMA2 the
+ * capacity of the descriptor table */
+#ifndef SDHCI_ADMA2_DISABLED
+#define SDHCI_ADMA2_MAX_BLOCKS \
+    ((SDHCI_ADMA2_DESC_COUNT * SDHCI_ADMA2_DESC_MAX_LEN) / SDHCI_BLOCK_SIZE)
+#define SDHCI_XFER_MAX_BLOCKS \
+    ((SDHCI_ADMA2_MAX_BLOCKS > 0xFFFFU) ? 0xFFFFU : SDHCI_ADMA2_MAX_BLOCKS)
+#else
+#define SDHCI_XFER_MAX_BLOCKS 0xFFFFU
+#endif
+
+#ifndef SDHCI_ADMA2_DISABLED
+/* Build the ADMA2 descriptor chain for buf/sz and point the controller at it.
+ * Returns 0 on success, -1 if the buffer cannot be described with the
+ * selected addressing (caller falls back to SDMA or PIO) */
+static int sdhci_adma2_setup(uint32_t* buf, uint32_t sz)
+{
+    uint64_t addr = (uint64_t)(uintptr_t)buf;
+    uint64_t table = (uint64_t)(uintptr_t)g_adma2_desc;
+    uint32_t stride = (g_adma2_bits == 64) ? 4 : 2;
+    uint32_t i = 0, len, reg;
+
+    if (g_adma2_bits == 0 || sz == 0 ||
+        sz > (SDHCI_ADMA2_DESC_COUNT * SDHCI_ADMA2_DESC_MAX_LEN) ||
+        (g_adma2_bits == 32 &&
+            (((addr + sz - 1) >> 32) != 0 || (table >> 32) != 0))) {
+        return -1;
+    }
+
+    while (sz > 0) {
+        uint32_t* desc = &g_adma2_desc[i * stride];
+        len = (sz > SDHCI_ADMA2_DESC_MAX_LEN) ? SDHCI_ADMA2_DESC_MAX_LEN : sz;
+        sz -= len;
+        /* a length field of 0 encodes 65536 bytes */
+        desc[0] = ((len & 0xFFFFU) << SDHCI_ADMA2_LEN_SHIFT) |
+            SDHCI_ADMA2_ATTR_TRAN | SDHCI_ADMA2_ATTR_VALID |
+            ((sz == 0) ? SDHCI_ADMA2_ATTR_END : 0);
+        desc[1] = (uint32_t)addr;
+        if (stride == 4) {
+            desc[2] = (uint32_t)(addr >> 32);
+            desc[3] = 0;
+        }
+        addr += len;
+        i++;
+    }
+
+    /* Descriptor table must be visible to the DMA engine */
+    sdhci_platform_dma_prepare(g_adma2_desc, i * stride * sizeof(uint32_t), 1);
+
+    reg = SDHCI_REG(SDHCI_SRS10);
+    reg &= ~SDHCI_SRS10_DMA_MASK;
+    reg |= SDHCI_SRS10_DMA_ADMA2;
+    SDHCI_REG_SET(SDHCI_SRS10, reg);
+    if (g_adma2_bits == 64) {
+        sdhci_reg_or(SDHCI_SRS15, SDHCI_SRS15_HV4E | SDHCI_SRS15_A64);
+    }
+    else {
+        sdhci_reg_and(SDHCI_SRS15, ~SDHCI_SRS15_A64);
+    }
+
+    /* Set descriptor table address (high first, as for SDMA) */
+    SDHCI_REG_SET(SDHCI_SRS23, (uint32_t)(table >> 32));
+    SDHCI_REG_SET(SDHCI_SRS22, (uint32_t)table);
+    return 0;
+}
+#endif /* !SDHCI_ADMA2_DISABLED */
+
 /* Unified internal transfer function for read and write operations
  * dir: SDHCI_DIR_READ or SDHCI_DIR_WRITE
  * cmd_index: command to send (e.g., MMC_CMD17_READ_SINGLE, MMC_CMD25_WRITE_MULTIPLE)
@@ -1210,6 +1593,21 @@ static int sdhci_transfer(int dir, uint32_t cmd_index, uint32_t block_addr,
     else if (is_multi_block) {
         cmd_reg |= SDHCI_SRS03_MSBS; /* enable multi-block select */
 
+    #ifndef SDHCI_ADMA2_DISABLED
+        if (sz >= SDHCI_ADMA2_THRESHOLD && sdhci_adma2_setup(buf, sz) == 0) {
+            /* ADMA2 walks the descriptor table for the whole transfer,
+             * there are no boundary interrupts to service */
+            cmd_reg |= SDHCI_SRS03_DMAE;
+            bcr_reg = (block_count << SDHCI_SRS01_BCCT_SHIFT) |
+                SDHCI_BLOCK_SIZE;
+
+            /* Platform DMA cache maintenance before transfer */
+            sdhci_platform_dma_prepare(buf, sz, dir == SDHCI_DIR_WRITE);
+
+            sdhci_enable_sdma_interrupts();
+        }
+        else
+    #endif /* !SDHCI_ADMA2_DISABLED */
     #ifndef SDHCI_SDMA_DISABLED
         if (sz >= SDHCI_DMA_THRESHOLD) { /* use DMA for large transfers */
             cmd_reg |= SDHCI_SRS03_DMAE; /* enable DMA */
@@ -1223,6 +1621,7 @@ static int sdhci_transfer(int dir, uint32_t cmd_index, uint32_t block_addr,
              * A64 is cleared in SRS15 to use 32-bit DMA addressing.
              * Note: Platform may redirect SRS22/SRS23 to SRS00 for legacy
              * SDMA on controllers that don't support HV4E. */
+            sdhci_reg_and(SDHCI_SRS10, ~SDHCI_SRS10_DMA_MASK);
             sdhci_reg_or(SDHCI_SRS10, SDHCI_SRS10_DMA_SDMA);
             sdhci_reg_or(SDHCI_SRS15, SDHCI_SRS15_HV4E);
             sdhci_reg_and(SDHCI_SRS15, ~SDHCI_SRS15_A64);
@@ -1256,7 +1655,8 @@ static int sdhci_transfer(int dir, uint32_t cmd_index, uint32_t block_addr,
         while (1) {
             status = sdhci_wait_irq(SDHCI_IRQ_FLAG_TC, 0x00FFFFFF);
             if (status != 0) {
-                wolfBoot_printf("sdhci_transfer: SDMA timeout/error\n");
+                wolfBoot_printf("sdhci_transfer: DMA timeout/error "
+                    "(ADMA err 0x%x)\n", SDHCI_REG(SDHCI_SRS21));
                 status = -1;
                 break;
             }
@@ -1267,10 +1667,10 @@ static int sdhci_transfer(int dir, uint32_t cmd_index, uint32_t block_addr,
         }
         sdhci_disable_sdma_interrupts();
 
-    #ifndef SDHCI_SDMA_DISABLED
+    #ifdef SDHCI_DMA_ENABLED
         /* Platform DMA cache maintenance after transfer */
         sdhci_platform_dma_complete(buf, sz, dir == SDHCI_DIR_WRITE);
-    #endif /* !SDHCI_SDMA_DISABLED */
+    #endif /* SDHCI_DMA_ENABLED */
     }
     else {
         /* Blocking mode - buffer ready flag differs for read vs write */
@@ -1430,6 +1830,18 @@ int sdhci_init(void)
         reg |= SDHCI_SRS15_HV4E;
         SDHCI_REG_SET(SDHCI_SRS15, reg);
     }
+#ifndef SDHCI_ADMA2_DISABLED
+    /* ADMA2 uses 64-bit addressing only when Host Version 4 with A64 is
+     * active (read back, as v3 controllers ignore these bits) */
+    g_adma2_bits = 0;
+    if (cap & SDHCI_SRS16_ADMA2S) {
+        reg = SDHCI_REG(SDHCI_SRS15) & (SDHCI_SRS15_HV4E | SDHCI_SRS15_A64);
+        g_adma2_bits = (reg == (SDHCI_SRS15_HV4E | SDHCI_SRS15_A64)) ? 64 : 32;
+    }
+#ifdef DEBUG_SDHCI
+    wolfBoot_printf("SDHCI: ADMA2 %d-bit\n", g_adma2_bits);
+#endif
+#endif
     /* Set all status enables - 0xbff40ff */
     SDHCI_REG_SET(SDHCI_SRS13, (
         SDHCI_SRS13_ETUNE_SE | SDHCI_SRS13_EADMA_SE | SDHCI_SRS13_EAC_SE |
@@ -1562,6 +1974,9 @@ int disk_read(int drv, uint64_t start, uint32_t count, uint8_t *buf)
         else {
             /* direct full block(s) read */
             uint32_t blocks = (count / SDHCI_BLOCK_SIZE);
+            if (blocks > SDHCI_XFER_MAX_BLOCKS) {
+                blocks = SDHCI_XFER_MAX_BLOCKS;
+            }
             read_sz = (blocks * SDHCI_BLOCK_SIZE);
             status = sdhci_read(blocks > 1 ?
                                 MMC_CMD18_READ_MULTIPLE :
@@ -1616,6 +2031,9 @@ int disk_write(int drv, uint64_t start, uint32_t count, const uint8_t *buf)
         else {
             /* direct full block(s) write */
             uint32_t blocks = (count / SDHCI_BLOCK_SIZE);
+            if (blocks > SDHCI_XFER_MAX_BLOCKS) {
+                blocks = SDHCI_XFER_MAX_BLOCKS;
+            }
             write_sz = (blocks * SDHCI_BLOCK_SIZE);
             status = sdhci_write(blocks > 1 ?
                                 MMC_CMD25_WRITE_MULTIPLE :
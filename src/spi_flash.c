@@ -51,6 +51,25 @@
 #define EWSR            0x50
 #define EBSY            0x70
 #define DBSY            0x80
+#define FAST_READ       0x0B
+#define FAST_READ_4B    0x0C
+#define BYTE_WRITE_4B   0x12
+#define SECTOR_ERASE_4B 0x21
+#define SFDP_READ       0x5A
+
+/* SFDP (JESD216) layout */
+#define SFDP_SIGNATURE          0x50444653UL /* "SFDP" */
+#define SFDP_PARAM_BASIC        0xFF00       /* JEDEC Basic Flash Parameters */
+#define SFDP_PARAM_4B_ADDR      0xFF84       /* 4-byte Address Instructions */
+#define SFDP_MAX_PARAM_HEADERS  8
+#define SFDP_BFPT_DWORDS        16
+#   define BFPT1_4K_ERASE       0x01 /* bits 1:0 = 01: 4KB erase supported */
+#   define BFPT1_ADDR_4B_SHIFT  17   /* bits 18:17: 00 = 3-byte address only */
+#   define BFPT2_DENSITY_POW2   (1UL << 31)
+#   define BFPT11_PAGE_SHIFT    4    /* bits 7:4: page size = 2^N */
+#   define ADDR4B_FAST_READ     (1UL << 1) /* 0x0C supported */
+#   define ADDR4B_PAGE_PROGRAM  (1UL << 6) /* 0x12 supported */
+#   define ADDR4B_ERASE_TYPE1   (1UL << 9) /* 4-byte erase type 1 supported */
 
 #ifdef TEST_EXT_FLASH
 static int test_ext_flash(void);
@@ -61,14 +80,53 @@ static enum write_mode {
     SST_SINGLEBYTE = 0x01
 } chip_write_mode = WB_WRITEPAGE;
 
-static void RAMFUNCTION write_address(uint32_t address)
+/* Commands used to access the flash array. Defaults to the basic 3-byte
+ * address command set. With SPI_FLASH_SFDP, spi_flash_probe() selects
+ * Fast Read, 4-byte address commands and the page size from the SFDP
+ * tables of the device. */
+static struct spi_flash_cmds {
+    uint8_t read;
+    uint8_t read_dummy;   /* dummy bytes between address and data */
+    uint8_t write;
+    uint8_t erase;
+    uint8_t addr_bytes;
+    uint32_t page_size;
+} flash_cmds = {
+    BYTE_READ, 0, BYTE_WRITE, SECTOR_ERASE, 3, SPI_FLASH_PAGE_SIZE
+};
+
+#define SPI_FLASH_HDR_MAX 6 /* command + 4 address bytes + 1 dummy */
+
+#ifndef SPI_DRV_HAS_BURST
+/* Default burst for HAL drivers without a FIFO/DMA burst: clock each byte
+ * through spi_write()/spi_read(). */
+void RAMFUNCTION spi_burst(const uint8_t *tx, uint8_t *rx, uint32_t sz)
 {
-    spi_write((address & 0xFF0000) >> 16);
-    spi_read();
-    spi_write((address & 0xFF00) >> 8);
-    spi_read();
-    spi_write((address & 0xFF));
-    spi_read();
+    uint32_t i;
+    uint8_t b;
+    for (i = 0; i < sz; i++) {
+        spi_write(tx != NULL ? (const char)tx[i] : (const char)0xFF);
+        b = spi_read();
+        if (rx != NULL)
+            rx[i] = b;
+    }
+}
+#endif
+
+/* Build command, address and dummy bytes. Returns the header length. */
+static int RAMFUNCTION cmd_header(uint8_t *hdr, uint8_t cmd, uint32_t address,
+    int dummy)
+{
+    int n = 0;
+    hdr[n++] = cmd;
+    if (flash_cmds.addr_bytes == 4)
+        hdr[n++] = (uint8_t)(address >> 24);
+    hdr[n++] = (uint8_t)(address >> 16);
+    hdr[n++] = (uint8_t)(address >> 8);
+    hdr[n++] = (uint8_t)(address);
+    while (dummy-- > 0)
+        hdr[n++] = 0xFF;
+    return n;
 }
 
 static uint8_t RAMFUNCTION read_status(void)
@@ -116,23 +174,25 @@ static void RAMFUNCTION wait_busy(void)
 static int RAMFUNCTION spi_flash_write_page(uint32_t address, const void *data, int len)
 {
     const uint8_t *buf = data;
+    uint8_t hdr[SPI_FLASH_HDR_MAX];
+    uint32_t chunk;
     int j = 0;
     if (len < 1)
         return -1;
     while (len > 0) {
+        /* program up to the end of the current page */
+        chunk = flash_cmds.page_size - (address & (flash_cmds.page_size - 1));
+        if (chunk > (uint32_t)len)
+            chunk = (uint32_t)len;
         wait_busy();
         flash_write_enable();
         spi_cs_on(SPI_CS_PIO_BASE, SPI_CS_FLASH);
-        spi_write(BYTE_WRITE);
-        spi_read();
-        write_address(address);
-        do {
-            spi_write(buf[j++]);
-            address++;
-            spi_read();
-            len--;
-        } while (len > 0 && (address & (SPI_FLASH_PAGE_SIZE - 1)) != 0);
+        spi_burst(hdr, NULL, cmd_header(hdr, flash_cmds.write, address, 0));
+        spi_burst(buf + j, NULL, chunk);
         spi_cs_off(SPI_CS_PIO_BASE, SPI_CS_FLASH);
+        j += chunk;
+        address += chunk;
+        len -= chunk;
     }
     wait_busy();
     return 0;
@@ -141,41 +201,143 @@ static int RAMFUNCTION spi_flash_write_page(uint32_t address, const void *data,
 static int RAMFUNCTION spi_flash_write_sb(uint32_t address, const void *data, int len)
 {
     const uint8_t *buf = data;
-    uint8_t verify = 0;
-    int j = 0;
+    uint8_t hdr[SPI_FLASH_HDR_MAX];
+    uint8_t verify[16];
+    int j, n, k;
 
     wait_busy();
     if (len < 1)
         return -1;
-    while (len > 0) {
+    for (j = 0; j < len; j++) {
         flash_write_enable();
         spi_cs_on(SPI_CS_PIO_BASE, SPI_CS_FLASH);
-        spi_write(BYTE_WRITE);
-        spi_read();
-        write_address(address);
-        spi_write(buf[j]);
-        spi_read();
+        spi_burst(hdr, NULL, cmd_header(hdr, flash_cmds.write,
+            address + (uint32_t)j, 0));
+        spi_burst(buf + j, NULL, 1);
         spi_cs_off(SPI_CS_PIO_BASE, SPI_CS_FLASH);
         wait_busy();
-        spi_flash_read(address, &verify, 1);
-        /* Check if the read value matches the written value */
-        if (verify == buf[j]) {
-            j++;
-            len--;
-            address++;
+    }
+    /* Check the programmed bytes in bursts rather than after each byte */
+    for (j = 0; j < len; j += n) {
+        n = len - j;
+        if (n > (int)sizeof(verify))
+            n = (int)sizeof(verify);
+        spi_flash_read(address + (uint32_t)j, verify, n);
+        for (k = 0; k < n; k++) {
+            if (verify[k] != buf[j + k]) {
+                /* Verification failed, return error */
+                wolfBoot_printf(
+                    "SPI SB write verification failed at addr 0x%x. Wrote 0x%x, Read 0x%x\n",
+                    address + (uint32_t)(j + k),
+                    buf[j + k],
+                    verify[k]);
+                return -1;
+            }
         }
-        else {
-            /* Verification failed, return error */
-            wolfBoot_printf(
-                "SPI SB write verification failed at addr 0x%x. Wrote 0x%x, Read 0x%x\n",
-                address,
-                buf[j],
-                verify);
-            return -1;
+    }
+    return 0;
+}
+
+#ifdef SPI_FLASH_SFDP
+/* SFDP reads always use a 3-byte address and 8 dummy clocks */
+static void RAMFUNCTION sfdp_read(uint32_t address, void *data, uint32_t len)
+{
+    uint8_t hdr[5];
+    hdr[0] = SFDP_READ;
+    hdr[1] = (uint8_t)(address >> 16);
+    hdr[2] = (uint8_t)(address >> 8);
+    hdr[3] = (uint8_t)(address);
+    hdr[4] = 0xFF;
+    wait_busy();
+    spi_cs_on(SPI_CS_PIO_BASE, SPI_CS_FLASH);
+    spi_burst(hdr, NULL, sizeof(hdr));
+    spi_burst(NULL, data, len);
+    spi_cs_off(SPI_CS_PIO_BASE, SPI_CS_FLASH);
+}
+
+static uint32_t sfdp_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+        ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Select read/program/erase commands from the SFDP Basic Flash Parameter
+ * Table. Returns 0 if the device provides SFDP, -1 to keep the defaults. */
+static int spi_flash_sfdp_probe(void)
+{
+    uint8_t hdr[8];
+    uint8_t bfpt[SFDP_BFPT_DWORDS * 4];
+    uint32_t nph, i, id, ptp, dwords, bfpt_dwords = 0;
+    uint32_t addr4b = 0, dw1, dw2;
+    uint64_t size_bytes;
+    int has_addr4b = 0;
+
+    sfdp_read(0, hdr, sizeof(hdr));
+    if (sfdp_le32(hdr) != SFDP_SIGNATURE)
+        return -1;
+
+    nph = (uint32_t)hdr[6] + 1;
+    if (nph > SFDP_MAX_PARAM_HEADERS)
+        nph = SFDP_MAX_PARAM_HEADERS;
+    for (i = 0; i < nph; i++) {
+        sfdp_read(8 + (i * 8), hdr, sizeof(hdr));
+        id = ((uint32_t)hdr[7] << 8) | hdr[0];
+        dwords = hdr[3];
+        ptp = (uint32_t)hdr[4] | ((uint32_t)hdr[5] << 8) |
+            ((uint32_t)hdr[6] << 16);
+        if (id == SFDP_PARAM_BASIC && bfpt_dwords == 0 && dwords >= 2) {
+            bfpt_dwords = (dwords > SFDP_BFPT_DWORDS) ?
+                SFDP_BFPT_DWORDS : dwords;
+            sfdp_read(ptp, bfpt, bfpt_dwords * 4);
+        }
+        else if (id == SFDP_PARAM_4B_ADDR && dwords >= 1) {
+            sfdp_read(ptp, hdr, 4);
+            addr4b = sfdp_le32(hdr);
+            has_addr4b = 1;
         }
     }
+    if (bfpt_dwords == 0)
+        return -1;
+
+    dw1 = sfdp_le32(&bfpt[0]);
+    dw2 = sfdp_le32(&bfpt[4]);
+    if (dw2 & BFPT2_DENSITY_POW2)
+        size_bytes = 1ULL << (((dw2 & ~BFPT2_DENSITY_POW2) & 0x3F) - 3);
+    else
+        size_bytes = ((uint64_t)dw2 + 1) / 8;
+
+    /* Fast Read (1-1-1) is supported by every SFDP compliant device */
+    flash_cmds.read = FAST_READ;
+    flash_cmds.read_dummy = 1;
+    if ((dw1 & 0x03) == BFPT1_4K_ERASE && SPI_FLASH_SECTOR_SIZE == 4096)
+        flash_cmds.erase = (uint8_t)(dw1 >> 8);
+
+    /* Devices above 16MB: use the stateless 4-byte address commands, so the
+     * address mode never needs to be restored for the boot ROM */
+    if (size_bytes > (16UL * 1024 * 1024) &&
+            ((dw1 >> BFPT1_ADDR_4B_SHIFT) & 0x03) != 0 &&
+            (!has_addr4b ||
+             (addr4b & (ADDR4B_FAST_READ | ADDR4B_PAGE_PROGRAM |
+                ADDR4B_ERASE_TYPE1)) ==
+             (ADDR4B_FAST_READ | ADDR4B_PAGE_PROGRAM | ADDR4B_ERASE_TYPE1))) {
+        flash_cmds.addr_bytes = 4;
+        flash_cmds.read = FAST_READ_4B;
+        flash_cmds.write = BYTE_WRITE_4B;
+        flash_cmds.erase = SECTOR_ERASE_4B;
+    }
+
+    if (bfpt_dwords >= 11) {
+        i = (sfdp_le32(&bfpt[40]) >> BFPT11_PAGE_SHIFT) & 0x0F;
+        if (i > 0 && (1UL << i) <= SPI_FLASH_PAGE_SIZE)
+            flash_cmds.page_size = (1UL << i);
+    }
+
+    wolfBoot_printf("SPI SFDP: %d MB, %d-byte address, read 0x%x, page %d\n",
+        (int)(size_bytes >> 20), flash_cmds.addr_bytes, flash_cmds.read,
+        (int)flash_cmds.page_size);
     return 0;
 }
+#endif /* SPI_FLASH_SFDP */
 
 /* --- */
 
@@ -199,6 +361,10 @@ uint16_t spi_flash_probe(void)
     if (manuf == 0xEF)
         chip_write_mode = WB_WRITEPAGE;
 
+#ifdef SPI_FLASH_SFDP
+    (void)spi_flash_sfdp_probe();
+#endif
+
 #ifndef READONLY
     wait_busy();
     flash_write_enable();
@@ -229,15 +395,14 @@ uint16_t spi_flash_probe(void)
 
 int RAMFUNCTION spi_flash_sector_erase(uint32_t address)
 {
+    uint8_t hdr[SPI_FLASH_HDR_MAX];
     address &= (~(SPI_FLASH_SECTOR_SIZE - 1));
 
     wait_busy();
     flash_write_enable();
     wait_busy();
     spi_cs_on(SPI_CS_PIO_BASE, SPI_CS_FLASH);
-    spi_write(SECTOR_ERASE);
-    spi_read();
-    write_address(address);
+    spi_burst(hdr, NULL, cmd_header(hdr, flash_cmds.erase, address, 0));
     spi_cs_off(SPI_CS_PIO_BASE, SPI_CS_FLASH);
     wait_busy();
     return 0;
@@ -258,20 +423,16 @@ int RAMFUNCTION spi_flash_chip_erase(void)
 
 int RAMFUNCTION spi_flash_read(uint32_t address, void *data, int len)
 {
-    uint8_t *buf = data;
-    int i = 0;
+    uint8_t hdr[SPI_FLASH_HDR_MAX];
+    if (len < 0)
+        len = 0;
     wait_busy();
     spi_cs_on(SPI_CS_PIO_BASE, SPI_CS_FLASH);
-    spi_write(BYTE_READ);
-    spi_read();
-    write_address(address);
-    while (len > 0) {
-        spi_write(0xFF);
-        buf[i++] = spi_read();
-        len--;
-    }
+    spi_burst(hdr, NULL, cmd_header(hdr, flash_cmds.read, address,
+        flash_cmds.read_dummy));
+    spi_burst(NULL, data, (uint32_t)len);
     spi_cs_off(SPI_CS_PIO_BASE, SPI_CS_FLASH);
-    return i;
+    return len;
 }
 
 int RAMFUNCTION spi_flash_write(uint32_t address, const void *data, int len)
@@ -27,6 +27,7 @@
 
 #include <stdlib.h>
 
+#include "hal.h"
 #include "image.h"
 #include "printf.h"
 #include "spi_drv.h"
@@ -230,11 +231,9 @@ static int TPM2_IoCb(TPM2_CTX* ctx, const uint8_t* txBuf, uint8_t* rxBuf,
 #ifdef WOLFBOOT_MEASURED_BOOT
 
 #ifdef WOLFBOOT_MEASURED_BOOT_APP_PARTITION
-    /* Legacy: measure the boot (application) partition */
-    #ifndef WOLFBOOT_NO_PARTITIONS
-        #define SELF_HASH_ADDR  ((uintptr_t)WOLFBOOT_PARTITION_BOOT_ADDRESS)
-        #define SELF_HASH_SZ    ((uint32_t)WOLFBOOT_PARTITION_SIZE)
-    #endif
+    /* Legacy: measure the boot (application) image. The loader extends the
+     * PCR with the digest checked by wolfBoot_verify_integrity(), see
+     * wolfBoot_tpm2_measure_image(), so nothing is hashed here. */
 #elif defined(ARCH_SIM)
     /* Simulator: no linker script, use bootloader partition region */
     #if defined(WOLFBOOT_PARTITION_BOOT_ADDRESS) && defined(ARCH_FLASH_OFFSET)
@@ -270,15 +269,7 @@ static int self_sha256(uint8_t *hash)
         blksz = WOLFBOOT_SHA_BLOCK_SIZE;
         if (position + blksz > sz)
             blksz = sz - position;
-    #if defined(EXT_FLASH) && defined(NO_XIP) && \
-        defined(WOLFBOOT_MEASURED_BOOT_APP_PARTITION)
-        rc = ext_flash_read(p, ext_hash_block, WOLFBOOT_SHA_BLOCK_SIZE);
-        if (rc != WOLFBOOT_SHA_BLOCK_SIZE)
-            return -1;
-        wc_Sha256Update(&sha256_ctx, ext_hash_block, blksz);
-    #else
         wc_Sha256Update(&sha256_ctx, (uint8_t*)p, blksz);
-    #endif
         position += blksz;
         p += blksz;
     } while (position < sz);
@@ -301,15 +292,7 @@ static int self_sha384(uint8_t *hash)
         blksz = WOLFBOOT_SHA_BLOCK_SIZE;
         if (position + blksz > sz)
             blksz = sz - position;
-    #if defined(EXT_FLASH) && defined(NO_XIP) && \
-        defined(WOLFBOOT_MEASURED_BOOT_APP_PARTITION)
-        rc = ext_flash_read(p, ext_hash_block, WOLFBOOT_SHA_BLOCK_SIZE);
-        if (rc != WOLFBOOT_SHA_BLOCK_SIZE)
-            return -1;
-        wc_Sha384Update(&sha384_ctx, ext_hash_block, blksz);
-    #else
         wc_Sha384Update(&sha384_ctx, (uint8_t*)p, blksz);
-    #endif
         position += blksz;
         p += blksz;
     } while (position < sz);
@@ -318,8 +301,68 @@ static int self_sha384(uint8_t *hash)
     return 0;
 }
 #endif /* HASH type */
+
+#ifdef WOLFBOOT_MEASURED_BOOT_SELF_CACHE
+#ifndef WOLFBOOT_BUILD_ID
+    /* __DATE__/__TIME__ of this file would not change when only the other
+     * files of wolfBoot are rebuilt */
+    #error WOLFBOOT_MEASURED_BOOT_SELF_CACHE requires WOLFBOOT_BUILD_ID
+#endif
+
+#define SELF_CACHE_MAGIC 0x4D534257UL /* "WBSM" */
+
+/* Self-measurement, as stored by hal_measured_self_write() */
+struct wolfBoot_self_measurement {
+    uint32_t magic;
+    uint32_t size;
+    char     build_id[32];
+    uint8_t  digest[WOLFBOOT_SHA_DIGEST_SIZE];
+};
+
+/**
+ * @brief Get the digest of wolfBoot code, hashing it only once per build.
+ *
+ * The code region only changes when wolfBoot is reprogrammed, so the digest
+ * computed on the first boot is stored together with WOLFBOOT_BUILD_ID and
+ * reused for as long as the build id matches.
+ *
+ * @param[out] hash Buffer receiving WOLFBOOT_SHA_DIGEST_SIZE bytes.
+ * @return 0 on success, an error code on failure.
+ */
+static int self_hash_cached(uint8_t *hash)
+{
+    struct wolfBoot_self_measurement m;
+    int rc;
+
+    if ((hal_measured_self_read((uint8_t*)&m, sizeof(m)) == 0) &&
+            (m.magic == SELF_CACHE_MAGIC) && (m.size == SELF_HASH_SZ) &&
+            (strncmp(m.build_id, WOLFBOOT_BUILD_ID, sizeof(m.build_id)) == 0)) {
+        memcpy(hash, m.digest, WOLFBOOT_SHA_DIGEST_SIZE);
+        return 0;
+    }
+
+    rc = self_hash(hash);
+    if (rc == 0) {
+        memset(&m, 0, sizeof(m));
+        m.magic = SELF_CACHE_MAGIC;
+        m.size = SELF_HASH_SZ;
+        strncpy(m.build_id, WOLFBOOT_BUILD_ID, sizeof(m.build_id));
+        memcpy(m.digest, hash, WOLFBOOT_SHA_DIGEST_SIZE);
+        if (hal_measured_self_write((const uint8_t*)&m, sizeof(m)) != 0) {
+            wolfBoot_printf("Measured boot: self digest not cached\n");
+        }
+    }
+    return rc;
+}
+#endif /* WOLFBOOT_MEASURED_BOOT_SELF_CACHE */
 #endif /* SELF_HASH_ADDR */
 
+/* Measurements extended by wolfBoot, in order */
+static struct wolfBoot_tpm_event measured_log[WOLFBOOT_MEASURED_LOG_ENTRIES];
+static uint32_t measured_log_count;
+/* Set when a measurement did not fit in the log */
+static uint8_t measured_log_truncated;
+
 /**
  * @brief Extends a PCR in the TPM with a hash.
  *
@@ -341,6 +384,12 @@ int wolfBoot_tpm2_extend(uint8_t pcrIndex, uint8_t* hash, int line)
     int     digestSz = 0;
 #endif
 
+#ifdef WOLFBOOT_TPM_INIT_ASYNC
+    rc = wolfBoot_tpm2_init_wait();
+    if (rc != 0)
+        return rc;
+#endif
+
     /* clear auth session for PCR */
     wolfTPM2_SetAuthPassword(&wolftpm_dev, 0, NULL);
 
@@ -373,6 +422,90 @@ int wolfBoot_tpm2_extend(uint8_t pcrIndex, uint8_t* hash, int line)
 
     return rc;
 }
+
+/**
+ * @brief Extends a PCR and records the measurement in the event log.
+ *
+ * The entry is only added if the PCR was extended. When the log is full the
+ * PCR is still extended and only the entry is dropped: the log is then
+ * flagged as truncated by wolfBoot_tpm2_get_event_log().
+ *
+ * @param[in] pcrIndex The PCR Index (0-24 is valid range).
+ * @param[in] eventType TCG event type of the entry (WOLFBOOT_EV_*).
+ * @param[in] hash Digest to extend into the PCR.
+ * @param[in] desc Event data, truncated to WOLFBOOT_MEASURED_EVENT_SZ bytes.
+ * @return 0 on success, an error code on failure.
+ */
+int wolfBoot_tpm2_measure(uint8_t pcrIndex, uint32_t eventType,
+    const uint8_t* hash, const char* desc)
+{
+    struct wolfBoot_tpm_event* ev;
+    uint32_t len;
+    int rc;
+
+    rc = wolfBoot_tpm2_extend(pcrIndex, (uint8_t*)hash, __LINE__);
+    if (rc != 0)
+        return rc;
+
+    if (measured_log_count >= WOLFBOOT_MEASURED_LOG_ENTRIES) {
+        wolfBoot_printf("Measured boot: event log full\n");
+        measured_log_truncated = 1;
+        return 0;
+    }
+    ev = &measured_log[measured_log_count++];
+    ev->pcrIndex = pcrIndex;
+    ev->eventType = eventType;
+    memcpy(ev->digest, hash, WOLFBOOT_TPM_PCR_DIG_SZ);
+    len = (uint32_t)strlen(desc);
+    if (len > WOLFBOOT_MEASURED_EVENT_SZ)
+        len = WOLFBOOT_MEASURED_EVENT_SZ;
+    memcpy(ev->event, desc, len);
+    ev->eventSize = len;
+    return 0;
+}
+
+/**
+ * @brief Measures an image that was already verified.
+ *
+ * Extends the PCR with the digest checked by wolfBoot_verify_integrity() (or
+ * accepted through a verification ticket), instead of hashing the image
+ * again.
+ *
+ * @param[in] pcrIndex The PCR Index (0-24 is valid range).
+ * @param[in] img The verified image.
+ * @return 0 on success, an error code on failure.
+ */
+int wolfBoot_tpm2_measure_image(uint8_t pcrIndex, struct wolfBoot_image* img)
+{
+    int rc;
+
+    if (img == NULL || img->sha_ok != 1 || img->sha_hash == NULL)
+        return -1;
+    rc = wolfBoot_tpm2_measure(pcrIndex, WOLFBOOT_EV_IPL, img->sha_hash,
+        "boot image");
+    if (rc != 0) {
+        wolfBoot_printf("Error %d performing image measurement!\n", rc);
+    }
+    return rc;
+}
+
+/**
+ * @brief Get the event log of the measurements done so far.
+ *
+ * @param[out] log Pointer to the first entry.
+ * @param[out] count Number of entries.
+ * @return 0 on success, 1 if measurements were extended but did not fit in
+ * the log (it can't be replayed to the PCR values), -1 on invalid arguments.
+ */
+int wolfBoot_tpm2_get_event_log(const struct wolfBoot_tpm_event** log,
+    uint32_t* count)
+{
+    if (log == NULL || count == NULL)
+        return -1;
+    *log = measured_log;
+    *count = measured_log_count;
+    return measured_log_truncated;
+}
 #endif /* WOLFBOOT_MEASURED_BOOT */
 
 #if defined(WOLFBOOT_TPM_VERIFY) || defined(WOLFBOOT_TPM_SEAL)
@@ -386,6 +519,11 @@ int wolfBoot_load_pubkey(const uint8_t* pubkey_hint, WOLFTPM2_KEY* pubKey,
     uint16_t hdrSz;
 
     *pAlg = TPM_ALG_NULL;
+#ifdef WOLFBOOT_TPM_INIT_ASYNC
+    rc = wolfBoot_tpm2_init_wait();
+    if (rc != 0)
+        return rc;
+#endif
 
     /* get public key */
     key_slot = keyslot_id_by_sha(pubkey_hint);
@@ -464,6 +602,11 @@ int wolfBoot_load_pubkey(const uint8_t* pubkey_hint, WOLFTPM2_KEY* pubKey,
 #ifdef WOLFBOOT_TPM_SEAL
 int wolfBoot_get_random(uint8_t* buf, int sz)
 {
+#ifdef WOLFBOOT_TPM_INIT_ASYNC
+    int rc = wolfBoot_tpm2_init_wait();
+    if (rc != 0)
+        return rc;
+#endif
     return wolfTPM2_GetRandom(&wolftpm_dev, buf, sz);
 }
 
@@ -925,6 +1068,11 @@ int wolfBoot_seal_auth(const uint8_t* pubkey_hint,
         return BAD_FUNC_ARG;
     if (authSz > (int)sizeof(seal_blob.handle.auth.buffer))
         return BAD_FUNC_ARG;
+#ifdef WOLFBOOT_TPM_INIT_ASYNC
+    rc = wolfBoot_tpm2_init_wait();
+    if (rc != 0)
+        return rc;
+#endif
 
     memset(&seal_blob, 0, sizeof(seal_blob));
 
@@ -1166,6 +1314,12 @@ int wolfBoot_unseal_auth(const uint8_t* pubkey_hint,
     int rc;
     WOLFTPM2_KEYBLOB seal_blob;
 
+#ifdef WOLFBOOT_TPM_INIT_ASYNC
+    rc = wolfBoot_tpm2_init_wait();
+    if (rc != 0)
+        return rc;
+#endif
+
     memset(&seal_blob, 0, sizeof(seal_blob));
 
     /* Do not use NV auth, since it cannot be encrypted on transport. The
@@ -1391,23 +1545,36 @@ int CSME_NSE_API wolfBoot_tpm2_quote(WOLFTPM2_KEY* aik,
 #endif /* WOLFTPM_MFG_IDENTITY */
 
 
+/* TPM bring-up steps, run one at a time by wolfBoot_tpm2_init_poll() */
+enum tpm2_init_step {
+    TPM2_INIT_IDLE = 0,
+    TPM2_INIT_DEV,      /* TIS init, TPM2_Startup */
+    TPM2_INIT_CAPS,     /* Capabilities */
+    TPM2_INIT_SRK,      /* Primary storage key */
+    TPM2_INIT_SESSION,  /* Parameter encryption session */
+    TPM2_INIT_MEASURE,  /* Self-measurement */
+    TPM2_INIT_DONE
+};
+static int tpm2_init_step = TPM2_INIT_IDLE;
+static int tpm2_init_rc;
+static int tpm2_init_busy; /* a step is running */
+#ifdef BOOT_BENCHMARK
+static uint64_t tpm2_init_us;
+#endif
+
 /**
- * @brief Initialize the TPM2 device and retrieve its capabilities.
+ * @brief Start the initialization of the TPM2 device.
  *
- * This function initializes the TPM2 device and retrieves its capabilities.
+ * Sets up the SPI bus, the following steps are run by
+ * wolfBoot_tpm2_init_poll(). Calling it again once started has no effect,
+ * so targets can start the bring-up early from hal_init().
  *
- * @return 0 on success, an error code on failure.
+ * @return None.
  */
-int wolfBoot_tpm2_init(void)
+void wolfBoot_tpm2_init_start(void)
 {
-    int rc;
-    WOLFTPM2_CAPS caps;
-#if defined(WOLFBOOT_TPM_KEYSTORE) || defined(WOLFBOOT_TPM_SEAL)
-    TPM_ALG_ID alg;
-#endif
-#ifdef WOLFBOOT_MEASURED_BOOT
-    uint8_t digest[WOLFBOOT_SHA_DIGEST_SIZE];
-#endif
+    if (tpm2_init_step != TPM2_INIT_IDLE)
+        return;
 
 #if !defined(ARCH_SIM) && !defined(WOLFTPM_MMIO)
     spi_init(0,0);
@@ -1417,32 +1584,70 @@ int wolfBoot_tpm2_init(void)
     memset(&wolftpm_session, 0, sizeof(wolftpm_session));
     memset(&wolftpm_srk, 0, sizeof(wolftpm_srk));
 #endif
+    tpm2_init_rc = 0;
+    tpm2_init_step = TPM2_INIT_DEV;
+}
 
-    /* Init the TPM2 device */
-    /* simulator should use the network connection, not spi */
-#if defined(ARCH_SIM) || defined(WOLFTPM_MMIO)
-    rc = wolfTPM2_Init(&wolftpm_dev, NULL, NULL);
-#else
-    rc = wolfTPM2_Init(&wolftpm_dev, TPM2_IoCb, NULL);
+/**
+ * @brief Run the next step of the TPM2 initialization.
+ *
+ * Each step is one wolfTPM call, and blocks until the TPM replies to it.
+ * With WOLFBOOT_TPM_INIT_ASYNC the steps are interleaved with the image
+ * hash, see get_hash_chunk() in image.c.
+ *
+ * @return 1 while the initialization is in progress, then 0 on success or
+ * an error code on failure.
+ */
+int wolfBoot_tpm2_init_poll(void)
+{
+    int rc = 0;
+    WOLFTPM2_CAPS caps;
+#if defined(WOLFBOOT_TPM_KEYSTORE) || defined(WOLFBOOT_TPM_SEAL)
+    TPM_ALG_ID alg;
+#endif
+#if defined(WOLFBOOT_MEASURED_BOOT) && defined(SELF_HASH_ADDR)
+    uint8_t digest[WOLFBOOT_SHA_DIGEST_SIZE];
+#endif
+#ifdef BOOT_BENCHMARK
+    uint64_t start;
+#endif
+
+    if (tpm2_init_step == TPM2_INIT_IDLE)
+        return -1;
+    if (tpm2_init_step == TPM2_INIT_DONE)
+        return tpm2_init_rc;
+    if (tpm2_init_busy)
+        return 1;
+#ifdef BOOT_BENCHMARK
+    start = hal_get_timer_us();
 #endif
-    if (rc == 0)  {
-        /* Get device capabilities + options */
-        rc = wolfTPM2_GetCapabilities(&wolftpm_dev, &caps);
-    }
-    if (rc == 0) {
-        wolfBoot_printf("Mfg %s (%d), Vendor %s, Fw %u.%u (0x%x), "
-            "FIPS 140-2 %d, CC-EAL4 %d\n",
-            caps.mfgStr, caps.mfg, caps.vendorStr, caps.fwVerMajor,
-            caps.fwVerMinor, caps.fwVerVendor, caps.fips140_2, caps.cc_eal4);
-    }
 
+    tpm2_init_busy = 1;
+    switch (tpm2_init_step) {
+    case TPM2_INIT_DEV:
+        /* Init the TPM2 device */
+        /* simulator should use the network connection, not spi */
+    #if defined(ARCH_SIM) || defined(WOLFTPM_MMIO)
+        rc = wolfTPM2_Init(&wolftpm_dev, NULL, NULL);
+    #else
+        rc = wolfTPM2_Init(&wolftpm_dev, TPM2_IoCb, NULL);
+    #endif
+        break;
 
-    if (rc != 0) {
-        wolfBoot_printf("TPM Init failed! %d\n", rc);
-    }
+    case TPM2_INIT_CAPS:
+        /* Get device capabilities + options */
+        rc = wolfTPM2_GetCapabilities(&wolftpm_dev, &caps);
+        if (rc == 0) {
+            wolfBoot_printf("Mfg %s (%d), Vendor %s, Fw %u.%u (0x%x), "
+                "FIPS 140-2 %d, CC-EAL4 %d\n",
+                caps.mfgStr, caps.mfg, caps.vendorStr, caps.fwVerMajor,
+                caps.fwVerMinor, caps.fwVerVendor, caps.fips140_2,
+                caps.cc_eal4);
+        }
+        break;
 
 #if defined(WOLFBOOT_TPM_KEYSTORE) || defined(WOLFBOOT_TPM_SEAL)
-    if (rc == 0) {
+    case TPM2_INIT_SRK:
     #ifdef WC_RNG_SEED_CB
         /* setup callback for RNG seed to use TPM */
         wc_SetSeed_Cb(wolfRNG_GetSeedCB);
@@ -1458,32 +1663,111 @@ int wolfBoot_tpm2_init(void)
         alg = TPM_ALG_NULL;
     #endif
         rc = wolfTPM2_CreateSRK(&wolftpm_dev, &wolftpm_srk, alg, NULL, 0);
-        if (rc == 0) {
-            /* Setup a TPM session that can be used for parameter encryption */
-            rc = wolfTPM2_StartSession(&wolftpm_dev, &wolftpm_session,
-                &wolftpm_srk, NULL, TPM_SE_HMAC, TPM_ALG_CFB);
+        if (rc != 0) {
+            wolfBoot_printf("TPM Create SRK error %d (%s)!\n",
+                rc, wolfTPM2_GetRCString(rc));
         }
+        break;
+
+    case TPM2_INIT_SESSION:
+        /* Setup a TPM session that can be used for parameter encryption */
+        rc = wolfTPM2_StartSession(&wolftpm_dev, &wolftpm_session,
+            &wolftpm_srk, NULL, TPM_SE_HMAC, TPM_ALG_CFB);
         if (rc != 0) {
-            wolfBoot_printf("TPM Create SRK or Session error %d (%s)!\n",
+            wolfBoot_printf("TPM Session error %d (%s)!\n",
                 rc, wolfTPM2_GetRCString(rc));
         }
-    }
+        break;
 #endif /* WOLFBOOT_TPM_KEYSTORE | WOLFBOOT_TPM_SEAL */
 
 #if defined(WOLFBOOT_MEASURED_BOOT) && defined(SELF_HASH_ADDR)
-    /* measured boot: hash wolfBoot code (or boot partition if
-     * WOLFBOOT_MEASURED_BOOT_APP_PARTITION) and extend PCR */
-    if (rc == 0) {
+    case TPM2_INIT_MEASURE:
+        /* measured boot: hash wolfBoot code and extend PCR */
+    #ifdef WOLFBOOT_MEASURED_BOOT_SELF_CACHE
+        rc = self_hash_cached(digest);
+    #else
         rc = self_hash(digest);
+    #endif
         if (rc == 0) {
             rc = measure_boot(digest);
         }
         if (rc != 0) {
             wolfBoot_printf("Error %d performing wolfBoot measurement!\n", rc);
         }
-    }
+        break;
 #endif /* WOLFBOOT_MEASURED_BOOT && SELF_HASH_ADDR */
 
+    default:
+        break;
+    }
+    tpm2_init_busy = 0;
+
+#ifdef BOOT_BENCHMARK
+    tpm2_init_us += hal_get_timer_us() - start;
+#endif
+    if (rc != 0) {
+        if (tpm2_init_step <= TPM2_INIT_CAPS)
+            wolfBoot_printf("TPM Init failed! %d\n", rc);
+        tpm2_init_rc = rc;
+        tpm2_init_step = TPM2_INIT_DONE;
+    }
+    else {
+        tpm2_init_step++;
+    }
+    if (tpm2_init_step != TPM2_INIT_DONE)
+        return 1;
+#ifdef BOOT_BENCHMARK
+    wolfBoot_printf("TPM init (%lu ms)\r\n",
+        (unsigned long)(tpm2_init_us / 1000));
+#endif
+    return tpm2_init_rc;
+}
+
+/**
+ * @brief Complete the initialization of the TPM2 device.
+ *
+ * Runs the steps not done yet by wolfBoot_tpm2_init_poll(). Called before
+ * the TPM is used, and before booting the image.
+ *
+ * @return 0 on success, an error code on failure, -1 if the initialization
+ * was not started.
+ */
+int wolfBoot_tpm2_init_wait(void)
+{
+    int rc;
+    BENCHMARK_DECLARE();
+
+    /* the steps themselves use the TPM */
+    if (tpm2_init_busy)
+        return 0;
+    if ((tpm2_init_step == TPM2_INIT_IDLE) ||
+            (tpm2_init_step == TPM2_INIT_DONE))
+        return wolfBoot_tpm2_init_poll();
+    wolfBoot_printf("Waiting for TPM...");
+    BENCHMARK_START();
+    do {
+        rc = wolfBoot_tpm2_init_poll();
+    } while (rc == 1);
+    BENCHMARK_END("done");
+    return rc;
+}
+
+/**
+ * @brief Initialize the TPM2 device and retrieve its capabilities.
+ *
+ * This function initializes the TPM2 device and retrieves its capabilities,
+ * running all the steps of wolfBoot_tpm2_init_poll() in a row.
+ *
+ * @return 0 on success, an error code on failure.
+ */
+int wolfBoot_tpm2_init(void)
+{
+    int rc;
+
+    wolfBoot_tpm2_init_start();
+    do {
+        rc = wolfBoot_tpm2_init_poll();
+    } while (rc == 1);
     return rc;
 }
 
@@ -1496,6 +1780,9 @@ int wolfBoot_tpm2_init(void)
  */
 void wolfBoot_tpm2_deinit(void)
 {
+#ifdef WOLFBOOT_TPM_INIT_ASYNC
+    (void)wolfBoot_tpm2_init_wait();
+#endif
 #ifdef WOLFBOOT_TPM_KEYSTORE
     #if !defined(ARCH_SIM) && !defined(WOLFBOOT_TPM_NO_CHG_PLAT_AUTH)
     /* Enable parameter encryption for session */
@@ -1543,6 +1830,12 @@ int wolfBoot_check_rot(int key_slot, uint8_t* pubkey_hint)
     uint32_t digestSz = WOLFBOOT_SHA_DIGEST_SIZE;
     WOLFTPM2_NV nv;
 
+#ifdef WOLFBOOT_TPM_INIT_ASYNC
+    rc = wolfBoot_tpm2_init_wait();
+    if (rc != 0)
+        return rc;
+#endif
+
     memset(&nv, 0, sizeof(nv));
     nv.handle.hndl = WOLFBOOT_TPM_KEYSTORE_NV_BASE + key_slot;
 #ifdef WOLFBOOT_TPM_KEYSTORE_AUTH
@@ -31,21 +31,23 @@
 
 #include "wolfboot/wolfboot.h"
 #include "hal.h"
+#include "uart_flash.h"
 #include <stdint.h>
 #include <string.h>
 
-#define CMD_HDR_WOLF  'W'
-#define CMD_HDR_WRITE 0x01
-#define CMD_HDR_READ  0x02
-#define CMD_HDR_ERASE 0x03
-#define CMD_ACK       0x06
-
 #define WAIT_CYCLES 500000
 #define ERASE_TIMEOUT 5
 #define READ_TIMEOUT 1
+#define UART_FLASH_RETRIES 8
+
+#define UART_RX_TIMEOUT   (-1)
+#define UART_RX_BAD_FRAME (-2)
 
-int uart_tx(const uint8_t c);
-int uart_rx(uint8_t *c);
+/* Protocol in use, detected on first access. Servers that do not know
+ * CMD_HDR_HELLO do not answer it, and are accessed with protocol v1. */
+static int uart_proto = 0;
+/* Sequence number of the next v2 command frame */
+static uint8_t uart_seq = 0;
 
 static int wait_ack(void)
 {
@@ -58,10 +60,10 @@ static int wait_ack(void)
     return -1;
 }
 
-static int uart_rx_timeout(uint8_t *c)
+static int uart_rx_timeout(uint8_t *c, int timeout)
 {
     volatile int count = 0;
-    while(++count < (WAIT_CYCLES * READ_TIMEOUT)) {
+    while(++count < (WAIT_CYCLES * timeout)) {
         if (uart_rx(c) == 1) /* Success */
            return 0;
     }
@@ -69,8 +71,217 @@ static int uart_rx_timeout(uint8_t *c)
     return -1;
 }
 
+static void uart_flash_put_u32(uint8_t *p, uint32_t w)
+{
+    p[0] = w & 0xFF;
+    p[1] = (w >> 8) & 0xFF;
+    p[2] = (w >> 16) & 0xFF;
+    p[3] = (w >> 24) & 0xFF;
+}
 
-int  ext_flash_write(uintptr_t address, const uint8_t *data, int len)
+static int uart_flash_probe(void)
+{
+    uint8_t ver;
+    uart_tx(CMD_HDR_WOLF);
+    if (wait_ack() != 0)
+        return -1;
+    uart_tx(CMD_HDR_HELLO);
+    if ((wait_ack() == 0) && (uart_rx_timeout(&ver, READ_TIMEOUT) == 0) &&
+            (ver >= UART_FLASH_PROTO_V2))
+        uart_proto = UART_FLASH_PROTO_V2;
+    else
+        uart_proto = UART_FLASH_PROTO_V1;
+    return 0;
+}
+
+static void uart_tx_frame(uint8_t type, uint8_t seq, const uint8_t *payload,
+    uint16_t len)
+{
+    uint8_t hdr[UART_FLASH_FRAME_HDR_SIZE];
+    uint16_t crc;
+    int i;
+
+    hdr[0] = type;
+    hdr[1] = seq;
+    hdr[2] = len & 0xFF;
+    hdr[3] = (len >> 8) & 0xFF;
+    crc = uart_flash_crc16(UART_FLASH_CRC_INIT, hdr, sizeof(hdr));
+    crc = uart_flash_crc16(crc, payload, len);
+    uart_tx(UART_FLASH_SOF);
+    for (i = 0; i < UART_FLASH_FRAME_HDR_SIZE; i++)
+        uart_tx(hdr[i]);
+    for (i = 0; i < len; i++)
+        uart_tx(payload[i]);
+    uart_tx(crc & 0xFF);
+    uart_tx((crc >> 8) & 0xFF);
+}
+
+/* Receive one frame. The payload is stored in 'buf', and must fit in 'max'
+ * bytes. Returns the payload length, UART_RX_TIMEOUT or UART_RX_BAD_FRAME.
+ */
+static int uart_rx_frame(uint8_t *type, uint8_t *seq, uint8_t *buf,
+    uint16_t max, int timeout)
+{
+    uint8_t hdr[UART_FLASH_FRAME_HDR_SIZE];
+    uint8_t c[2];
+    uint16_t len, crc;
+    int i;
+
+    do {
+        if (uart_rx_timeout(&c[0], timeout) != 0)
+            return UART_RX_TIMEOUT;
+    } while (c[0] != UART_FLASH_SOF);
+    for (i = 0; i < UART_FLASH_FRAME_HDR_SIZE; i++) {
+        if (uart_rx_timeout(&hdr[i], READ_TIMEOUT) != 0)
+            return UART_RX_TIMEOUT;
+    }
+    len = hdr[2] | (hdr[3] << 8);
+    if (len > max)
+        return UART_RX_BAD_FRAME;
+    for (i = 0; i < len; i++) {
+        if (uart_rx_timeout(&buf[i], READ_TIMEOUT) != 0)
+            return UART_RX_TIMEOUT;
+    }
+    for (i = 0; i < 2; i++) {
+        if (uart_rx_timeout(&c[i], READ_TIMEOUT) != 0)
+            return UART_RX_TIMEOUT;
+    }
+    crc = uart_flash_crc16(UART_FLASH_CRC_INIT, hdr, sizeof(hdr));
+    crc = uart_flash_crc16(crc, buf, len);
+    if (crc != (c[0] | (c[1] << 8)))
+        return UART_RX_BAD_FRAME;
+    *type = hdr[0];
+    *seq = hdr[1];
+    return len;
+}
+
+/* Send the command frame (index 0) and the data frames (index 1..n-1) of a
+ * write, keeping up to UART_FLASH_WINDOW frames in flight */
+static int uart_v2_write(uintptr_t address, const uint8_t *data, int len)
+{
+    uint8_t cmd[UART_FLASH_CMD_SIZE];
+    uint32_t n_frames = 1 + (len + UART_FLASH_FRAME_MAX - 1) /
+        UART_FLASH_FRAME_MAX;
+    uint32_t base = 0, next = 0, idx, off, sz;
+    int retries = 0;
+    uint8_t s0 = uart_seq, type, seq;
+    int ret;
+
+    uart_seq = (uint8_t)(s0 + n_frames);
+    uart_flash_put_u32(cmd, address);
+    uart_flash_put_u32(cmd + 4, len);
+    while (base < n_frames) {
+        while ((next < n_frames) && (next - base < UART_FLASH_WINDOW)) {
+            if (next == 0) {
+                uart_tx_frame(UART_FLASH_FRAME_WRITE, s0, cmd, sizeof(cmd));
+            } else {
+                off = (next - 1) * UART_FLASH_FRAME_MAX;
+                sz = len - off;
+                if (sz > UART_FLASH_FRAME_MAX)
+                    sz = UART_FLASH_FRAME_MAX;
+                uart_tx_frame(UART_FLASH_FRAME_DATA, (uint8_t)(s0 + next),
+                    data + off, sz);
+            }
+            next++;
+        }
+        ret = uart_rx_frame(&type, &seq, NULL, 0, READ_TIMEOUT);
+        if (ret == UART_RX_TIMEOUT) {
+            if (++retries > UART_FLASH_RETRIES)
+                return -1;
+            next = base;
+            continue;
+        }
+        if (ret < 0)
+            continue; /* Corrupted answer: wait for the next one */
+        if (type == UART_FLASH_FRAME_ERR)
+            return -1;
+        idx = base + (uint8_t)(seq - s0 - base);
+        if (idx > next)
+            continue;
+        if (type == UART_FLASH_FRAME_ACK) {
+            base = idx;
+            retries = 0;
+        } else if (type == UART_FLASH_FRAME_NAK) {
+            base = idx;
+            next = idx;
+        }
+    }
+    return len;
+}
+
+static int uart_v2_read(uintptr_t address, uint8_t *data, int len)
+{
+    uint8_t cmd[UART_FLASH_CMD_SIZE];
+    uint32_t n_frames = 1 + (len + UART_FLASH_FRAME_MAX - 1) /
+        UART_FLASH_FRAME_MAX;
+    uint32_t expected = 1, off, sz;
+    int retries = 0, nak_sent = 0;
+    uint8_t s0 = uart_seq, cur, type, seq;
+    int ret;
+
+    uart_seq = (uint8_t)(s0 + n_frames);
+    uart_flash_put_u32(cmd, address);
+    uart_flash_put_u32(cmd + 4, len);
+    uart_tx_frame(UART_FLASH_FRAME_READ, s0, cmd, sizeof(cmd));
+    while (expected < n_frames) {
+        cur = (uint8_t)(s0 + expected);
+        off = (expected - 1) * UART_FLASH_FRAME_MAX;
+        sz = len - off;
+        if (sz > UART_FLASH_FRAME_MAX)
+            sz = UART_FLASH_FRAME_MAX;
+        ret = uart_rx_frame(&type, &seq, data + off, sz, READ_TIMEOUT);
+        if (ret == UART_RX_TIMEOUT) {
+            if (++retries > UART_FLASH_RETRIES)
+                return -1;
+            if (expected == 1)
+                uart_tx_frame(UART_FLASH_FRAME_READ, s0, cmd, sizeof(cmd));
+            else
+                uart_tx_frame(UART_FLASH_FRAME_NAK, cur, NULL, 0);
+            continue;
+        }
+        if ((ret >= 0) && (type == UART_FLASH_FRAME_ERR))
+            return -1;
+        if ((ret == (int)sz) && (type == UART_FLASH_FRAME_DATA) &&
+                (seq == cur)) {
+            expected++;
+            retries = 0;
+            nak_sent = 0;
+            uart_tx_frame(UART_FLASH_FRAME_ACK, (uint8_t)(cur + 1), NULL, 0);
+        } else if ((ret >= 0) && (seq != cur) &&
+                ((uint8_t)(cur - seq) <= UART_FLASH_WINDOW)) {
+            /* Retransmitted frame: repeat the last ack */
+            uart_tx_frame(UART_FLASH_FRAME_ACK, cur, NULL, 0);
+        } else if (!nak_sent) {
+            uart_tx_frame(UART_FLASH_FRAME_NAK, cur, NULL, 0);
+            nak_sent = 1;
+        }
+    }
+    return len;
+}
+
+static int uart_v2_erase(uintptr_t address, int len)
+{
+    uint8_t cmd[UART_FLASH_CMD_SIZE];
+    uint8_t s0 = uart_seq, type, seq;
+    int retries, ret;
+
+    uart_seq = (uint8_t)(s0 + 1);
+    uart_flash_put_u32(cmd, address);
+    uart_flash_put_u32(cmd + 4, len);
+    for (retries = 0; retries <= UART_FLASH_RETRIES; retries++) {
+        uart_tx_frame(UART_FLASH_FRAME_ERASE, s0, cmd, sizeof(cmd));
+        ret = uart_rx_frame(&type, &seq, NULL, 0, ERASE_TIMEOUT);
+        if (ret < 0)
+            continue;
+        if ((type == UART_FLASH_FRAME_ACK) && (seq == uart_seq))
+            return 0;
+        if (type == UART_FLASH_FRAME_ERR)
+            return -1;
+    }
+    return -1;
+}
+
+static int uart_v1_write(uintptr_t address, const uint8_t *data, int len)
 {
     int i;
     uint8_t cmd[10];
@@ -97,7 +308,7 @@ int  ext_flash_write(uintptr_t address, const uint8_t *data, int len)
     return len;
 }
 
-int  ext_flash_read(uintptr_t address, uint8_t *data, int len)
+static int uart_v1_read(uintptr_t address, uint8_t *data, int len)
 {
     int i;
     uint8_t cmd[10];
@@ -117,14 +328,14 @@ int  ext_flash_read(uintptr_t address, uint8_t *data, int len)
             return -1;
     }
     for (i = 0; i < len; i++) {
-        if (uart_rx_timeout(&data[i]) != 0)
+        if (uart_rx_timeout(&data[i], READ_TIMEOUT) != 0)
             return 0;
         uart_tx(CMD_ACK);
     }
     return i;
 }
 
-int  ext_flash_erase(uintptr_t address, int len)
+static int uart_v1_erase(uintptr_t address, int len)
 {
     int i;
     uint8_t cmd[10];
@@ -149,6 +360,33 @@ int  ext_flash_erase(uintptr_t address, int len)
     return -1;
 }
 
+int  ext_flash_write(uintptr_t address, const uint8_t *data, int len)
+{
+    if ((uart_proto == 0) && (uart_flash_probe() != 0))
+        return -1;
+    if (uart_proto == UART_FLASH_PROTO_V2)
+        return uart_v2_write(address, data, len);
+    return uart_v1_write(address, data, len);
+}
+
+int  ext_flash_read(uintptr_t address, uint8_t *data, int len)
+{
+    if ((uart_proto == 0) && (uart_flash_probe() != 0))
+        return -1;
+    if (uart_proto == UART_FLASH_PROTO_V2)
+        return uart_v2_read(address, data, len);
+    return uart_v1_read(address, data, len);
+}
+
+int  ext_flash_erase(uintptr_t address, int len)
+{
+    if ((uart_proto == 0) && (uart_flash_probe() != 0))
+        return -1;
+    if (uart_proto == UART_FLASH_PROTO_V2)
+        return uart_v2_erase(address, len);
+    return uart_v1_erase(address, len);
+}
+
 void ext_flash_lock(void)
 {
     wait_ack();
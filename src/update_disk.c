@@ -47,6 +47,12 @@
 #ifdef WOLFBOOT_ELF
 #include "elf.h"
 #endif
+#ifdef WOLFBOOT_LZ4
+#include "lz4.h"
+#endif
+#ifdef WOLFBOOT_TPM
+#include "tpm.h"
+#endif
 
 /* Disk encryption support for AES-256, AES-128, or ChaCha20 */
 #if defined(ENCRYPT_WITH_AES256) || defined(ENCRYPT_WITH_AES128) || \
@@ -94,6 +100,33 @@ static uint8_t disk_encrypt_nonce[ENCRYPT_NONCE_SIZE];
 #define DISK_BLOCK_SIZE 512
 #endif
 
+/* Time spent in each stage of the streaming loader */
+#ifdef BOOT_BENCHMARK
+    #define LOAD_BENCH_DECLARE() \
+        uint64_t _t_lap, _t_read, _t_decrypt, _t_hash, _t_inflate
+    #define LOAD_BENCH_START() do { \
+        _t_read = _t_decrypt = _t_hash = _t_inflate = 0; \
+        _t_lap = hal_get_timer_us(); \
+    } while(0)
+    #define LOAD_BENCH_LAP(stage) do { \
+        uint64_t _t_now = hal_get_timer_us(); \
+        _t_##stage += _t_now - _t_lap; \
+        _t_lap = _t_now; \
+    } while(0)
+    #define LOAD_BENCH_REPORT() \
+        wolfBoot_printf("Read %lu ms, decrypt %lu ms, hash %lu ms, " \
+            "inflate %lu ms\r\n", \
+            (unsigned long)(_t_read / 1000), \
+            (unsigned long)(_t_decrypt / 1000), \
+            (unsigned long)(_t_hash / 1000), \
+            (unsigned long)(_t_inflate / 1000))
+#else
+    #define LOAD_BENCH_DECLARE() do {} while(0)
+    #define LOAD_BENCH_START() do {} while(0)
+    #define LOAD_BENCH_LAP(stage) do {} while(0)
+    #define LOAD_BENCH_REPORT() do {} while(0)
+#endif
+
 #ifdef DISK_ENCRYPT
 
 /* Module-level storage for encryption key */
@@ -228,6 +261,11 @@ static void disk_decrypted_header_clear(uint8_t *hdr)
 
 #endif /* DISK_ENCRYPT */
 
+#ifdef WOLFBOOT_LZ4
+/* A compressed payload is read here, then inflated to the load address */
+static uint8_t lz4_chunk[DISK_BLOCK_SIZE] XALIGNED(16);
+#endif
+
 extern int wolfBoot_get_dts_size(void *dts_addr);
 
 #if defined(WOLFBOOT_NO_LOAD_ADDRESS) || !defined(WOLFBOOT_LOAD_ADDRESS)
@@ -259,7 +297,13 @@ void RAMFUNCTION wolfBoot_start(void)
     uint32_t *load_address;
     int failures = 0;
     uint32_t load_off;
+    uint32_t load_size;
     const uint8_t *hdr_ptr = NULL;
+#ifdef WOLFBOOT_LZ4
+    struct lz4_stream lz4;
+    uint32_t raw_size = 0;
+    int compressed = 0;
+#endif
 #ifdef MMU
     uint8_t *dts_addr = NULL;
     #ifdef WOLFBOOT_FDT
@@ -268,6 +312,7 @@ void RAMFUNCTION wolfBoot_start(void)
 #endif
     char part_name[4] = {'P', ':', 'X', '\0'};
     BENCHMARK_DECLARE();
+    LOAD_BENCH_DECLARE();
 
 #ifdef DISK_ENCRYPT
     /* Initialize encryption - this sets up the cipher with key from storage */
@@ -399,34 +444,89 @@ void RAMFUNCTION wolfBoot_start(void)
             selected ^= 1;
             continue;
         }
+        load_size = os_image.fw_size;
+#ifdef WOLFBOOT_LZ4
+        compressed = wolfBoot_image_compressed(&os_image, &raw_size);
+        if ((compressed < 0) ||
+                (compressed && (raw_size > WOLFBOOT_LZ4_MAX_SIZE))) {
+            wolfBoot_printf("Error parsing loaded image\r\n");
+            selected ^= 1;
+            continue;
+        }
+        if (compressed) {
+            load_size = raw_size;
+            lz4_stream_init(&lz4, (uint8_t *)load_address, raw_size);
+        }
+#endif
 
 #ifdef WOLFBOOT_FSP
         /* Verify image size fits in low memory */
-        if (os_image.fw_size > ((uint32_t)(stage2_params->tolum) -
+        if (load_size > ((uint32_t)(stage2_params->tolum) -
                                            (uint32_t)(uintptr_t)load_address)) {
             wolfBoot_printf("Image size %d doesn't fit in low memory\r\n",
-                os_image.fw_size);
+                load_size);
             break;
         }
         /* Log memory load */
         x86_log_memory_load((uint32_t)(uintptr_t)load_address,
-                            (uint32_t)(uintptr_t)load_address + os_image.fw_size,
+                            (uint32_t)(uintptr_t)load_address + load_size,
                             part_name);
 #endif
 
-        /* Read the payload into RAM (skip header) */
+#ifdef DISK_ENCRYPT
+        if ((IMAGE_HEADER_SIZE % ENCRYPT_BLOCK_SIZE) != 0) {
+            disk_decrypted_header_clear(dec_hdr);
+            disk_crypto_clear();
+            wolfBoot_printf("Encrypted disk images require aligned header size\r\n");
+            wolfBoot_panic();
+        }
+        disk_crypto_set_iv(IMAGE_HEADER_SIZE / ENCRYPT_BLOCK_SIZE);
+#endif
+#ifndef WOLFBOOT_SKIP_BOOT_VERIFY
+        if (wolfBoot_hash_stream_init(&os_image) != 0) {
+            wolfBoot_printf("Error parsing image header\r\n");
+            selected ^= 1;
+            continue;
+        }
+#endif
+
+        /* Read the payload into RAM (skip header). Each chunk is decrypted
+         * and hashed right after being read, while it is still in the cache,
+         * instead of walking the whole image again for each step. A
+         * compressed payload is inflated to the load address as it goes. */
         wolfBoot_printf("Loading image from disk...");
         BENCHMARK_START();
+        LOAD_BENCH_START();
         load_off = 0;
         do {
+            uint8_t *chunk_ptr = ((uint8_t *)load_address) + load_off;
             uint32_t chunk = os_image.fw_size - load_off;
+#ifdef WOLFBOOT_LZ4
+            if (compressed)
+                chunk_ptr = lz4_chunk;
+#endif
             if (chunk > DISK_BLOCK_SIZE)
                 chunk = DISK_BLOCK_SIZE;
             ret = disk_part_read(BOOT_DISK, cur_part,
-                IMAGE_HEADER_SIZE + load_off, chunk,
-                ((uint8_t *)load_address) + load_off);
+                IMAGE_HEADER_SIZE + load_off, chunk, chunk_ptr);
+            LOAD_BENCH_LAP(read);
             if (ret <= 0)
                 break;
+#ifdef DISK_ENCRYPT
+            crypto_decrypt(chunk_ptr, chunk_ptr, (uint32_t)ret);
+            LOAD_BENCH_LAP(decrypt);
+#endif
+#ifndef WOLFBOOT_SKIP_BOOT_VERIFY
+            wolfBoot_hash_stream_update(chunk_ptr, (uint32_t)ret);
+            LOAD_BENCH_LAP(hash);
+#endif
+#ifdef WOLFBOOT_LZ4
+            /* On error, the check of the stream below fails */
+            if (compressed &&
+                    (lz4_stream_update(&lz4, chunk_ptr, (uint32_t)ret) != 0))
+                break;
+            LOAD_BENCH_LAP(inflate);
+#endif
             load_off += ret;
         } while (load_off < os_image.fw_size);
 
@@ -436,22 +536,23 @@ void RAMFUNCTION wolfBoot_start(void)
             selected ^= 1;
             continue;
         }
-        BENCHMARK_END("done");
-
-#ifdef DISK_ENCRYPT
-        /* Decrypt the payload in RAM */
-        wolfBoot_printf("Decrypting image...");
-        BENCHMARK_START();
-        if ((IMAGE_HEADER_SIZE % ENCRYPT_BLOCK_SIZE) != 0) {
-            disk_decrypted_header_clear(dec_hdr);
-            disk_crypto_clear();
-            wolfBoot_printf("Encrypted disk images require aligned header size\r\n");
-            wolfBoot_panic();
+#ifdef WOLFBOOT_LZ4
+        if (compressed && (lz4_stream_final(&lz4) != (int)raw_size)) {
+            wolfBoot_printf("Error decompressing image from %s\r\n",
+                    part_name);
+            selected ^= 1;
+            continue;
         }
-        disk_crypto_set_iv(IMAGE_HEADER_SIZE / ENCRYPT_BLOCK_SIZE);
-        crypto_decrypt((uint8_t*)load_address, (uint8_t*)load_address,
-            os_image.fw_size);
+#endif
         BENCHMARK_END("done");
+        LOAD_BENCH_REPORT();
+#if defined(BOOT_BENCHMARK) && defined(WOLFBOOT_DISK_CACHE)
+        {
+            struct disk_cache_stats cs;
+            disk_cache_get_stats(&cs);
+            wolfBoot_printf("Disk cache: %u hits, %u misses, %u read ahead, "
+                "%u direct\r\n", cs.hits, cs.misses, cs.prefetched, cs.direct);
+        }
 #endif
 
         memset(&os_image, 0, sizeof(os_image));
@@ -466,7 +567,7 @@ void RAMFUNCTION wolfBoot_start(void)
 #ifndef WOLFBOOT_SKIP_BOOT_VERIFY
         wolfBoot_printf("Checking image integrity...");
         BENCHMARK_START();
-        if (wolfBoot_verify_integrity(&os_image) != 0) {
+        if (wolfBoot_verify_integrity_stream(&os_image) != 0) {
             wolfBoot_printf("Error validating integrity for %s\r\n", part_name);
             selected ^= 1;
             continue;
@@ -482,6 +583,9 @@ void RAMFUNCTION wolfBoot_start(void)
             continue;
         } else {
             BENCHMARK_END("done");
+        #ifdef WOLFBOOT_MEASURED_BOOT_APP_PARTITION
+            (void)measure_image(&os_image);
+        #endif
             failures = 0;
             break; /* Success case */
         }
@@ -505,6 +609,7 @@ void RAMFUNCTION wolfBoot_start(void)
     wolfBoot_printf("Firmware Valid.\r\n");
 
     load_address = (uint32_t*)os_image.fw_base;
+    os_image.fw_size = load_size;
 
 #ifdef WOLFBOOT_FDT
     /* Is this a Flattened uImage Tree (FIT) image (FDT format) */
@@ -541,6 +646,11 @@ void RAMFUNCTION wolfBoot_start(void)
     }
 #endif
 
+#ifdef WOLFBOOT_TPM_INIT_ASYNC
+    /* finish the TPM bring-up, if hashing the image did not */
+    (void)wolfBoot_tpm2_init_wait();
+#endif
+
     wolfBoot_printf("Booting at %08lx\r\n", load_address);
 
 #ifdef WOLFBOOT_ENABLE_WOLFHSM_CLIENT
@@ -60,6 +60,10 @@ static void wolfBoot_zeroize(void *ptr, size_t len)
 #error "MMU is not yet supported for update_flash.c, please consider update_ram.c instead"
 #endif
 
+#ifdef WOLFBOOT_LZ4
+#error "LZ4 compressed images are not supported by update_flash.c, please consider update_ram.c instead"
+#endif
+
 #ifdef __CCRX__
 #pragma section FRAM
 #endif
@@ -233,6 +237,68 @@ void RAMFUNCTION wolfBoot_check_self_update(void)
 }
 #endif /* RAM_CODE for self_update */
 
+static int erase_sync_ret = 0;
+
+/**
+ * @brief Start erasing internal flash. This default implementation erases
+ * synchronously; targets able to erase in the background override it
+ * together with hal_flash_erase_poll().
+ *
+ * @return 0 if the erase was started, -1 otherwise.
+ */
+int WEAKFUNCTION hal_flash_erase_start(haladdr_t address, int len)
+{
+    erase_sync_ret = hal_flash_erase(address, len);
+    return 0;
+}
+
+/**
+ * @brief Check the erase started by hal_flash_erase_start().
+ *
+ * @return 1 while the erase is in progress, otherwise its result.
+ */
+int WEAKFUNCTION hal_flash_erase_poll(void)
+{
+    return erase_sync_ret;
+}
+
+/* Erase scheduling: the destination sector is erased with wb_erase_start()
+ * before the data to be written is read, decrypted or patched, and
+ * wb_erase_wait() is called before the first write. With a background
+ * erase HAL, preparing the first chunk overlaps with the erase.
+ */
+static int erase_pending = 0;
+
+static int RAMFUNCTION wb_erase_wait(void)
+{
+    int ret = 0;
+    if (erase_pending) {
+        do {
+            ret = hal_flash_erase_poll();
+        } while (ret > 0);
+        erase_pending = 0;
+    }
+    return ret;
+}
+
+static int RAMFUNCTION wb_erase_start(struct wolfBoot_image *img, uint32_t off,
+    uint32_t size)
+{
+    int ret = wb_erase_wait();
+    if (ret < 0)
+        return ret;
+#ifdef EXT_FLASH
+    if (PART_IS_EXT(img))
+        return ext_flash_erase((uintptr_t)(img->hdr) + off, size);
+#endif
+    ret = hal_flash_erase_start((uintptr_t)(img->hdr) + off, size);
+    if (ret == 0)
+        erase_pending = 1;
+    else
+        ret = wb_flash_erase(img, off, size);
+    return ret;
+}
+
 static int RAMFUNCTION wolfBoot_copy_sector(struct wolfBoot_image *src,
     struct wolfBoot_image *dst, uint32_t sector)
 {
@@ -282,12 +348,26 @@ static int RAMFUNCTION wolfBoot_copy_sector(struct wolfBoot_image *src,
 #define BUFFER_DECLARED
         static uint8_t buffer[FLASHBUFFER_SIZE] XALIGNED(4);
 #endif
-        wb_flash_erase(dst, dst_sector_offset, WOLFBOOT_SECTOR_SIZE);
+        const uint8_t *mapped = NULL;
+#ifndef EXT_ENCRYPTED
+        /* Program internal flash straight from the memory-mapped source.
+         * Not when the destination is external too: writing it leaves
+         * memory-mapped mode. */
+        if (!PART_IS_EXT(dst)) {
+            mapped = ext_flash_mmap((uintptr_t)(src->hdr) + src_sector_offset,
+                WOLFBOOT_SECTOR_SIZE);
+        }
+#endif
+        wb_erase_start(dst, dst_sector_offset, WOLFBOOT_SECTOR_SIZE);
         while (pos < WOLFBOOT_SECTOR_SIZE)  {
           if (src_sector_offset + pos <
               (src->fw_size + IMAGE_HEADER_SIZE + FLASHBUFFER_SIZE)) {
+              const uint8_t *data = buffer;
+              if (mapped != NULL) {
+                  data = mapped + pos;
+              }
               /* bypass decryption, copy encrypted data into swap if its external */
-              if (dst->part == PART_SWAP && SWAP_EXT) {
+              else if (dst->part == PART_SWAP && SWAP_EXT) {
                   ext_flash_read((uintptr_t)(src->hdr) + src_sector_offset + pos,
                                  (void *)buffer, FLASHBUFFER_SIZE);
               } else {
@@ -296,11 +376,13 @@ static int RAMFUNCTION wolfBoot_copy_sector(struct wolfBoot_image *src,
                                      (void *)buffer, FLASHBUFFER_SIZE);
               }
 
-              wb_flash_write(dst, dst_sector_offset + pos, buffer,
+              wb_erase_wait();
+              wb_flash_write(dst, dst_sector_offset + pos, data,
                   FLASHBUFFER_SIZE);
             }
             pos += FLASHBUFFER_SIZE;
         }
+        wb_erase_wait();
         ret = pos;
         goto out;
     }
@@ -325,6 +407,79 @@ out:
     return ret;
 }
 
+#ifdef WOLFBOOT_SKIP_SAME_SECTORS
+#define SAME_SECTOR_CHUNK 64
+
+/* Returns a pointer to 'SAME_SECTOR_CHUNK' bytes at 'off' in the partition,
+ * read (and decrypted) into 'buf' for external partitions */
+static const uint8_t* RAMFUNCTION wolfBoot_sector_chunk(
+    struct wolfBoot_image *img, uint32_t off, uint8_t *buf)
+{
+#ifdef EXT_FLASH
+    if (PART_IS_EXT(img)) {
+        if (ext_flash_check_read((uintptr_t)(img->hdr) + off, buf,
+                SAME_SECTOR_CHUNK) < 0)
+            return NULL;
+        return buf;
+    }
+#endif
+    (void)buf;
+    return (const uint8_t *)img->hdr + off;
+}
+
+/* Returns 1 if the sector holds the same content in both partitions */
+static int RAMFUNCTION wolfBoot_sector_is_same(struct wolfBoot_image *a,
+    struct wolfBoot_image *b, uint32_t sector)
+{
+    uint8_t buf_a[SAME_SECTOR_CHUNK] XALIGNED(4);
+    uint8_t buf_b[SAME_SECTOR_CHUNK] XALIGNED(4);
+    uint32_t off = sector * WOLFBOOT_SECTOR_SIZE;
+    uint32_t pos;
+    const uint8_t *pa, *pb;
+
+    for (pos = 0; pos < WOLFBOOT_SECTOR_SIZE; pos += SAME_SECTOR_CHUNK) {
+        pa = wolfBoot_sector_chunk(a, off + pos, buf_a);
+        pb = wolfBoot_sector_chunk(b, off + pos, buf_b);
+        if ((pa == NULL) || (pb == NULL) ||
+                (memcmp(pa, pb, SAME_SECTOR_CHUNK) != 0))
+            return 0;
+    }
+    return 1;
+}
+
+#ifndef DISABLE_BACKUP
+/* Before a new swap starts, mark the sectors that are identical in BOOT and
+ * UPDATE, so that the swap leaves them alone. Marks are stored as sector
+ * flags: if power fails, the pass is simply run again. Sector 0 (manifest
+ * header) is never skipped, so that its flag keeps telling a fresh update
+ * from a swap in progress. */
+static void RAMFUNCTION wolfBoot_mark_same_sectors(struct wolfBoot_image *boot,
+    struct wolfBoot_image *update, uint32_t total_size)
+{
+    uint32_t sector;
+    uint8_t flag;
+    uint32_t same = 0;
+
+    for (sector = 1; (sector * WOLFBOOT_SECTOR_SIZE) < total_size; sector++) {
+        if (((sector + 1) * WOLFBOOT_SECTOR_SIZE) >= WOLFBOOT_PARTITION_SIZE)
+            break;
+        flag = SECT_FLAG_NEW;
+        wolfBoot_get_update_sector_flag(sector, &flag);
+        if (flag == SECT_FLAG_SAME) {
+            same++;
+            continue;
+        }
+        if ((flag == SECT_FLAG_NEW) &&
+                wolfBoot_sector_is_same(boot, update, sector)) {
+            wolfBoot_set_update_sector_flag(sector, SECT_FLAG_SAME);
+            same++;
+        }
+    }
+    wolfBoot_printf("%u sectors unchanged, skipped\n", same);
+}
+#endif /* !DISABLE_BACKUP */
+#endif /* WOLFBOOT_SKIP_SAME_SECTORS */
+
 #ifdef EXT_ENCRYPTED
 static int RAMFUNCTION wolfBoot_backup_last_boot_sector(uint32_t sector)
 {
@@ -426,11 +581,8 @@ static int RAMFUNCTION wolfBoot_swap_and_final_erase(int resume)
     struct wolfBoot_image update[1];
     struct wolfBoot_image swap[1];
     uint8_t updateState = IMG_STATE_NEW;
-    int eraseLen = (WOLFBOOT_SECTOR_SIZE
-#ifdef NVM_FLASH_WRITEONCE /* need to erase the redundant sector too */
-        * 2
-#endif
-    );
+    /* WRITEONCE keeps redundant trailer sectors, erase all of them */
+    int eraseLen = WOLFBOOT_SECTOR_SIZE * WOLFBOOT_TRAILER_SECTORS;
     int swapDone = 0;
     /* Calculate position of staging sector - just before the final sectors
      * that store partition state */
@@ -560,6 +712,15 @@ static int wolfBoot_delta_update(struct wolfBoot_image *boot,
     uint8_t *delta_base_hash;
     uint16_t base_hash_sz;
     uint8_t *base_hash;
+    int (*patch_init)(WB_PATCH_CTX *, uint8_t *, uint32_t, uint8_t *,
+            uint32_t) = wb_patch_init;
+
+#ifdef DELTA_RANGE_CODER
+    if ((wolfBoot_get_image_type(PART_UPDATE) & 0x00F0) ==
+            HDR_IMG_TYPE_DIFF_RC) {
+        patch_init = wb_patch_init_rc;
+    }
+#endif
 
     if (boot->fw_size == 0) {
         /* Resume after powerfail can leave boot header erased; bound by partition size. */
@@ -618,7 +779,7 @@ static int wolfBoot_delta_update(struct wolfBoot_image *boot,
         if (resume ||
             ((cur_v == upd_v) && (delta_base_v <= cur_v)) ||
             ((cur_v == delta_base_v) && (upd_v >= cur_v))) {
-            ret = wb_patch_init(&ctx, boot->hdr, boot->fw_size +
+            ret = patch_init(&ctx, boot->hdr, boot->fw_size +
                     IMAGE_HEADER_SIZE, update->hdr + *img_offset, *img_size);
         } else {
             wolfBoot_printf("Delta version check failed! "
@@ -638,7 +799,7 @@ static int wolfBoot_delta_update(struct wolfBoot_image *boot,
             wolfBoot_printf("Delta Base hash mismatch\n");
             ret = -1;
         } else {
-            ret = wb_patch_init(&ctx, boot->hdr, boot->fw_size + IMAGE_HEADER_SIZE,
+            ret = patch_init(&ctx, boot->hdr, boot->fw_size + IMAGE_HEADER_SIZE,
                     update->hdr + IMAGE_HEADER_SIZE, *img_size);
         }
     }
@@ -649,9 +810,14 @@ static int wolfBoot_delta_update(struct wolfBoot_image *boot,
         if ((wolfBoot_get_update_sector_flag(sector, &flag) != 0) ||
                 (flag == SECT_FLAG_NEW)) {
             uint32_t len = 0;
-            wb_flash_erase(swap, 0, WOLFBOOT_SECTOR_SIZE);
+            /* the first block is patched while the swap sector is erased */
+            wb_erase_start(swap, 0, WOLFBOOT_SECTOR_SIZE);
             while (len < WOLFBOOT_SECTOR_SIZE) {
                 ret = wb_patch(&ctx, delta_blk, DELTA_BLOCK_SIZE);
+                if (wb_erase_wait() < 0) {
+                    ret = -1;
+                    goto out;
+                }
                 if (ret > 0) {
 #ifdef EXT_ENCRYPTED
                     uint32_t iv_counter = sector * WOLFBOOT_SECTOR_SIZE + len;
@@ -725,13 +891,9 @@ static int wolfBoot_delta_update(struct wolfBoot_image *boot,
         sector++;
     }
     ret = 0;
-    /* erase to the last sector, writeonce has 2 sectors */
+    /* erase up to the trailer sectors */
     while((sector * WOLFBOOT_SECTOR_SIZE) < WOLFBOOT_PARTITION_SIZE -
-        WOLFBOOT_SECTOR_SIZE
-#ifdef NVM_FLASH_WRITEONCE
-        * 2
-#endif
-    ) {
+        WOLFBOOT_SECTOR_SIZE * WOLFBOOT_TRAILER_SECTORS) {
         wb_flash_erase(boot, sector * WOLFBOOT_SECTOR_SIZE, WOLFBOOT_SECTOR_SIZE);
         sector++;
     }
@@ -771,13 +933,8 @@ out:
 #endif
 
 /* Max firmware size: partition must hold header + fw + trailer sector(s) */
-#ifndef NVM_FLASH_WRITEONCE
-    #define MAX_UPDATE_SIZE (size_t)((WOLFBOOT_PARTITION_SIZE - \
-        IMAGE_HEADER_SIZE - WOLFBOOT_SECTOR_SIZE))
-#else
-    #define MAX_UPDATE_SIZE (size_t)((WOLFBOOT_PARTITION_SIZE - \
-        IMAGE_HEADER_SIZE - (2 * WOLFBOOT_SECTOR_SIZE)))
-#endif
+#define MAX_UPDATE_SIZE (size_t)((WOLFBOOT_PARTITION_SIZE - \
+    IMAGE_HEADER_SIZE - (WOLFBOOT_TRAILER_SECTORS * WOLFBOOT_SECTOR_SIZE)))
 #ifdef __CCRX__
 #pragma section FRAM
 #endif
@@ -825,6 +982,10 @@ static int RAMFUNCTION wolfBoot_update(int fallback_allowed)
     uint8_t st;
     int resume = 0;
     int stateRet = -1;
+#endif
+#ifdef WOLFBOOT_MERKLE
+    struct wolfBoot_merkle merkle;
+    int merkle_swap = 0;
 #endif
     uint32_t cur_ver, upd_ver;
 
@@ -927,6 +1088,12 @@ static int RAMFUNCTION wolfBoot_update(int fallback_allowed)
 #endif
         }
         PART_SANITY_CHECK(&update);
+#ifdef WOLFBOOT_MERKLE
+        /* The leaf hashes have just been verified: use them to check each
+         * sector as it is installed in BOOT */
+        merkle_swap = (wolfBoot_merkle_open(&update, &merkle) == 1) &&
+            (merkle.leaf_size == WOLFBOOT_SECTOR_SIZE);
+#endif
 
 
         wolfBoot_printf("Versions: Current 0x%x, Update 0x%x\n",
@@ -944,12 +1111,24 @@ static int RAMFUNCTION wolfBoot_update(int fallback_allowed)
         }
 #endif
     }
+#ifdef WOLFBOOT_MERKLE
+    else if (flag == SECT_FLAG_UPDATED) {
+        /* Resuming a swap: the header of the new image, checked before the
+         * swap started, is already installed in BOOT */
+        merkle_swap = (wolfBoot_merkle_open(&boot, &merkle) == 1) &&
+            (merkle.leaf_size == WOLFBOOT_SECTOR_SIZE);
+    }
+#endif
 
 #ifdef DELTA_UPDATES
     if (cur_ver > upd_ver)
         inverse = 1;
 
-    if ((update_type & 0x00F0) == HDR_IMG_TYPE_DIFF) {
+    if (((update_type & 0x00F0) == HDR_IMG_TYPE_DIFF)
+#ifdef DELTA_RANGE_CODER
+        || ((update_type & 0x00F0) == HDR_IMG_TYPE_DIFF_RC)
+#endif
+       ) {
         /* if magic isn't set stateRet will be -1 but that means we're on a
          * fresh partition and aren't resuming */
         stateRet = wolfBoot_get_partition_state(PART_UPDATE, &st);
@@ -1007,6 +1186,10 @@ static int RAMFUNCTION wolfBoot_update(int fallback_allowed)
      * The status is saved in the sector flags of the update partition.
      * If something goes wrong, the operation will be resumed upon reboot.
      */
+#ifdef WOLFBOOT_SKIP_SAME_SECTORS
+    if (flag == SECT_FLAG_NEW)
+        wolfBoot_mark_same_sectors(&boot, &update, total_size);
+#endif
     while ((sector * sector_size) < total_size) {
         flag = SECT_FLAG_NEW;
         wolfBoot_get_update_sector_flag(sector, &flag);
@@ -1014,6 +1197,25 @@ static int RAMFUNCTION wolfBoot_update(int fallback_allowed)
             case SECT_FLAG_NEW:
                flag = SECT_FLAG_SWAPPING;
                wolfBoot_copy_sector(&update, &swap, sector);
+#ifdef WOLFBOOT_MERKLE
+               /* Check the copy in SWAP while BOOT and UPDATE are intact:
+                * copy it again once, then stop before overwriting them. The
+                * sector is still NEW, so the copy is repeated next time */
+               if (merkle_swap && (wolfBoot_merkle_check_sector(&merkle,
+                           sector, PART_SWAP) != 0)) {
+                   wolfBoot_copy_sector(&update, &swap, sector);
+                   if (wolfBoot_merkle_check_sector(&merkle, sector,
+                               PART_SWAP) != 0) {
+                       wolfBoot_printf("Sector %u corrupted in swap, "
+                           "update stopped\n", sector);
+                   #ifdef EXT_FLASH
+                       ext_flash_lock();
+                   #endif
+                       hal_flash_lock();
+                       return -1;
+                   }
+               }
+#endif
                if (((sector + 1) * sector_size) < WOLFBOOT_PARTITION_SIZE)
                    wolfBoot_set_update_sector_flag(sector, flag);
                 /* FALL THROUGH */
@@ -1047,9 +1249,43 @@ static int RAMFUNCTION wolfBoot_update(int fallback_allowed)
                     size = sector_size;
                 flag = SECT_FLAG_UPDATED;
                 wolfBoot_copy_sector(&swap, &boot, sector);
+#ifdef WOLFBOOT_MERKLE
+                if (merkle_swap && (wolfBoot_merkle_check_sector(&merkle,
+                            sector, PART_BOOT) != 0)) {
+                    /* SWAP has been checked: retry once, then stop before
+                     * marking the sector as updated, the swap is resumed
+                     * from SWAP at the next boot */
+                    wolfBoot_copy_sector(&swap, &boot, sector);
+                    if (wolfBoot_merkle_check_sector(&merkle, sector,
+                                PART_BOOT) != 0) {
+                        wolfBoot_printf("Sector %u corrupted during swap\n",
+                            sector);
+                    #ifdef EXT_FLASH
+                        ext_flash_lock();
+                    #endif
+                        hal_flash_lock();
+                        return -1;
+                    }
+                }
+#endif
                 if (((sector + 1) * sector_size) < WOLFBOOT_PARTITION_SIZE)
                     wolfBoot_set_update_sector_flag(sector, flag);
                 break;
+#ifdef WOLFBOOT_SKIP_SAME_SECTORS
+            case SECT_FLAG_SAME:
+    #ifdef EXT_ENCRYPTED
+                /* BOOT is already up to date, but the backup in UPDATE must
+                 * be encrypted with the fallback IV like the other sectors.
+                 * BOOT is not modified, so this is repeated if interrupted */
+                {
+                    int prev_iv = wolfBoot_enable_fallback_iv(1);
+                    wolfBoot_copy_sector(&boot, &update, sector);
+                    wolfBoot_enable_fallback_iv(prev_iv);
+                }
+                wolfBoot_set_update_sector_flag(sector, SECT_FLAG_UPDATED);
+    #endif
+                break;
+#endif
             case SECT_FLAG_UPDATED:
                 /* FALL THROUGH */
             default:
@@ -1078,12 +1314,9 @@ static int RAMFUNCTION wolfBoot_update(int fallback_allowed)
     /* Erase remainder of partition */
 #if defined(WOLFBOOT_FLASH_MULTI_SECTOR_ERASE) || defined(PRINTF_ENABLED)
     /* calculate number of remaining bytes */
-    /* reserve 1 sector for status (2 sectors for NV write once) */
-#ifdef NVM_FLASH_WRITEONCE
-    size = WOLFBOOT_PARTITION_SIZE - (sector * sector_size) - (2 * sector_size);
-#else
-    size = WOLFBOOT_PARTITION_SIZE - (sector * sector_size) - sector_size;
-#endif
+    /* reserve the trailer sectors holding the status */
+    size = WOLFBOOT_PARTITION_SIZE - (sector * sector_size) -
+        (WOLFBOOT_TRAILER_SECTORS * sector_size);
 
     wolfBoot_printf("Erasing remainder of partition (%d sectors)...\n",
         size/sector_size);
@@ -1099,11 +1332,7 @@ static int RAMFUNCTION wolfBoot_update(int fallback_allowed)
     /* Iterate over every remaining sector and erase individually. */
     /* This loop is smallest code size */
     while ((sector * sector_size) < WOLFBOOT_PARTITION_SIZE -
-        sector_size
-    #ifdef NVM_FLASH_WRITEONCE
-        * 2
-    #endif
-    ) {
+        (WOLFBOOT_TRAILER_SECTORS * sector_size)) {
         wb_flash_erase(&boot, sector * sector_size, sector_size);
         wb_flash_erase(&update, sector * sector_size, sector_size);
         sector++;
@@ -1146,8 +1375,9 @@ static int RAMFUNCTION wolfBoot_update(int fallback_allowed)
     if (wolfBoot_check_flash_image_elf(PART_BOOT, &entry) < 0) {
         wolfBoot_printf("ELF Scattered image digest check: failed. Restoring "
                         "scattered image...\n");
-        wolfBoot_load_flash_image_elf(PART_BOOT, &entry, PART_IS_EXT(boot));
-        if (wolfBoot_check_flash_image_elf(PART_BOOT, &entry) < 0) {
+        /* copies and re-hashes the segments in a single pass */
+        if (wolfBoot_load_flash_image_elf(PART_BOOT, &entry,
+                                          PART_IS_EXT(boot)) < 0) {
             wolfBoot_printf(
                 "Fatal: Could not verify digest after scattering. Panic().\n");
             wolfBoot_panic();
@@ -1172,7 +1402,10 @@ static int RAMFUNCTION wolfBoot_update(int fallback_allowed)
     /* Directly copy the content of the UPDATE partition into the BOOT
      * partition. */
     while ((sector * sector_size) < total_size) {
-        wolfBoot_copy_sector(&update, &boot, sector);
+#ifdef WOLFBOOT_SKIP_SAME_SECTORS
+        if (!wolfBoot_sector_is_same(&update, &boot, sector))
+#endif
+            wolfBoot_copy_sector(&update, &boot, sector);
         sector++;
     }
     /* erase remainder of partition */
@@ -1326,6 +1559,9 @@ void RAMFUNCTION wolfBoot_start(void)
     uint8_t bootState;
     uint8_t updateState;
     struct wolfBoot_image boot;
+#ifdef WOLFBOOT_VERIFY_TICKET
+    int ticketRet = -1;
+#endif
 
 #if defined(ARCH_SIM) && defined(WOLFBOOT_TPM) && defined(WOLFBOOT_TPM_SEAL)
     wolfBoot_unlock_disk();
@@ -1398,6 +1634,14 @@ void RAMFUNCTION wolfBoot_start(void)
         wolfBoot_get_blob_version(boot.hdr));
 
 #ifndef WOLFBOOT_SKIP_BOOT_VERIFY
+#ifdef WOLFBOOT_VERIFY_TICKET
+    /* A valid ticket means this exact image was fully verified before */
+    if (bootRet == 0)
+        ticketRet = wolfBoot_check_verify_ticket(&boot);
+    if (ticketRet == 0)
+        wolfBoot_printf("Boot image accepted by verification ticket\n");
+    else
+#endif
     if (bootRet < 0
             || (wolfBoot_verify_integrity(&boot) < 0)
             || (wolfBoot_verify_authenticity(&boot) < 0)
@@ -1429,6 +1673,15 @@ void RAMFUNCTION wolfBoot_start(void)
         }
     }
     PART_SANITY_CHECK(&boot);
+#ifdef WOLFBOOT_VERIFY_TICKET
+    if (ticketRet != 0) {
+        if (wolfBoot_store_verify_ticket(&boot) != 0)
+            wolfBoot_printf("Verification ticket not stored\n");
+    }
+#endif
+#ifdef WOLFBOOT_MEASURED_BOOT_APP_PARTITION
+    (void)measure_image(&boot);
+#endif
 #else
     if (bootRet < 0) {
         wolfBoot_panic();
@@ -1437,19 +1690,22 @@ void RAMFUNCTION wolfBoot_start(void)
 
 #ifdef WOLFBOOT_ELF_FLASH_SCATTER
     unsigned long entry;
+    int elfRet;
     wolfBoot_printf("ELF Scattered image digest check\n");
     if (wolfBoot_check_flash_image_elf(PART_BOOT, &entry) < 0) {
         wolfBoot_printf("ELF Scattered image digest check: failed. Restoring "
                         "scattered image...\n");
-        if (wolfBoot_load_flash_image_elf(PART_BOOT, &entry,
-                                          PART_IS_EXT(&boot)) < 0) {
+        /* copies and re-hashes the segments in a single pass */
+        elfRet = wolfBoot_load_flash_image_elf(PART_BOOT, &entry,
+                                               PART_IS_EXT(&boot));
+        if (elfRet == -2) {
             wolfBoot_printf(
-                "ELF: [BOOT] ERROR: could not store scattered image\n");
+                "Fatal: Could not verify digest after scattering. Panic().\n");
             wolfBoot_panic();
         }
-        if (wolfBoot_check_flash_image_elf(PART_BOOT, &entry) < 0) {
+        else if (elfRet < 0) {
             wolfBoot_printf(
-                "Fatal: Could not verify digest after scattering. Panic().\n");
+                "ELF: [BOOT] ERROR: could not store scattered image\n");
             wolfBoot_panic();
         }
     }
@@ -1463,6 +1719,9 @@ void RAMFUNCTION wolfBoot_start(void)
 #if defined(WOLFBOOT_TPM) && !defined(WOLFCRYPT_SECURE_MODE)
     /* leave TPM2 available to be called from non-secure callable */
     wolfBoot_tpm2_deinit();
+#elif defined(WOLFBOOT_TPM_INIT_ASYNC)
+    /* finish the TPM bring-up, if hashing the image did not */
+    (void)wolfBoot_tpm2_init_wait();
 #endif
 
 #ifdef ENCRYPT_PKCS11
@@ -32,6 +32,10 @@
 int WP11_Library_Init(void);
 #endif
 
+#ifdef WOLFBOOT_LZ4
+#error "LZ4 compressed images are not supported by update_flash_hwswap.c, please consider update_ram.c instead"
+#endif
+
 extern void hal_flash_dualbank_swap(void);
 
 static inline void boot_panic(void)
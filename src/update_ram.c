@@ -37,6 +37,9 @@
 #ifdef WOLFBOOT_ELF
 #include "elf.h"
 #endif
+#ifdef WOLFBOOT_LZ4
+#include "lz4.h"
+#endif
 
 extern void hal_flash_dualbank_swap(void);
 extern int wolfBoot_get_dts_size(void *dts_addr);
@@ -52,6 +55,60 @@ extern uint32_t dts_load_addr;
     #define WOLFBOOT_USE_RAMBOOT
 #endif
 
+#ifdef WOLFBOOT_LZ4
+#ifndef WOLFBOOT_LZ4_CHUNK_SIZE
+#define WOLFBOOT_LZ4_CHUNK_SIZE 4096
+#endif
+#if defined(EXT_FLASH) && defined(NO_XIP)
+static uint8_t lz4_chunk[WOLFBOOT_LZ4_CHUNK_SIZE] XALIGNED(16);
+#endif
+
+/* Inflate a compressed firmware of 'size' bytes from src to dst. With
+ * 'hash' set, the compressed stream is also passed to the streaming
+ * integrity check, so it is read only once. */
+static int ram_inflate(uint8_t *src, uint32_t size, uint8_t *dst,
+    uint32_t raw_size, int hash)
+{
+    struct lz4_stream lz4;
+    uint32_t off = 0, chunk;
+    uint8_t *p;
+
+    if (raw_size > WOLFBOOT_LZ4_MAX_SIZE) {
+        wolfBoot_printf("Invalid decompressed size %u\n", raw_size);
+        return -1;
+    }
+    lz4_stream_init(&lz4, dst, raw_size);
+    while (off < size) {
+        chunk = size - off;
+        if (chunk > WOLFBOOT_LZ4_CHUNK_SIZE)
+            chunk = WOLFBOOT_LZ4_CHUNK_SIZE;
+    #if defined(EXT_FLASH) && defined(NO_XIP)
+        p = lz4_chunk;
+        if (ext_flash_read((uintptr_t)src + off, p, chunk) < 0) {
+            wolfBoot_printf("Error reading image at %p\n", src);
+            return -1;
+        }
+    #else
+        p = src + off;
+    #endif
+    #ifndef WOLFBOOT_SKIP_BOOT_VERIFY
+        if (hash)
+            wolfBoot_hash_stream_update(p, chunk);
+    #else
+        (void)hash;
+    #endif
+        if (lz4_stream_update(&lz4, p, chunk) != 0)
+            break;
+        off += chunk;
+    }
+    if (lz4_stream_final(&lz4) != (int)raw_size) {
+        wolfBoot_printf("Error decompressing image at %p\n", src);
+        return -1;
+    }
+    return 0;
+}
+#endif /* WOLFBOOT_LZ4 */
+
 #ifdef WOLFBOOT_USE_RAMBOOT
 
 /* Function to load image from flash to ram */
@@ -59,6 +116,9 @@ int wolfBoot_ramboot(struct wolfBoot_image *img, uint8_t *src, uint8_t *dst)
 {
     int ret;
     uint32_t img_size;
+#ifdef WOLFBOOT_LZ4
+    uint32_t raw_size = 0;
+#endif
     BENCHMARK_DECLARE();
 
     /* read header into RAM */
@@ -98,6 +158,35 @@ int wolfBoot_ramboot(struct wolfBoot_image *img, uint8_t *src, uint8_t *dst)
     }
 #endif
 
+#ifdef WOLFBOOT_LZ4
+    /* the header is in RAM from now on */
+    img->not_ext = 1;
+    if (wolfBoot_open_image_address(img, dst) < 0)
+        return -1;
+    ret = wolfBoot_image_compressed(img, &raw_size);
+    if (ret < 0)
+        return -1;
+    if (ret > 0) {
+        /* The compressed stream is hashed while it is inflated to the load
+         * address, the check is completed by
+         * wolfBoot_verify_integrity_stream() */
+    #ifndef WOLFBOOT_SKIP_BOOT_VERIFY
+        if (wolfBoot_hash_stream_init(img) != 0)
+            return -1;
+    #endif
+        wolfBoot_printf("Inflating image %d -> %d bytes from %p to %p...",
+            img_size, raw_size, src + IMAGE_HEADER_SIZE,
+            dst + IMAGE_HEADER_SIZE);
+        BENCHMARK_START();
+        if (ram_inflate(src + IMAGE_HEADER_SIZE, img_size,
+                dst + IMAGE_HEADER_SIZE, raw_size, 1) != 0) {
+            return -1;
+        }
+        BENCHMARK_END("done");
+        return 0;
+    }
+#endif
+
     /* Read the entire image into RAM */
     wolfBoot_printf("Loading image %d bytes from %p to %p...",
         img_size, src + IMAGE_HEADER_SIZE, dst + IMAGE_HEADER_SIZE);
@@ -138,6 +227,10 @@ void RAMFUNCTION wolfBoot_start(void)
     uint8_t *dts_addr = NULL;
     uint32_t dts_size = 0;
 #endif
+#ifdef WOLFBOOT_LZ4
+    int compressed = 0;
+    uint32_t raw_size = 0;
+#endif
 
     memset(&os_image, 0, sizeof(struct wolfBoot_image));
 
@@ -191,11 +284,32 @@ void RAMFUNCTION wolfBoot_start(void)
         if (ret < 0) {
             goto backup_on_failure;
         }
+    #ifdef WOLFBOOT_LZ4
+        compressed = wolfBoot_image_compressed(&os_image, &raw_size);
+        if (compressed < 0) {
+            ret = -1;
+            goto backup_on_failure;
+        }
+      #if defined(EXT_ENCRYPTED) && defined(MMU)
+        if (compressed) {
+            wolfBoot_printf("Compressed images require an unencrypted "
+                            "partition\n");
+            ret = -1;
+            goto backup_on_failure;
+        }
+      #endif
+    #endif
 
 #ifndef WOLFBOOT_SKIP_BOOT_VERIFY
         /* Verify image integrity (hash check) */
         wolfBoot_printf("Checking integrity...");
         BENCHMARK_START();
+    #if defined(WOLFBOOT_LZ4) && defined(WOLFBOOT_USE_RAMBOOT)
+        /* the compressed stream was hashed by wolfBoot_ramboot() */
+        if (compressed)
+            ret = wolfBoot_verify_integrity_stream(&os_image);
+        else
+    #endif
         ret = wolfBoot_verify_integrity(&os_image);
         if (ret < 0) {
             wolfBoot_printf("FAILED\n");
@@ -212,6 +326,9 @@ void RAMFUNCTION wolfBoot_start(void)
             goto backup_on_failure;
         }
         BENCHMARK_END("done");
+    #ifdef WOLFBOOT_MEASURED_BOOT_APP_PARTITION
+        (void)measure_image(&os_image);
+    #endif
 #endif
 
         {
@@ -296,22 +413,42 @@ backup_on_failure:
 
 #ifndef WOLFBOOT_USE_RAMBOOT
     /* copy image to RAM */
-    #if defined(EXT_FLASH) && defined(NO_XIP)
-    wolfBoot_printf("Loading flash image from %p to RAM at %p (%d bytes)\n",
-        os_image.fw_base, load_address, os_image.fw_size);
-    ret = ext_flash_read((uintptr_t)os_image.fw_base, (uint8_t*)load_address,
-        os_image.fw_size);
-    if (ret < 0){
-        wolfBoot_printf("Error loading image at %p (ret %d)\n",
-            os_image.fw_base, ret);
-        return;
+    #ifdef WOLFBOOT_LZ4
+    if (compressed) {
+        wolfBoot_printf("Inflating image from %p to RAM at %p "
+            "(%d -> %d bytes)\n", os_image.fw_base, load_address,
+            os_image.fw_size, raw_size);
+        if (ram_inflate(os_image.fw_base, os_image.fw_size,
+                (uint8_t*)load_address, raw_size, 0) != 0) {
+            return;
+        }
     }
+    else
+    #endif
+    {
+    #if defined(EXT_FLASH) && defined(NO_XIP)
+        wolfBoot_printf("Loading flash image from %p to RAM at %p "
+            "(%d bytes)\n", os_image.fw_base, load_address,
+            os_image.fw_size);
+        ret = ext_flash_read((uintptr_t)os_image.fw_base,
+            (uint8_t*)load_address, os_image.fw_size);
+        if (ret < 0){
+            wolfBoot_printf("Error loading image at %p (ret %d)\n",
+                os_image.fw_base, ret);
+            return;
+        }
     #else
-    wolfBoot_printf("Copying image from %p to RAM at %p (%d bytes)\n",
-        os_image.fw_base, load_address, os_image.fw_size);
-    memcpy((void*)load_address, os_image.fw_base, os_image.fw_size);
+        wolfBoot_printf("Copying image from %p to RAM at %p (%d bytes)\n",
+            os_image.fw_base, load_address, os_image.fw_size);
+        memcpy((void*)load_address, os_image.fw_base, os_image.fw_size);
     #endif
+    }
 #endif /* !WOLFBOOT_USE_RAMBOOT */
+#ifdef WOLFBOOT_LZ4
+    /* from now on, the firmware is the decompressed one */
+    if (compressed)
+        os_image.fw_size = raw_size;
+#endif
 
 #ifdef WOLFBOOT_ELF
     /* Load elf */
@@ -382,6 +519,11 @@ backup_on_failure:
     }
 #endif /* MMU */
 
+#ifdef WOLFBOOT_TPM_INIT_ASYNC
+    /* finish the TPM bring-up, if hashing the image did not */
+    (void)wolfBoot_tpm2_init_wait();
+#endif
+
     wolfBoot_printf("Booting at %p\n", load_address);
 
 #ifdef WOLFBOOT_ENABLE_WOLFHSM_CLIENT
@@ -82,7 +82,7 @@
 
 #define HBA_FIS_SIZE 0x100
 #define HBA_CLB_SIZE 0x400
-#define HBA_TBL_SIZE 0x800
+#define HBA_TBL_SIZE (ATA_CMD_TABLE_SIZE * ATA_MAX_CMD_SLOTS)
 #define HBA_TBL_ALIGN 0x80
 
 static uint8_t ahci_hba_fis[HBA_FIS_SIZE * AHCI_MAX_PORTS]
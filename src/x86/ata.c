@@ -41,6 +41,18 @@
 
 #define CACHE_INVALID 0xBADF00DBADC0FFEEULL
 
+/* Maximum number of sectors transferred by each queued read command */
+#ifndef ATA_QUEUE_XFER_SECTORS
+#define ATA_QUEUE_XFER_SECTORS 256
+#endif
+
+#define ATA_PRDT_ENTRIES 8
+#define ATA_PRDT_MAX_BYTES (4 * 1024 * 1024) /* 22-bit byte count */
+
+#if (ATA_QUEUE_XFER_SECTORS < 1) || (ATA_QUEUE_XFER_SECTORS > 0xFFFF)
+#error "ATA_QUEUE_XFER_SECTORS must fit the 16-bit sector count"
+#endif
+
 #ifdef DEBUG_ATA
 /**
  * @brief This macro is used to conditionally print debug messages for the ATA
@@ -78,6 +90,9 @@ struct ata_drive {
     uint8_t  sector_cache[MAX_SECTOR_SIZE];
     uint64_t cached;
     enum ata_security_state sec;
+    uint32_t n_slots;
+    uint32_t queue_depth;
+    int ncq;
 };
 
 /**
@@ -106,7 +121,7 @@ struct __attribute__((packed)) hba_cmd_table {
     uint8_t cfis[64];
     uint8_t acmd[16];
     uint8_t _res[48];
-    struct hba_prdt_entry prdt_entry[8];
+    struct hba_prdt_entry prdt_entry[ATA_PRDT_ENTRIES];
 };
 
 /**
@@ -195,6 +210,7 @@ int ata_drive_new(uint32_t ahci_base, unsigned ahci_port, uint32_t clb,
                   uint32_t ctable, uint32_t fis)
 {
     struct ata_drive *ata = (void *)0;
+    uint32_t cap;
     if (++ata_drive_count >= MAX_ATA_DRIVES)
         return -1;
 
@@ -206,6 +222,13 @@ int ata_drive_new(uint32_t ahci_base, unsigned ahci_port, uint32_t clb,
     ata->fis_port = fis;
     ata->sector_size_shift = 9; /* 512 */
     ata->cached = CACHE_INVALID;
+    cap = mmio_read32(AHCI_HBA_CAP(ahci_base));
+    ata->n_slots = AHCI_CAP_NCS(cap);
+    if (ata->n_slots > ATA_MAX_CMD_SLOTS)
+        ata->n_slots = ATA_MAX_CMD_SLOTS;
+    /* Updated by ata_identify_device() if the drive supports NCQ */
+    ata->queue_depth = ata->n_slots;
+    ata->ncq = 0;
     return ata_drive_count;
 }
 
@@ -226,7 +249,7 @@ static int find_cmd_slot(int drv)
     sact = mmio_read32((AHCI_PxSACT(ata->ahci_base, ata->ahci_port)));
     ci = mmio_read32((AHCI_PxCI(ata->ahci_base, ata->ahci_port)));
     slots = sact | ci;
-    for (i = 0; i < 32; i++) {
+    for (i = 0; i < ata->n_slots; i++) {
         if ((slots & 1) == 0)
             return i;
         slots >>= 1;
@@ -236,37 +259,75 @@ static int find_cmd_slot(int drv)
 }
 
 /**
- * @brief This static function prepares a command slot for DMA data transfer by
- * initializing the command header and command table entries.
+ * @brief This static function prepares the given command slot for DMA data
+ * transfer by initializing the command header and the command table of the
+ * slot. The buffer is described by as many PRDT entries as needed, each one
+ * covering up to ATA_PRDT_MAX_BYTES.
  *
  * @param[in] drv The index of the ATA drive in the ATA_Drv array.
+ * @param[in] slot The index of the command slot to prepare.
  * @param[in] buf The buffer containing the data to be transferred.
  * @param[in] sz The size of the data to be transferred in bytes.
+ * @param[in] w 1 if the data is written to the device, 0 otherwise.
  *
- * @return The index of the prepared command slot if successful, or -1 if an error
- * occurs.
+ * @return 0 on success, or -1 if the buffer does not fit the PRDT.
  */
-static int prepare_cmd_h2d_slot(int drv, const uint8_t *buf, int sz, int w)
+static int prepare_cmd_slot(int drv, int slot, const uint8_t *buf, uint32_t sz,
+        int w)
 {
     struct hba_cmd_header *cmd;
     struct hba_cmd_table *tbl;
     struct ata_drive *ata = &ATA_Drv[drv];
-    int slot = find_cmd_slot(drv);
-    if (slot < 0) {
-        wolfBoot_printf("ATA: Operation aborted: no free command slot\r\n");
+    uint32_t len;
+    int n = 0;
+
+    if (sz > ATA_PRDT_ENTRIES * ATA_PRDT_MAX_BYTES)
         return -1;
-    }
     cmd = (struct hba_cmd_header *)(uintptr_t)ata->clb_port;
     cmd += slot;
     memset(cmd, 0, sizeof(struct hba_cmd_header));
     cmd->cfl = FIS_LEN_H2D / 4;
-    cmd->ctba = (uint32_t)(ata->ctable_port);
-    tbl = (struct hba_cmd_table *)(uintptr_t)(ata->ctable_port);
+    cmd->ctba = (uint32_t)(ata->ctable_port + slot * ATA_CMD_TABLE_SIZE);
+    tbl = (struct hba_cmd_table *)(uintptr_t)cmd->ctba;
     memset(tbl, 0, sizeof(struct hba_cmd_table));
-    cmd->prdtl = 1;
     cmd->w = w;
-    tbl->prdt_entry[0].dba = (uint32_t)(uintptr_t)buf;
-    tbl->prdt_entry[0].dbc = sz - 1;
+    do {
+        len = sz;
+        if (len > ATA_PRDT_MAX_BYTES)
+            len = ATA_PRDT_MAX_BYTES;
+        tbl->prdt_entry[n].dba = (uint32_t)(uintptr_t)buf;
+        tbl->prdt_entry[n].dbc = len - 1;
+        buf += len;
+        sz -= len;
+        n++;
+    } while (sz > 0);
+    cmd->prdtl = n;
+    return 0;
+}
+
+/**
+ * @brief This static function finds a free command slot and prepares it for
+ * DMA data transfer.
+ *
+ * @param[in] drv The index of the ATA drive in the ATA_Drv array.
+ * @param[in] buf The buffer containing the data to be transferred.
+ * @param[in] sz The size of the data to be transferred in bytes.
+ * @param[in] w 1 if the data is written to the device, 0 otherwise.
+ *
+ * @return The index of the prepared command slot if successful, or -1 if an error
+ * occurs.
+ */
+static int prepare_cmd_h2d_slot(int drv, const uint8_t *buf, int sz, int w)
+{
+    int slot = find_cmd_slot(drv);
+    if (slot < 0) {
+        wolfBoot_printf("ATA: Operation aborted: no free command slot\r\n");
+        return -1;
+    }
+    if (prepare_cmd_slot(drv, slot, buf, sz, w) < 0) {
+        wolfBoot_printf("ATA: Operation aborted: transfer too large\r\n");
+        return -1;
+    }
     return slot;
 }
 
@@ -393,6 +454,9 @@ static uint8_t buffer[ATA_BUF_SIZE];
 #define ATA_ID_MODEL_NO_LEN  40
 
 
+#define ATA_ID_QUEUE_DEPTH_POS 75 * 2
+#define ATA_ID_SATA_CAPABILITIES_POS 76 * 2
+#define ATA_ID_SATA_CAP_NCQ (1 << 8)
 #define ATA_ID_COMMAND_SET_SUPPORTED_POS 82 * 2
 #define ATA_ID_SECURITY_STATUS_POS 128 * 2
 
@@ -611,6 +675,7 @@ int ata_identify_device(int drv)
         (void)id_buf;
         uint16_t cmd_set_supported;
         uint16_t sec_status;
+        uint16_t sata_cap, qdepth;
         ATA_DEBUG_PRINTF("Device identified\r\n");
         ATA_DEBUG_PRINTF("Cylinders: %d\r\n", id_buf[1]);
         ATA_DEBUG_PRINTF("Heads: %d\r\n", id_buf[3]);
@@ -625,6 +690,18 @@ int ata_identify_device(int drv)
                 ATA_ID_MODEL_NO_LEN);
         ATA_DEBUG_PRINTF("Model: %s\r\n", model_no);
 
+        memcpy(&sata_cap, buffer + ATA_ID_SATA_CAPABILITIES_POS, 2);
+        memcpy(&qdepth, buffer + ATA_ID_QUEUE_DEPTH_POS, 2);
+        ata->ncq = 0;
+        ata->queue_depth = ata->n_slots;
+        if ((mmio_read32(AHCI_HBA_CAP(ata->ahci_base)) & AHCI_CAP_SNCQ) &&
+                (sata_cap != 0xFFFF) && (sata_cap & ATA_ID_SATA_CAP_NCQ)) {
+            ata->ncq = 1;
+            if ((uint32_t)(qdepth & 0x1F) + 1 < ata->queue_depth)
+                ata->queue_depth = (qdepth & 0x1F) + 1;
+        }
+        ATA_DEBUG_PRINTF("NCQ: %ssupported, queue depth %d\r\n",
+                ata->ncq ? "" : "not ", ata->queue_depth);
 
         ATA_DEBUG_PRINTF("Security mode information:\r\n");
         memcpy(&cmd_set_supported, buffer + ATA_ID_COMMAND_SET_SUPPORTED_POS, 2);
@@ -684,6 +761,17 @@ enum ata_security_state ata_security_get_state(int drv)
     return ata->sec;
 }
 
+static void fis_set_lba(struct fis_reg_h2d *cmdfis, uint64_t start)
+{
+    cmdfis->lba0 = (uint8_t)(start & 0xFF);
+    cmdfis->lba1 = (uint8_t)((start >> 8) & 0xFF);
+    cmdfis->lba2 = (uint8_t)((start >> 16) & 0xFF);
+    cmdfis->lba3 = (uint8_t)((start >> 24) & 0xFF);
+    cmdfis->lba4 = (uint8_t)((start >> 32) & 0xFF);
+    cmdfis->lba5 = (uint8_t)((start >> 40) & 0xFF);
+    cmdfis->device = (1 << 6); /* LBA mode */
+}
+
 static int ata_drive_read_sector(int drv, uint64_t start, uint32_t count,
         uint8_t *buf)
 {
@@ -702,13 +790,7 @@ static int ata_drive_read_sector(int drv, uint64_t start, uint32_t count,
     cmdfis->fis_type = FIS_TYPE_REG_H2D;
     cmdfis->c = 1;
     cmdfis->command = ATA_CMD_READ_DMA_EX;
-    cmdfis->lba0 = (uint8_t)(start & 0xFF);
-    cmdfis->lba1 = (uint8_t)((start >> 8) & 0xFF);
-    cmdfis->lba2 = (uint8_t)((start >> 16) & 0xFF);
-    cmdfis->lba3 = (uint8_t)((start >> 24) & 0xFF);
-    cmdfis->lba4 = (uint8_t)((start >> 32) & 0xFF);
-    cmdfis->lba5 = (uint8_t)((start >> 40) & 0xFF);
-    cmdfis->device = (1 << 6); /* LBA mode */
+    fis_set_lba(cmdfis, start);
     cmdfis->count = (uint16_t)(count & 0xFFFF);
     exec_cmd_slot(drv, slot);
     return count << ata->sector_size_shift;
@@ -731,19 +813,139 @@ static int ata_drive_write_sector(int drv, uint64_t start, uint32_t count,
     cmdfis->fis_type = FIS_TYPE_REG_H2D;
     cmdfis->c = 1;
     cmdfis->command = ATA_CMD_WRITE_DMA;
-    cmdfis->lba0 = (uint8_t)(start & 0xFF);
-    cmdfis->lba1 = (uint8_t)((start >> 8) & 0xFF);
-    cmdfis->lba2 = (uint8_t)((start >> 16) & 0xFF);
-    cmdfis->lba3 = (uint8_t)((start >> 24) & 0xFF);
-    cmdfis->lba4 = (uint8_t)((start >> 32) & 0xFF);
-    cmdfis->lba5 = (uint8_t)((start >> 40) & 0xFF);
-    cmdfis->device = (1 << 6); /* LBA mode */
+    fis_set_lba(cmdfis, start);
     cmdfis->count = (uint16_t)(count & 0xFFFF);
 
     exec_cmd_slot(drv, slot);
     return count << ata->sector_size_shift;
 }
 
+/**
+ * @brief This static function stops and restarts the command engine of the
+ * port after a task file error, dropping all the outstanding commands.
+ *
+ * @param[in] drv The index of the ATA drive in the ATA_Drv array.
+ */
+static void ata_port_recover(int drv)
+{
+    struct ata_drive *ata = &ATA_Drv[drv];
+    uint32_t reg;
+
+    reg = mmio_read32(AHCI_PxCMD(ata->ahci_base, ata->ahci_port));
+    mmio_write32(AHCI_PxCMD(ata->ahci_base, ata->ahci_port),
+            reg & ~AHCI_PORT_CMD_START);
+    while (mmio_read32(AHCI_PxCMD(ata->ahci_base, ata->ahci_port)) &
+            AHCI_PORT_CMD_CR)
+        ;
+    reg = mmio_read32(AHCI_PxSERR(ata->ahci_base, ata->ahci_port));
+    mmio_write32(AHCI_PxSERR(ata->ahci_base, ata->ahci_port), reg);
+    reg = mmio_read32(AHCI_PxIS(ata->ahci_base, ata->ahci_port));
+    mmio_write32(AHCI_PxIS(ata->ahci_base, ata->ahci_port), reg);
+    reg = mmio_read32(AHCI_PxCMD(ata->ahci_base, ata->ahci_port));
+    mmio_write32(AHCI_PxCMD(ata->ahci_base, ata->ahci_port),
+            reg | AHCI_PORT_CMD_START);
+}
+
+/**
+ * @brief This static function reads a range of sectors by splitting it into
+ * commands of up to ATA_QUEUE_XFER_SECTORS sectors, and keeping up to
+ * `queue_depth` of them in flight, one per command slot. Free slots are
+ * refilled as soon as the previous commands complete, so the drive never
+ * waits for the host between two commands.
+ * If the drive and the HBA support it, the commands are issued as NCQ
+ * READ FPDMA QUEUED, otherwise as READ DMA EXT, which the HBA executes in
+ * order from the command list.
+ * On error, the port is restarted and NCQ is disabled for the drive.
+ *
+ * @param[in] drv The index of the ATA drive in the ATA_Drv array.
+ * @param[in] start The first sector to read.
+ * @param[in] count The number of sectors to read.
+ * @param[out] buf The buffer to store the read data.
+ *
+ * @return 0 on success, ATA_ERR_OP_IN_PROGRESS if an asynchronous operation
+ * is running, or -1 if an error occurs.
+ */
+static int ata_drive_read_queued(int drv, uint64_t start, uint32_t count,
+        uint8_t *buf)
+{
+    struct ata_drive *ata = &ATA_Drv[drv];
+    struct hba_cmd_header *cmd;
+    struct hba_cmd_table *tbl;
+    struct fis_reg_h2d *cmdfis;
+    uint32_t pending = 0;
+    uint32_t issue, busy, n, reg;
+    uint32_t slot;
+
+    if (ata_async_info.in_progress)
+        return ATA_ERR_OP_IN_PROGRESS;
+
+    /* Clear IS */
+    reg = mmio_read32(AHCI_PxIS(ata->ahci_base, ata->ahci_port));
+    mmio_write32(AHCI_PxIS(ata->ahci_base, ata->ahci_port), reg);
+
+    /* Wait until port not busy */
+    while (mmio_read32(AHCI_PxTFD(ata->ahci_base, ata->ahci_port)) & (ATA_DEV_BUSY | ATA_DEV_DRQ))
+        ;
+
+    while ((count > 0) || (pending != 0)) {
+        issue = 0;
+        busy = pending |
+            mmio_read32(AHCI_PxSACT(ata->ahci_base, ata->ahci_port)) |
+            mmio_read32(AHCI_PxCI(ata->ahci_base, ata->ahci_port));
+        for (slot = 0; (slot < ata->queue_depth) && (count > 0); slot++) {
+            if (busy & (1U << slot))
+                continue;
+            n = count;
+            if (n > ATA_QUEUE_XFER_SECTORS)
+                n = ATA_QUEUE_XFER_SECTORS;
+            if (prepare_cmd_slot(drv, slot, buf, n << ata->sector_size_shift,
+                        0) < 0)
+                return -1;
+            cmd = (struct hba_cmd_header *)(uintptr_t)ata->clb_port;
+            cmd += slot;
+            tbl = (struct hba_cmd_table *)(uintptr_t)cmd->ctba;
+            cmdfis = (struct fis_reg_h2d *)(&tbl->cfis);
+            cmdfis->fis_type = FIS_TYPE_REG_H2D;
+            cmdfis->c = 1;
+            fis_set_lba(cmdfis, start);
+            if (ata->ncq) {
+                cmdfis->command = ATA_CMD_READ_FPDMA_QUEUED;
+                cmdfis->feature_l = (uint8_t)(n & 0xFF);
+                cmdfis->feature_h = (uint8_t)((n >> 8) & 0xFF);
+                cmdfis->count = (uint16_t)(slot << 3); /* NCQ tag */
+            } else {
+                cmdfis->command = ATA_CMD_READ_DMA_EX;
+                cmdfis->count = (uint16_t)n;
+            }
+            issue |= (1U << slot);
+            start += n;
+            buf += n << ata->sector_size_shift;
+            count -= n;
+        }
+        if (issue != 0) {
+            /* NCQ commands must be marked active before being issued */
+            if (ata->ncq)
+                mmio_write32(AHCI_PxSACT(ata->ahci_base, ata->ahci_port), issue);
+            mmio_write32(AHCI_PxCI(ata->ahci_base, ata->ahci_port), issue);
+            pending |= issue;
+        }
+        if (mmio_read32(AHCI_PxIS(ata->ahci_base, ata->ahci_port)) & AHCI_PORT_IS_TFES) {
+            wolfBoot_printf("ATA: port error\r\n");
+            ata_port_recover(drv);
+            if (ata->ncq) {
+                wolfBoot_printf("ATA: disabling NCQ\r\n");
+                ata->ncq = 0;
+            }
+            return -1;
+        }
+        /* NCQ commands complete when their SACT bit is cleared, the others
+         * when their CI bit is cleared */
+        pending &= mmio_read32(AHCI_PxSACT(ata->ahci_base, ata->ahci_port)) |
+            mmio_read32(AHCI_PxCI(ata->ahci_base, ata->ahci_port));
+    }
+    return 0;
+}
+
 static void ata_invalidate_cache(int drv)
 {
     struct ata_drive *ata = &ATA_Drv[drv];
@@ -809,7 +1011,7 @@ int ata_drive_read(int drv, uint64_t start, uint32_t size, uint8_t *buf)
     if (size > 0)
         count = size >> ata->sector_size_shift;
     if (count > 0) {
-        if (ata_drive_read_sector(drv, sect_start, count, buf + buffer_off) < 0)
+        if (ata_drive_read_queued(drv, sect_start, count, buf + buffer_off) != 0)
             return -1;
         size -= (count << ata->sector_size_shift);
         buffer_off += (count << ata->sector_size_shift);
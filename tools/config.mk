@@ -31,6 +31,7 @@ ifeq ($(ARCH),)
   UART_FLASH?=0
   ALLOW_DOWNGRADE?=0
   NVM_FLASH_WRITEONCE?=0
+  NVM_FLASH_JOURNAL?=0
   DISABLE_BACKUP?=0
   WOLFBOOT_VERSION?=0
   V?=0
@@ -78,9 +79,11 @@ ifeq ($(ARCH),)
   WOLFBOOT_SMALL_STACK?=0
   DELTA_UPDATES?=0
   DELTA_BLOCK_SIZE?=256
+  DELTA_RANGE_CODER?=0
   WOLFBOOT_HUGE_STACK?=0
   ARMORED?=0
   ELF?=0
+  LZ4?=0
   FORCE_32BIT=0
   DISK_LOCK?=0
   DISK_LOCK_PASSWORD?=
@@ -94,6 +97,7 @@ endif
 CONFIG_VARS:= ARCH TARGET SIGN HASH MCUXSDK MCUXPRESSO MCUXPRESSO_CPU MCUXPRESSO_DRIVERS \
 	MCUXPRESSO_CMSIS FREEDOM_E_SDK STM32CUBE CYPRESS_PDL CYPRESS_CORE_LIB CYPRESS_TARGET_LIB DEBUG VTOR \
 	CORTEX_M0 CORTEX_M7 CORTEX_M33 NO_ASM EXT_FLASH SPI_FLASH NO_XIP UART_FLASH ALLOW_DOWNGRADE NVM_FLASH_WRITEONCE \
+	NVM_FLASH_JOURNAL NVM_JOURNAL_SECTORS \
 	DISABLE_BACKUP WOLFBOOT_VERSION V NO_MPU ENCRYPT FLAGS_HOME FLAGS_INVERT \
 	SPMATH SPMATHALL RAM_CODE DUALBANK_SWAP IMAGE_HEADER_SIZE PKA TZEN PSOC6_CRYPTO \
 	WOLFTPM WOLFBOOT_TPM_VERIFY MEASURED_BOOT WOLFBOOT_TPM_SEAL WOLFBOOT_TPM_KEYSTORE \
@@ -107,16 +111,23 @@ CONFIG_VARS:= ARCH TARGET SIGN HASH MCUXSDK MCUXPRESSO MCUXPRESSO_CPU MCUXPRESSO
 	WOLFBOOT_PARTITION_BOOT_ADDRESS WOLFBOOT_PARTITION_UPDATE_ADDRESS \
 	WOLFBOOT_PARTITION_SWAP_ADDRESS WOLFBOOT_LOAD_ADDRESS \
 	WOLFBOOT_LOAD_DTS_ADDRESS WOLFBOOT_DTS_BOOT_ADDRESS WOLFBOOT_DTS_UPDATE_ADDRESS \
-	WOLFBOOT_SMALL_STACK DELTA_UPDATES DELTA_BLOCK_SIZE \
+	WOLFBOOT_SMALL_STACK DELTA_UPDATES DELTA_BLOCK_SIZE DELTA_RANGE_CODER \
 	WOLFBOOT_HUGE_STACK FORCE_32BIT\
 	ENCRYPT_WITH_CHACHA ENCRYPT_WITH_AES128 ENCRYPT_WITH_AES256 ARMORED \
 	LMS_LEVELS LMS_HEIGHT LMS_WINTERNITZ \
 	WOLFBOOT_UNIVERSAL_KEYSTORE \
 	XMSS_PARAMS \
-	ELF BIG_ENDIAN \
+	ELF LZ4 BIG_ENDIAN \
 	NXP_CUSTOM_DCD NXP_CUSTOM_DCD_OBJS \
 	FLASH_OTP_KEYSTORE \
 	KEYVAULT_OBJ_SIZE \
+	WOLFBOOT_HASH_CHUNK_SIZE \
+	WOLFBOOT_VERIFY_TICKET \
+	WOLFBOOT_MERKLE \
+	WOLFBOOT_SKIP_SAME_SECTORS \
+	WOLFBOOT_DISK_CACHE \
+	SPI_FLASH_SFDP \
+	QSPI_FLASH_MMAP \
 	KEYVAULT_MAX_ITEMS \
 	NO_ARM_ASM \
 	SIGN_SECONDARY \
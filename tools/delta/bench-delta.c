@@ -0,0 +1,216 @@
+/* bench-delta.c
+ *
+ * Benchmark for the wolfBoot delta patch generator.
+ *
+ * For each pair of images (base, new), generates the patch with every
+ * available wb_diff() mode, and reports the patch size and generation time.
+ * The linear mode is also run through wb_diff_generate() with one job per
+ * online CPU (or BENCH_JOBS, if set).
+ * Each patch is also applied in place, sector by sector, the same way
+ * wolfBoot_delta_update() does, to check that it reproduces the new image.
+ *
+ * Usage: WOLFBOOT_SECTOR_SIZE=<size> bench-delta base1 new1 [base2 new2 ...]
+ *
+ *
+ * Copyright (C) 2025 wolfSSL Inc.
+ *
+ * This file is part of wolfBoot.
+ *
+ * wolfBoot is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfBoot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335, USA
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <string.h>
+#include "delta.h"
+
+#define MAX_SRC_SIZE (1 << 24)
+#define PATCH_CHUNK_SIZE 256
+
+static const struct {
+    int mode;
+    int parallel;
+    const char *name;
+} modes[] = {
+    { WB_DIFF_MODE_LINEAR,  0, "greedy (linear)" },
+    { WB_DIFF_MODE_LINEAR,  1, "greedy (jobs)" },
+    { WB_DIFF_MODE_HASH,    0, "greedy (hash)" },
+    { WB_DIFF_MODE_OPTIMAL, 0, "optimal" },
+};
+
+static int bench_jobs = 1;
+
+static uint8_t *map_file(const char *path, int *len)
+{
+    struct stat st;
+    int fd;
+    void *p;
+
+    if (stat(path, &st) < 0) {
+        printf("Cannot stat %s\n", path);
+        return NULL;
+    }
+    if ((st.st_size <= 0) || (st.st_size > MAX_SRC_SIZE)) {
+        printf("%s: invalid file size\n", path);
+        return NULL;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Cannot open file %s\n", path);
+        return NULL;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == (void *)(-1)) {
+        perror("mmap");
+        return NULL;
+    }
+    *len = (int)st.st_size;
+    return p;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Apply the patch on top of a copy of 'base', one sector at a time */
+static int apply_in_place(uint8_t *base, int len_base, uint8_t *img,
+        int len_img, uint8_t *patch, int len_patch, uint32_t sector_size)
+{
+    uint32_t total = (len_base > len_img) ? len_base : len_img;
+    uint8_t *dst = calloc(1, total + sector_size);
+    uint8_t *sector = malloc(sector_size);
+    WB_PATCH_CTX px;
+    uint32_t off = 0;
+    int ret = -1;
+
+    if (!dst || !sector)
+        goto out;
+    memcpy(dst, base, len_base);
+    if (wb_patch_init(&px, dst, len_base, patch, len_patch) != 0)
+        goto out;
+    while (off < total) {
+        uint32_t len = 0;
+        int r;
+        while (len < sector_size) {
+            r = wb_patch(&px, sector + len, PATCH_CHUNK_SIZE);
+            if (r < 0)
+                goto out;
+            if (r == 0)
+                break;
+            len += r;
+        }
+        memcpy(dst + off, sector, len);
+        off += len;
+        if (len < sector_size)
+            break;
+    }
+    if ((off == (uint32_t)len_img) && (memcmp(dst, img, len_img) == 0))
+        ret = 0;
+out:
+    free(dst);
+    free(sector);
+    return ret;
+}
+
+static int bench_pair(const char *f_base, const char *f_img,
+        uint32_t sector_size)
+{
+    uint8_t *base, *img, *patch, *patch_jobs;
+    int len_base = 0, len_img = 0;
+    unsigned int i;
+    int ret = 0;
+
+    base = map_file(f_base, &len_base);
+    img = map_file(f_img, &len_img);
+    if (!base || !img)
+        exit(3);
+    patch = malloc(2 * (len_img + sector_size));
+    if (!patch)
+        exit(3);
+
+    printf("%s -> %s (%d -> %d bytes)\n", f_base, f_img, len_base, len_img);
+    for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        WB_DIFF_CTX dx;
+        uint32_t len_patch = 0;
+        double t0, t1;
+        int r;
+
+        t0 = now();
+        if (wb_diff_init_ex(&dx, base, len_base, img, len_img,
+                    modes[i].mode) < 0)
+            exit(6);
+        if (modes[i].parallel) {
+            if (wb_diff_generate(&dx, bench_jobs, &patch_jobs,
+                        &len_patch) < 0)
+                exit(4);
+            memcpy(patch, patch_jobs, len_patch);
+            free(patch_jobs);
+        } else {
+            do {
+                r = wb_diff(&dx, patch + len_patch, sector_size);
+                if (r < 0)
+                    exit(4);
+                len_patch += r;
+            } while (r > 0);
+        }
+        wb_diff_free(&dx);
+        t1 = now();
+
+        r = apply_in_place(base, len_base, img, len_img, patch, len_patch,
+                sector_size);
+        printf("  %-16s %10u bytes %10.3f s  %s\n", modes[i].name, len_patch,
+                t1 - t0, (r == 0) ? "OK" : "PATCH MISMATCH");
+        if (r != 0)
+            ret = 5;
+    }
+    free(patch);
+    munmap(base, len_base);
+    munmap(img, len_img);
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t sector_size;
+    int i;
+    int ret = 0;
+
+    if ((argc < 3) || ((argc % 2) == 0)) {
+        printf("Usage: %s base1 new1 [base2 new2 ...]\n", argv[0]);
+        exit(2);
+    }
+    sector_size = (uint32_t)wb_diff_get_sector_size();
+    if (getenv("BENCH_JOBS") != NULL)
+        bench_jobs = atoi(getenv("BENCH_JOBS"));
+    else
+        bench_jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (bench_jobs < 1)
+        bench_jobs = 1;
+    printf("Jobs: %d\n", bench_jobs);
+    for (i = 1; i < argc; i += 2) {
+        if (bench_pair(argv[i], argv[i + 1], sector_size) != 0)
+            ret = 5;
+    }
+    return ret;
+}
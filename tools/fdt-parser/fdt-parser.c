@@ -29,13 +29,50 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 static int gEnableUnitTest = 0;
 static int gParseFit = 0;
+static int gBenchmark = 0;
 #define UNIT_TEST_GROW_SIZE 1024
+#define BENCH_RUNS          200
+#define BENCH_MAX_NODES     512
+#define BENCH_MAX_FIXUPS    64
+
+/* With a transaction, fixups are recorded and applied by fdt_tx_commit() */
+static int test_fixup_str(struct fdt_tx* tx, void* fdt, int off,
+    const char* node, const char* name, const char* str)
+{
+    if (tx != NULL)
+        return fdt_tx_fixup_str(tx, off, node, name, str);
+    return fdt_fixup_str(fdt, off, node, name, str);
+}
+static int test_fixup_val(struct fdt_tx* tx, void* fdt, int off,
+    const char* node, const char* name, uint32_t val)
+{
+    if (tx != NULL)
+        return fdt_tx_fixup_val(tx, off, node, name, val);
+    return fdt_fixup_val(fdt, off, node, name, val);
+}
+static int test_fixup_val64(struct fdt_tx* tx, void* fdt, int off,
+    const char* node, const char* name, uint64_t val)
+{
+    if (tx != NULL)
+        return fdt_tx_fixup_val64(tx, off, node, name, val);
+    return fdt_fixup_val64(fdt, off, node, name, val);
+}
+static int test_setprop(struct fdt_tx* tx, void* fdt, int off,
+    const char* name, const void* val, int len)
+{
+    if (tx != NULL)
+        return fdt_tx_setprop(tx, off, name, val, len);
+    return fdt_setprop(fdt, off, name, val, len);
+}
 
 /* Test case for "nxp_t1024.dtb" */
-static int fdt_test(void* fdt)
+static int fdt_test(void* fdt, struct fdt_tx* tx)
 {
     int ret = 0, off, i;
     uint32_t *reg, oldsize;
@@ -112,7 +149,7 @@ static int fdt_test(void* fdt)
         p += sizeof(uint64_t);
         *(uint64_t*)p = cpu_to_fdt64(DDR_SIZE);
         p += sizeof(uint64_t);
-        ret = fdt_setprop(fdt, off, "reg", ranges, (int)(p - ranges));
+        ret = test_setprop(tx, fdt, off, "reg", ranges, (int)(p - ranges));
         if (ret != 0) goto exit;
         printf("FDT: Set memory, start=0x%x, size=0x%x\n",
             DDR_ADDRESS, (uint32_t)DDR_SIZE);
@@ -136,17 +173,17 @@ static int fdt_test(void* fdt)
         core_spin_table_addr = (uint64_t)((uintptr_t)(
             SPIN_TABLE_ADDR + (core * ENTRY_SIZE)));
 
-        ret = fdt_fixup_str(fdt, off, "cpu", "status", (core == 0) ? "okay" : "disabled");
+        ret = test_fixup_str(tx, fdt, off, "cpu", "status", (core == 0) ? "okay" : "disabled");
         if (ret == 0)
-            ret = fdt_fixup_val64(fdt, off, "cpu", "cpu-release-addr", core_spin_table_addr);
+            ret = test_fixup_val64(tx, fdt, off, "cpu", "cpu-release-addr", core_spin_table_addr);
         if (ret == 0)
-            ret = fdt_fixup_str(fdt, off, "cpu", "enable-method", "spin-table");
+            ret = test_fixup_str(tx, fdt, off, "cpu", "enable-method", "spin-table");
         if (ret == 0)
-            ret = fdt_fixup_val(fdt, off, "cpu", "timebase-frequency", TIMEBASE_HZ);
+            ret = test_fixup_val(tx, fdt, off, "cpu", "timebase-frequency", TIMEBASE_HZ);
         if (ret == 0)
-            ret = fdt_fixup_val(fdt, off, "cpu", "clock-frequency", PLAT_CLK);
+            ret = test_fixup_val(tx, fdt, off, "cpu", "clock-frequency", PLAT_CLK);
         if (ret == 0)
-            ret = fdt_fixup_val(fdt, off, "cpu", "bus-frequency", PLAT_CLK);
+            ret = test_fixup_val(tx, fdt, off, "cpu", "bus-frequency", PLAT_CLK);
         if (ret != 0) goto exit;
 
         off = fdt_find_devtype(fdt, off, "cpu");
@@ -155,14 +192,14 @@ static int fdt_test(void* fdt)
     /* fixup the soc clock */
     off = fdt_find_devtype(fdt, -1, "soc");
     if (off != -FDT_ERR_NOTFOUND) {
-        ret = fdt_fixup_val(fdt, off, "soc", "bus-frequency", PLAT_CLK);
+        ret = test_fixup_val(tx, fdt, off, "soc", "bus-frequency", PLAT_CLK);
         if (ret != 0) goto exit;
     }
 
     /* fixup the serial clocks */
     off = fdt_find_devtype(fdt, -1, "serial");
     while (off != -FDT_ERR_NOTFOUND) {
-        ret = fdt_fixup_val(fdt, off, "serial", "clock-frequency", BUS_CLK);
+        ret = test_fixup_val(tx, fdt, off, "serial", "clock-frequency", BUS_CLK);
         if (ret != 0) goto exit;
         off = fdt_find_devtype(fdt, off, "serial");
     }
@@ -170,11 +207,11 @@ static int fdt_test(void* fdt)
     /* fixup the QE bridge and bus blocks */
     off = fdt_find_devtype(fdt, -1, "qe");
     if (off != -FDT_ERR_NOTFOUND) {
-        ret = fdt_fixup_val(fdt, off, "qe", "clock-frequency", BUS_CLK);
+        ret = test_fixup_val(tx, fdt, off, "qe", "clock-frequency", BUS_CLK);
         if (ret == 0)
-            ret = fdt_fixup_val(fdt, off, "qe", "bus-frequency", BUS_CLK);
+            ret = test_fixup_val(tx, fdt, off, "qe", "bus-frequency", BUS_CLK);
         if (ret == 0)
-            ret = fdt_fixup_val(fdt, off, "qe", "brg-frequency", BUS_CLK/2);
+            ret = test_fixup_val(tx, fdt, off, "qe", "brg-frequency", BUS_CLK/2);
         if (ret != 0) goto exit;
     }
 
@@ -182,7 +219,7 @@ static int fdt_test(void* fdt)
     for (i=0; i<(int)(sizeof(liodn_tbl)/sizeof(struct liodn_id_table)); i++) {
         off = fdt_node_offset_by_compatible(fdt, -1, liodn_tbl[i].compat);
         if (off >= 0) {
-            ret = fdt_fixup_val(fdt, off, liodn_tbl[i].compat, "fsl,liodn",
+            ret = test_fixup_val(tx, fdt, off, liodn_tbl[i].compat, "fsl,liodn",
                 liodn_tbl[i].id);
             if (ret != 0) goto exit;
         }
@@ -209,7 +246,7 @@ static int fdt_test(void* fdt)
         liodns[1] = qp_info[i].fliodn;
         printf("FDT: Set %s@%d (%d), %s=%d,%d\n",
             "qman-portal", i, off, "fsl,liodn", liodns[0], liodns[1]);
-        ret = fdt_setprop(fdt, off, "fsl,liodn", liodns, sizeof(liodns));
+        ret = test_setprop(tx, fdt, off, "fsl,liodn", liodns, sizeof(liodns));
         if (ret != 0) goto exit;
 
         off = fdt_node_offset_by_compatible(fdt, off, "fsl,qman-portal");
@@ -218,7 +255,12 @@ static int fdt_test(void* fdt)
     /* mpic clock */
     off = fdt_find_devtype(fdt, -1, "open-pic");
     if (off != -FDT_ERR_NOTFOUND) {
-        ret = fdt_fixup_val(fdt, off, "open-pic", "clock-frequency", BUS_CLK);
+        ret = test_fixup_val(tx, fdt, off, "open-pic", "clock-frequency", BUS_CLK);
+        if (ret != 0) goto exit;
+    }
+
+    if (tx != NULL) {
+        ret = fdt_tx_commit(tx);
         if (ret != 0) goto exit;
     }
 
@@ -233,6 +275,91 @@ exit:
     return ret;
 }
 
+static double bench_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000000.0 + (double)ts.tv_nsec / 1000.0;
+}
+
+/* Run the fixups of fdt_test() on fresh copies of the tree: walking the
+ * tree and splicing each property, with the node index, and with the index
+ * and a single transaction. The resulting trees must be identical. */
+static int fdt_benchmark(const uint8_t* image, size_t imageSz)
+{
+    static struct fdt_index_node nodes[BENCH_MAX_NODES];
+    static struct fdt_tx_prop props[BENCH_MAX_FIXUPS];
+    const char* modes[] = { "walk + splice", "index + splice",
+        "index + transaction" };
+    uint8_t* work[3];
+    double elapsed[3], t0;
+    struct fdt_tx tx;
+    int ret = 0, m, r, saved_out, saved_err, devnull;
+
+    /* silence the fixup messages */
+    fflush(stdout);
+    fflush(stderr);
+    saved_out = dup(STDOUT_FILENO);
+    saved_err = dup(STDERR_FILENO);
+    devnull = open("/dev/null", O_WRONLY);
+    if (saved_out < 0 || saved_err < 0 || devnull < 0)
+        return -1;
+    dup2(devnull, STDOUT_FILENO);
+    dup2(devnull, STDERR_FILENO);
+
+    for (m = 0; m < 3; m++) {
+        work[m] = (uint8_t*)malloc(imageSz + UNIT_TEST_GROW_SIZE);
+        elapsed[m] = 0;
+        for (r = 0; work[m] != NULL && r < BENCH_RUNS && ret == 0; r++) {
+            memcpy(work[m], image, imageSz);
+            t0 = bench_time_us();
+            if (m > 0) {
+                ret = fdt_index_build(work[m], nodes, BENCH_MAX_NODES);
+                if (ret < 0)
+                    break;
+            }
+            if (m == 2)
+                fdt_tx_begin(&tx, work[m], props, BENCH_MAX_FIXUPS);
+            ret = fdt_test(work[m], (m == 2) ? &tx : NULL);
+            elapsed[m] += bench_time_us() - t0;
+            fdt_index_clear();
+        }
+        if (work[m] == NULL)
+            ret = -1;
+        if (ret != 0)
+            break;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+    close(devnull);
+
+    if (ret == 0) {
+        printf("FDT fixups (%d runs):\n", BENCH_RUNS);
+        for (m = 0; m < 3; m++) {
+            printf("\t%-20s %8.1f us\n", modes[m], elapsed[m] / BENCH_RUNS);
+        }
+        for (m = 1; m < 3; m++) {
+            if (fdt_totalsize(work[m]) != fdt_totalsize(work[0]) ||
+                memcmp(work[m], work[0], fdt_totalsize(work[0])) != 0) {
+                printf("FDT mismatch: %s\n", modes[m]);
+                ret = -1;
+            }
+        }
+    }
+    else {
+        printf("FDT benchmark failed %d\n", ret);
+    }
+    for (m--; m >= 0; m--) {
+        free(work[m]);
+    }
+    return ret;
+}
+
 static void print_bin(const uint8_t* buffer, uint32_t length)
 {
     uint32_t i, notprintable = 0;
@@ -447,9 +574,11 @@ int dts_parse(void* image)
 static void Usage(void)
 {
     printf("Expected usage:\n");
-    printf("./tools/fdt-parser/fdt-parser [-t] [-i] filename\n");
+    printf("./tools/fdt-parser/fdt-parser [-t] [-b] [-i] filename\n");
     printf("\t* -i: Parse Flattened uImage Tree (FIT) image\n");
     printf("\t* -t: Test several updates (used with nxp_t1024.dtb)\n");
+    printf("\t* -b: Benchmark the updates of -t, with and without the node "
+           "index and fixup transaction\n");
 }
 
 int main(int argc, char *argv[])
@@ -470,6 +599,9 @@ int main(int argc, char *argv[])
         if (strcmp(argv[argc-1], "-t") == 0) {
             gEnableUnitTest = 1;
         }
+        else if (strcmp(argv[argc-1], "-b") == 0) {
+            gBenchmark = 1;
+        }
         else if (strcmp(argv[argc-1], "-i") == 0) {
             gParseFit = 1;
         }
@@ -502,7 +634,7 @@ int main(int argc, char *argv[])
             fdt_version(image), fdt_totalsize(image));
     }
     if (ret == 0 && gEnableUnitTest) {
-        ret = fdt_test(image);
+        ret = fdt_test(image, NULL);
         if (ret == 0) {
             char outfilename[PATH_MAX];
             strncpy(outfilename, filename, sizeof(outfilename)-1);
@@ -514,7 +646,10 @@ int main(int argc, char *argv[])
             write_bin(outfilename, image, imageSz + UNIT_TEST_GROW_SIZE);
         }
     }
-    if (ret == 0) {
+    if (ret == 0 && gBenchmark) {
+        ret = fdt_benchmark(image, imageSz);
+    }
+    else if (ret == 0) {
         if (gParseFit) {
             ret = dts_parse_fit(image);
         }
@@ -42,7 +42,9 @@
 #include <fcntl.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <time.h>
 #include <delta.h>
+#include <lz4.h>
 
 #include "wolfboot/version.h"
 
@@ -69,9 +71,14 @@ static inline int fp_truncate(FILE *f, size_t len)
 #else
 #define HAVE_MMAP 1
 #include <sys/mman.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #endif
 
+#ifdef WB_DIFF_THREADS
+#include <pthread.h>
+#endif
+
 #define MAX_SRC_SIZE (1 << 24)
 
 #ifndef MAX_CUSTOM_TLVS
@@ -174,12 +181,16 @@ static inline int fp_truncate(FILE *f, size_t len)
 #define HDR_IMG_DELTA_BASE_HASH 0x07
 #define HDR_IMG_DELTA_INVERSE 0x15
 #define HDR_IMG_DELTA_INVERSE_SIZE 0x16
+#define HDR_IMG_RAW_SIZE 0x17
+#define HDR_MERKLE_ROOT 0x08
 
 #define HDR_IMG_TYPE_AUTH_MASK    0xFF00
 #define HDR_IMG_TYPE_AUTH_NONE    0xFF00
 #define HDR_IMG_TYPE_WOLFBOOT     0x0000
 #define HDR_IMG_TYPE_APP          0x0001
 #define HDR_IMG_TYPE_DIFF         0x00D0
+#define HDR_IMG_TYPE_DIFF_RC      0x00E0
+#define HDR_IMG_TYPE_LZ4          0x00C0
 #define HDR_IMG_TYPE_HYBRID       0x0080
 
 #define HASH_SHA256    HDR_SHA256
@@ -234,7 +245,10 @@ static void header_append_tag(uint8_t* header, uint32_t* idx, uint16_t tag,
 #include "../xmss/xmss_common.h"
 
 /* Globals */
-static const char wolfboot_delta_file[] = "/tmp/wolfboot-delta.bin";
+/* Temporary files, renamed per worker process in batch mode */
+static char wolfboot_delta_file[64] = "/tmp/wolfboot-delta.bin";
+static char wolfboot_merkle_file[64] = "/tmp/wolfboot-merkle.bin";
+static char wolfboot_lz4_file[64] = "/tmp/wolfboot-lz4.bin";
 
 static struct {
     ed25519_key ed;
@@ -258,6 +272,11 @@ struct cmd_options {
     int hybrid;
     int secondary_sign;
     int delta;
+    int delta_mode;
+    int delta_rc;
+    int jobs;
+    int merkle;
+    int compress;
     int no_ts;
     int sign_wenc;
     const char *image_file;
@@ -269,6 +288,7 @@ struct cmd_options {
     const char *encrypt_key_file;
     const char *delta_base_file;
     const char *cert_chain_file;
+    const char *batch_file;
     int no_base_sha;
     char output_image_file[PATH_MAX];
     char output_diff_file[PATH_MAX];
@@ -293,9 +313,15 @@ static struct cmd_options CMD = {
     .encrypt  = ENC_OFF,
     .hash_algo = HASH_SHA256,
     .partition_id = HDR_IMG_TYPE_APP,
+    .delta_mode = WB_DIFF_MODE_LINEAR,
+    .jobs = 1,
     .hybrid = 0
 };
 
+static const char *sign_str = "AUTO";
+static const char *hash_str = "SHA256";
+static const char *secondary_sign_str = "NONE";
+
 static uint16_t sign_tool_find_header(uint8_t *haystack, uint16_t type, uint8_t **ptr)
 {
     uint8_t *p = haystack;
@@ -1107,6 +1133,318 @@ static int sign_digest(int sign, int hash_algo,
 #define ALIGN_8(x) while ((x % 8) != 4) { x++; }
 #define ALIGN_4(x) while ((x % 4) != 0) { x++; }
 
+/* Hash a buffer with the selected algorithm, returns the digest size */
+static uint32_t merkle_hash(const uint8_t *data, uint32_t len, uint8_t *out)
+{
+    int ret = -1;
+    uint32_t digest_sz = 0;
+
+    if (CMD.hash_algo == HASH_SHA256) {
+    #ifndef NO_SHA256
+        wc_Sha256 sha;
+        ret = wc_InitSha256_ex(&sha, NULL, INVALID_DEVID);
+        if (ret == 0)
+            ret = wc_Sha256Update(&sha, data, len);
+        if (ret == 0)
+            ret = wc_Sha256Final(&sha, out);
+        wc_Sha256Free(&sha);
+        digest_sz = HDR_SHA256_LEN;
+    #endif
+    }
+    else if (CMD.hash_algo == HASH_SHA384) {
+    #ifndef NO_SHA384
+        wc_Sha384 sha;
+        ret = wc_InitSha384_ex(&sha, NULL, INVALID_DEVID);
+        if (ret == 0)
+            ret = wc_Sha384Update(&sha, data, len);
+        if (ret == 0)
+            ret = wc_Sha384Final(&sha, out);
+        wc_Sha384Free(&sha);
+        digest_sz = HDR_SHA384_LEN;
+    #endif
+    }
+    else if (CMD.hash_algo == HASH_SHA3) {
+    #ifdef WOLFSSL_SHA3
+        wc_Sha3 sha;
+        ret = wc_InitSha3_384(&sha, NULL, INVALID_DEVID);
+        if (ret == 0)
+            ret = wc_Sha3_384_Update(&sha, data, len);
+        if (ret == 0)
+            ret = wc_Sha3_384_Final(&sha, out);
+        wc_Sha3_384_Free(&sha);
+        digest_sz = HDR_SHA3_384_LEN;
+    #endif
+    }
+    return (ret == 0) ? digest_sz : 0;
+}
+
+/* Build the Merkle tree of the image into wolfboot_merkle_file.
+ *
+ * The firmware is split in leaves aligned to the flash sectors of the
+ * partition (i.e. the first leaf is shorter, as it starts after the
+ * manifest header). The table of leaf hashes is appended to the firmware,
+ * and the root is the hash of the table.
+ *
+ * On success, the value of the HDR_MERKLE_ROOT TLV (leaf size, offset of the
+ * table in the firmware, root) is stored in 'tlv' and its size is returned.
+ * Returns 0 on error.
+ */
+static uint32_t merkle_build(const char *image_file, uint8_t *tlv)
+{
+    uint32_t leaf_sz = (uint32_t)wb_diff_get_sector_size();
+    uint32_t hdr_sz = CMD.header_sz;
+    uint8_t *img = NULL, *table = NULL;
+    uint32_t img_sz, first, n_leaves, digest_sz = 0, i;
+    uint32_t tlv_sz = 0;
+    struct stat st;
+    FILE *f;
+
+    if ((stat(image_file, &st) != 0) || (st.st_size <= 0)) {
+        printf("Cannot stat %s\n", image_file);
+        return 0;
+    }
+    img_sz = (uint32_t)st.st_size;
+    first = hdr_sz / leaf_sz;
+    n_leaves = (hdr_sz + img_sz + leaf_sz - 1) / leaf_sz - first;
+    img = malloc(img_sz);
+    table = malloc(n_leaves * HDR_SHA384_LEN);
+    if ((img == NULL) || (table == NULL)) {
+        printf("Merkle table malloc error!\n");
+        goto out;
+    }
+    f = fopen(image_file, "rb");
+    if (f == NULL) {
+        printf("Open image file %s failed\n", image_file);
+        goto out;
+    }
+    if (fread(img, 1, img_sz, f) != img_sz) {
+        printf("Read image file %s failed\n", image_file);
+        fclose(f);
+        goto out;
+    }
+    fclose(f);
+
+    for (i = 0; i < n_leaves; i++) {
+        uint32_t start = (first + i) * leaf_sz;
+        uint32_t end = start + leaf_sz;
+        start = (start > hdr_sz) ? start - hdr_sz : 0;
+        end -= hdr_sz;
+        if (end > img_sz)
+            end = img_sz;
+        digest_sz = merkle_hash(img + start, end - start,
+                table + i * digest_sz);
+        if (digest_sz == 0) {
+            printf("Merkle leaf hash failed\n");
+            goto out;
+        }
+    }
+    memcpy(tlv, &leaf_sz, sizeof(uint32_t));
+    memcpy(tlv + 4, &img_sz, sizeof(uint32_t));
+    if (merkle_hash(table, n_leaves * digest_sz, tlv + 8) != digest_sz) {
+        printf("Merkle root hash failed\n");
+        goto out;
+    }
+
+    f = fopen(wolfboot_merkle_file, "wb");
+    if (f == NULL) {
+        printf("Cannot open file %s for writing\n", wolfboot_merkle_file);
+        goto out;
+    }
+    if ((fwrite(img, 1, img_sz, f) != img_sz) ||
+        (fwrite(table, digest_sz, n_leaves, f) != n_leaves)) {
+        printf("Write to %s failed\n", wolfboot_merkle_file);
+        fclose(f);
+        goto out;
+    }
+    fclose(f);
+    printf("Merkle tree: %u leaves of %u bytes\n", n_leaves, leaf_sz);
+    tlv_sz = 8 + digest_sz;
+out:
+    free(img);
+    free(table);
+    return tlv_sz;
+}
+
+/* Input images are hashed and written from memory, in chunks of this size
+ * when encrypting */
+#define SIGN_IO_CHUNK (1024 * 1024)
+
+/* Map (or load) the whole input image, so that it is read only once */
+static uint8_t *image_map(const char *file, uint32_t *sz)
+{
+    struct stat st;
+    uint8_t *img;
+#if HAVE_MMAP
+    int fd;
+#else
+    FILE *f;
+#endif
+
+    if ((stat(file, &st) < 0) || ((uint64_t)st.st_size > UINT32_MAX))
+        return NULL;
+    *sz = (uint32_t)st.st_size;
+    if (*sz == 0)
+        return malloc(1);
+#if HAVE_MMAP
+    fd = open(file, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    img = mmap(NULL, *sz, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (img == MAP_FAILED)
+        return NULL;
+    madvise(img, *sz, MADV_SEQUENTIAL);
+#else
+    f = fopen(file, "rb");
+    if (f == NULL)
+        return NULL;
+    img = malloc(*sz);
+    if ((img != NULL) && (fread(img, 1, *sz, f) != *sz)) {
+        free(img);
+        img = NULL;
+    }
+    fclose(f);
+#endif
+    return img;
+}
+
+static void image_unmap(uint8_t *img, uint32_t sz)
+{
+#if HAVE_MMAP
+    if (sz > 0) {
+        munmap(img, sz);
+        return;
+    }
+#endif
+    (void)sz;
+    free(img);
+}
+
+/* Encrypt header + image into 'fef', in SIGN_IO_CHUNK steps (a multiple of
+ * every cipher block size, so the key stream is continuous across chunks).
+ * With AES, the last block is padded with 0xFF. */
+static int encrypt_signed_image(FILE *fef, const uint8_t *key, int keySz,
+    const uint8_t *iv, int encBlockSz, const uint8_t *header,
+    uint32_t header_sz, const uint8_t *image, uint32_t image_sz)
+{
+    ChaCha cha;
+    Aes aes_e;
+    uint8_t *buf;
+    uint32_t fsize = header_sz + image_sz;
+    uint32_t pos, len, n, off;
+    int ret = 0;
+
+    buf = malloc(SIGN_IO_CHUNK);
+    if (buf == NULL)
+        return -1;
+    if (CMD.encrypt == ENC_CHACHA) {
+#ifndef HAVE_CHACHA
+        fprintf(stderr, "Encryption not supported: chacha support not found"
+               "in wolfssl configuration.\n");
+        exit(100);
+#endif
+        wc_Chacha_SetKey(&cha, key, keySz);
+        wc_Chacha_SetIV(&cha, iv, 0);
+    } else {
+        wc_AesInit(&aes_e, NULL, 0);
+        wc_AesSetKeyDirect(&aes_e, key, keySz, iv, AES_ENCRYPTION);
+    }
+    for (pos = 0; (ret == 0) && (pos < fsize); pos += len) {
+        len = fsize - pos;
+        if (len > SIGN_IO_CHUNK)
+            len = SIGN_IO_CHUNK;
+        /* Assemble the chunk from the header and the image */
+        for (off = 0; off < len; off += n) {
+            if (pos + off < header_sz) {
+                n = header_sz - (pos + off);
+                if (n > len - off)
+                    n = len - off;
+                memcpy(buf + off, header + pos + off, n);
+            } else {
+                n = len - off;
+                memcpy(buf + off, image + (pos + off - header_sz), n);
+            }
+        }
+        n = len;
+        if (CMD.encrypt == ENC_CHACHA) {
+            ret = wc_Chacha_Process(&cha, buf, buf, n);
+        } else {
+            /* Pad with FF if input is too short */
+            while ((n % encBlockSz) != 0)
+                buf[n++] = 0xFF;
+            ret = wc_AesCtrEncrypt(&aes_e, buf, buf, n);
+        }
+        if ((ret == 0) && (fwrite(buf, 1, n, fef) != n))
+            ret = -1;
+    }
+    if (CMD.encrypt != ENC_CHACHA)
+        wc_AesFree(&aes_e);
+    free(buf);
+    return ret;
+}
+
+/* Compress the image into wolfboot_lz4_file, as a single LZ4 frame.
+ *
+ * The size of the firmware before compression is stored in 'raw_sz'.
+ * Returns 0 on success.
+ */
+static int lz4_build(const char *image_file, uint32_t *raw_sz)
+{
+    uint8_t *img = NULL, *frame = NULL;
+    uint32_t img_sz, frame_sz;
+    struct stat st;
+    int ret = -1, len;
+    FILE *f;
+
+    if ((stat(image_file, &st) != 0) || (st.st_size <= 0)) {
+        printf("Cannot stat %s\n", image_file);
+        return -1;
+    }
+    img_sz = (uint32_t)st.st_size;
+    frame_sz = lz4_compress_bound(img_sz);
+    img = malloc(img_sz);
+    frame = malloc(frame_sz);
+    if ((img == NULL) || (frame == NULL)) {
+        printf("Compression buffer malloc error!\n");
+        goto out;
+    }
+    f = fopen(image_file, "rb");
+    if (f == NULL) {
+        printf("Open image file %s failed\n", image_file);
+        goto out;
+    }
+    if (fread(img, 1, img_sz, f) != img_sz) {
+        printf("Read image file %s failed\n", image_file);
+        fclose(f);
+        goto out;
+    }
+    fclose(f);
+
+    len = lz4_compress(img, img_sz, frame, frame_sz);
+    if (len <= 0) {
+        printf("LZ4 compression failed\n");
+        goto out;
+    }
+    f = fopen(wolfboot_lz4_file, "wb");
+    if (f == NULL) {
+        printf("Cannot open file %s for writing\n", wolfboot_lz4_file);
+        goto out;
+    }
+    if (fwrite(frame, 1, (size_t)len, f) != (size_t)len) {
+        printf("Write to %s failed\n", wolfboot_lz4_file);
+        fclose(f);
+        goto out;
+    }
+    fclose(f);
+    printf("Compressed image: %u -> %d bytes\n", img_sz, len);
+    *raw_sz = img_sz;
+    ret = 0;
+out:
+    free(img);
+    free(frame);
+    return ret;
+}
+
 static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
         const char *image_file, const char *outfile,
         uint32_t delta_base_version, uint32_t patch_len, uint32_t patch_inv_off,
@@ -1115,7 +1453,7 @@ static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
 {
     uint32_t header_idx;
     uint8_t *header;
-    FILE *f = NULL, *f2 = NULL, *fek = NULL, *fef = NULL;
+    FILE *f = NULL, *fek = NULL, *fef = NULL;
     uint32_t fw_version32;
     struct stat attrib;
     uint16_t image_type;
@@ -1125,13 +1463,20 @@ static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
     int ret = -1;
     uint8_t  buf[4096];
     uint8_t  second_buf[4096];
-    uint32_t read_sz, pos;
+    uint8_t *image = NULL;
     uint8_t  digest[48]; /* max digest */
     uint32_t digest_sz = 0;
     uint32_t image_sz = 0;
     int io_sz;
     uint8_t*    cert_chain    = NULL;
     uint32_t    cert_chain_sz = 0;
+    uint32_t    hash_sz;
+    const char *ts_file = image_file;
+    int         merkle = (CMD.merkle && !is_diff);
+    uint8_t     merkle_tlv[8 + HDR_SHA384_LEN];
+    uint32_t    merkle_tlv_sz = 0;
+    int         compress = (CMD.compress && !is_diff);
+    uint32_t    raw_sz = 0;
 
     /* Check certificate chain file size before allocating header, and adjust
      * header size if needed */
@@ -1170,6 +1515,26 @@ static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
         }
     }
 
+    if (compress) {
+        if (merkle) {
+            printf("--compress cannot be combined with --merkle\n");
+            goto failure;
+        }
+        /* The payload is replaced by its LZ4 frame: digest and signature
+         * cover the compressed stream */
+        if (lz4_build(image_file, &raw_sz) != 0)
+            goto failure;
+        image_file = wolfboot_lz4_file;
+    }
+
+    if (merkle) {
+        /* The payload is followed by the table of leaf hashes */
+        merkle_tlv_sz = merkle_build(image_file, merkle_tlv);
+        if (merkle_tlv_sz == 0)
+            goto failure;
+        image_file = wolfboot_merkle_file;
+    }
+
     header_idx = 0;
     header = malloc(CMD.header_sz);
     if (header == NULL) {
@@ -1178,16 +1543,15 @@ static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
     }
     memset(header, 0xFF, CMD.header_sz);
 
-    /* Get size of image */
-    f = fopen(image_file, "rb");
-    if (f == NULL) {
+    /* Map the image: it is hashed and copied to the output from memory */
+    image = image_map(image_file, &image_sz);
+    if (image == NULL) {
         printf("Open image file %s failed\n", image_file);
         goto failure;
     }
-    fseek(f, 0, SEEK_END);
-    image_sz = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    fclose(f);
+    /* With a Merkle root, the digest only covers the header: the payload is
+     * covered by the leaf hashes */
+    hash_sz = merkle ? 0 : image_sz;
 
     /* Append Magic header (spells 'WOLF') */
     header_append_u32(header, &header_idx, WOLFBOOT_MAGIC);
@@ -1206,7 +1570,7 @@ static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
 
     if (!CMD.no_ts) {
         /* Append Timestamp field */
-        stat(image_file, &attrib);
+        stat(ts_file, &attrib);
         header_append_tag(header, &header_idx, HDR_TIMESTAMP, HDR_TIMESTAMP_LEN,
             &attrib.st_ctime);
     }
@@ -1214,11 +1578,28 @@ static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
     /* Append Image type field */
     image_type = (uint16_t)CMD.sign & HDR_IMG_TYPE_AUTH_MASK;
     image_type |= CMD.partition_id;
-    if (is_diff)
+    if (is_diff && CMD.delta_rc)
+        image_type |= HDR_IMG_TYPE_DIFF_RC;
+    else if (is_diff)
         image_type |= HDR_IMG_TYPE_DIFF;
+    else if (compress)
+        image_type |= HDR_IMG_TYPE_LZ4;
     header_append_tag(header, &header_idx, HDR_IMG_TYPE, HDR_IMG_TYPE_LEN,
         &image_type);
 
+    if (compress) {
+        /* Append pad bytes, so the size is 4-byte aligned */
+        ALIGN_4(header_idx);
+        header_append_tag(header, &header_idx, HDR_IMG_RAW_SIZE, 4, &raw_sz);
+    }
+
+    if (merkle) {
+        /* Append pad bytes, so the root is 8-byte aligned */
+        ALIGN_8(header_idx);
+        header_append_tag(header, &header_idx, HDR_MERKLE_ROOT, merkle_tlv_sz,
+                merkle_tlv);
+    }
+
     if (is_diff) {
         /* Append pad bytes, so fields are 4-byte aligned */
         ALIGN_4(header_idx);
@@ -1398,22 +1779,9 @@ static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
             /* Hash Header */
             ret = wc_Sha256Update(&sha, header, header_idx);
 
-            /* Hash image file */
-            f = fopen(image_file, "rb");
-            pos = 0;
-            while (ret == 0 && pos < image_sz) {
-                read_sz = image_sz - pos;
-                if (read_sz > 32)
-                    read_sz = 32;
-                io_sz = (int)fread(buf, 1, read_sz, f);
-                if ((io_sz < 0) && !feof(f)) {
-                    ret = -1;
-                    break;
-                }
-                ret = wc_Sha256Update(&sha, buf, read_sz);
-                pos += read_sz;
-            }
-            fclose(f);
+            /* Hash image */
+            if ((ret == 0) && (hash_sz > 0))
+                ret = wc_Sha256Update(&sha, image, hash_sz);
             if (ret == 0) {
                 wc_Sha256Final(&sha, digest);
                 digest_sz = HDR_SHA256_LEN;
@@ -1467,22 +1835,9 @@ static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
             /* Hash Header */
             ret = wc_Sha384Update(&sha, header, header_idx);
 
-            /* Hash image file */
-            f = fopen(image_file, "rb");
-            pos = 0;
-            while (ret == 0 && pos < image_sz) {
-                read_sz = image_sz - pos;
-                if (read_sz > 32)
-                    read_sz = 32;
-                io_sz = (int)fread(buf, 1, read_sz, f);
-                if ((io_sz < 0) && !feof(f)) {
-                    ret = -1;
-                    break;
-                }
-                ret = wc_Sha384Update(&sha, buf, read_sz);
-                pos += read_sz;
-            }
-            fclose(f);
+            /* Hash image */
+            if ((ret == 0) && (hash_sz > 0))
+                ret = wc_Sha384Update(&sha, image, hash_sz);
             if (ret == 0) {
                 wc_Sha384Final(&sha, digest);
                 digest_sz = HDR_SHA384_LEN;
@@ -1534,22 +1889,9 @@ static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
             /* Hash Header */
             ret = wc_Sha3_384_Update(&sha, header, header_idx);
 
-            /* Hash image file */
-            f = fopen(image_file, "rb");
-            pos = 0;
-            while (ret == 0 && pos < image_sz) {
-                read_sz = image_sz - pos;
-                if (read_sz > 128)
-                    read_sz = 128;
-                io_sz = (int)fread(buf, 1, read_sz, f);
-                if ((io_sz < 0) && !feof(f)) {
-                    ret = -1;
-                    break;
-                }
-                ret = wc_Sha3_384_Update(&sha, buf, read_sz);
-                pos += read_sz;
-            }
-            fclose(f);
+            /* Hash image */
+            if ((ret == 0) && (hash_sz > 0))
+                ret = wc_Sha3_384_Update(&sha, image, hash_sz);
             if (ret == 0) {
                 ret = wc_Sha3_384_Final(&sha, digest);
                 digest_sz = HDR_SHA3_384_LEN;
@@ -1750,8 +2092,12 @@ static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
             unsigned long tmp;
             uint32_t partition_sz, sector_sz = 0;
             const char *env_nvm_wo = getenv("NVM_FLASH_WRITEONCE");
+            const char *env_nvm_journal = getenv("NVM_FLASH_JOURNAL");
+            const char *env_journal_sz = getenv("NVM_JOURNAL_SECTORS");
             int nvm_writeonce = (env_nvm_wo && *env_nvm_wo &&
                 strcmp(env_nvm_wo, "1") == 0);
+            /* Same as WOLFBOOT_TRAILER_SECTORS in wolfboot.h */
+            uint32_t trailer_sectors = 1;
 
             errno = 0;
             tmp = strtoul(env_psize, &endptr, 0);
@@ -1775,26 +2121,47 @@ static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
                 sector_sz = (uint32_t)tmp;
             }
 
+            if (nvm_writeonce) {
+                trailer_sectors = 2;
+                if (env_nvm_journal && strcmp(env_nvm_journal, "1") == 0) {
+                    trailer_sectors = 4;
+                    if (env_journal_sz && *env_journal_sz) {
+                        errno = 0;
+                        tmp = strtoul(env_journal_sz, &endptr, 0);
+                        if (endptr == env_journal_sz || *endptr != '\0' ||
+                                errno == ERANGE || tmp < 2 ||
+                                tmp > UINT32_MAX) {
+                            printf("Error: Invalid NVM_JOURNAL_SECTORS "
+                                "'%s'\n", env_journal_sz);
+                            goto failure;
+                        }
+                        trailer_sectors = (uint32_t)tmp;
+                    }
+                }
+            }
+
             {
                 uint32_t total_img_sz = CMD.header_sz + image_sz;
-                /* Only subtract sector for trailer when sector < partition.
+                /* Only subtract sectors for trailer when sector < partition.
                  * When sector >= partition (e.g. update_ram targets), the
                  * entire partition is available for the image.
-                 * NVM_FLASH_WRITEONCE reserves 2 sectors (active + redundant).
+                 * NVM_FLASH_WRITEONCE reserves 2 sectors (active + redundant),
+                 * NVM_FLASH_JOURNAL reserves NVM_JOURNAL_SECTORS.
                  */
-                uint32_t trailer_sz = sector_sz;
+                uint32_t trailer_sz = trailer_sectors * sector_sz;
                 uint32_t max_img_sz;
-                if (nvm_writeonce && sector_sz < partition_sz)
-                    trailer_sz = 2 * sector_sz;
-                max_img_sz = (sector_sz < partition_sz) ?
-                    (partition_sz - trailer_sz) : partition_sz;
+                if (sector_sz >= partition_sz)
+                    max_img_sz = partition_sz;
+                else if (trailer_sz < partition_sz)
+                    max_img_sz = partition_sz - trailer_sz;
+                else
+                    max_img_sz = 0;
                 if (total_img_sz > max_img_sz) {
                     if (sector_sz < partition_sz) {
                         printf("Error: Image size %u (header %u + firmware %u) "
-                            "exceeds max %u (partition %u - %d x sector %u)\n",
+                            "exceeds max %u (partition %u - %u x sector %u)\n",
                             total_img_sz, CMD.header_sz, image_sz,
-                            max_img_sz, partition_sz,
-                            nvm_writeonce ? 2 : 1,
+                            max_img_sz, partition_sz, trailer_sectors,
                             sector_sz);
                     } else {
                         printf("Error: Image size %u (header %u + firmware %u) "
@@ -1817,29 +2184,16 @@ static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
     fwrite(header, 1, header_idx, f);
     /* Copy image to output */
     if (!CMD.header_only) {
-        f2  = fopen(image_file, "rb");
-        pos = 0;
-        while (pos < image_sz) {
-            read_sz = image_sz;
-            if (read_sz > sizeof(buf)) {
-                read_sz = sizeof(buf);
-            }
-            read_sz = (uint32_t)fread(buf, 1, read_sz, f2);
-            if ((read_sz == 0) && (feof(f2))) {
-                break;
-            }
-            fwrite(buf, 1, read_sz, f);
-            pos += read_sz;
+        if (fwrite(image, 1, image_sz, f) != image_sz) {
+            printf("Write output image file %s failed\n", outfile);
+            ret = -1;
+            goto close_output;
         }
-        fclose(f2);
-        f2 = NULL;
     }
 
     if (!CMD.header_only && (CMD.encrypt != ENC_OFF) && CMD.encrypt_key_file) {
         uint8_t key[ENC_MAX_KEY_SZ], iv[ENC_MAX_IV_SZ];
-        uint8_t enc_buf[ENC_MAX_BLOCK_SZ];
         int ivSz, keySz, encBlockSz;
-        uint32_t fsize = 0;
         switch (CMD.encrypt) {
             case ENC_CHACHA:
                 ivSz = ENCRYPT_NONCE_SIZE_CHACHA;
@@ -1858,7 +2212,8 @@ static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
                 break;
             default:
                 printf("No valid encryption mode selected\n");
-                goto failure;
+                ret = -1;
+                goto close_output;
 
         }
         fek = fopen(CMD.encrypt_key_file, "rb");
@@ -1882,61 +2237,33 @@ static int make_header_ex(int is_diff, uint8_t *pubkey, uint32_t pubkey_sz,
         fef = fopen(CMD.output_encrypted_image_file, "wb");
         if (!fef) {
             fprintf(stderr, "Open encrypted output file %s: %s\n",
-                    CMD.encrypt_key_file, strerror(errno));
-        }
-        fsize = ftell(f);
-        fseek(f, 0, SEEK_SET); /* restart the _signed file from 0 */
-
-        printf("Encrypting %u bytes...\n", fsize);
-
-        if (CMD.encrypt == ENC_CHACHA) {
-            ChaCha cha;
-#ifndef HAVE_CHACHA
-            fprintf(stderr, "Encryption not supported: chacha support not found"
-                   "in wolfssl configuration.\n");
-            exit(100);
-#endif
-            wc_Chacha_SetKey(&cha, key, sizeof(key));
-            wc_Chacha_SetIV(&cha, iv, 0);
-            for (pos = 0; pos < fsize; pos += encBlockSz) {
-                int fread_retval;
-                fread_retval = (int)fread(buf, 1, encBlockSz, f);
-                if ((fread_retval == 0) && feof(f)) {
-                    break;
-                }
-                wc_Chacha_Process(&cha, enc_buf, buf, fread_retval);
-                fwrite(enc_buf, 1, fread_retval, fef);
-            }
-        } else if ((CMD.encrypt == ENC_AES128) || (CMD.encrypt == ENC_AES256)) {
-            Aes aes_e;
-            wc_AesInit(&aes_e, NULL, 0);
-            wc_AesSetKeyDirect(&aes_e, key, keySz, iv, AES_ENCRYPTION);
-            for (pos = 0; pos < fsize; pos += encBlockSz) {
-                int fread_retval;
-                fread_retval = (int)fread(buf, 1, encBlockSz, f);
-                if ((fread_retval == 0) && feof(f)) {
-                    break;
-                }
-                /* Pad with FF if input is too short */
-                while((fread_retval % encBlockSz) != 0) {
-                    buf[fread_retval++] = 0xFF;
-                }
-                wc_AesCtrEncrypt(&aes_e, enc_buf, buf, fread_retval);
-                fwrite(enc_buf, 1, fread_retval, fef);
-            }
+                    CMD.output_encrypted_image_file, strerror(errno));
+            ret = -1;
+            goto close_output;
         }
+        /* Encrypt the signed image from memory, instead of reading it back */
+        printf("Encrypting %u bytes...\n", header_idx + image_sz);
+        ret = encrypt_signed_image(fef, key, keySz, iv, encBlockSz, header,
+            header_idx, image, image_sz);
         fclose(fef);
+        if (ret != 0) {
+            fprintf(stderr, "Encryption failed\n");
+            ret = -1;
+            goto close_output;
+        }
         printf("Encryption complete.\n");
     }
     printf("Output image(s) successfully created.\n");
     ret = 0;
-    if (f2) {
-        fclose(f2);
-    }
-    if (f) {
-        fclose(f);
-    }
+close_output:
+    fclose(f);
 failure:
+    if (image)
+        image_unmap(image, image_sz);
+    if (merkle)
+        unlink(wolfboot_merkle_file);
+    if (compress)
+        unlink(wolfboot_lz4_file);
     if (cert_chain)
         free(cert_chain);
     if (policy)
@@ -1977,6 +2304,59 @@ static int make_hybrid_header(uint8_t *pubkey, uint32_t pubkey_sz,
             secondary_key, secondary_key_sz, NULL, 0);
 }
 
+struct delta_job {
+    WB_DIFF_CTX ctx;
+    int jobs;
+    uint8_t *patch;
+    uint32_t patch_len;
+    int ret;
+};
+
+/* Generate the whole patch for an initialized diff context. With
+ * --delta-rc, the patch is range-coded as a whole.
+ */
+static int delta_generate(struct delta_job *job)
+{
+    uint8_t *raw = NULL;
+    uint32_t raw_len = 0;
+    int r;
+
+    r = wb_diff_generate(&job->ctx, job->jobs, &raw, &raw_len);
+    wb_diff_free(&job->ctx);
+    if ((r < 0) || (raw_len == 0)) {
+        free(raw);
+        return -1;
+    }
+    if (CMD.delta_rc) {
+        uint32_t cap = wb_diff_rc_bound(raw_len);
+        uint8_t *coded = malloc(cap);
+        r = -1;
+        if (coded != NULL)
+            r = wb_diff_rc_encode(raw, raw_len, coded, cap);
+        if (r < 0) {
+            free(coded);
+            free(raw);
+            return -1;
+        }
+        printf("Range-coded patch: %u -> %d bytes\n", raw_len, r);
+        free(raw);
+        raw = coded;
+        raw_len = (uint32_t)r;
+    }
+    job->patch = raw;
+    job->patch_len = raw_len;
+    return 0;
+}
+
+#ifdef WB_DIFF_THREADS
+static void *delta_generate_thread(void *arg)
+{
+    struct delta_job *job = (struct delta_job *)arg;
+    job->ret = delta_generate(job);
+    return NULL;
+}
+#endif
+
 static int base_diff(const char *f_base, uint8_t *pubkey, uint32_t pubkey_sz, int padding)
 {
 #if HAVE_MMAP
@@ -1988,29 +2368,22 @@ static int base_diff(const char *f_base, uint8_t *pubkey, uint32_t pubkey_sz, in
     struct stat st;
     void *base = NULL;
     void *buffer = NULL;
-    uint8_t *dest = NULL;
     uint8_t ff = 0xff;
-    int r;
     uint32_t patch_sz, patch_inv_sz;
     uint32_t patch_inv_off;
     uint32_t *delta_base_version = NULL;
     uint16_t delta_base_version_sz = 0;
-    WB_DIFF_CTX diff_ctx;
+    struct delta_job fwd, inv;
     int ret = -1;
     int io_sz;
     uint8_t *base_hash = NULL;
     uint16_t base_hash_sz = 0;
     uint32_t wolfboot_sector_size = 0;
-    uint32_t blksz;
 
+    memset(&fwd, 0, sizeof(fwd));
+    memset(&inv, 0, sizeof(inv));
     wolfboot_sector_size = wb_diff_get_sector_size();
     printf("delta update: WOLFBOOT_SECTOR_SIZE: %u\n", wolfboot_sector_size);
-    blksz = wolfboot_sector_size;
-    dest = malloc(wolfboot_sector_size);
-    if (!dest) {
-        printf("Error allocating memory to prepare patch sectors\n");
-        goto cleanup;
-    }
 
     /* Get source file size */
     if (stat(f_base, &st) < 0) {
@@ -2145,25 +2518,46 @@ static int base_diff(const char *f_base, uint8_t *pubkey, uint32_t pubkey_sz, in
     len3 = 0;
 #endif
 
-    /* Direct base->second patch */
-    if (wb_diff_init(&diff_ctx, base, len1, buffer, len2) < 0) {
+    /* Direct base->second patch, and inverse second->base patch */
+    if ((wb_diff_init_ex(&fwd.ctx, base, len1, buffer, len2,
+                    CMD.delta_mode) < 0) ||
+        (wb_diff_init_ex(&inv.ctx, buffer, len2, base, len1,
+                    CMD.delta_mode) < 0)) {
         goto cleanup;
     }
-    do {
-        r = wb_diff(&diff_ctx, dest, blksz);
-        if (r < 0)
+    fwd.jobs = (CMD.jobs + 1) / 2;
+    inv.jobs = CMD.jobs - fwd.jobs;
+#ifdef WB_DIFF_THREADS
+    if (inv.jobs > 0) {
+        pthread_t th;
+        if (pthread_create(&th, NULL, delta_generate_thread, &inv) != 0) {
+            fprintf(stderr, "Cannot start delta thread\n");
             goto cleanup;
+        }
+        fwd.ret = delta_generate(&fwd);
+        pthread_join(th, NULL);
+    } else
+#endif
+    {
+        fwd.ret = delta_generate(&fwd);
+        if (fwd.ret == 0)
+            inv.ret = delta_generate(&inv);
+    }
+    if ((fwd.ret < 0) || (inv.ret < 0)) {
+        goto cleanup;
+    }
+    patch_sz = fwd.patch_len;
+    patch_inv_sz = inv.patch_len;
+
 #if HAVE_MMAP
-        io_sz = write(fd3, dest, r);
+    io_sz = write(fd3, fwd.patch, patch_sz);
 #else
-        io_sz = (int)fwrite(dest, r, 1, f3);
+    io_sz = (int)fwrite(fwd.patch, 1, patch_sz, f3);
 #endif
-        if (io_sz != r) {
-            goto cleanup;
-        }
-        len3 += r;
-    } while (r > 0);
-    patch_sz = len3;
+    if (io_sz != (int)patch_sz) {
+        goto cleanup;
+    }
+    len3 = patch_sz;
     while ((len3 % padding) != 0) {
         uint8_t zero = 0;
 #if HAVE_MMAP
@@ -2177,27 +2571,16 @@ static int base_diff(const char *f_base, uint8_t *pubkey, uint32_t pubkey_sz, in
         len3++;
     }
     patch_inv_off = (uint32_t)len3 + CMD.header_sz;
-    patch_inv_sz = 0;
 
-    /* Inverse second->base patch */
-    if (wb_diff_init(&diff_ctx, buffer, len2, base, len1) < 0) {
-        goto cleanup;
-    }
-    do {
-        r = wb_diff(&diff_ctx, dest, blksz);
-        if (r < 0)
-            goto cleanup;
 #if HAVE_MMAP
-        io_sz = write(fd3, dest, r);
+    io_sz = write(fd3, inv.patch, patch_inv_sz);
 #else
-        io_sz = (int)fwrite(dest, r, 1, f3);
+    io_sz = (int)fwrite(inv.patch, 1, patch_inv_sz, f3);
 #endif
-        if (io_sz != r) {
-            goto cleanup;
-        }
-        patch_inv_sz += r;
-        len3 += r;
-    } while (r > 0);
+    if (io_sz != (int)patch_inv_sz) {
+        goto cleanup;
+    }
+    len3 += patch_inv_sz;
 #if HAVE_MMAP
     if (fd3 >= 0) {
         if (len3 > 0) {
@@ -2227,10 +2610,10 @@ static int base_diff(const char *f_base, uint8_t *pubkey, uint32_t pubkey_sz, in
             *delta_base_version, patch_sz, patch_inv_off, patch_inv_sz, base_hash, base_hash_sz);
 
 cleanup:
-    if (dest) {
-        free(dest);
-        dest = NULL;
-    }
+    wb_diff_free(&fwd.ctx);
+    wb_diff_free(&inv.ctx);
+    free(fwd.patch);
+    free(inv.patch);
     /* Unlink output file */
     unlink(wolfboot_delta_file);
 #if HAVE_MMAP
@@ -2487,39 +2870,11 @@ static void set_signature_sizes(int secondary)
     printf("Manifest header size: %u\n", CMD.header_sz);
 }
 
-int main(int argc, char** argv)
+/* Parse the options in argv[i..], up to the first positional argument.
+ * Returns the index of the last option parsed. */
+static int parse_options(int argc, char** argv, int i)
 {
-    int ret = 0;
-    int i;
-    char* tmpstr;
-    const char* sign_str = "AUTO";
-    const char* hash_str = "SHA256";
-    const char* secondary_sign_str = "NONE";
-    uint8_t  buf[PATH_MAX-32]; /* leave room to avoid "directive output may be truncated" */
-    uint8_t *pubkey = NULL;
-    uint32_t pubkey_sz = 0;
-    uint8_t *kbuf=NULL, *key_buffer, *key_buffer2;
-    uint32_t key_buffer_sz, key_buffer_sz2;
-
-#ifdef DEBUG_SIGNTOOL
-    wolfSSL_Debugging_ON();
-#endif
-
-    printf("wolfBoot KeyTools (Compiled C version)\n");
-    printf("wolfBoot version %X\n", WOLFBOOT_VERSION);
-
-    /* Check arguments and print usage */
-    if (argc < 4 || argc > 14) {
-        printf("Usage: %s [options] image key version\n", argv[0]);
-        printf("For full usage manual, see 'docs/Signing.md'\n");
-        exit(1);
-    }
-
-    /* Set initial manifest header size to a minimum default value */
-    CMD.header_sz = 256;
-
-    /* Parse Arguments */
-    for (i=1; i<argc; i++) {
+    for (; i<argc; i++) {
         if (strcmp(argv[i], "--no-sign") == 0) {
             CMD.sign = NO_SIGN;
             sign_str = "NONE";
@@ -2717,6 +3072,47 @@ int main(int argc, char** argv)
         else if (strcmp(argv[i], "--delta") == 0) {
             CMD.delta = 1;
             CMD.delta_base_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--delta-rc") == 0) {
+            CMD.delta_rc = 1;
+        }
+        else if (strcmp(argv[i], "--merkle") == 0) {
+            CMD.merkle = 1;
+        }
+        else if (strcmp(argv[i], "--compress") == 0) {
+            CMD.compress = 1;
+        }
+        else if (strcmp(argv[i], "--jobs") == 0) {
+            if (argc <= (i + 1)) {
+                fprintf(stderr, "Missing number of jobs argument\n");
+                exit(16);
+            }
+            CMD.jobs = atoi(argv[++i]);
+            if (CMD.jobs < 1) {
+                fprintf(stderr, "Invalid number of jobs: %s\n", argv[i]);
+                exit(16);
+            }
+        }
+        else if (strcmp(argv[i], "--delta-mode") == 0) {
+            if (argc <= (i + 1)) {
+                fprintf(stderr, "Missing delta mode argument\n");
+                fprintf(stderr, "Usage: --delta-mode linear|hash|optimal\n");
+                exit(16);
+            }
+            i++;
+            if (strcmp(argv[i], "linear") == 0) {
+                CMD.delta_mode = WB_DIFF_MODE_LINEAR;
+            }
+            else if (strcmp(argv[i], "hash") == 0) {
+                CMD.delta_mode = WB_DIFF_MODE_HASH;
+            }
+            else if (strcmp(argv[i], "optimal") == 0) {
+                CMD.delta_mode = WB_DIFF_MODE_OPTIMAL;
+            }
+            else {
+                fprintf(stderr, "Invalid delta mode: %s\n", argv[i]);
+                exit(16);
+            }
         } else if (strcmp(argv[i], "--no-base-sha") == 0) {
             CMD.no_base_sha = 1;
         }
@@ -2847,45 +3243,27 @@ int main(int argc, char** argv)
             }
             CMD.cert_chain_file = argv[++i];
         }
+        else if (strcmp(argv[i], "--batch") == 0) {
+            if (argc <= (i + 1)) {
+                fprintf(stderr, "Missing batch manifest file argument\n");
+                exit(16);
+            }
+            CMD.batch_file = argv[++i];
+        }
         else {
             i--;
             break;
         }
     }
-    if ((CMD.sign == CMD.secondary_sign) && (CMD.hybrid)) {
-        printf("Warning: Duplicate signature algorithm detected. Fix your command line!\n");
-        CMD.hybrid = 0;
-        CMD.secondary_key_file = NULL;
-        CMD.secondary_signature_sz = 0;
-    }
-
+    return i;
+}
 
-    if (CMD.sign != NO_SIGN) {
-        if (CMD.hybrid) {
-            printf("Parsing arguments in hybrid mode\n");
-            CMD.image_file = argv[i+1];
-            CMD.key_file = argv[i+2];
-            CMD.secondary_key_file = argv[i+3];
-            CMD.fw_version = argv[i+4];
-            if (CMD.manual_sign) {
-                CMD.signature_file = argv[i+5];
-            }
-            printf("Secondary private key: %s\n", CMD.secondary_key_file);
-            printf("Secondary cipher: %s\n", secondary_sign_str);
-            printf("Version: %s\n", CMD.fw_version);
-        } else {
-            CMD.image_file = argv[i+1];
-            CMD.key_file = argv[i+2];
-            CMD.fw_version = argv[i+3];
-            if (CMD.manual_sign) {
-                CMD.signature_file = argv[i+4];
-            }
-        }
-    } else {
-        CMD.image_file = argv[i+1];
-        CMD.key_file = NULL;
-        CMD.fw_version = argv[i+2];
-    }
+/* Derive the output file names from the input image name and version.
+ * 'output' overrides the name of the signed image, if not NULL. */
+static void set_output_files(const char *output)
+{
+    char* tmpstr;
+    uint8_t  buf[PATH_MAX-32]; /* leave room to avoid "directive output may be truncated" */
 
     memset(buf, 0, sizeof(buf));
     strncpy((char*)buf, CMD.image_file, sizeof(buf)-1);
@@ -2893,7 +3271,10 @@ int main(int argc, char** argv)
     if (tmpstr) {
         *tmpstr = '\0'; /* null terminate at last "." */
     }
-    {
+    if (output) {
+        snprintf(CMD.output_image_file, sizeof(CMD.output_image_file) - 1,
+                 "%s", output);
+    } else {
         const char* artifact =
             CMD.header_only ? "header" : (CMD.sha_only ? "digest" : "signed");
         snprintf(CMD.output_image_file, sizeof(CMD.output_image_file) - 1,
@@ -2905,6 +3286,19 @@ int main(int argc, char** argv)
             "%s_v%s_signed_and_encrypted.bin",
             (char*)buf, CMD.fw_version);
 
+    if (CMD.delta) {
+        snprintf(CMD.output_diff_file, sizeof(CMD.output_image_file),
+                "%s_v%s_signed_diff.bin",
+                (char*)buf, CMD.fw_version);
+        snprintf(CMD.output_encrypted_image_file,
+                sizeof(CMD.output_encrypted_image_file),
+                "%s_v%s_signed_diff_encrypted.bin",
+                (char*)buf, CMD.fw_version);
+    }
+}
+
+static void print_image_info(void)
+{
     printf("Update type:          %s\n",
             CMD.self_update ? "wolfBoot" : "Firmware");
     switch(CMD.encrypt) {
@@ -2932,13 +3326,6 @@ int main(int argc, char** argv)
     }
     if (CMD.delta) {
         printf("Delta Base file:      %s\n", CMD.delta_base_file);
-        snprintf(CMD.output_diff_file, sizeof(CMD.output_image_file),
-                "%s_v%s_signed_diff.bin",
-                (char*)buf, CMD.fw_version);
-        snprintf(CMD.output_encrypted_image_file,
-                sizeof(CMD.output_encrypted_image_file),
-                "%s_v%s_signed_diff_encrypted.bin",
-                (char*)buf, CMD.fw_version);
     }
     printf("Output %6s:        %s\n",
            CMD.header_only ? "header" : (CMD.sha_only ? "digest" : "image"),
@@ -2972,6 +3359,406 @@ int main(int argc, char** argv)
             printf("-----\n");
         }
     }
+}
+
+/* Create the signed image (and the delta update, if requested) described by
+ * CMD, with the keys already loaded */
+static int sign_image(uint8_t *pubkey, uint32_t pubkey_sz,
+        uint8_t *pubkey2, uint32_t pubkey_sz2)
+{
+    int ret;
+
+    if (CMD.hybrid) {
+        printf("Creating hybrid signature\n");
+        ret = make_hybrid_header(pubkey, pubkey_sz, CMD.image_file,
+                CMD.output_image_file, pubkey2, pubkey_sz2);
+        DEBUG_PRINT("Signature size: %u\n", CMD.signature_sz);
+        DEBUG_PRINT("Secondary signature size: %u\n", CMD.secondary_signature_sz);
+        DEBUG_PRINT("Header size: %u\n", CMD.header_sz);
+    } else {
+        ret = make_header(pubkey, pubkey_sz, CMD.image_file, CMD.output_image_file);
+    }
+
+    if ((ret == 0) && CMD.delta) {
+        if (CMD.encrypt)
+            ret = base_diff(CMD.delta_base_file, pubkey, pubkey_sz, 64);
+        else
+            ret = base_diff(CMD.delta_base_file, pubkey, pubkey_sz, 16);
+    }
+    return ret;
+}
+
+/* Batch mode: sign all the images listed in a manifest file, one per line:
+ *
+ *   [options] image version [output]
+ *
+ * The options are the same as on the command line, except for the signature
+ * algorithm, which is common to the whole batch. Keys are loaded once, then
+ * the images are signed by up to --jobs worker processes.
+ */
+#define BATCH_MAX_ARGS 64
+
+struct sign_job {
+    struct cmd_options cmd;
+    const char *hash_str;
+    char *line;
+    double start;
+    double elapsed;
+#if !defined(_WIN32)
+    pid_t pid;
+    FILE *log;
+#endif
+    int ret;
+};
+
+static double batch_time(void)
+{
+#ifdef _WIN32
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+/* Split a manifest line into arguments, in place. Double quotes group
+ * arguments containing spaces. Returns the number of arguments, or -1. */
+static int batch_split(char *line, char **args, int max_args)
+{
+    int n = 0;
+    char *p = line, *q;
+
+    while (1) {
+        while ((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\n'))
+            p++;
+        if ((*p == '\0') || (*p == '#'))
+            break;
+        if (n >= max_args)
+            return -1;
+        if (*p == '"') {
+            q = strchr(++p, '"');
+            if (q == NULL)
+                return -1;
+        } else {
+            q = p + strcspn(p, " \t\r\n");
+        }
+        args[n++] = p;
+        if (*q == '\0')
+            break;
+        *q = '\0';
+        p = q + 1;
+    }
+    args[n] = NULL;
+    return n;
+}
+
+/* Stateful hash-based keys must never sign from two copies of the same
+ * state, so they are used in this process, one image at a time. */
+static int batch_key_is_stateful(void)
+{
+    return (CMD.sign == SIGN_LMS) || (CMD.sign == SIGN_XMSS) ||
+        (CMD.hybrid && ((CMD.secondary_sign == SIGN_LMS) ||
+                        (CMD.secondary_sign == SIGN_XMSS)));
+}
+
+static int batch_run_job(struct sign_job *job, uint8_t *pubkey,
+        uint32_t pubkey_sz, uint8_t *pubkey2, uint32_t pubkey_sz2)
+{
+    memcpy(&CMD, &job->cmd, sizeof(CMD));
+    hash_str = job->hash_str;
+    print_image_info();
+    set_signature_sizes(0);
+    if (CMD.hybrid)
+        set_signature_sizes(1);
+    return sign_image(pubkey, pubkey_sz, pubkey2, pubkey_sz2);
+}
+
+static void batch_report(struct sign_job *job, uint32_t idx, uint32_t n_jobs)
+{
+    printf("[%u/%u] %s -> %s: %s, %.3f s\n", idx + 1, n_jobs,
+        job->cmd.image_file, job->cmd.output_image_file,
+        (job->ret == 0) ? "OK" : "FAILED", job->elapsed);
+}
+
+static int sign_batch(uint8_t *pubkey, uint32_t pubkey_sz,
+        uint8_t *pubkey2, uint32_t pubkey_sz2)
+{
+    struct cmd_options base;
+    const char *base_hash_str = hash_str;
+    struct sign_job *jobs = NULL, *job;
+    char line[4096];
+    char *args[BATCH_MAX_ARGS + 1];
+    uint32_t n_jobs = 0, lineno = 0, j, failed = 0;
+    int workers = CMD.jobs;
+    int nargs, i;
+    int ret = 0;
+    double t0;
+    FILE *f;
+
+    memcpy(&base, &CMD, sizeof(base));
+    base.jobs = 1;
+    f = fopen(CMD.batch_file, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot open batch manifest %s: %s\n",
+                CMD.batch_file, strerror(errno));
+        return -1;
+    }
+
+    /* Parse the whole manifest first, so that errors are reported before
+     * anything is signed */
+    while ((ret == 0) && (fgets(line, sizeof(line), f) != NULL)) {
+        char *copy;
+        lineno++;
+        copy = strdup(line);
+        nargs = (copy != NULL) ? batch_split(copy, args, BATCH_MAX_ARGS) : -1;
+        if (nargs == 0) {
+            free(copy);
+            continue;
+        }
+        if (nargs < 0) {
+            fprintf(stderr, "%s:%u: invalid line\n", CMD.batch_file, lineno);
+            free(copy);
+            ret = -1;
+            break;
+        }
+        job = realloc(jobs, (n_jobs + 1) * sizeof(*jobs));
+        if (job == NULL) {
+            free(copy);
+            ret = -1;
+            break;
+        }
+        jobs = job;
+        job = &jobs[n_jobs++];
+        memset(job, 0, sizeof(*job));
+        job->line = copy;
+
+        memcpy(&CMD, &base, sizeof(CMD));
+        hash_str = base_hash_str;
+        i = parse_options(nargs, args, 0);
+        if ((CMD.sign != base.sign) || (CMD.hybrid != base.hybrid) ||
+                (CMD.secondary_sign != base.secondary_sign) ||
+                CMD.manual_sign || (CMD.batch_file != base.batch_file)) {
+            fprintf(stderr, "%s:%u: signature options must be given on the "
+                    "command line\n", base.batch_file, lineno);
+            ret = -1;
+        } else if ((nargs < i + 3) || (nargs > i + 4)) {
+            fprintf(stderr, "%s:%u: expected: [options] image version "
+                    "[output]\n", base.batch_file, lineno);
+            ret = -1;
+        } else {
+            CMD.image_file = args[i + 1];
+            CMD.fw_version = args[i + 2];
+            set_output_files(args[i + 3]);
+        }
+        memcpy(&job->cmd, &CMD, sizeof(CMD));
+        job->hash_str = hash_str;
+    }
+    fclose(f);
+    memcpy(&CMD, &base, sizeof(CMD));
+    hash_str = base_hash_str;
+    if ((ret == 0) && (n_jobs == 0)) {
+        fprintf(stderr, "%s: no images to sign\n", CMD.batch_file);
+        ret = -1;
+    }
+#ifdef _WIN32
+    workers = 0;
+#endif
+    if (batch_key_is_stateful())
+        workers = 0;
+
+    if (ret == 0) {
+        if (workers == 0)
+            printf("Batch: signing %u images sequentially\n", n_jobs);
+        else
+            printf("Batch: signing %u images with %d workers\n", n_jobs,
+                    workers);
+    }
+    t0 = batch_time();
+    if ((ret == 0) && (workers == 0)) {
+        for (j = 0; j < n_jobs; j++) {
+            job = &jobs[j];
+            job->start = batch_time();
+            job->ret = batch_run_job(job, pubkey, pubkey_sz, pubkey2,
+                    pubkey_sz2);
+            job->elapsed = batch_time() - job->start;
+            batch_report(job, j, n_jobs);
+        }
+    }
+#if !defined(_WIN32)
+    else if (ret == 0) {
+        uint32_t next = 0, done = 0;
+        int running = 0;
+
+        while (done < n_jobs) {
+            pid_t pid;
+            int status;
+
+            while ((running < workers) && (next < n_jobs)) {
+                job = &jobs[next++];
+                job->log = tmpfile();
+                fflush(stdout);
+                fflush(stderr);
+                job->start = batch_time();
+                job->pid = fork();
+                if (job->pid == 0) {
+                    /* Worker: the output goes to the job log */
+                    if (job->log != NULL) {
+                        dup2(fileno(job->log), STDOUT_FILENO);
+                        dup2(fileno(job->log), STDERR_FILENO);
+                        setvbuf(stdout, NULL, _IOLBF, 0);
+                    }
+                    snprintf(wolfboot_delta_file, sizeof(wolfboot_delta_file),
+                            "/tmp/wolfboot-delta-%d.bin", (int)getpid());
+                    snprintf(wolfboot_merkle_file, sizeof(wolfboot_merkle_file),
+                            "/tmp/wolfboot-merkle-%d.bin", (int)getpid());
+                    snprintf(wolfboot_lz4_file, sizeof(wolfboot_lz4_file),
+                            "/tmp/wolfboot-lz4-%d.bin", (int)getpid());
+                    ret = batch_run_job(job, pubkey, pubkey_sz, pubkey2,
+                            pubkey_sz2);
+                    fflush(stdout);
+                    exit((ret == 0) ? 0 : 1);
+                }
+                if (job->pid < 0) {
+                    fprintf(stderr, "Cannot start batch worker: %s\n",
+                            strerror(errno));
+                    job->ret = -1;
+                    batch_report(job, next - 1, n_jobs);
+                    done++;
+                    continue;
+                }
+                running++;
+            }
+            if (running == 0)
+                continue;
+            pid = wait(&status);
+            if (pid < 0)
+                break;
+            for (j = 0; j < next; j++) {
+                if (jobs[j].pid == pid)
+                    break;
+            }
+            if (j == next)
+                continue;
+            job = &jobs[j];
+            job->elapsed = batch_time() - job->start;
+            job->ret = (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ?
+                0 : -1;
+            if (job->log != NULL) {
+                size_t sz;
+                rewind(job->log);
+                while ((sz = fread(line, 1, sizeof(line), job->log)) > 0)
+                    fwrite(line, 1, sz, stdout);
+                fclose(job->log);
+                job->log = NULL;
+            }
+            batch_report(job, j, n_jobs);
+            running--;
+            done++;
+        }
+    }
+#endif
+    if (ret == 0) {
+        for (j = 0; j < n_jobs; j++) {
+            if (jobs[j].ret != 0)
+                failed++;
+        }
+        printf("Batch: %u images signed, %u failed, %.3f s\n",
+                n_jobs - failed, failed, batch_time() - t0);
+        if (failed > 0)
+            ret = -1;
+    }
+
+    for (j = 0; j < n_jobs; j++) {
+        uint32_t k;
+        for (k = base.custom_tlvs; k < jobs[j].cmd.custom_tlvs; k++)
+            free(jobs[j].cmd.custom_tlv[k].buffer);
+        free(jobs[j].line);
+    }
+    free(jobs);
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    int ret = 0;
+    int i;
+    uint8_t *pubkey = NULL, *pubkey2 = NULL;
+    uint32_t pubkey_sz = 0, pubkey_sz2 = 0;
+    uint8_t *kbuf=NULL, *kbuf2 = NULL, *key_buffer, *key_buffer2;
+    uint32_t key_buffer_sz, key_buffer_sz2;
+
+#ifdef DEBUG_SIGNTOOL
+    wolfSSL_Debugging_ON();
+#endif
+
+    printf("wolfBoot KeyTools (Compiled C version)\n");
+    printf("wolfBoot version %X\n", WOLFBOOT_VERSION);
+
+    /* Check arguments and print usage */
+    if (argc < 4 || argc > 19) {
+        printf("Usage: %s [options] image key version\n", argv[0]);
+        printf("       %s [options] --batch manifest key\n", argv[0]);
+        printf("For full usage manual, see 'docs/Signing.md'\n");
+        exit(1);
+    }
+
+    /* Set initial manifest header size to a minimum default value */
+    CMD.header_sz = 256;
+
+    /* Parse Arguments */
+    i = parse_options(argc, argv, 1);
+    if ((CMD.sign == CMD.secondary_sign) && (CMD.hybrid)) {
+        printf("Warning: Duplicate signature algorithm detected. Fix your command line!\n");
+        CMD.hybrid = 0;
+        CMD.secondary_key_file = NULL;
+        CMD.secondary_signature_sz = 0;
+    }
+
+    if (CMD.batch_file) {
+        /* Only the keys on the command line, images are in the manifest */
+        if (CMD.manual_sign) {
+            fprintf(stderr, "--manual-sign is not supported in batch mode\n");
+            exit(16);
+        }
+        if (CMD.sign != NO_SIGN) {
+            CMD.key_file = argv[i+1];
+            if (CMD.hybrid)
+                CMD.secondary_key_file = argv[i+2];
+        }
+        printf("Batch manifest:       %s\n", CMD.batch_file);
+    }
+    else if (CMD.sign != NO_SIGN) {
+        if (CMD.hybrid) {
+            printf("Parsing arguments in hybrid mode\n");
+            CMD.image_file = argv[i+1];
+            CMD.key_file = argv[i+2];
+            CMD.secondary_key_file = argv[i+3];
+            CMD.fw_version = argv[i+4];
+            if (CMD.manual_sign) {
+                CMD.signature_file = argv[i+5];
+            }
+            printf("Secondary private key: %s\n", CMD.secondary_key_file);
+            printf("Secondary cipher: %s\n", secondary_sign_str);
+            printf("Version: %s\n", CMD.fw_version);
+        } else {
+            CMD.image_file = argv[i+1];
+            CMD.key_file = argv[i+2];
+            CMD.fw_version = argv[i+3];
+            if (CMD.manual_sign) {
+                CMD.signature_file = argv[i+4];
+            }
+        }
+    } else {
+        CMD.image_file = argv[i+1];
+        CMD.key_file = NULL;
+        CMD.fw_version = argv[i+2];
+    }
+
+    if (!CMD.batch_file) {
+        set_output_files(NULL);
+        print_image_info();
+    }
 
     set_signature_sizes(0);
     if (CMD.hybrid) {
@@ -2997,32 +3784,19 @@ int main(int argc, char** argv)
     } /* CMD.sign != NO_SIGN */
 
     if (CMD.hybrid) {
-        uint8_t *kbuf2 = NULL;
-        uint8_t *pubkey2 = NULL;
-        uint32_t pubkey_sz2;
         DEBUG_PRINT("Loading secondary key\n");
         kbuf2 = load_key(&key_buffer2, &key_buffer_sz2, &pubkey2, &pubkey_sz2, 1);
-        printf("Creating hybrid signature\n");
-        make_hybrid_header(pubkey, pubkey_sz, CMD.image_file, CMD.output_image_file,
-                pubkey2, pubkey_sz2);
-        DEBUG_PRINT("Signature size: %u\n", CMD.signature_sz);
-        DEBUG_PRINT("Secondary signature size: %u\n", CMD.secondary_signature_sz);
-        DEBUG_PRINT("Header size: %u\n", CMD.header_sz);
-        if (kbuf2)
-            free(kbuf2);
-        if (pubkey2)
-            free(pubkey2);
-    } else {
-        make_header(pubkey, pubkey_sz, CMD.image_file, CMD.output_image_file);
     }
 
+    if (CMD.batch_file)
+        ret = sign_batch(pubkey, pubkey_sz, pubkey2, pubkey_sz2);
+    else
+        ret = sign_image(pubkey, pubkey_sz, pubkey2, pubkey_sz2);
 
-    if (CMD.delta) {
-        if (CMD.encrypt)
-            ret = base_diff(CMD.delta_base_file, pubkey, pubkey_sz, 64);
-        else
-            ret = base_diff(CMD.delta_base_file, pubkey, pubkey_sz, 16);
-    }
+    if (kbuf2)
+        free(kbuf2);
+    if (pubkey2)
+        free(pubkey2);
 
     /* Add pubkey cleanup */
     if (pubkey)
@@ -74,6 +74,10 @@ HDR_IMG_TYPE_APP          = 0x0001
 WOLFBOOT_HEADER_SIZE = 256
 WOLFBOOT_PARTITION_SIZE = 0
 WOLFBOOT_SECTOR_SIZE = 0
+# Same as WOLFBOOT_TRAILER_SECTORS in wolfboot.h
+NVM_FLASH_WRITEONCE = False
+NVM_FLASH_JOURNAL = False
+NVM_JOURNAL_SECTORS = 4
 
 sign="auto"
 self_update=False
@@ -394,6 +398,13 @@ if cfile:
         if "WOLFBOOT_SECTOR_SIZE" in l:
             val=l.split('=')[1].rstrip('\n')
             WOLFBOOT_SECTOR_SIZE = int(val,0)
+        if not l.startswith('#'):
+            if "NVM_FLASH_WRITEONCE" in l:
+                NVM_FLASH_WRITEONCE = l.split('=')[1].strip() == '1'
+            if "NVM_FLASH_JOURNAL" in l:
+                NVM_FLASH_JOURNAL = l.split('=')[1].strip() == '1'
+            if "NVM_JOURNAL_SECTORS" in l:
+                NVM_JOURNAL_SECTORS = int(l.split('=')[1].strip(), 0)
 
         l = cfile.readline()
     cfile.close()
@@ -716,19 +727,26 @@ outfile.close()
 if WOLFBOOT_PARTITION_SIZE > 0:
     img_size = os.path.getsize(image_file)
     total_img_sz = WOLFBOOT_HEADER_SIZE + img_size
-    # Only subtract sector for trailer when sector < partition.
+    # Only subtract sectors for trailer when sector < partition.
     # When sector >= partition (e.g. update_ram targets), the
     # entire partition is available for the image.
+    # NVM_FLASH_WRITEONCE reserves 2 sectors (active + redundant),
+    # NVM_FLASH_JOURNAL reserves NVM_JOURNAL_SECTORS.
+    trailer_sectors = 1
+    if NVM_FLASH_WRITEONCE:
+        trailer_sectors = NVM_JOURNAL_SECTORS if NVM_FLASH_JOURNAL else 2
     if WOLFBOOT_SECTOR_SIZE < WOLFBOOT_PARTITION_SIZE:
-        max_img_sz = WOLFBOOT_PARTITION_SIZE - WOLFBOOT_SECTOR_SIZE
+        max_img_sz = max(0, WOLFBOOT_PARTITION_SIZE -
+                         trailer_sectors * WOLFBOOT_SECTOR_SIZE)
     else:
         max_img_sz = WOLFBOOT_PARTITION_SIZE
     if total_img_sz > max_img_sz:
         if WOLFBOOT_SECTOR_SIZE < WOLFBOOT_PARTITION_SIZE:
             print("Error: Image size %d (header %d + firmware %d) "
-                "exceeds max %d (partition %d - sector %d)" %
+                "exceeds max %d (partition %d - %d x sector %d)" %
                 (total_img_sz, WOLFBOOT_HEADER_SIZE, img_size,
-                max_img_sz, WOLFBOOT_PARTITION_SIZE, WOLFBOOT_SECTOR_SIZE))
+                max_img_sz, WOLFBOOT_PARTITION_SIZE, trailer_sectors,
+                WOLFBOOT_SECTOR_SIZE))
         else:
             print("Error: Image size %d (header %d + firmware %d) "
                 "exceeds max %d (partition %d)" %
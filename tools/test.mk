@@ -38,6 +38,35 @@ test-size: FORCE
 	$(Q)$(CROSS_COMPILE)strip wolfboot.elf
 	$(Q)FP=`$(SIZE) -A wolfboot.elf | awk ' /Total/ {print $$2;}'`; echo SIZE: $$FP LIMIT: $$LIMIT; test $$FP -le $$LIMIT
 
+# Batch signing: the images signed by parallel workers (--jobs) must be the
+# same as the ones signed one by one. ED25519 signatures are deterministic.
+SIGN_BATCH_DIR=sign-batch
+SIGN_BATCH_IMAGES=1 2 3 4 5 6
+
+test-sign-batch: FORCE
+	$(Q)rm -rf $(SIGN_BATCH_DIR) && mkdir -p $(SIGN_BATCH_DIR)
+	$(Q)$(KEYGEN_TOOL) --ed25519 --force -g $(SIGN_BATCH_DIR)/key.der \
+		-keystoreDir $(SIGN_BATCH_DIR)
+	$(Q)for i in $(SIGN_BATCH_IMAGES); do \
+		dd if=/dev/urandom of=$(SIGN_BATCH_DIR)/img$$i.bin bs=1k count=$$((i * 37)) 2>/dev/null; \
+		$(SIGN_TOOL) --ed25519 --sha256 --no-ts $(SIGN_BATCH_DIR)/img$$i.bin \
+			$(SIGN_BATCH_DIR)/key.der $$i >/dev/null || exit 1; \
+		echo "$(SIGN_BATCH_DIR)/img$$i.bin $$i $(SIGN_BATCH_DIR)/batch$$i.bin" \
+			>> $(SIGN_BATCH_DIR)/manifest.txt; \
+	done
+	$(Q)$(SIGN_TOOL) --ed25519 --sha256 --no-ts --jobs 4 \
+		--batch $(SIGN_BATCH_DIR)/manifest.txt $(SIGN_BATCH_DIR)/key.der
+	$(Q)for i in $(SIGN_BATCH_IMAGES); do \
+		cmp $(SIGN_BATCH_DIR)/img$${i}_v$${i}_signed.bin \
+			$(SIGN_BATCH_DIR)/batch$$i.bin || exit 1; \
+	done
+	@# A failed image is reported in the exit code
+	$(Q)echo "$(SIGN_BATCH_DIR)/missing.bin 7" >> $(SIGN_BATCH_DIR)/manifest.txt
+	$(Q)! $(SIGN_TOOL) --ed25519 --sha256 --no-ts --jobs 4 \
+		--batch $(SIGN_BATCH_DIR)/manifest.txt $(SIGN_BATCH_DIR)/key.der
+	$(Q)rm -rf $(SIGN_BATCH_DIR)
+	@echo "Batch signing test: OK"
+
 # Testbed actions
 #
 #
@@ -30,6 +30,8 @@
 #include <fcntl.h>
 #include "wolfboot/wolfboot.h"
 #include "hal.h"
+#include "uart_flash.h"
+#include <poll.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <termios.h>
@@ -43,18 +45,15 @@
 #endif
 
 
-#define CMD_HDR_WOLF  'W'
-#define CMD_HDR_VER   'V'
-#define CMD_APP_VER   '*'
-#define CMD_HDR_WRITE 0x01
-#define CMD_HDR_READ  0x02
-#define CMD_HDR_ERASE 0x03
-#define CMD_ACK       0x06
-
 #define FIRMWARE_PARTITION_SIZE 0x20000
 #define SWAP_SIZE 0x1000
 #define UART_BITRATE 115200
 
+/* Protocol v2 timeouts */
+#define UF2_BYTE_TIMEOUT_MS  100
+#define UF2_FRAME_TIMEOUT_MS 1000
+#define UF2_RETRIES          8
+
 /* Change the following to 1 to debug flash access */
 #define LOG_FLASH_ADDRESS 0
 
@@ -354,6 +353,301 @@ static void uart_flash_write(uint8_t *base, int ud)
 }
 
 
+/* Protocol v2 */
+struct uf2_frame {
+    uint8_t type;
+    uint8_t seq;
+    uint16_t len;
+    uint8_t payload[UART_FLASH_FRAME_MAX];
+};
+
+/* Next sequence number acknowledged at the end of the last write, repeated
+ * if the target retransmits its last frames because the ACK was lost */
+static uint8_t uf2_last_ack = 0;
+
+static int read_byte_timeout(int ud, uint8_t *c, int ms)
+{
+    struct pollfd pfd;
+    pfd.fd = ud;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, ms) <= 0)
+        return -1;
+    return (read(ud, c, 1) == 1) ? 0 : -1;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Receive a frame, after the start-of-frame byte.
+ * Returns 0 on success, -1 on timeout, -2 if the frame is corrupted.
+ */
+static int uf2_rx_frame_body(int ud, struct uf2_frame *f)
+{
+    uint8_t hdr[UART_FLASH_FRAME_HDR_SIZE];
+    uint8_t c[2];
+    uint16_t crc;
+    int i;
+
+    for (i = 0; i < UART_FLASH_FRAME_HDR_SIZE; i++) {
+        if (read_byte_timeout(ud, &hdr[i], UF2_BYTE_TIMEOUT_MS) != 0)
+            return -1;
+    }
+    f->len = hdr[2] | (hdr[3] << 8);
+    if (f->len > UART_FLASH_FRAME_MAX)
+        return -2;
+    for (i = 0; i < f->len; i++) {
+        if (read_byte_timeout(ud, &f->payload[i], UF2_BYTE_TIMEOUT_MS) != 0)
+            return -1;
+    }
+    for (i = 0; i < 2; i++) {
+        if (read_byte_timeout(ud, &c[i], UF2_BYTE_TIMEOUT_MS) != 0)
+            return -1;
+    }
+    crc = uart_flash_crc16(UART_FLASH_CRC_INIT, hdr, sizeof(hdr));
+    crc = uart_flash_crc16(crc, f->payload, f->len);
+    if (crc != (c[0] | (c[1] << 8)))
+        return -2;
+    f->type = hdr[0];
+    f->seq = hdr[1];
+    return 0;
+}
+
+static int uf2_rx_frame(int ud, struct uf2_frame *f, int ms)
+{
+    uint8_t c;
+    do {
+        if (read_byte_timeout(ud, &c, ms) != 0)
+            return -1;
+    } while (c != UART_FLASH_SOF);
+    return uf2_rx_frame_body(ud, f);
+}
+
+static void uf2_tx_frame(int ud, uint8_t type, uint8_t seq,
+    const uint8_t *payload, uint16_t len)
+{
+    uint8_t buf[1 + UART_FLASH_FRAME_HDR_SIZE + UART_FLASH_FRAME_MAX + 2];
+    uint16_t crc;
+    int sz = 0;
+
+    buf[sz++] = UART_FLASH_SOF;
+    buf[sz++] = type;
+    buf[sz++] = seq;
+    buf[sz++] = len & 0xFF;
+    buf[sz++] = (len >> 8) & 0xFF;
+    if (len > 0)
+        memcpy(buf + sz, payload, len);
+    sz += len;
+    crc = uart_flash_crc16(UART_FLASH_CRC_INIT, buf + 1,
+        UART_FLASH_FRAME_HDR_SIZE + len);
+    buf[sz++] = crc & 0xFF;
+    buf[sz++] = (crc >> 8) & 0xFF;
+    if (write(ud, buf, sz) != sz)
+        fprintf(stderr, "UART write error\n");
+}
+
+static int uf2_valid_range(uint32_t address, uint32_t len)
+{
+    return (len <= (FIRMWARE_PARTITION_SIZE + SWAP_SIZE)) &&
+        (address <= (FIRMWARE_PARTITION_SIZE + SWAP_SIZE) - len);
+}
+
+static uint32_t uf2_frame_size(uint32_t len, uint32_t idx)
+{
+    uint32_t sz = len - (idx - 1) * UART_FLASH_FRAME_MAX;
+    return (sz > UART_FLASH_FRAME_MAX) ? UART_FLASH_FRAME_MAX : sz;
+}
+
+/* The uf2_* transfer functions return 1 if they stopped because a new
+ * command was received in 'f', 0 otherwise. */
+static int uf2_write(uint8_t *base, int ud, struct uf2_frame *f)
+{
+    uint8_t cmd[UART_FLASH_CMD_SIZE];
+    uint32_t address = get_u32(f->payload);
+    uint32_t len = get_u32(f->payload + 4);
+    uint32_t n_frames = 1 + (len + UART_FLASH_FRAME_MAX - 1) /
+        UART_FLASH_FRAME_MAX;
+    uint32_t expected = 1, sz;
+    int nak_sent = 0, bad_frame = 0, retries = 0, ret;
+    uint8_t s0 = f->seq, cur;
+
+    memcpy(cmd, f->payload, sizeof(cmd));
+    if (address < FIRMWARE_PARTITION_SIZE) {
+        printmsg(msgWriteUpdate);
+    } else {
+        printmsg(msgWriteSwap);
+    }
+#if LOG_FLASH_ADDRESS
+    printf("Write @%x\n", address);
+#endif
+    uf2_last_ack = (uint8_t)(s0 + 1);
+    uf2_tx_frame(ud, UART_FLASH_FRAME_ACK, uf2_last_ack, NULL, 0);
+    while (expected < n_frames) {
+        cur = (uint8_t)(s0 + expected);
+        ret = uf2_rx_frame(ud, f, UF2_FRAME_TIMEOUT_MS);
+        if (ret == -1) {
+            if (++retries > UF2_RETRIES)
+                break;
+            continue;
+        }
+        if (ret == -2) {
+            /* NAK each corrupted frame, but not the noise that follows */
+            if (!bad_frame)
+                uf2_tx_frame(ud, UART_FLASH_FRAME_NAK, cur, NULL, 0);
+            bad_frame = 1;
+            nak_sent = 1;
+            continue;
+        }
+        bad_frame = 0;
+        if ((f->type == UART_FLASH_FRAME_WRITE) && (f->seq == s0) &&
+                (f->len == sizeof(cmd)) &&
+                (memcmp(f->payload, cmd, sizeof(cmd)) == 0)) {
+            /* Command retransmitted */
+            uf2_tx_frame(ud, UART_FLASH_FRAME_ACK, cur, NULL, 0);
+            continue;
+        }
+        if (f->type != UART_FLASH_FRAME_DATA)
+            return 1;
+        sz = uf2_frame_size(len, expected);
+        if ((f->seq == cur) && (f->len == sz)) {
+            memcpy(base + address + (expected - 1) * UART_FLASH_FRAME_MAX,
+                f->payload, sz);
+            expected++;
+            nak_sent = 0;
+            retries = 0;
+            uf2_last_ack = (uint8_t)(cur + 1);
+            uf2_tx_frame(ud, UART_FLASH_FRAME_ACK, uf2_last_ack, NULL, 0);
+        } else if ((f->seq != cur) &&
+                ((uint8_t)(cur - f->seq) <= UART_FLASH_WINDOW)) {
+            uf2_tx_frame(ud, UART_FLASH_FRAME_ACK, cur, NULL, 0);
+        } else if (!nak_sent) {
+            uf2_tx_frame(ud, UART_FLASH_FRAME_NAK, cur, NULL, 0);
+            nak_sent = 1;
+        }
+    }
+    msync(base, FIRMWARE_PARTITION_SIZE + SWAP_SIZE, MS_SYNC);
+    return 0;
+}
+
+static int uf2_read(uint8_t *base, int ud, struct uf2_frame *f)
+{
+    uint8_t cmd[UART_FLASH_CMD_SIZE];
+    uint32_t address = get_u32(f->payload);
+    uint32_t len = get_u32(f->payload + 4);
+    uint32_t n_frames = 1 + (len + UART_FLASH_FRAME_MAX - 1) /
+        UART_FLASH_FRAME_MAX;
+    uint32_t b = 1, next = 1, idx;
+    int retries = 0, ret;
+    uint8_t s0 = f->seq;
+
+    memcpy(cmd, f->payload, sizeof(cmd));
+    if (len == 16) {
+        printmsg(msgSha);
+    } else if (address < FIRMWARE_PARTITION_SIZE) {
+        printmsg(msgReadUpdate);
+    } else {
+        printmsg(msgReadSwap);
+    }
+#if LOG_FLASH_ADDRESS
+    printf("Read @%x\n", address);
+#endif
+    while (b < n_frames) {
+        while ((next < n_frames) && (next - b < UART_FLASH_WINDOW)) {
+            uf2_tx_frame(ud, UART_FLASH_FRAME_DATA, (uint8_t)(s0 + next),
+                base + address + (next - 1) * UART_FLASH_FRAME_MAX,
+                uf2_frame_size(len, next));
+            next++;
+        }
+        ret = uf2_rx_frame(ud, f, UF2_FRAME_TIMEOUT_MS);
+        if (ret == -1) {
+            if (++retries > UF2_RETRIES)
+                break;
+            next = b;
+            continue;
+        }
+        if (ret == -2)
+            continue;
+        if ((f->type == UART_FLASH_FRAME_ACK) ||
+                (f->type == UART_FLASH_FRAME_NAK)) {
+            idx = b + (uint8_t)(f->seq - s0 - b);
+            if (idx > next)
+                continue;
+            b = idx;
+            if (f->type == UART_FLASH_FRAME_NAK)
+                next = idx;
+            else
+                retries = 0;
+        } else if ((f->type == UART_FLASH_FRAME_READ) && (f->seq == s0) &&
+                (f->len == sizeof(cmd)) &&
+                (memcmp(f->payload, cmd, sizeof(cmd)) == 0)) {
+            /* Command retransmitted: start over */
+            b = next = 1;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void uf2_erase(uint8_t *base, int ud, struct uf2_frame *f)
+{
+    uint32_t address = get_u32(f->payload);
+    uint32_t len = get_u32(f->payload + 4);
+
+    if (address < FIRMWARE_PARTITION_SIZE) {
+        printmsg(msgEraseUpdate);
+    } else {
+        printmsg(msgEraseSwap);
+    }
+#if LOG_FLASH_ADDRESS
+    printf("Erase @%x\n", address);
+#endif
+    memset(base + address, 0xFF, len);
+    msync(base, FIRMWARE_PARTITION_SIZE + SWAP_SIZE, MS_SYNC);
+    uf2_tx_frame(ud, UART_FLASH_FRAME_ACK, (uint8_t)(f->seq + 1), NULL, 0);
+}
+
+/* Serve protocol v2 frames, after a start-of-frame byte was received */
+static void uf2_serve(uint8_t *base, int ud)
+{
+    struct uf2_frame f;
+    int pending;
+
+    /* Corrupted frames are dropped: the target will retransmit */
+    if (uf2_rx_frame_body(ud, &f) != 0)
+        return;
+    do {
+        pending = 0;
+        switch (f.type) {
+            case UART_FLASH_FRAME_WRITE:
+            case UART_FLASH_FRAME_READ:
+            case UART_FLASH_FRAME_ERASE:
+                if ((f.len != UART_FLASH_CMD_SIZE) ||
+                        !uf2_valid_range(get_u32(f.payload),
+                            get_u32(f.payload + 4))) {
+                    uf2_tx_frame(ud, UART_FLASH_FRAME_ERR, f.seq, NULL, 0);
+                    break;
+                }
+                if (f.type == UART_FLASH_FRAME_WRITE)
+                    pending = uf2_write(base, ud, &f);
+                else if (f.type == UART_FLASH_FRAME_READ)
+                    pending = uf2_read(base, ud, &f);
+                else
+                    uf2_erase(base, ud, &f);
+                break;
+            case UART_FLASH_FRAME_DATA:
+                /* End of a write whose last ACK was lost */
+                if ((uint8_t)(uf2_last_ack - f.seq - 1) < UART_FLASH_WINDOW)
+                    uf2_tx_frame(ud, UART_FLASH_FRAME_ACK, uf2_last_ack,
+                        NULL, 0);
+                break;
+            default:
+                break;
+        }
+    } while (pending);
+}
+
 static void serve_update(uint8_t *base, const char *uart_dev)
 {
     int ret = 0;
@@ -373,6 +667,10 @@ static void serve_update(uint8_t *base, const char *uart_dev)
        if (ret == 0)
            continue;
 
+       if (buf[0] == UART_FLASH_SOF) {
+           uf2_serve(base, ud);
+           continue;
+       }
        if ((buf[0] != CMD_HDR_WOLF) &&
            (buf[0] != CMD_HDR_VER) &&
            (buf[0] != CMD_APP_VER)) {
@@ -438,6 +736,16 @@ static void serve_update(uint8_t *base, const char *uart_dev)
                send_ack(ud);
                uart_flash_write(base, ud);
                break;
+           case CMD_HDR_HELLO:
+               {
+                   uint8_t ver = UART_FLASH_PROTO_V2;
+                   send_ack(ud);
+                   if (write(ud, &ver, 1) != 1) {
+                       fprintf(stderr, "UART write error\n");
+                       return;
+                   }
+               }
+               break;
            default:
                fprintf(stderr, "Unrecognized command: %02X\n", buf[0]);
                break;
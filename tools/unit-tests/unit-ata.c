@@ -0,0 +1,343 @@
+/* unit-ata.c
+ *
+ * Unit tests for the AHCI/ATA driver (src/x86/ata.c), running against a
+ * mocked AHCI port that executes the command list from memory.
+ *
+ *
+ * Copyright (C) 2025 wolfSSL Inc.
+ *
+ * This file is part of wolfBoot.
+ *
+ * wolfBoot is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfBoot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335, USA
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "x86/ata.c"
+
+/* The command list and the PRDT hold 32-bit addresses: this test is linked
+ * with -no-pie, so that all the static buffers below are in the low 4GB.
+ */
+#define MOCK_AHCI_BASE 0x10000
+#define MOCK_PORT 0
+#define MOCK_DISK_SIZE (8 * 1024 * 1024)
+#define MOCK_SECTOR_SIZE 512
+
+static uint8_t mock_disk[MOCK_DISK_SIZE];
+static uint8_t read_buf[MOCK_DISK_SIZE];
+static uint8_t clb[0x400] __attribute__((aligned(0x400)));
+static uint8_t ctable[ATA_CMD_TABLE_SIZE * ATA_MAX_CMD_SLOTS]
+    __attribute__((aligned(0x80)));
+static uint8_t rfis[0x100] __attribute__((aligned(0x100)));
+
+/* Mocked HBA state */
+static uint32_t reg_cap, reg_is, reg_cmd, reg_serr, reg_sact, reg_ci;
+static uint32_t queued;      /* Slots accepted by the port, not yet done */
+static int max_outstanding;
+static int n_read_cmds;
+static int n_fpdma_cmds;
+static int max_prdtl;
+static int64_t fail_lba = -1;
+static uint16_t identify_sata_cap;
+static uint16_t identify_qdepth;
+
+static int popcount32(uint32_t v)
+{
+    int n = 0;
+    while (v) {
+        n += v & 1;
+        v >>= 1;
+    }
+    return n;
+}
+
+/* Copy between the mocked disk and the PRDT of the command table */
+static void mock_dma(struct hba_cmd_header *cmd, uint64_t off, int to_disk)
+{
+    struct hba_cmd_table *tbl = (struct hba_cmd_table *)(uintptr_t)cmd->ctba;
+    uint32_t len;
+    int i;
+    if (cmd->prdtl > max_prdtl)
+        max_prdtl = cmd->prdtl;
+    for (i = 0; i < cmd->prdtl; i++) {
+        len = tbl->prdt_entry[i].dbc + 1;
+        ck_assert_uint_le(off + len, MOCK_DISK_SIZE);
+        if (to_disk)
+            memcpy(mock_disk + off,
+                   (void *)(uintptr_t)tbl->prdt_entry[i].dba, len);
+        else
+            memcpy((void *)(uintptr_t)tbl->prdt_entry[i].dba,
+                   mock_disk + off, len);
+        off += len;
+    }
+}
+
+/* Execute the oldest accepted command. Returns 0 if a task file error was
+ * raised instead. */
+static int mock_complete_one(void)
+{
+    struct hba_cmd_header *cmd;
+    struct hba_cmd_table *tbl;
+    struct fis_reg_h2d *fis;
+    uint64_t lba;
+    uint32_t slot, count;
+    uint16_t *id;
+
+    for (slot = 0; slot < 32; slot++) {
+        if (queued & (1U << slot))
+            break;
+    }
+    cmd = (struct hba_cmd_header *)(uintptr_t)clb + slot;
+    tbl = (struct hba_cmd_table *)(uintptr_t)cmd->ctba;
+    ck_assert_uint_eq(cmd->ctba,
+        (uint32_t)(uintptr_t)ctable + slot * ATA_CMD_TABLE_SIZE);
+    fis = (struct fis_reg_h2d *)tbl->cfis;
+    lba = (uint64_t)fis->lba0 | ((uint64_t)fis->lba1 << 8) |
+        ((uint64_t)fis->lba2 << 16) | ((uint64_t)fis->lba3 << 24) |
+        ((uint64_t)fis->lba4 << 32) | ((uint64_t)fis->lba5 << 40);
+    if ((fail_lba >= 0) && ((int64_t)lba == fail_lba)) {
+        reg_is |= AHCI_PORT_IS_TFES;
+        return 0;
+    }
+    switch (fis->command) {
+        case ATA_CMD_IDENTIFY_DEVICE:
+            id = (uint16_t *)(uintptr_t)tbl->prdt_entry[0].dba;
+            memset(id, 0, ATA_IDENTIFY_DEVICE_COMMAND_LEN);
+            id[75] = identify_qdepth;
+            id[76] = identify_sata_cap;
+            break;
+        case ATA_CMD_READ_FPDMA_QUEUED:
+            ck_assert_uint_eq(fis->count >> 3, slot);
+            count = fis->feature_l | ((uint32_t)fis->feature_h << 8);
+            ck_assert_uint_eq(count * MOCK_SECTOR_SIZE,
+                tbl->prdt_entry[0].dbc + 1);
+            mock_dma(cmd, lba * MOCK_SECTOR_SIZE, 0);
+            n_read_cmds++;
+            n_fpdma_cmds++;
+            break;
+        case ATA_CMD_READ_DMA_EX:
+            mock_dma(cmd, lba * MOCK_SECTOR_SIZE, 0);
+            n_read_cmds++;
+            break;
+        case ATA_CMD_WRITE_DMA:
+            mock_dma(cmd, lba * MOCK_SECTOR_SIZE, 1);
+            break;
+        default:
+            ck_abort_msg("Unexpected ATA command %02x", fis->command);
+    }
+    queued &= ~(1U << slot);
+    reg_ci &= ~(1U << slot);
+    reg_sact &= ~(1U << slot);
+    return 1;
+}
+
+void mmio_write32(uintptr_t address, uint32_t value)
+{
+    uint32_t off = address - AHCI_PORT_REG_START(MOCK_AHCI_BASE, MOCK_PORT);
+    switch (off) {
+        case AHCI_PORT_IS_OFFSET:
+            reg_is &= ~value;
+            break;
+        case AHCI_PORT_SERR_OFFSET:
+            reg_serr &= ~value;
+            break;
+        case AHCI_PORT_CMD_OFFSET:
+            reg_cmd = value;
+            if ((value & AHCI_PORT_CMD_START) == 0) {
+                /* Stopping the engine drops all the outstanding commands */
+                queued = 0;
+                reg_ci = 0;
+                reg_sact = 0;
+            }
+            break;
+        case AHCI_PORT_SACT_OFFSET:
+            reg_sact |= value;
+            break;
+        case AHCI_PORT_CI_OFFSET:
+            reg_ci |= value;
+            queued |= value;
+            if (popcount32(queued) > max_outstanding)
+                max_outstanding = popcount32(queued);
+            break;
+        default:
+            ck_abort_msg("Unexpected MMIO write at %08lx", (unsigned long)address);
+    }
+}
+
+uint32_t mmio_read32(uintptr_t address)
+{
+    uint32_t off;
+    if (address == AHCI_HBA_CAP(MOCK_AHCI_BASE))
+        return reg_cap;
+    off = address - AHCI_PORT_REG_START(MOCK_AHCI_BASE, MOCK_PORT);
+    switch (off) {
+        case AHCI_PORT_IS_OFFSET:
+            return reg_is;
+        case AHCI_PORT_SERR_OFFSET:
+            return reg_serr;
+        case AHCI_PORT_CMD_OFFSET:
+            return reg_cmd;
+        case AHCI_PORT_TFD_OFFSET:
+            return 0;
+        case AHCI_PORT_SACT_OFFSET:
+            return reg_sact;
+        case AHCI_PORT_CI_OFFSET:
+            /* The port makes progress each time the driver polls it */
+            if ((queued != 0) && ((reg_is & AHCI_PORT_IS_TFES) == 0))
+                mock_complete_one();
+            return reg_ci;
+        default:
+            ck_abort_msg("Unexpected MMIO read at %08lx", (unsigned long)address);
+    }
+    return 0;
+}
+
+static int setup_drive(uint32_t cap, uint16_t sata_cap, uint16_t qdepth)
+{
+    int drv;
+    uint32_t i;
+
+    reg_cap = cap;
+    reg_is = reg_serr = reg_sact = reg_ci = 0;
+    reg_cmd = AHCI_PORT_CMD_START;
+    queued = 0;
+    max_outstanding = 0;
+    n_read_cmds = n_fpdma_cmds = 0;
+    max_prdtl = 0;
+    fail_lba = -1;
+    identify_sata_cap = sata_cap;
+    identify_qdepth = qdepth;
+    for (i = 0; i < MOCK_DISK_SIZE; i++)
+        mock_disk[i] = (uint8_t)((i * 7) ^ (i >> 9));
+    memset(read_buf, 0, sizeof(read_buf));
+
+    ata_drive_count = -1;
+    drv = ata_drive_new(MOCK_AHCI_BASE, MOCK_PORT, (uint32_t)(uintptr_t)clb,
+            (uint32_t)(uintptr_t)ctable, (uint32_t)(uintptr_t)rfis);
+    ck_assert_int_ge(drv, 0);
+    ck_assert_int_eq(ata_identify_device(drv), 0);
+    return drv;
+}
+
+START_TEST(test_ata_ncq_queued_read)
+{
+    /* 32 command slots, NCQ on both sides */
+    int drv = setup_drive(AHCI_CAP_SNCQ | (31 << 8), ATA_ID_SATA_CAP_NCQ, 31);
+    uint32_t off = 100, len = (1024 * 1024) + 300;
+
+    ck_assert_int_eq(ATA_Drv[drv].ncq, 1);
+    ck_assert_uint_eq(ATA_Drv[drv].queue_depth, ATA_MAX_CMD_SLOTS);
+    ck_assert_int_eq(ata_drive_read(drv, off, len, read_buf), len);
+    ck_assert_mem_eq(read_buf, mock_disk + off, len);
+    /* The aligned part is split into ATA_QUEUE_XFER_SECTORS commands, all
+     * queued at the same time */
+    ck_assert_int_eq(n_fpdma_cmds,
+        ((len - (MOCK_SECTOR_SIZE - off)) / MOCK_SECTOR_SIZE +
+         ATA_QUEUE_XFER_SECTORS - 1) / ATA_QUEUE_XFER_SECTORS);
+    ck_assert_int_eq(max_outstanding, ATA_MAX_CMD_SLOTS);
+}
+END_TEST
+
+START_TEST(test_ata_non_ncq_queued_read)
+{
+    /* 4 command slots, drive reports NCQ but the HBA does not */
+    int drv = setup_drive(3 << 8, ATA_ID_SATA_CAP_NCQ, 31);
+    uint32_t len = 512 * 1024;
+
+    ck_assert_int_eq(ATA_Drv[drv].ncq, 0);
+    ck_assert_uint_eq(ATA_Drv[drv].queue_depth, 4);
+    ck_assert_int_eq(ata_drive_read(drv, 0, len, read_buf), len);
+    ck_assert_mem_eq(read_buf, mock_disk, len);
+    ck_assert_int_eq(n_fpdma_cmds, 0);
+    ck_assert_int_eq(n_read_cmds, len / MOCK_SECTOR_SIZE / ATA_QUEUE_XFER_SECTORS);
+    ck_assert_int_eq(max_outstanding, 4);
+}
+END_TEST
+
+START_TEST(test_ata_drive_queue_depth)
+{
+    /* Drive queue depth (4) lower than the HBA slots */
+    int drv = setup_drive(AHCI_CAP_SNCQ | (31 << 8), ATA_ID_SATA_CAP_NCQ, 3);
+    uint32_t len = 512 * 1024;
+
+    ck_assert_int_eq(ATA_Drv[drv].ncq, 1);
+    ck_assert_uint_eq(ATA_Drv[drv].queue_depth, 4);
+    ck_assert_int_eq(ata_drive_read(drv, 0, len, read_buf), len);
+    ck_assert_mem_eq(read_buf, mock_disk, len);
+    ck_assert_int_eq(max_outstanding, 4);
+}
+END_TEST
+
+START_TEST(test_ata_ncq_error_fallback)
+{
+    int drv = setup_drive(AHCI_CAP_SNCQ | (31 << 8), ATA_ID_SATA_CAP_NCQ, 31);
+    uint32_t len = 1024 * 1024;
+
+    fail_lba = 3 * ATA_QUEUE_XFER_SECTORS;
+    ck_assert_int_eq(ata_drive_read(drv, 0, len, read_buf), -1);
+    ck_assert_int_eq(ATA_Drv[drv].ncq, 0);
+    ck_assert_uint_eq(reg_cmd & AHCI_PORT_CMD_START, AHCI_PORT_CMD_START);
+    ck_assert_uint_eq(reg_is, 0);
+
+    /* Following reads are not queued on the drive */
+    fail_lba = -1;
+    n_fpdma_cmds = 0;
+    ck_assert_int_eq(ata_drive_read(drv, 0, len, read_buf), len);
+    ck_assert_mem_eq(read_buf, mock_disk, len);
+    ck_assert_int_eq(n_fpdma_cmds, 0);
+}
+END_TEST
+
+START_TEST(test_ata_multi_prdt_write)
+{
+    int drv = setup_drive(31 << 8, 0, 0);
+    uint32_t len = ATA_PRDT_MAX_BYTES + (64 * 1024);
+    uint32_t i;
+
+    for (i = 0; i < len; i++)
+        read_buf[i] = (uint8_t)(i * 13);
+    ck_assert_int_eq(ata_drive_write(drv, 0, len, read_buf), len);
+    ck_assert_int_eq(max_prdtl, 2);
+    ck_assert_mem_eq(mock_disk, read_buf, len);
+}
+END_TEST
+
+Suite *wolfboot_suite(void)
+{
+    Suite *s = suite_create("wolfBoot");
+    TCase *ata = tcase_create("ATA queued reads");
+
+    tcase_add_test(ata, test_ata_ncq_queued_read);
+    tcase_add_test(ata, test_ata_non_ncq_queued_read);
+    tcase_add_test(ata, test_ata_drive_queue_depth);
+    tcase_add_test(ata, test_ata_ncq_error_fallback);
+    tcase_add_test(ata, test_ata_multi_prdt_write);
+    tcase_set_timeout(ata, 20);
+    suite_add_tcase(s, ata);
+    return s;
+}
+
+int main(void)
+{
+    int fails;
+    Suite *s = wolfboot_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    fails = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return fails;
+}
@@ -25,6 +25,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "delta.h"
 #define WC_RSA_BLINDING
@@ -327,6 +328,342 @@ START_TEST(test_wb_patch_and_diff)
 }
 END_TEST
 
+START_TEST(test_wb_diff_hash_mode_matches_linear)
+{
+    WB_DIFF_CTX diff_ctx;
+    static uint8_t src_a[4 * SRC_SIZE];
+    static uint8_t src_b[4 * SRC_SIZE];
+    static uint8_t patch_linear[4 * PATCH_SIZE];
+    static uint8_t patch_hash[4 * PATCH_SIZE];
+    uint32_t sz_linear = 0, sz_hash = 0;
+    int ret;
+    int i;
+
+    initialize_buffers(src_a, src_b, sizeof(src_a));
+    /* Move some content around, so matches are found backwards in 'B' too */
+    memcpy(src_b + 3 * SRC_SIZE, src_b + 100, 700);
+    memcpy(src_b + 2 * SRC_SIZE, src_a + 3 * SRC_SIZE + 17, 900);
+    memset(src_b + SRC_SIZE, 0xFF, 300);
+
+    ck_assert_int_eq(wb_diff_init_ex(&diff_ctx, src_a, sizeof(src_a), src_b,
+                sizeof(src_b), WB_DIFF_MODE_LINEAR), 0);
+    do {
+        ret = wb_diff(&diff_ctx, patch_linear + sz_linear, DELTA_BLOCK_SIZE);
+        ck_assert_int_ge(ret, 0);
+        sz_linear += ret;
+    } while (ret > 0);
+    wb_diff_free(&diff_ctx);
+
+    ck_assert_int_eq(wb_diff_init_ex(&diff_ctx, src_a, sizeof(src_a), src_b,
+                sizeof(src_b), WB_DIFF_MODE_HASH), 0);
+    do {
+        ret = wb_diff(&diff_ctx, patch_hash + sz_hash, DELTA_BLOCK_SIZE);
+        ck_assert_int_ge(ret, 0);
+        sz_hash += ret;
+    } while (ret > 0);
+    wb_diff_free(&diff_ctx);
+
+    ck_assert_uint_eq(sz_hash, sz_linear);
+    for (i = 0; i < (int)sz_linear; i++)
+        ck_assert_uint_eq(patch_hash[i], patch_linear[i]);
+
+    ck_assert_int_eq(wb_diff_init_ex(&diff_ctx, src_a, sizeof(src_a), src_b,
+                sizeof(src_b), 42), -1);
+}
+END_TEST
+
+START_TEST(test_wb_diff_optimal_mode_patch)
+{
+    WB_DIFF_CTX diff_ctx;
+    WB_PATCH_CTX patch_ctx;
+    static uint8_t src_a[4 * SRC_SIZE];
+    static uint8_t src_b[4 * SRC_SIZE];
+    static uint8_t patch[4 * PATCH_SIZE];
+    static uint8_t patched_dst[4 * DST_SIZE];
+    uint32_t sz_greedy = 0, sz_optimal = 0;
+    uint32_t sector_size, off;
+    int ret;
+    int i;
+
+    initialize_buffers(src_a, src_b, sizeof(src_a));
+    memcpy(src_b + 3 * SRC_SIZE, src_b + 100, 700);
+    memcpy(src_b + 2 * SRC_SIZE, src_a + 3 * SRC_SIZE + 17, 900);
+    memset(src_b + SRC_SIZE, ESC, 300);
+
+    ck_assert_int_eq(wb_diff_init_ex(&diff_ctx, src_a, sizeof(src_a), src_b,
+                sizeof(src_b), WB_DIFF_MODE_HASH), 0);
+    do {
+        ret = wb_diff(&diff_ctx, patch + sz_greedy, DELTA_BLOCK_SIZE);
+        ck_assert_int_ge(ret, 0);
+        sz_greedy += ret;
+    } while (ret > 0);
+    wb_diff_free(&diff_ctx);
+
+    ck_assert_int_eq(wb_diff_init_ex(&diff_ctx, src_a, sizeof(src_a), src_b,
+                sizeof(src_b), WB_DIFF_MODE_OPTIMAL), 0);
+    do {
+        ret = wb_diff(&diff_ctx, patch + sz_optimal, DELTA_BLOCK_SIZE);
+        ck_assert_int_ge(ret, 0);
+        sz_optimal += ret;
+    } while (ret > 0);
+    wb_diff_free(&diff_ctx);
+
+    ck_assert_uint_le(sz_optimal, sz_greedy);
+
+    /* Apply in place, one sector at a time, as wolfBoot_delta_update does:
+     * matches may refer to sectors of 'B' that have already been patched.
+     */
+    sector_size = wb_diff_get_sector_size();
+    memcpy(patched_dst, src_a, sizeof(src_a));
+    ret = wb_patch_init(&patch_ctx, patched_dst, sizeof(src_a), patch,
+            sz_optimal);
+    ck_assert_int_eq(ret, 0);
+    for (off = 0; off < sizeof(src_b); off += sector_size) {
+        uint8_t sector[4 * SRC_SIZE];
+        uint32_t len = 0;
+        ck_assert_uint_le(sector_size, sizeof(sector));
+        while (len < sector_size) {
+            ret = wb_patch(&patch_ctx, sector + len, DELTA_BLOCK_SIZE);
+            ck_assert_int_ge(ret, 0);
+            if (ret == 0)
+                break;
+            len += ret;
+        }
+        ck_assert_uint_eq(len, sector_size);
+        memcpy(patched_dst + off, sector, len);
+    }
+    for (i = 0; i < (int)sizeof(src_b); ++i) {
+        ck_assert_uint_eq(patched_dst[i], src_b[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_wb_diff_generate_jobs)
+{
+    WB_DIFF_CTX diff_ctx;
+    static uint8_t src_a[4 * SRC_SIZE];
+    static uint8_t src_b[4 * SRC_SIZE];
+    static uint8_t patch[4 * PATCH_SIZE];
+    uint32_t sz_serial = 0, sz_jobs;
+    uint8_t *patch_jobs;
+    int jobs;
+    int ret;
+
+    initialize_buffers(src_a, src_b, sizeof(src_a));
+    /* Matches from 'B' running across sector boundaries */
+    memcpy(src_b + 3 * 1024 - 100, src_b + 200, 600);
+    memcpy(src_b + 7 * 1024 - 3, src_b + 1500, 1800);
+    memset(src_b + 12 * 1024 - 50, ESC, 100);
+
+    ck_assert_int_eq(wb_diff_init(&diff_ctx, src_a, sizeof(src_a), src_b,
+                sizeof(src_b)), 0);
+    do {
+        ret = wb_diff(&diff_ctx, patch + sz_serial, DELTA_BLOCK_SIZE);
+        ck_assert_int_ge(ret, 0);
+        sz_serial += ret;
+    } while (ret > 0);
+
+    /* Same output as the serial wb_diff() loop, whatever the job count */
+    for (jobs = 1; jobs <= 8; jobs++) {
+        ck_assert_int_eq(wb_diff_init(&diff_ctx, src_a, sizeof(src_a), src_b,
+                    sizeof(src_b)), 0);
+        ret = wb_diff_generate(&diff_ctx, jobs, &patch_jobs, &sz_jobs);
+        ck_assert_int_eq(ret, 0);
+        ck_assert_uint_eq(sz_jobs, sz_serial);
+        ck_assert_mem_eq(patch_jobs, patch, sz_serial);
+        free(patch_jobs);
+        wb_diff_free(&diff_ctx);
+    }
+
+    /* Not from a fresh context */
+    ck_assert_int_eq(wb_diff_generate(&diff_ctx, 2, &patch_jobs, &sz_jobs), -1);
+}
+END_TEST
+
+static int rc_round_trip(const uint8_t *raw, uint32_t raw_len,
+        uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len)
+{
+    WB_PATCH_CTX patch_ctx;
+    static uint8_t coded[4 * PATCH_SIZE];
+    int coded_len;
+    uint32_t off = 0;
+    int ret;
+
+    ck_assert_uint_le(wb_diff_rc_bound(raw_len), sizeof(coded));
+    coded_len = wb_diff_rc_encode(raw, raw_len, coded, sizeof(coded));
+    ck_assert_int_gt(coded_len, WB_RC_HDR_SIZE);
+    ret = wb_patch_init_rc(&patch_ctx, src, src_len, coded, coded_len);
+    ck_assert_int_eq(ret, 0);
+    ck_assert_uint_eq(patch_ctx.patch_size, raw_len);
+    do {
+        ck_assert_uint_le(off, dst_len);
+        ret = wb_patch(&patch_ctx, dst + off, DELTA_BLOCK_SIZE);
+        ck_assert_int_ge(ret, 0);
+        off += ret;
+    } while (ret > 0);
+    return (int)off;
+}
+
+START_TEST(test_wb_patch_rc_round_trip)
+{
+    WB_DIFF_CTX diff_ctx;
+    WB_PATCH_CTX patch_ctx;
+    static uint8_t src_a[4 * SRC_SIZE];
+    static uint8_t src_b[4 * SRC_SIZE];
+    static uint8_t patch[4 * PATCH_SIZE];
+    static uint8_t raw_dst[4 * DST_SIZE + DELTA_BLOCK_SIZE];
+    static uint8_t coded_dst[4 * DST_SIZE + DELTA_BLOCK_SIZE];
+    uint32_t p_written = 0, raw_len = 0;
+    int ret;
+
+    initialize_buffers(src_a, src_b, sizeof(src_a));
+    memset(src_b + SRC_SIZE, ESC, 300);
+
+    ret = wb_diff_init(&diff_ctx, src_a, sizeof(src_a), src_b, sizeof(src_b));
+    ck_assert_int_eq(ret, 0);
+    do {
+        ret = wb_diff(&diff_ctx, patch + p_written, DELTA_BLOCK_SIZE);
+        ck_assert_int_ge(ret, 0);
+        p_written += ret;
+    } while (ret > 0);
+
+    /* The range-coded patch must produce exactly what the raw one does */
+    ret = wb_patch_init(&patch_ctx, src_a, sizeof(src_a), patch, p_written);
+    ck_assert_int_eq(ret, 0);
+    do {
+        ret = wb_patch(&patch_ctx, raw_dst + raw_len, DELTA_BLOCK_SIZE);
+        ck_assert_int_ge(ret, 0);
+        raw_len += ret;
+    } while (ret > 0);
+    ck_assert_uint_eq(raw_len, sizeof(src_b));
+
+    ret = rc_round_trip(patch, p_written, src_a, sizeof(src_a), coded_dst,
+            sizeof(coded_dst));
+    ck_assert_int_eq(ret, raw_len);
+    ck_assert_mem_eq(coded_dst, raw_dst, raw_len);
+}
+END_TEST
+
+struct rc_encode_job {
+    const uint8_t *raw;
+    uint32_t raw_len;
+    uint8_t *out;
+    uint32_t out_len;
+    int ret;
+};
+
+static void *rc_encode_worker(void *arg)
+{
+    struct rc_encode_job *job = (struct rc_encode_job *)arg;
+    int i;
+
+    for (i = 0; i < 50; i++) {
+        job->ret = wb_diff_rc_encode(job->raw, job->raw_len, job->out,
+                job->out_len);
+        if (job->ret < 0)
+            break;
+    }
+    return NULL;
+}
+
+START_TEST(test_wb_diff_rc_encode_concurrent)
+{
+    static uint8_t raw[2][4 * PATCH_SIZE];
+    static uint8_t ref[2][4 * PATCH_SIZE + 64];
+    static uint8_t out[2][4 * PATCH_SIZE + 64];
+    struct rc_encode_job job[2];
+    pthread_t th[2];
+    int ref_len[2];
+    uint32_t x = 0x9E3779B9;
+    int i, j;
+
+    /* Two compressible streams with different statistics, as the forward
+     * and the inverse patch encoded by the sign tool with --jobs */
+    for (j = 0; j < 2; j++) {
+        for (i = 0; i < (int)sizeof(raw[j]); i++) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            raw[j][i] = (uint8_t)((j == 0) ? (x & 0x0F) : (0xF0 | (x >> 28)));
+        }
+        ck_assert_uint_le(wb_diff_rc_bound(sizeof(raw[j])), sizeof(ref[j]));
+        ref_len[j] = wb_diff_rc_encode(raw[j], sizeof(raw[j]), ref[j],
+                sizeof(ref[j]));
+        ck_assert_int_gt(ref_len[j], 0);
+    }
+
+    for (j = 0; j < 2; j++) {
+        job[j].raw = raw[j];
+        job[j].raw_len = sizeof(raw[j]);
+        job[j].out = out[j];
+        job[j].out_len = sizeof(out[j]);
+        job[j].ret = 0;
+        ck_assert_int_eq(pthread_create(&th[j], NULL, rc_encode_worker,
+                    &job[j]), 0);
+    }
+    for (j = 0; j < 2; j++) {
+        pthread_join(th[j], NULL);
+    }
+    for (j = 0; j < 2; j++) {
+        ck_assert_int_eq(job[j].ret, ref_len[j]);
+        ck_assert_mem_eq(out[j], ref[j], ref_len[j]);
+    }
+}
+END_TEST
+
+START_TEST(test_wb_patch_rc_stored_frames)
+{
+    static uint8_t src[SRC_SIZE];
+    static uint8_t raw[3 * WB_RC_FRAME_SIZE + 100];
+    static uint8_t dst[sizeof(raw) + DELTA_BLOCK_SIZE];
+    uint32_t x = 0x12345678;
+    int ret;
+    int i;
+
+    /* Incompressible literals, no ESC: frames are stored verbatim */
+    for (i = 0; i < (int)sizeof(raw); i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        raw[i] = (uint8_t)x;
+        if (raw[i] == ESC)
+            raw[i] = 0;
+    }
+    ret = rc_round_trip(raw, sizeof(raw), src, sizeof(src), dst, sizeof(dst));
+    ck_assert_int_eq(ret, sizeof(raw));
+    ck_assert_mem_eq(dst, raw, sizeof(raw));
+}
+END_TEST
+
+START_TEST(test_wb_patch_rc_invalid)
+{
+    WB_PATCH_CTX patch_ctx;
+    uint8_t src[SRC_SIZE] = {0};
+    uint8_t raw[64];
+    uint8_t coded[256];
+    uint8_t dst[DELTA_BLOCK_SIZE];
+    int coded_len;
+
+    memset(raw, 0x41, sizeof(raw));
+    coded_len = wb_diff_rc_encode(raw, sizeof(raw), coded, sizeof(coded));
+    ck_assert_int_gt(coded_len, 0);
+    ck_assert_int_eq(wb_diff_rc_encode(raw, sizeof(raw), coded, 8), -1);
+
+    /* Too short for the container header */
+    ck_assert_int_eq(wb_patch_init_rc(&patch_ctx, src, sizeof(src), coded,
+                WB_RC_HDR_SIZE - 1), -1);
+
+    /* Truncated frame */
+    ck_assert_int_eq(wb_patch_init_rc(&patch_ctx, src, sizeof(src), coded,
+                coded_len - 1), 0);
+    ck_assert_int_eq(wb_patch(&patch_ctx, dst, sizeof(dst)), -1);
+
+    /* Unknown format version */
+    coded[6] = 0xAA;
+    ck_assert_int_eq(wb_patch_init_rc(&patch_ctx, src, sizeof(src), coded,
+                coded_len), -1);
+}
+END_TEST
 
 Suite *patch_diff_suite(void)
 {
@@ -349,6 +686,13 @@ Suite *patch_diff_suite(void)
     tcase_add_test(tc_wolfboot_delta, test_wb_diff_preserves_trailing_header_margin_for_escape);
     tcase_add_test(tc_wolfboot_delta, test_wb_diff_preserves_main_loop_header_margin_for_escape);
     tcase_add_test(tc_wolfboot_delta, test_wb_patch_and_diff);
+    tcase_add_test(tc_wolfboot_delta, test_wb_diff_hash_mode_matches_linear);
+    tcase_add_test(tc_wolfboot_delta, test_wb_diff_optimal_mode_patch);
+    tcase_add_test(tc_wolfboot_delta, test_wb_diff_generate_jobs);
+    tcase_add_test(tc_wolfboot_delta, test_wb_patch_rc_round_trip);
+    tcase_add_test(tc_wolfboot_delta, test_wb_diff_rc_encode_concurrent);
+    tcase_add_test(tc_wolfboot_delta, test_wb_patch_rc_stored_frames);
+    tcase_add_test(tc_wolfboot_delta, test_wb_patch_rc_invalid);
     suite_add_tcase(s, tc_wolfboot_delta);
 
     return s;
@@ -32,14 +32,19 @@
 #define FAKE_DISK_SIZE (128 * 1024) /* 128 KB */
 static uint8_t fake_disk[FAKE_DISK_SIZE];
 
-/* Set to a byte offset to make disk_read fail at that address. -1 = no fail */
+/* Set to a byte offset to make disk_read fail when reading that address.
+ * -1 = no fail */
 static int64_t mock_disk_read_fail_at = -1;
+static int mock_disk_read_count;
 
 /* Mock disk I/O — copies to/from fake_disk buffer */
 int disk_read(int drv, uint64_t start, uint32_t count, uint8_t *buf)
 {
     (void)drv;
-    if (mock_disk_read_fail_at >= 0 && (int64_t)start == mock_disk_read_fail_at)
+    mock_disk_read_count++;
+    if (mock_disk_read_fail_at >= 0 &&
+            (int64_t)start <= mock_disk_read_fail_at &&
+            (int64_t)(start + count) > mock_disk_read_fail_at)
         return -1;
     if (start + count > FAKE_DISK_SIZE)
         return -1;
@@ -877,6 +882,136 @@ START_TEST(test_sfdisk_gpt_last_lba_access)
 }
 END_TEST
 
+#ifdef WOLFBOOT_DISK_CACHE
+/* ============================================================
+ *  Block cache
+ * ============================================================ */
+
+/* Fill partition 1 with a position-dependent pattern */
+static void fill_part1_pattern(void)
+{
+    uint32_t i;
+    uint8_t *p1 = fake_disk + PART1_OFF * GPT_SECTOR_SIZE;
+    for (i = 0; i < (uint32_t)(PART1_END - PART1_OFF + 1) * GPT_SECTOR_SIZE; i++)
+        p1[i] = (uint8_t)(i ^ (i >> 8));
+}
+
+START_TEST(test_disk_cache_open_single_read)
+{
+    build_gpt_disk();
+    mock_disk_read_count = 0;
+    /* MBR, GPT header and partition entries all fit in the first block */
+    ck_assert_int_eq(disk_open(0), 2);
+    ck_assert_int_eq(mock_disk_read_count, 1);
+}
+END_TEST
+
+START_TEST(test_disk_cache_sequential_readahead)
+{
+    uint8_t buf[GPT_SECTOR_SIZE];
+    struct disk_cache_stats st0, st;
+    uint8_t *p1 = fake_disk + PART1_OFF * GPT_SECTOR_SIZE;
+    uint32_t off;
+    int n_chunks = 0;
+
+    build_gpt_disk();
+    fill_part1_pattern();
+    ck_assert_int_eq(disk_open(0), 2);
+    disk_cache_get_stats(&st0);
+    mock_disk_read_count = 0;
+
+    /* Header, then payload in unaligned 512-byte chunks, as the disk
+     * loader does */
+    ck_assert_int_eq(disk_part_read(0, 1, 0, 256, buf), 256);
+    ck_assert_mem_eq(buf, p1, 256);
+    for (off = 256; off + GPT_SECTOR_SIZE <= 40 * 1024;
+            off += GPT_SECTOR_SIZE) {
+        ck_assert_int_eq(disk_part_read(0, 1, off, GPT_SECTOR_SIZE, buf),
+            GPT_SECTOR_SIZE);
+        ck_assert_mem_eq(buf, p1 + off, GPT_SECTOR_SIZE);
+        n_chunks++;
+    }
+    disk_cache_get_stats(&st);
+    ck_assert_uint_gt(st.prefetched, st0.prefetched);
+    ck_assert_uint_gt(st.hits, st0.hits);
+    /* Each request reads 1 + DISK_CACHE_READAHEAD blocks */
+    ck_assert_int_le(mock_disk_read_count,
+        2 + (40 * 1024) / (DISK_CACHE_BLOCK_SIZE * (1 + DISK_CACHE_READAHEAD)));
+    ck_assert_int_lt(mock_disk_read_count, n_chunks / 8);
+}
+END_TEST
+
+START_TEST(test_disk_cache_coalesce_whole_blocks)
+{
+    static uint8_t buf[5 * DISK_CACHE_BLOCK_SIZE];
+    struct disk_cache_stats st0, st;
+    uint64_t part_start = PART1_OFF * GPT_SECTOR_SIZE;
+    /* Partition offset of the first block boundary in partition 1 */
+    uint32_t off = (uint32_t)(((part_start + DISK_CACHE_BLOCK_SIZE - 1) &
+        ~((uint64_t)DISK_CACHE_BLOCK_SIZE - 1)) - part_start);
+    uint32_t len = 4 * DISK_CACHE_BLOCK_SIZE + 100;
+
+    build_gpt_disk();
+    fill_part1_pattern();
+    ck_assert_int_eq(disk_open(0), 2);
+    disk_cache_get_stats(&st0);
+    mock_disk_read_count = 0;
+
+    /* 4 whole blocks in one request, plus a partial block */
+    ck_assert_int_eq(disk_part_read(0, 1, off, len, buf), len);
+    ck_assert_mem_eq(buf, fake_disk + part_start + off, len);
+    ck_assert_int_eq(mock_disk_read_count, 2);
+    disk_cache_get_stats(&st);
+    ck_assert_uint_eq(st.direct - st0.direct, 4);
+    ck_assert_uint_eq(st.misses - st0.misses, 1);
+
+    /* Re-reading the partial block is a hit */
+    mock_disk_read_count = 0;
+    ck_assert_int_eq(disk_part_read(0, 1, off + 4 * DISK_CACHE_BLOCK_SIZE,
+        100, buf), 100);
+    ck_assert_int_eq(mock_disk_read_count, 0);
+}
+END_TEST
+
+START_TEST(test_disk_cache_write_invalidates)
+{
+    uint8_t buf[GPT_SECTOR_SIZE];
+    uint8_t wbuf[16];
+
+    build_gpt_disk();
+    ck_assert_int_eq(disk_open(0), 2);
+    ck_assert_int_eq(disk_part_read(0, 0, 0, 64, buf), 64);
+    ck_assert_uint_eq(buf[10], 0xAA);
+
+    memset(wbuf, 0x5C, sizeof(wbuf));
+    ck_assert_int_eq(disk_part_write(0, 0, 8, sizeof(wbuf), wbuf),
+        sizeof(wbuf));
+    ck_assert_int_eq(disk_part_read(0, 0, 0, 64, buf), 64);
+    ck_assert_uint_eq(buf[7], 0xAA);
+    ck_assert_uint_eq(buf[10], 0x5C);
+    ck_assert_uint_eq(buf[24], 0xAA);
+}
+END_TEST
+
+START_TEST(test_disk_cache_no_readahead_past_partition)
+{
+    uint8_t buf[GPT_SECTOR_SIZE];
+    uint64_t part_size = (PART1_END - PART1_OFF + 1) * GPT_SECTOR_SIZE;
+
+    build_gpt_disk();
+    fill_part1_pattern();
+    /* Shrink the disk to the end of partition 1 */
+    mock_disk_read_fail_at = (PART1_END + 1) * GPT_SECTOR_SIZE;
+    ck_assert_int_eq(disk_open(0), 2);
+    ck_assert_int_eq(disk_part_read(0, 1, part_size - 300, 200, buf), 200);
+    ck_assert_mem_eq(buf,
+        fake_disk + PART1_OFF * GPT_SECTOR_SIZE + part_size - 300, 200);
+    ck_assert_int_eq(disk_part_read(0, 1, part_size - 100, 100, buf), 100);
+    mock_disk_read_fail_at = -1;
+}
+END_TEST
+#endif /* WOLFBOOT_DISK_CACHE */
+
 /* ============================================================
  *  Suite setup
  * ============================================================ */
@@ -935,6 +1070,16 @@ Suite *wolfboot_suite(void)
     tcase_add_test(tc_sfdisk, test_sfdisk_gpt_last_lba_access);
     suite_add_tcase(s, tc_sfdisk);
 
+#ifdef WOLFBOOT_DISK_CACHE
+    TCase *tc_cache = tcase_create("disk-cache");
+    tcase_add_test(tc_cache, test_disk_cache_open_single_read);
+    tcase_add_test(tc_cache, test_disk_cache_sequential_readahead);
+    tcase_add_test(tc_cache, test_disk_cache_coalesce_whole_blocks);
+    tcase_add_test(tc_cache, test_disk_cache_write_invalidates);
+    tcase_add_test(tc_cache, test_disk_cache_no_readahead_past_partition);
+    suite_add_tcase(s, tc_cache);
+#endif
+
     return s;
 }
 
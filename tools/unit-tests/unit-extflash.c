@@ -46,6 +46,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "user_settings.h"
 #include "image.h"
 
@@ -260,6 +261,75 @@ START_TEST(test_ext_enc_flash_operations) {
 }
 END_TEST
 
+#define BENCH_ADDRESS 0x2000
+#define BENCH_LOOPS 256
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Per-block reference: one cipher call and one copy per ENCRYPT_BLOCK_SIZE,
+ * as ext_flash_encrypt_write() used to do */
+static void encrypt_per_block(uint32_t address, uint8_t *out,
+    const uint8_t *in, int len)
+{
+    uint8_t block[ENCRYPT_BLOCK_SIZE];
+    int i;
+
+    wolfBoot_crypto_set_iv(encrypt_iv_nonce, address / ENCRYPT_BLOCK_SIZE);
+    for (i = 0; i < len; i += ENCRYPT_BLOCK_SIZE) {
+        memcpy(block, in + i, ENCRYPT_BLOCK_SIZE);
+        crypto_encrypt(out + i, block, ENCRYPT_BLOCK_SIZE);
+    }
+}
+
+START_TEST(test_ext_enc_flash_bulk) {
+    uint8_t plain[WOLFBOOT_SECTOR_SIZE];
+    uint8_t ref[WOLFBOOT_SECTOR_SIZE];
+    uint8_t data[WOLFBOOT_SECTOR_SIZE];
+    double t0, t_ref, t_write, t_read;
+    int i;
+
+    for (i = 0; i < WOLFBOOT_SECTOR_SIZE; i++)
+        plain[i] = (uint8_t)(i * 7 + 3);
+
+    /* The bulk path produces the same ciphertext as the per-block one */
+    ck_assert_int_eq(ext_flash_check_write(BENCH_ADDRESS, plain,
+                WOLFBOOT_SECTOR_SIZE), 0);
+    encrypt_per_block(BENCH_ADDRESS, ref, plain, WOLFBOOT_SECTOR_SIZE);
+    ck_assert_mem_eq(&flash[BENCH_ADDRESS], ref, WOLFBOOT_SECTOR_SIZE);
+
+    /* Aligned and unaligned reads */
+    ck_assert_int_eq(ext_flash_check_read(BENCH_ADDRESS, data,
+                WOLFBOOT_SECTOR_SIZE), WOLFBOOT_SECTOR_SIZE);
+    ck_assert_mem_eq(data, plain, WOLFBOOT_SECTOR_SIZE);
+    memset(data, 0, sizeof(data));
+    ck_assert_int_eq(ext_flash_check_read(BENCH_ADDRESS + 5, data, 1000),
+            1000);
+    ck_assert_mem_eq(data, plain + 5, 1000);
+
+    /* Benchmark */
+    t0 = bench_now();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        encrypt_per_block(BENCH_ADDRESS, ref, plain, WOLFBOOT_SECTOR_SIZE);
+    t_ref = bench_now() - t0;
+    t0 = bench_now();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        ext_flash_check_write(BENCH_ADDRESS, plain, WOLFBOOT_SECTOR_SIZE);
+    t_write = bench_now() - t0;
+    t0 = bench_now();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        ext_flash_check_read(BENCH_ADDRESS, data, WOLFBOOT_SECTOR_SIZE);
+    t_read = bench_now() - t0;
+    ck_assert_mem_eq(data, plain, WOLFBOOT_SECTOR_SIZE);
+    printf("Encrypted ext flash, %d x %d bytes: per-block cipher %.3f ms, "
+            "write %.3f ms, read %.3f ms\n", BENCH_LOOPS, WOLFBOOT_SECTOR_SIZE,
+            t_ref * 1000.0, t_write * 1000.0, t_read * 1000.0);
+}
+END_TEST
 
 
 Suite *wolfboot_suite(void)
@@ -271,15 +341,19 @@ Suite *wolfboot_suite(void)
     /* Test cases */
     TCase *ext_flash_operations  = tcase_create("External flash operations: API");
     TCase *ext_enc_flash_operations  = tcase_create("External encrypted flash operations");
+    TCase *ext_enc_flash_bulk  = tcase_create("External encrypted flash bulk cipher");
 
     /* Set parameters + add to suite */
     tcase_add_test(ext_flash_operations, test_ext_flash_operations);
     tcase_add_test(ext_enc_flash_operations, test_ext_enc_flash_operations);
+    tcase_add_test(ext_enc_flash_bulk, test_ext_enc_flash_bulk);
 
     tcase_set_timeout(ext_flash_operations, 20);
     tcase_set_timeout(ext_enc_flash_operations, 20);
+    tcase_set_timeout(ext_enc_flash_bulk, 20);
     suite_add_tcase(s, ext_flash_operations);
     suite_add_tcase(s, ext_enc_flash_operations);
+    suite_add_tcase(s, ext_enc_flash_bulk);
 
     return s;
 }
@@ -0,0 +1,342 @@
+/* unit-fdt.c
+ *
+ * unit tests for the FDT node index and fixup transactions
+ *
+ * Copyright (C) 2025 wolfSSL Inc.
+ *
+ * This file is part of wolfBoot.
+ *
+ * wolfBoot is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfBoot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335, USA
+ */
+#define WOLFBOOT_FDT
+#include <check.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fdt.c"
+
+#define DTB_FILE    "../fdt-parser/nxp_t1024.dtb"
+#define DTB_MAX     (64 * 1024)
+#define GROW_SIZE   1024
+#define MAX_NODES   512
+#define MAX_PROPS   32
+
+static uint8_t dtb[DTB_MAX];
+static uint32_t dtb_size;
+static uint8_t fdt_a[DTB_MAX];
+static uint8_t fdt_b[DTB_MAX];
+static struct fdt_index_node nodes[MAX_NODES];
+static struct fdt_index_node nodes_ref[MAX_NODES];
+static struct fdt_tx_prop props[MAX_PROPS];
+
+static void load_dtb(void)
+{
+    FILE *f = fopen(DTB_FILE, "rb");
+    ck_assert_ptr_nonnull(f);
+    dtb_size = (uint32_t)fread(dtb, 1, sizeof(dtb) - GROW_SIZE, f);
+    fclose(f);
+    ck_assert_uint_gt(dtb_size, 0);
+    ck_assert_int_eq(fdt_check_header(dtb), 0);
+    ck_assert_uint_eq(fdt_totalsize(dtb), dtb_size);
+}
+
+static void fresh_copy(uint8_t *fdt, uint32_t grow)
+{
+    memset(fdt, 0, DTB_MAX);
+    memcpy(fdt, dtb, dtb_size);
+    fdt_set_totalsize(fdt, dtb_size + grow);
+}
+
+/* the index follows the edits: it must match a new one */
+static void check_index(const void *fdt)
+{
+    int i, count = fdt_idx.count;
+
+    ck_assert(fdt_index_active_(fdt));
+    memcpy(nodes_ref, nodes, count * sizeof(nodes[0]));
+    ck_assert_int_eq(fdt_index_build(fdt, nodes, MAX_NODES), count);
+    for (i = 0; i < count; i++) {
+        ck_assert_int_eq(nodes[i].offset, nodes_ref[i].offset);
+        ck_assert_int_eq(nodes[i].depth, nodes_ref[i].depth);
+        ck_assert_uint_eq(nodes[i].hash, nodes_ref[i].hash);
+        ck_assert_uint_eq(nodes[i].phandle, nodes_ref[i].phandle);
+        /* bits are only added, never removed */
+        ck_assert_uint_eq(nodes[i].filter & nodes_ref[i].filter,
+            nodes[i].filter);
+    }
+}
+
+START_TEST(test_fdt_index_lookups)
+{
+    static const char *compat[] = { "fsl,qman-portal", "fsl,fman-memac",
+        "fsl,elo3-dma", "fsl,qoriq-pcie-v2.4", "fsl,esdhc", "ns16550" };
+    static const char *devtype[] = { "cpu", "memory", "serial", "soc", "qe",
+        "open-pic", "pci" };
+    int off, ref, start, count, i;
+
+    load_dtb();
+    fresh_copy(fdt_a, 0);
+
+    count = fdt_index_build(fdt_a, nodes, MAX_NODES);
+    ck_assert_int_gt(count, 200);
+    ck_assert_int_eq(nodes[0].offset, 0);
+    ck_assert_int_eq(nodes[0].depth, 1);
+    ck_assert_int_eq(fdt_index_build(fdt_a, nodes, 16), -FDT_ERR_NOSPACE);
+    ck_assert(!fdt_index_active_(fdt_a));
+
+    /* every lookup gives the same result with and without the index */
+    for (i = 0; i < (int)(sizeof(compat) / sizeof(compat[0])); i++) {
+        start = -1;
+        do {
+            fdt_index_clear();
+            ref = fdt_node_offset_by_compatible(fdt_a, start, compat[i]);
+            ck_assert_int_eq(fdt_index_build(fdt_a, nodes, MAX_NODES), count);
+            off = fdt_node_offset_by_compatible(fdt_a, start, compat[i]);
+            ck_assert_int_eq(off, ref);
+            start = ref;
+        } while (ref >= 0);
+    }
+    for (i = 0; i < (int)(sizeof(devtype) / sizeof(devtype[0])); i++) {
+        start = -1;
+        do {
+            fdt_index_clear();
+            ref = fdt_find_devtype(fdt_a, start, devtype[i]);
+            ck_assert_int_eq(fdt_index_build(fdt_a, nodes, MAX_NODES), count);
+            off = fdt_find_devtype(fdt_a, start, devtype[i]);
+            ck_assert_int_eq(off, ref);
+            start = ref;
+        } while (ref >= 0);
+    }
+    for (i = 0; i < count; i++) {
+        const char *name = fdt_get_name(fdt_a, nodes[i].offset, NULL);
+        if (*name != '\0') {
+            off = fdt_find_node_offset(fdt_a, -1, name);
+            fdt_index_clear();
+            ref = fdt_find_node_offset(fdt_a, -1, name);
+            fdt_index_build(fdt_a, nodes, MAX_NODES);
+            ck_assert_int_eq(off, ref);
+        }
+        if (nodes[i].phandle != 0) {
+            ck_assert_int_eq(fdt_node_offset_by_phandle(fdt_a,
+                nodes[i].phandle), nodes[i].offset);
+            fdt_index_clear();
+            ck_assert_int_eq(fdt_node_offset_by_phandle(fdt_a,
+                nodes[i].phandle), nodes[i].offset);
+            fdt_index_build(fdt_a, nodes, MAX_NODES);
+        }
+    }
+    ck_assert_int_eq(fdt_node_offset_by_phandle(fdt_a, 0xFFFF),
+        -FDT_ERR_NOTFOUND);
+
+    /* paths */
+    ck_assert_int_eq(fdt_path_offset(fdt_a, "/"), 0);
+    ck_assert_int_eq(fdt_path_offset(fdt_a, "/cpus/PowerPC,e5500@1"), 656);
+    ck_assert_int_eq(fdt_path_offset(fdt_a, "/cpus/PowerPC,e5500@1/l2-cache"),
+        796);
+    ck_assert_int_eq(fdt_path_offset(fdt_a, "/cpus/PowerPC,e5500"), 444);
+    ck_assert_int_eq(fdt_path_offset(fdt_a, "/memory/"), 3256);
+    ck_assert_int_eq(fdt_path_offset(fdt_a, "/cpus/l2-cache"),
+        -FDT_ERR_NOTFOUND);
+    ck_assert_int_eq(fdt_path_offset(fdt_a, "cpus"), -FDT_ERR_BADOFFSET);
+    fdt_index_clear();
+    ck_assert_int_eq(fdt_path_offset(fdt_a, "/cpus/PowerPC,e5500@1/l2-cache"),
+        796);
+    ck_assert_int_eq(fdt_path_offset(fdt_a, "/cpus/PowerPC,e5500"), 444);
+}
+END_TEST
+
+START_TEST(test_fdt_index_follows_edits)
+{
+    uint32_t val = cpu_to_fdt32(0x1234);
+    int off, sub;
+
+    load_dtb();
+    fresh_copy(fdt_a, GROW_SIZE);
+    ck_assert_int_gt(fdt_index_build(fdt_a, nodes, MAX_NODES), 0);
+
+    off = fdt_path_offset(fdt_a, "/cpus/PowerPC,e5500@0");
+    ck_assert_int_eq(fdt_setprop(fdt_a, off, "status", "disabled", 9), 0);
+    ck_assert_int_eq(fdt_setprop(fdt_a, off, "new-prop", &val, 4), 0);
+    check_index(fdt_a);
+
+    off = fdt_path_offset(fdt_a, "/memory");
+    ck_assert_int_eq(fdt_setprop(fdt_a, off, "compatible", "test,mem", 9), 0);
+    ck_assert_int_eq(fdt_node_offset_by_compatible(fdt_a, -1, "test,mem"),
+        off);
+
+    sub = fdt_add_subnode(fdt_a, off, "bank@0");
+    ck_assert_int_gt(sub, off);
+    ck_assert_int_eq(fdt_add_subnode(fdt_a, off, "bank@0"), -FDT_ERR_EXISTS);
+    ck_assert_int_eq(fdt_path_offset(fdt_a, "/memory/bank"), sub);
+    check_index(fdt_a);
+
+    off = fdt_path_offset(fdt_a, "/cpus");
+    ck_assert_int_eq(fdt_del_node(fdt_a, off), 0);
+    ck_assert_int_eq(fdt_path_offset(fdt_a, "/cpus"), -FDT_ERR_NOTFOUND);
+    ck_assert_int_gt(fdt_path_offset(fdt_a, "/memory/bank@0"), 0);
+    check_index(fdt_a);
+    fdt_index_clear();
+}
+END_TEST
+
+/* the same edits, with fdt_setprop() and with a transaction. The offsets
+ * move after each fdt_setprop(), not within a transaction */
+static void apply_edits(uint8_t *fdt, struct fdt_tx *tx)
+{
+    static const char long_str[] = "a value longer than the inline buffer";
+    uint64_t v64 = cpu_to_fdt64(0x123456789ULL);
+    uint32_t v32 = cpu_to_fdt32(42);
+
+#define SET(path, n, v, l) \
+    ck_assert_int_eq((tx != NULL) ? \
+        fdt_tx_setprop(tx, fdt_path_offset(fdt, path), n, v, l) : \
+        fdt_setprop(fdt, fdt_path_offset(fdt, path), n, v, l), 0)
+    /* shrinking, growing and new properties, in no particular order */
+    SET("/memory", "reg", &v64, sizeof(v64));
+    SET("/cpus/PowerPC,e5500@0", "status", "disabled", 9);
+    SET("/", "model", "x", 2);
+    SET("/cpus/PowerPC,e5500@1", "cpu-release-addr", &v64, sizeof(v64));
+    SET("/cpus/PowerPC,e5500@1", "enable-method", "spin-table", 11);
+    SET("/cpus/PowerPC,e5500@0", "new-a", &v32, sizeof(v32));
+    SET("/cpus/PowerPC,e5500@0", "new-b", long_str, sizeof(long_str));
+    SET("/", "compatible", "", 0);
+    SET("/cpus/PowerPC,e5500@0", "new-a", "y", 2);
+    SET("/memory", "device_type", "memory", 7);
+#undef SET
+}
+
+START_TEST(test_fdt_tx_matches_setprop)
+{
+    struct fdt_tx tx;
+
+    load_dtb();
+    fresh_copy(fdt_a, GROW_SIZE);
+    fresh_copy(fdt_b, GROW_SIZE);
+
+    apply_edits(fdt_a, NULL);
+
+    ck_assert_int_gt(fdt_index_build(fdt_b, nodes, MAX_NODES), 0);
+    fdt_tx_begin(&tx, fdt_b, props, MAX_PROPS);
+    apply_edits(fdt_b, &tx);
+    /* nothing changes before the commit */
+    ck_assert_mem_eq(fdt_b + sizeof(struct fdt_header),
+        dtb + sizeof(struct fdt_header), dtb_size - sizeof(struct fdt_header));
+    ck_assert_int_eq(tx.count, 9);
+    ck_assert_int_eq(fdt_tx_commit(&tx), 0);
+    ck_assert_int_eq(tx.count, 0);
+
+    ck_assert_uint_eq(fdt_size_dt_struct(fdt_a), fdt_size_dt_struct(fdt_b));
+    ck_assert_uint_eq(fdt_size_dt_strings(fdt_a), fdt_size_dt_strings(fdt_b));
+    ck_assert_mem_eq(fdt_a, fdt_b, fdt_data_size_(fdt_a));
+    check_index(fdt_b);
+    fdt_index_clear();
+}
+END_TEST
+
+START_TEST(test_fdt_tx_apply)
+{
+    struct fdt_tx tx;
+
+    load_dtb();
+    fresh_copy(fdt_a, GROW_SIZE);
+    fresh_copy(fdt_b, GROW_SIZE);
+
+    apply_edits(fdt_a, NULL);
+
+    ck_assert_int_gt(fdt_index_build(fdt_b, nodes, MAX_NODES), 0);
+    fdt_tx_begin(&tx, fdt_b, props, MAX_PROPS);
+    apply_edits(fdt_b, &tx);
+    ck_assert_int_eq(fdt_tx_apply(&tx), 0);
+    ck_assert_int_eq(tx.count, 0);
+
+    ck_assert_uint_eq(fdt_size_dt_struct(fdt_a), fdt_size_dt_struct(fdt_b));
+    ck_assert_uint_eq(fdt_size_dt_strings(fdt_a), fdt_size_dt_strings(fdt_b));
+    check_index(fdt_b);
+    fdt_index_clear();
+}
+END_TEST
+
+START_TEST(test_fdt_tx_errors)
+{
+    struct fdt_tx tx;
+    uint32_t v32 = 0;
+
+    load_dtb();
+
+    /* not enough room: the tree is left untouched */
+    fresh_copy(fdt_a, 16);
+    fdt_tx_begin(&tx, fdt_a, props, MAX_PROPS);
+    ck_assert_int_eq(fdt_tx_setprop(&tx, 0, "model",
+        "a model name that does not fit in the tree", 43), 0);
+    ck_assert_int_eq(fdt_tx_commit(&tx), -FDT_ERR_NOSPACE);
+    ck_assert_mem_eq(fdt_a + sizeof(struct fdt_header),
+        dtb + sizeof(struct fdt_header), dtb_size - sizeof(struct fdt_header));
+
+    /* too many edits */
+    fresh_copy(fdt_a, GROW_SIZE);
+    fdt_tx_begin(&tx, fdt_a, props, 2);
+    ck_assert_int_eq(fdt_tx_setprop(&tx, 0, "p0", &v32, sizeof(v32)), 0);
+    ck_assert_int_eq(fdt_tx_setprop(&tx, 0, "p1", &v32, sizeof(v32)), 0);
+    /* setting a property again does not take a new entry */
+    ck_assert_int_eq(fdt_tx_setprop(&tx, 0, "p1", &v32, sizeof(v32)), 0);
+    ck_assert_int_eq(fdt_tx_setprop(&tx, 0, "p2", &v32, sizeof(v32)),
+        -FDT_ERR_NOSPACE);
+    ck_assert_int_eq(fdt_tx_commit(&tx), -FDT_ERR_NOSPACE);
+    ck_assert_ptr_null(fdt_getprop(fdt_a, 0, "p0", NULL));
+    /* the edits recorded can still be applied one by one */
+    ck_assert_int_eq(fdt_tx_apply(&tx), -FDT_ERR_NOSPACE);
+    ck_assert_ptr_nonnull(fdt_getprop(fdt_a, 0, "p0", NULL));
+    ck_assert_ptr_nonnull(fdt_getprop(fdt_a, 0, "p1", NULL));
+    ck_assert_ptr_null(fdt_getprop(fdt_a, 0, "p2", NULL));
+
+    /* invalid node offset */
+    fdt_tx_begin(&tx, fdt_a, props, MAX_PROPS);
+    ck_assert_int_eq(fdt_tx_setprop(&tx, 6, "p0", &v32, sizeof(v32)),
+        -FDT_ERR_BADOFFSET);
+    ck_assert_int_eq(fdt_tx_commit(&tx), -FDT_ERR_BADOFFSET);
+}
+END_TEST
+
+Suite *fdt_suite(void)
+{
+    Suite *s = suite_create("FDT");
+    TCase *tc = tcase_create("fdt");
+
+    tcase_add_test(tc, test_fdt_index_lookups);
+    tcase_add_test(tc, test_fdt_index_follows_edits);
+    tcase_add_test(tc, test_fdt_tx_matches_setprop);
+    tcase_add_test(tc, test_fdt_tx_apply);
+    tcase_add_test(tc, test_fdt_tx_errors);
+    suite_add_tcase(s, tc);
+    return s;
+}
+
+int main(void)
+{
+    int ret;
+    Suite *s;
+    SRunner *sr;
+
+    s = fdt_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    ret = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return ret;
+}
@@ -550,6 +550,76 @@ START_TEST(test_sha_ops)
 }
 END_TEST
 
+START_TEST(test_sha_chunks)
+{
+    uint8_t hash_int[WOLFBOOT_SHA_DIGEST_SIZE];
+    uint8_t hash_ext[WOLFBOOT_SHA_DIGEST_SIZE];
+    static uint8_t img_buf[IMAGE_HEADER_SIZE + 5 * WOLFBOOT_HASH_CHUNK_SIZE + 7];
+    struct wolfBoot_image test_img;
+    uint32_t fw_size = sizeof(img_buf) - IMAGE_HEADER_SIZE;
+    uint32_t i;
+
+    /* Firmware spanning several chunks, with a partial last chunk */
+    memcpy(img_buf, test_img_v200000000_signed_bin, IMAGE_HEADER_SIZE);
+    for (i = IMAGE_HEADER_SIZE; i < sizeof(img_buf); i++)
+        img_buf[i] = (uint8_t)(i * 7);
+    find_header_mocked = 0;
+    find_header_fail = 0;
+
+    /* Internal partition: hashed in place */
+    memset(&test_img, 0, sizeof(struct wolfBoot_image));
+    test_img.part = PART_BOOT;
+    test_img.hdr = img_buf;
+    test_img.fw_base = img_buf + IMAGE_HEADER_SIZE;
+    test_img.fw_size = fw_size;
+    ck_assert_int_eq(image_hash(&test_img, hash_int), 0);
+
+    /* External partition: read ahead, chunk by chunk */
+    ext_flash_erase(0, 2 * WOLFBOOT_SECTOR_SIZE);
+    ext_flash_write(0, img_buf, sizeof(img_buf));
+    hdr_cpy_done = 0;
+    memset(&test_img, 0, sizeof(struct wolfBoot_image));
+    test_img.part = PART_UPDATE;
+    test_img.hdr = 0;
+    test_img.fw_base = (void *)IMAGE_HEADER_SIZE;
+    test_img.fw_size = fw_size;
+    ck_assert_int_eq(image_hash(&test_img, hash_ext), 0);
+    ck_assert_mem_eq(hash_int, hash_ext, WOLFBOOT_SHA_DIGEST_SIZE);
+
+    /* Changes in the flash content are seen by the next pass */
+    ext_flash_erase(0, 2 * WOLFBOOT_SECTOR_SIZE);
+    img_buf[IMAGE_HEADER_SIZE] ^= 0xFF;
+    ext_flash_write(0, img_buf, sizeof(img_buf));
+    ck_assert_int_eq(image_hash(&test_img, hash_ext), 0);
+    ck_assert_mem_ne(hash_int, hash_ext, WOLFBOOT_SHA_DIGEST_SIZE);
+
+#ifdef EXT_HASH_PREFETCH
+    {
+        uint8_t *p;
+        uint32_t len;
+
+        /* A pass ending before the last chunk leaves no read ahead data
+         * behind for the next pass starting at the same offset */
+        p = get_hash_chunk(&test_img, WOLFBOOT_HASH_CHUNK_SIZE, &len);
+        ck_assert_ptr_nonnull(p);
+        ck_assert_int_eq(ext_hash_pending, 1);
+        ext_hash_prefetch_end();
+        ck_assert_int_eq(ext_hash_pending, 0);
+        ck_assert(ext_hash_next_addr == (uintptr_t)-1);
+
+        ext_flash_erase(0, 2 * WOLFBOOT_SECTOR_SIZE);
+        img_buf[IMAGE_HEADER_SIZE + 2 * WOLFBOOT_HASH_CHUNK_SIZE] ^= 0xFF;
+        ext_flash_write(0, img_buf, sizeof(img_buf));
+        p = get_hash_chunk(&test_img, 2 * WOLFBOOT_HASH_CHUNK_SIZE, &len);
+        ck_assert_ptr_nonnull(p);
+        ck_assert_mem_eq(p, img_buf + IMAGE_HEADER_SIZE +
+            2 * WOLFBOOT_HASH_CHUNK_SIZE, len);
+        ext_hash_prefetch_end();
+    }
+#endif
+}
+END_TEST
+
 START_TEST(test_headers)
 {
     struct wolfBoot_image img;
@@ -836,6 +906,7 @@ Suite *wolfboot_suite(void)
     TCase* tcase_sha_ops = tcase_create("sha_ops");
     tcase_set_timeout(tcase_sha_ops, 20);
     tcase_add_test(tcase_sha_ops, test_sha_ops);
+    tcase_add_test(tcase_sha_ops, test_sha_chunks);
     suite_add_tcase(s, tcase_sha_ops);
 
     TCase* tcase_headers = tcase_create("headers");
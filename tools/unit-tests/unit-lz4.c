@@ -0,0 +1,251 @@
+/* unit-lz4.c
+ *
+ * unit tests for the LZ4 frame decoder and encoder
+ *
+ * Copyright (C) 2025 wolfSSL Inc.
+ *
+ * This file is part of wolfBoot.
+ *
+ * wolfBoot is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfBoot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335, USA
+ */
+#include <check.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lz4.h"
+#include "lz4.c"
+
+#define SRC_SIZE (64 * 1024)
+
+static uint8_t src[SRC_SIZE];
+static uint8_t frame[SRC_SIZE + 1024];
+static uint8_t dst[SRC_SIZE];
+
+/* Text-like data: repeated words with some noise */
+static void fill_src(void)
+{
+    static const char *words[] = { "wolfBoot ", "image ", "partition ",
+        "update ", "signature ", "sector " };
+    uint32_t seed = 0x1234567;
+    uint32_t i = 0;
+
+    while (i < SRC_SIZE) {
+        const char *w;
+        seed = seed * 1103515245 + 12345;
+        w = words[(seed >> 16) % 6];
+        while (*w && i < SRC_SIZE)
+            src[i++] = (uint8_t)*w++;
+        if (((seed >> 8) & 7) == 0 && i < SRC_SIZE)
+            src[i++] = (uint8_t)(seed >> 24);
+    }
+}
+
+/* Minimal frame header: independent blocks, 64KB max block size, no
+ * optional fields. The header checksum is not verified.
+ */
+static uint32_t put_frame_hdr(uint8_t *p)
+{
+    p[0] = 0x04; p[1] = 0x22; p[2] = 0x4D; p[3] = 0x18;
+    p[4] = LZ4_FLG_VERSION | LZ4_FLG_BLOCK_INDEP;
+    p[5] = 0x40;
+    p[6] = 0x00;
+    return 7;
+}
+
+static uint32_t put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return 4;
+}
+
+START_TEST(test_lz4_roundtrip)
+{
+    int len, ret;
+
+    fill_src();
+    len = lz4_compress(src, SRC_SIZE, frame, sizeof(frame));
+    ck_assert_int_gt(len, 0);
+    ck_assert_int_lt(len, SRC_SIZE / 2);
+    ck_assert_uint_eq(lz4_read32(frame), LZ4_FRAME_MAGIC);
+
+    memset(dst, 0, sizeof(dst));
+    ret = lz4_decompress(frame, len, dst, sizeof(dst));
+    ck_assert_int_eq(ret, SRC_SIZE);
+    ck_assert_mem_eq(dst, src, SRC_SIZE);
+}
+END_TEST
+
+START_TEST(test_lz4_stream_chunks)
+{
+    static const uint32_t chunk[] = { 1, 3, 7, 64, 509, 4096 };
+    struct lz4_stream s;
+    int len;
+    uint32_t c, pos;
+
+    fill_src();
+    len = lz4_compress(src, SRC_SIZE, frame, sizeof(frame));
+    ck_assert_int_gt(len, 0);
+
+    for (c = 0; c < sizeof(chunk) / sizeof(chunk[0]); c++) {
+        memset(dst, 0, sizeof(dst));
+        lz4_stream_init(&s, dst, sizeof(dst));
+        for (pos = 0; pos < (uint32_t)len; pos += chunk[c]) {
+            uint32_t n = (uint32_t)len - pos;
+            if (n > chunk[c])
+                n = chunk[c];
+            ck_assert_int_eq(lz4_stream_update(&s, frame + pos, n), 0);
+        }
+        ck_assert_int_eq(lz4_stream_final(&s), SRC_SIZE);
+        ck_assert_mem_eq(dst, src, SRC_SIZE);
+    }
+}
+END_TEST
+
+START_TEST(test_lz4_incompressible)
+{
+    uint32_t i, seed = 0xCAFE;
+    int len;
+
+    for (i = 0; i < SRC_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        src[i] = (uint8_t)(seed >> 16);
+    }
+    /* the block is stored, the frame only adds its own overhead */
+    len = lz4_compress(src, SRC_SIZE, frame, sizeof(frame));
+    ck_assert_int_gt(len, 0);
+    ck_assert_uint_le((uint32_t)len, lz4_compress_bound(SRC_SIZE));
+    ck_assert_int_eq(lz4_decompress(frame, len, dst, sizeof(dst)), SRC_SIZE);
+    ck_assert_mem_eq(dst, src, SRC_SIZE);
+}
+END_TEST
+
+START_TEST(test_lz4_stored_block)
+{
+    uint8_t in[32];
+    uint32_t o;
+
+    o = put_frame_hdr(in);
+    o += put_u32(in + o, 5 | LZ4_BLOCK_STORED);
+    memcpy(in + o, "hello", 5);
+    o += 5;
+    o += put_u32(in + o, 0);
+    ck_assert_int_eq(lz4_decompress(in, o, dst, sizeof(dst)), 5);
+    ck_assert_mem_eq(dst, "hello", 5);
+}
+END_TEST
+
+START_TEST(test_lz4_overlapping_match)
+{
+    uint8_t in[32];
+    uint32_t o, b;
+
+    /* 'a' followed by a 12 bytes match at offset 1, then 5 literals */
+    o = put_frame_hdr(in);
+    b = o;
+    o += 4;
+    in[o++] = 0x18;
+    in[o++] = 'a';
+    in[o++] = 0x01;
+    in[o++] = 0x00;
+    in[o++] = 0x50;
+    memcpy(in + o, "bcdef", 5);
+    o += 5;
+    put_u32(in + b, o - b - 4);
+    o += put_u32(in + o, 0);
+    ck_assert_int_eq(lz4_decompress(in, o, dst, sizeof(dst)), 18);
+    ck_assert_mem_eq(dst, "aaaaaaaaaaaaabcdef", 18);
+}
+END_TEST
+
+START_TEST(test_lz4_invalid)
+{
+    uint8_t in[32];
+    uint32_t o, b;
+    int len;
+
+    /* bad magic */
+    o = put_frame_hdr(in);
+    o += put_u32(in + o, 0);
+    in[0] ^= 0xFF;
+    ck_assert_int_eq(lz4_decompress(in, o, dst, sizeof(dst)), -1);
+
+    /* external dictionary */
+    in[0] ^= 0xFF;
+    in[4] |= LZ4_FLG_DICT_ID;
+    ck_assert_int_eq(lz4_decompress(in, o, dst, sizeof(dst)), -1);
+
+    /* match offset before the start of the output */
+    o = put_frame_hdr(in);
+    b = o;
+    o += 4;
+    in[o++] = 0x10;
+    in[o++] = 'a';
+    in[o++] = 0x02;
+    in[o++] = 0x00;
+    in[o++] = 0x00;
+    put_u32(in + b, o - b - 4);
+    o += put_u32(in + o, 0);
+    ck_assert_int_eq(lz4_decompress(in, o, dst, sizeof(dst)), -1);
+
+    /* output buffer too small */
+    fill_src();
+    len = lz4_compress(src, SRC_SIZE, frame, sizeof(frame));
+    ck_assert_int_gt(len, 0);
+    ck_assert_int_eq(lz4_decompress(frame, len, dst, SRC_SIZE - 1), -1);
+
+    /* truncated frame */
+    ck_assert_int_eq(lz4_decompress(frame, len - 4, dst, sizeof(dst)), -1);
+    ck_assert_int_eq(lz4_decompress(frame, len / 2, dst, sizeof(dst)), -1);
+
+    /* output buffer too small for the encoder */
+    ck_assert_int_eq(lz4_compress(src, SRC_SIZE, frame, 64), -1);
+}
+END_TEST
+
+Suite *lz4_suite(void)
+{
+    Suite *s = suite_create("LZ4");
+    TCase *tc = tcase_create("lz4");
+
+    tcase_add_test(tc, test_lz4_roundtrip);
+    tcase_add_test(tc, test_lz4_stream_chunks);
+    tcase_add_test(tc, test_lz4_incompressible);
+    tcase_add_test(tc, test_lz4_stored_block);
+    tcase_add_test(tc, test_lz4_overlapping_match);
+    tcase_add_test(tc, test_lz4_invalid);
+    suite_add_tcase(s, tc);
+    return s;
+}
+
+int main(void)
+{
+    int ret;
+    Suite *s;
+    SRunner *sr;
+
+    s = lz4_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    ret = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return ret;
+}
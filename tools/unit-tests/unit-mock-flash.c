@@ -32,6 +32,8 @@ static int erased_nvm_bank0 = 0;
 static int erased_nvm_bank1 = 0;
 static int erased_vault = 0;
 static int hal_flash_write_fail = 0;
+static int ext_flash_swap_corrupt = 0; /* sector copies to corrupt */
+static int ext_flash_swap_corrupt_skip = 0; /* sector copies to skip first */
 const char *argv0;
 
 #include <sys/stat.h>
@@ -187,6 +189,18 @@ int ext_flash_write(uintptr_t address, const uint8_t *data, int len)
     for (i = 0; i < len; i++) {
         a[i] = data[i];
     }
+    /* Corrupt the middle of a sector copied to SWAP */
+    if ((address <= WOLFBOOT_PARTITION_SWAP_ADDRESS + WOLFBOOT_SECTOR_SIZE / 2)
+            && (address + len >
+                WOLFBOOT_PARTITION_SWAP_ADDRESS + WOLFBOOT_SECTOR_SIZE / 2)) {
+        if (ext_flash_swap_corrupt_skip > 0) {
+            ext_flash_swap_corrupt_skip--;
+        } else if (ext_flash_swap_corrupt > 0) {
+            ext_flash_swap_corrupt--;
+            a[WOLFBOOT_PARTITION_SWAP_ADDRESS + WOLFBOOT_SECTOR_SIZE / 2 -
+                address] ^= 0x01;
+        }
+    }
     return 0;
 }
 
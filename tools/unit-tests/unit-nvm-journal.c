@@ -0,0 +1,341 @@
+/* unit-nvm-journal.c
+ *
+ * unit tests for the NVM_FLASH_JOURNAL trailer journal.
+ *
+ * Copyright (C) 2025 wolfSSL Inc.
+ *
+ * This file is part of wolfBoot.
+ *
+ * wolfBoot is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfBoot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335, USA
+ */
+#define WOLFBOOT_HASH_SHA256
+#define IMAGE_HEADER_SIZE 256
+#define MOCK_ADDRESS 0xCC000000
+#define MOCK_ADDRESS_BOOT 0xCD000000
+#define MOCK_ADDRESS_SWAP 0xCE000000
+#include <stdio.h>
+#include "libwolfboot.c"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <check.h>
+
+#include "unit-mock-flash.c"
+
+#ifdef FLAGS_HOME
+#define FLAGS_PART PART_BOOT
+#else
+#define FLAGS_PART PART_UPDATE
+#endif
+
+/* sectors in the update partition, two flags per byte */
+#define N_FLAGS (WOLFBOOT_PARTITION_SIZE / WOLFBOOT_SECTOR_SIZE)
+
+Suite *wolfboot_suite(void);
+
+static void journal_setup(void)
+{
+    int ret;
+
+    ret = mmap_file("/tmp/wolfboot-unit-file.bin", (void *)MOCK_ADDRESS,
+            WOLFBOOT_PARTITION_SIZE, NULL);
+    ck_assert(ret >= 0);
+    ret = mmap_file("/tmp/wolfboot-unit-int-file.bin",
+            (void *)MOCK_ADDRESS_BOOT, WOLFBOOT_PARTITION_SIZE, NULL);
+    ck_assert(ret >= 0);
+    ret = mmap_file("/tmp/wolfboot-unit-swap.bin", (void *)MOCK_ADDRESS_SWAP,
+            WOLFBOOT_SECTOR_SIZE, NULL);
+    ck_assert(ret >= 0);
+    hal_flash_unlock();
+    wolfBoot_erase_partition(PART_BOOT);
+    wolfBoot_erase_partition(PART_UPDATE);
+    hal_flash_lock();
+    memset(nvm_journal, 0, sizeof(nvm_journal));
+    erased_boot = 0;
+    erased_update = 0;
+}
+
+static void journal_remount(void)
+{
+    memset(nvm_journal, 0, sizeof(nvm_journal));
+}
+
+START_TEST (test_journal_empty)
+{
+    uint8_t st = 0;
+
+    journal_setup();
+    ck_assert_int_eq(wolfBoot_get_partition_state(PART_UPDATE, &st), -1);
+    ck_assert_int_eq(wolfBoot_get_partition_state(PART_BOOT, &st), -1);
+    ck_assert_int_eq(nvm_journal[0].has_head, 0);
+    ck_assert_ptr_null(nvm_journal_ptr(PART_BOOT,
+                WOLFBOOT_PARTITION_BOOT_ADDRESS));
+}
+END_TEST
+
+START_TEST (test_journal_state_persists)
+{
+    uint8_t st = 0;
+
+    journal_setup();
+    hal_flash_unlock();
+    wolfBoot_set_partition_state(PART_UPDATE, IMG_STATE_UPDATING);
+    wolfBoot_set_partition_state(PART_BOOT, IMG_STATE_TESTING);
+    hal_flash_lock();
+    /* first write lands in an erased sector */
+    ck_assert_int_eq(erased_boot + erased_update, 0);
+
+    ck_assert_int_eq(wolfBoot_get_partition_state(PART_UPDATE, &st), 0);
+    ck_assert_uint_eq(st, IMG_STATE_UPDATING);
+
+    journal_remount();
+    ck_assert_int_eq(wolfBoot_get_partition_state(PART_UPDATE, &st), 0);
+    ck_assert_uint_eq(st, IMG_STATE_UPDATING);
+    ck_assert_int_eq(wolfBoot_get_partition_state(PART_BOOT, &st), 0);
+    ck_assert_uint_eq(st, IMG_STATE_TESTING);
+}
+END_TEST
+
+START_TEST (test_journal_sector_flags)
+{
+    uint8_t expected[N_FLAGS];
+    uint8_t flag;
+    int i, round;
+
+    journal_setup();
+    memset(expected, SECT_FLAG_NEW, sizeof(expected));
+    hal_flash_unlock();
+    wolfBoot_set_partition_state(PART_UPDATE, IMG_STATE_UPDATING);
+    /* walk all sectors through the swap states, as an update would */
+    for (round = 0; round < 3; round++) {
+        uint8_t f = (round == 0) ? SECT_FLAG_SWAPPING :
+            (round == 1) ? SECT_FLAG_BACKUP : SECT_FLAG_UPDATED;
+        for (i = 0; i < N_FLAGS; i++) {
+            ck_assert_int_eq(wolfBoot_set_update_sector_flag(i, f), 0);
+            expected[i] = f;
+        }
+    }
+    hal_flash_lock();
+
+    /* erases are counted per compaction, not per flag update */
+    ck_assert_int_le(erased_boot + erased_update,
+            (3 * N_FLAGS) / (NVM_JOURNAL_SLOTS / 2) + 1);
+
+    for (i = 0; i < N_FLAGS; i++) {
+        ck_assert_int_eq(wolfBoot_get_update_sector_flag(i, &flag), 0);
+        ck_assert_uint_eq(flag, expected[i]);
+    }
+    journal_remount();
+    for (i = 0; i < N_FLAGS; i++) {
+        ck_assert_int_eq(wolfBoot_get_update_sector_flag(i, &flag), 0);
+        ck_assert_uint_eq(flag, expected[i]);
+    }
+}
+END_TEST
+
+START_TEST (test_journal_ring_wear)
+{
+    int visited[NVM_JOURNAL_SECTORS] = { 0 };
+    struct nvm_journal *j;
+    uint8_t st = 0;
+    int i;
+
+    journal_setup();
+    j = &nvm_journal[nvm_journal_region(FLAGS_PART)];
+    hal_flash_unlock();
+    for (i = 0; i < NVM_JOURNAL_SECTORS * NVM_JOURNAL_SLOTS; i++) {
+        wolfBoot_set_partition_state(PART_UPDATE,
+            (i & 1) ? IMG_STATE_UPDATING : IMG_STATE_FINAL_FLAGS);
+        visited[j->head] = 1;
+    }
+    hal_flash_lock();
+    for (i = 0; i < NVM_JOURNAL_SECTORS; i++)
+        ck_assert_int_eq(visited[i], 1);
+    /* every sector of the ring was erased at most twice */
+    ck_assert_int_le(erased_boot + erased_update, 2 * NVM_JOURNAL_SECTORS);
+
+    journal_remount();
+    ck_assert_int_eq(wolfBoot_get_partition_state(PART_UPDATE, &st), 0);
+    ck_assert_uint_eq(st, IMG_STATE_UPDATING);
+}
+END_TEST
+
+START_TEST (test_journal_torn_group_dropped)
+{
+    struct nvm_journal *j;
+    uint8_t buf[2 * NVM_JOURNAL_PAYLOAD];
+    uint8_t *p;
+    uintptr_t addr;
+    int slot;
+
+    journal_setup();
+    j = &nvm_journal[nvm_journal_region(PART_BOOT)];
+    hal_flash_unlock();
+    wolfBoot_set_partition_state(PART_BOOT, IMG_STATE_TESTING);
+
+    /* multi-record update, then lose power before its last record */
+    addr = PART_BOOT_ENDFLAGS - sizeof(uint32_t) - 1 - sizeof(buf);
+    memset(buf, 0x5A, sizeof(buf));
+    ck_assert_int_eq(nvm_journal_write(PART_BOOT, addr, buf, sizeof(buf)), 0);
+    slot = j->slot - 1;
+    /* partially programmed last record */
+    memset(nvm_journal_slot(PART_BOOT, j->head, slot), 0, sizeof(uint32_t));
+    hal_flash_lock();
+
+    journal_remount();
+    p = nvm_journal_ptr(PART_BOOT, addr);
+    ck_assert_ptr_nonnull(p);
+    ck_assert_uint_eq(p[0], FLASH_BYTE_ERASED);
+    ck_assert_uint_eq(p[sizeof(buf) - 1], FLASH_BYTE_ERASED);
+    ck_assert_uint_eq(*get_partition_state(PART_BOOT), IMG_STATE_TESTING);
+
+    /* the next update goes after the torn slot */
+    ck_assert_int_eq(j->slot, slot + 1);
+    hal_flash_unlock();
+    ck_assert_int_eq(nvm_journal_write(PART_BOOT, addr, buf, sizeof(buf)), 0);
+    hal_flash_lock();
+    journal_remount();
+    p = nvm_journal_ptr(PART_BOOT, addr);
+    ck_assert_int_eq(memcmp(p, buf, sizeof(buf)), 0);
+}
+END_TEST
+
+START_TEST (test_journal_open_group_closed)
+{
+    struct nvm_journal *j;
+    uint8_t buf[3 * NVM_JOURNAL_PAYLOAD];
+    uint8_t *p;
+    uintptr_t addr;
+    int head, slot;
+
+    journal_setup();
+    j = &nvm_journal[nvm_journal_region(PART_BOOT)];
+    hal_flash_unlock();
+    wolfBoot_set_partition_state(PART_BOOT, IMG_STATE_TESTING);
+
+    /* multi-record update, lose power before its last record is written:
+     * the slot stays erased */
+    addr = PART_BOOT_ENDFLAGS - sizeof(uint32_t) - 1 - sizeof(buf);
+    memset(buf, 0x5A, sizeof(buf));
+    ck_assert_int_eq(nvm_journal_write(PART_BOOT, addr, buf, sizeof(buf)), 0);
+    head = j->head;
+    slot = j->slot - 1;
+    memset(nvm_journal_slot(PART_BOOT, head, slot), FLASH_BYTE_ERASED,
+        NVM_JOURNAL_RECORD_SIZE);
+    hal_flash_lock();
+
+    journal_remount();
+    ck_assert_uint_eq(*get_partition_state(PART_BOOT), IMG_STATE_TESTING);
+    ck_assert_int_eq(j->slot, slot);
+    ck_assert(j->open);
+
+    /* a one-byte flag update must not complete the open group */
+    hal_flash_unlock();
+    wolfBoot_set_partition_state(PART_BOOT, IMG_STATE_SUCCESS);
+    hal_flash_lock();
+    ck_assert(!j->open);
+    ck_assert_int_ne(j->head, head);
+
+    journal_remount();
+    p = nvm_journal_ptr(PART_BOOT, addr);
+    ck_assert_ptr_nonnull(p);
+    ck_assert_uint_eq(p[0], FLASH_BYTE_ERASED);
+    ck_assert_uint_eq(p[sizeof(buf) - NVM_JOURNAL_PAYLOAD - 1],
+        FLASH_BYTE_ERASED);
+    ck_assert_uint_eq(*get_partition_state(PART_BOOT), IMG_STATE_SUCCESS);
+    ck_assert(!j->open);
+}
+END_TEST
+
+START_TEST (test_journal_external_erase)
+{
+    uint8_t st = 0;
+
+    journal_setup();
+    hal_flash_unlock();
+    wolfBoot_set_partition_state(PART_UPDATE, IMG_STATE_UPDATING);
+    ck_assert_int_eq(wolfBoot_get_partition_state(PART_UPDATE, &st), 0);
+
+    /* final erase wipes the trailer sectors behind the journal */
+    wolfBoot_erase_partition(FLAGS_PART);
+    ck_assert_int_eq(wolfBoot_get_partition_state(PART_UPDATE, &st), -1);
+
+    wolfBoot_set_partition_state(PART_UPDATE, IMG_STATE_FINAL_FLAGS);
+    hal_flash_lock();
+    journal_remount();
+    ck_assert_int_eq(wolfBoot_get_partition_state(PART_UPDATE, &st), 0);
+    ck_assert_uint_eq(st, IMG_STATE_FINAL_FLAGS);
+}
+END_TEST
+
+START_TEST (test_journal_write_failure)
+{
+    uint8_t st = 0;
+
+    journal_setup();
+    hal_flash_unlock();
+    wolfBoot_set_partition_state(PART_UPDATE, IMG_STATE_UPDATING);
+    hal_flash_write_fail = 1;
+    ck_assert_int_ne(trailer_write(PART_UPDATE, PART_UPDATE_ENDFLAGS -
+                (sizeof(uint32_t) + 1), st), 0);
+    hal_flash_lock();
+    /* the RAM image is rebuilt from flash */
+    ck_assert_int_eq(wolfBoot_get_partition_state(PART_UPDATE, &st), 0);
+    ck_assert_uint_eq(st, IMG_STATE_UPDATING);
+}
+END_TEST
+
+START_TEST (test_journal_update_trigger)
+{
+    uint8_t st = 0;
+
+    journal_setup();
+    wolfBoot_update_trigger();
+    ck_assert_int_eq(wolfBoot_get_partition_state(PART_UPDATE, &st), 0);
+    ck_assert_uint_eq(st, IMG_STATE_UPDATING);
+    ck_assert_msg(locked, "The FLASH was left unlocked.\n");
+}
+END_TEST
+
+Suite *wolfboot_suite(void)
+{
+    Suite *s = suite_create("wolfboot");
+    TCase *tc = tcase_create("NVM journal");
+
+    tcase_add_test(tc, test_journal_empty);
+    tcase_add_test(tc, test_journal_state_persists);
+    tcase_add_test(tc, test_journal_sector_flags);
+    tcase_add_test(tc, test_journal_ring_wear);
+    tcase_add_test(tc, test_journal_torn_group_dropped);
+    tcase_add_test(tc, test_journal_open_group_closed);
+    tcase_add_test(tc, test_journal_external_erase);
+    tcase_add_test(tc, test_journal_write_failure);
+    tcase_add_test(tc, test_journal_update_trigger);
+    suite_add_tcase(s, tc);
+    return s;
+}
+
+
+int main(int argc, char *argv[])
+{
+    int fails;
+    argv0 = strdup(argv[0]);
+    Suite *s = wolfboot_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    fails = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return fails;
+}
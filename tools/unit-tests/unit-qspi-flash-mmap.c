@@ -0,0 +1,221 @@
+/* unit-qspi-flash-mmap.c
+ *
+ * Unit tests for the memory-mapped read mode of qspi_flash.c.
+ */
+
+#define QSPI_FLASH
+#define QSPI_FLASH_MMAP
+
+#include <check.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MOCK_FLASH_SIZE (64 * 1024)
+
+static uint8_t mock_flash[MOCK_FLASH_SIZE];
+static int mmap_active;
+static int mmap_enable_count;
+static int mmap_disable_count;
+static int indirect_read_count;
+static int indirect_write_count;
+static int indirect_erase_count;
+static uint8_t mmap_cmd;
+
+void spi_init(int polarity, int phase)
+{
+    (void)polarity;
+    (void)phase;
+}
+
+void spi_release(void)
+{
+}
+
+#include "../../src/qspi_flash.c"
+
+int qspi_transfer(uint8_t fmode, const uint8_t cmd,
+    uint32_t addr, uint32_t addrSz, uint32_t addrMode,
+    uint32_t alt, uint32_t altSz, uint32_t altMode,
+    uint32_t dummySz,
+    uint8_t* data, uint32_t dataSz, uint32_t dataMode)
+{
+    (void)fmode;
+    (void)addrSz;
+    (void)addrMode;
+    (void)alt;
+    (void)altSz;
+    (void)altMode;
+    (void)dummySz;
+    (void)dataMode;
+
+    ck_assert_msg(!mmap_active, "indirect transfer while memory-mapped");
+
+    if (cmd == READ_SR_CMD) {
+        data[0] = FLASH_SR_WRITE_EN;
+        return 0;
+    }
+    if (cmd == FLASH_WRITE_CMD) {
+        ck_assert_uint_le(addr + dataSz, MOCK_FLASH_SIZE);
+        memcpy(mock_flash + addr, data, dataSz);
+        indirect_write_count++;
+        return 0;
+    }
+    if (cmd == SEC_ERASE_CMD) {
+        memset(mock_flash + (addr & ~(FLASH_SECTOR_SIZE - 1)), 0xFF,
+            FLASH_SECTOR_SIZE);
+        indirect_erase_count++;
+        return 0;
+    }
+    if (cmd == FLASH_READ_CMD) {
+        memcpy(data, mock_flash + addr, dataSz);
+        indirect_read_count++;
+        return 0;
+    }
+    return 0;
+}
+
+void* qspi_mmap_enable(const uint8_t cmd,
+    uint32_t addrSz, uint32_t addrMode,
+    uint32_t alt, uint32_t altSz, uint32_t altMode,
+    uint32_t dummySz, uint32_t dataMode)
+{
+    (void)addrSz;
+    (void)addrMode;
+    (void)alt;
+    (void)altSz;
+    (void)altMode;
+    (void)dummySz;
+    (void)dataMode;
+
+    ck_assert_msg(!mmap_active, "memory-mapped mode entered twice");
+    mmap_active = 1;
+    mmap_enable_count++;
+    mmap_cmd = cmd;
+    return mock_flash;
+}
+
+void qspi_mmap_disable(void)
+{
+    ck_assert_msg(mmap_active, "memory-mapped mode left twice");
+    mmap_active = 0;
+    mmap_disable_count++;
+}
+
+static void setup(void)
+{
+    int i;
+    for (i = 0; i < MOCK_FLASH_SIZE; i++)
+        mock_flash[i] = (uint8_t)(i * 3);
+    if (mmap_active)
+        spi_flash_release();
+    mmap_active = 0;
+    mmap_enable_count = 0;
+    mmap_disable_count = 0;
+    indirect_read_count = 0;
+    indirect_write_count = 0;
+    indirect_erase_count = 0;
+    mmap_cmd = 0;
+}
+
+START_TEST(test_mmap_returns_flash_window)
+{
+    const uint8_t *p;
+
+    p = ext_flash_mmap(0x1000, 256);
+    ck_assert_ptr_eq(p, mock_flash + 0x1000);
+    ck_assert_int_eq(mmap_enable_count, 1);
+    ck_assert_uint_eq(mmap_cmd, FLASH_READ_CMD);
+
+    /* already mapped: no new command */
+    p = ext_flash_mmap(0x2000, 256);
+    ck_assert_ptr_eq(p, mock_flash + 0x2000);
+    ck_assert_int_eq(mmap_enable_count, 1);
+}
+END_TEST
+
+START_TEST(test_mmap_rejects_out_of_range)
+{
+    ck_assert_ptr_null(ext_flash_mmap(FLASH_DEVICE_SIZE - 16, 32));
+    ck_assert_ptr_null(ext_flash_mmap(0, -1));
+    ck_assert_int_eq(mmap_enable_count, 0);
+}
+END_TEST
+
+START_TEST(test_mmap_read_without_indirect_transfer)
+{
+    uint8_t out[64];
+    int ret;
+
+    ret = spi_flash_read(0x300, out, sizeof(out));
+    ck_assert_int_eq(ret, (int)sizeof(out));
+    ck_assert_int_eq(0, memcmp(out, mock_flash + 0x300, sizeof(out)));
+    ck_assert_int_eq(indirect_read_count, 0);
+    ck_assert_int_eq(mmap_active, 1);
+}
+END_TEST
+
+START_TEST(test_mmap_left_for_write_and_erase)
+{
+    uint8_t buf[32];
+    const uint8_t *p;
+
+    memset(buf, 0x5A, sizeof(buf));
+    p = ext_flash_mmap(0x4000, sizeof(buf));
+    ck_assert_ptr_nonnull(p);
+
+    ck_assert_int_eq(spi_flash_sector_erase(0x4000), 0);
+    ck_assert_int_eq(mmap_disable_count, 1);
+    ck_assert_int_eq(indirect_erase_count, 1);
+    ck_assert_int_eq(mmap_active, 0);
+
+    ck_assert_int_eq(spi_flash_write(0x4000, buf, sizeof(buf)), 0);
+    ck_assert_int_eq(indirect_write_count, 1);
+
+    /* reads map the flash again and see the new data */
+    p = ext_flash_mmap(0x4000, sizeof(buf));
+    ck_assert_ptr_nonnull(p);
+    ck_assert_int_eq(mmap_enable_count, 2);
+    ck_assert_int_eq(0, memcmp(p, buf, sizeof(buf)));
+    ck_assert_uint_eq(p[sizeof(buf)], 0xFF);
+}
+END_TEST
+
+START_TEST(test_mmap_release_leaves_mapping)
+{
+    ck_assert_ptr_nonnull(ext_flash_mmap(0, 16));
+    spi_flash_release();
+    ck_assert_int_eq(mmap_active, 0);
+    ck_assert_int_eq(mmap_disable_count, 1);
+}
+END_TEST
+
+static Suite *qspi_flash_mmap_suite(void)
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("QSPI Flash MMAP");
+    tc = tcase_create("MMAP");
+    tcase_add_checked_fixture(tc, setup, NULL);
+    tcase_add_test(tc, test_mmap_returns_flash_window);
+    tcase_add_test(tc, test_mmap_rejects_out_of_range);
+    tcase_add_test(tc, test_mmap_read_without_indirect_transfer);
+    tcase_add_test(tc, test_mmap_left_for_write_and_erase);
+    tcase_add_test(tc, test_mmap_release_leaves_mapping);
+    suite_add_tcase(s, tc);
+    return s;
+}
+
+int main(void)
+{
+    Suite *s;
+    SRunner *sr;
+    int failed;
+
+    s = qspi_flash_mmap_suite();
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return failed == 0 ? 0 : 1;
+}
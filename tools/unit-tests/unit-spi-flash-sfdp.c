@@ -0,0 +1,487 @@
+/* unit-spi-flash-sfdp.c
+ *
+ * Unit tests for the SFDP command selection and burst transfers
+ * in spi_flash.c.
+ *
+ *
+ * Copyright (C) 2025 wolfSSL Inc.
+ *
+ * This file is part of wolfBoot.
+ *
+ * wolfBoot is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfBoot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335, USA
+ */
+
+#define SPI_FLASH
+#define SPI_FLASH_SFDP
+#define SPI_DRV_HAS_BURST
+
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "spi_flash.c"
+
+/* Mock SPI NOR device, driven one byte at a time */
+#define MOCK_FLASH_SIZE (64 * 1024)
+#define MOCK_SFDP_SIZE  256
+#define MOCK_BFPT_PTR   0x30
+#define MOCK_4B_PTR     0x80
+
+/* Simulated bus: SCK of 50MHz for the basic read command (the limit of most
+ * devices for 0x03), 104MHz otherwise, plus a fixed cost per HAL call. */
+#define MOCK_SCK_SLOW_MHZ   50
+#define MOCK_SCK_FAST_MHZ   104
+#define MOCK_CALL_NS        40
+
+static uint8_t mock_flash[MOCK_FLASH_SIZE];
+static uint8_t mock_sfdp[MOCK_SFDP_SIZE];
+static int mock_has_sfdp;
+
+static int cs_asserted;
+static int byte_idx;
+static uint8_t cmd;
+static int cmd_addr_bytes;
+static int cmd_dummy;
+static uint32_t addr;
+static uint8_t last_rx;
+
+static uint8_t last_cmd;
+static int last_addr_bytes;
+static uint32_t last_addr;
+static uint8_t last_erase_cmd;
+static uint32_t last_erase_addr;
+static int erase_count;
+static int program_count;
+
+static int mock_fifo;
+static unsigned long hal_calls;
+static unsigned long long bus_ps;
+
+static void mock_sfdp_build(uint32_t dw2, uint8_t page_shift, int with_4b,
+    uint32_t dw4b)
+{
+    uint8_t *bfpt = mock_sfdp + MOCK_BFPT_PTR;
+    uint32_t dw1 = 0x01 | (SECTOR_ERASE << 8) | (0x01 << 17);
+    int i;
+
+    memset(mock_sfdp, 0xFF, sizeof(mock_sfdp));
+    memcpy(mock_sfdp, "SFDP", 4);
+    mock_sfdp[4] = 6;    /* JESD216B */
+    mock_sfdp[5] = 1;
+    mock_sfdp[6] = with_4b ? 1 : 0;
+    mock_sfdp[7] = 0xFF;
+
+    /* Basic Flash Parameter Table header */
+    mock_sfdp[8]  = 0x00;
+    mock_sfdp[9]  = 6;
+    mock_sfdp[10] = 1;
+    mock_sfdp[11] = 16;
+    mock_sfdp[12] = MOCK_BFPT_PTR;
+    mock_sfdp[13] = 0;
+    mock_sfdp[14] = 0;
+    mock_sfdp[15] = 0xFF;
+
+    /* 4-byte Address Instruction Table header */
+    mock_sfdp[16] = 0x84;
+    mock_sfdp[17] = 0;
+    mock_sfdp[18] = 1;
+    mock_sfdp[19] = 2;
+    mock_sfdp[20] = MOCK_4B_PTR;
+    mock_sfdp[21] = 0;
+    mock_sfdp[22] = 0;
+    mock_sfdp[23] = 0xFF;
+
+    memset(bfpt, 0, 16 * 4);
+    for (i = 0; i < 4; i++) {
+        bfpt[i] = (uint8_t)(dw1 >> (8 * i));
+        bfpt[4 + i] = (uint8_t)(dw2 >> (8 * i));
+        mock_sfdp[MOCK_4B_PTR + i] = (uint8_t)(dw4b >> (8 * i));
+    }
+    bfpt[40] = (uint8_t)(page_shift << 4);
+    mock_has_sfdp = 1;
+}
+
+static void reset_spi_mock(void)
+{
+    memset(mock_flash, 0xFF, sizeof(mock_flash));
+    memset(mock_sfdp, 0xFF, sizeof(mock_sfdp));
+    mock_has_sfdp = 0;
+    cs_asserted = 0;
+    byte_idx = 0;
+    last_cmd = 0;
+    last_addr_bytes = 0;
+    last_addr = 0;
+    last_erase_cmd = 0;
+    last_erase_addr = 0;
+    erase_count = 0;
+    program_count = 0;
+    mock_fifo = 0;
+    hal_calls = 0;
+    bus_ps = 0;
+    /* spi_flash.c keeps the selected commands across probes */
+    flash_cmds.read = BYTE_READ;
+    flash_cmds.read_dummy = 0;
+    flash_cmds.write = BYTE_WRITE;
+    flash_cmds.erase = SECTOR_ERASE;
+    flash_cmds.addr_bytes = 3;
+    flash_cmds.page_size = SPI_FLASH_PAGE_SIZE;
+}
+
+static void mock_decode_cmd(uint8_t c)
+{
+    cmd = c;
+    cmd_dummy = 0;
+    switch (c) {
+        case BYTE_READ:
+        case BYTE_WRITE:
+        case SECTOR_ERASE:
+            cmd_addr_bytes = 3;
+            break;
+        case FAST_READ:
+        case SFDP_READ:
+            cmd_addr_bytes = 3;
+            cmd_dummy = 1;
+            break;
+        case FAST_READ_4B:
+            cmd_addr_bytes = 4;
+            cmd_dummy = 1;
+            break;
+        case 0x13: /* READ_4B */
+        case BYTE_WRITE_4B:
+        case SECTOR_ERASE_4B:
+            cmd_addr_bytes = 4;
+            break;
+        default:
+            cmd_addr_bytes = 0;
+            break;
+    }
+}
+
+static uint8_t mock_xfer(uint8_t tx)
+{
+    int data_idx;
+    uint8_t rx = 0xFF;
+
+    ck_assert_msg(cs_asserted, "SPI transfer without CS asserted");
+    if (byte_idx == 0) {
+        mock_decode_cmd(tx);
+        addr = 0;
+        byte_idx++;
+        return 0;
+    }
+    if (byte_idx <= cmd_addr_bytes) {
+        addr = (addr << 8) | tx;
+        if (byte_idx == cmd_addr_bytes && cmd != SFDP_READ) {
+            last_cmd = cmd;
+            last_addr_bytes = cmd_addr_bytes;
+            last_addr = addr;
+            if (cmd == SECTOR_ERASE || cmd == SECTOR_ERASE_4B) {
+                last_erase_cmd = cmd;
+                last_erase_addr = addr;
+                erase_count++;
+            }
+            if (cmd == BYTE_WRITE || cmd == BYTE_WRITE_4B)
+                program_count++;
+        }
+        byte_idx++;
+        return 0;
+    }
+    data_idx = byte_idx - 1 - cmd_addr_bytes - cmd_dummy;
+    byte_idx++;
+    if (data_idx < 0)
+        return 0;
+
+    switch (cmd) {
+        case MDID:
+            rx = (data_idx == 0) ? 0xEF : 0x40;
+            break;
+        case RDSR:
+            rx = ST_WEL;
+            break;
+        case SFDP_READ:
+            if (mock_has_sfdp && (addr + data_idx) < MOCK_SFDP_SIZE)
+                rx = mock_sfdp[addr + data_idx];
+            break;
+        case BYTE_READ:
+        case FAST_READ:
+        case FAST_READ_4B:
+        case 0x13:
+            rx = mock_flash[(addr + data_idx) % MOCK_FLASH_SIZE];
+            break;
+        case BYTE_WRITE:
+        case BYTE_WRITE_4B:
+            /* page program wraps within the page */
+            mock_flash[((addr & ~0xFFUL) | ((addr + data_idx) & 0xFF)) %
+                MOCK_FLASH_SIZE] &= tx;
+            break;
+        default:
+            break;
+    }
+    return rx;
+}
+
+static void mock_bus_time(uint32_t bytes)
+{
+    uint32_t mhz = (cmd == BYTE_READ) ? MOCK_SCK_SLOW_MHZ : MOCK_SCK_FAST_MHZ;
+    bus_ps += ((unsigned long long)bytes * 8 * 1000000ULL) / mhz;
+}
+
+void spi_init(int polarity, int phase)
+{
+    (void)polarity;
+    (void)phase;
+}
+
+void spi_release(void)
+{
+}
+
+void spi_cs_on(uint32_t base, int pin)
+{
+    (void)base;
+    (void)pin;
+    cs_asserted = 1;
+    byte_idx = 0;
+    cmd = 0;
+    cmd_addr_bytes = 0;
+    cmd_dummy = 0;
+}
+
+void spi_cs_off(uint32_t base, int pin)
+{
+    (void)base;
+    (void)pin;
+    cs_asserted = 0;
+}
+
+void spi_write(const char byte)
+{
+    hal_calls++;
+    bus_ps += MOCK_CALL_NS * 1000ULL;
+    last_rx = mock_xfer((uint8_t)byte);
+    mock_bus_time(1);
+}
+
+uint8_t spi_read(void)
+{
+    hal_calls++;
+    bus_ps += MOCK_CALL_NS * 1000ULL;
+    return last_rx;
+}
+
+/* With mock_fifo set the transfer is streamed as one HAL call, as a FIFO or
+ * DMA capable driver would do; otherwise it costs a spi_write()/spi_read()
+ * pair per byte like the generic fallback. */
+void spi_burst(const uint8_t *tx, uint8_t *rx, uint32_t sz)
+{
+    uint32_t i;
+    uint8_t b;
+    if (mock_fifo) {
+        hal_calls++;
+        bus_ps += MOCK_CALL_NS * 1000ULL;
+    }
+    for (i = 0; i < sz; i++) {
+        if (!mock_fifo) {
+            hal_calls += 2;
+            bus_ps += 2 * MOCK_CALL_NS * 1000ULL;
+        }
+        b = mock_xfer(tx != NULL ? tx[i] : 0xFF);
+        mock_bus_time(1);
+        if (rx != NULL)
+            rx[i] = b;
+    }
+}
+
+START_TEST(test_sfdp_16mb_uses_fast_read)
+{
+    uint8_t buf[8], out[8];
+    int i;
+
+    reset_spi_mock();
+    mock_sfdp_build(0x07FFFFFF, 8, 0, 0); /* 128Mbit */
+    spi_flash_probe();
+
+    ck_assert_uint_eq(flash_cmds.read, FAST_READ);
+    ck_assert_uint_eq(flash_cmds.addr_bytes, 3);
+
+    for (i = 0; i < (int)sizeof(buf); i++)
+        buf[i] = (uint8_t)(0x10 + i);
+    ck_assert_int_eq(spi_flash_write(0x100, buf, sizeof(buf)), 0);
+    ck_assert_uint_eq(last_cmd, BYTE_WRITE);
+    ck_assert_int_eq(spi_flash_read(0x100, out, sizeof(out)),
+        (int)sizeof(out));
+    ck_assert_uint_eq(last_cmd, FAST_READ);
+    ck_assert_int_eq(last_addr_bytes, 3);
+    ck_assert_int_eq(0, memcmp(buf, out, sizeof(out)));
+}
+END_TEST
+
+START_TEST(test_sfdp_32mb_uses_4byte_commands)
+{
+    uint8_t buf[16], out[16];
+    uint32_t address = 0x01000100;
+    int i;
+
+    reset_spi_mock();
+    mock_sfdp_build(0x80000000 | 28, 8, 1, (1 << 1) | (1 << 6) | (1 << 9));
+    spi_flash_probe();
+
+    ck_assert_uint_eq(flash_cmds.addr_bytes, 4);
+    ck_assert_uint_eq(flash_cmds.read, FAST_READ_4B);
+
+    for (i = 0; i < (int)sizeof(buf); i++)
+        buf[i] = (uint8_t)(0xC0 + i);
+    ck_assert_int_eq(spi_flash_write(address, buf, sizeof(buf)), 0);
+    ck_assert_uint_eq(last_cmd, BYTE_WRITE_4B);
+    ck_assert_uint_eq(last_addr, address);
+
+    ck_assert_int_eq(spi_flash_read(address, out, sizeof(out)),
+        (int)sizeof(out));
+    ck_assert_uint_eq(last_cmd, FAST_READ_4B);
+    ck_assert_uint_eq(last_addr, address);
+    ck_assert_int_eq(last_addr_bytes, 4);
+    ck_assert_int_eq(0, memcmp(buf, out, sizeof(out)));
+
+    ck_assert_int_eq(spi_flash_sector_erase(address), 0);
+    ck_assert_uint_eq(last_erase_cmd, SECTOR_ERASE_4B);
+    ck_assert_uint_eq(last_erase_addr,
+        address & ~(SPI_FLASH_SECTOR_SIZE - 1));
+}
+END_TEST
+
+START_TEST(test_sfdp_missing_keeps_legacy_commands)
+{
+    uint8_t out[4];
+
+    reset_spi_mock();
+    spi_flash_probe();
+
+    ck_assert_uint_eq(flash_cmds.read, BYTE_READ);
+    ck_assert_uint_eq(flash_cmds.addr_bytes, 3);
+    spi_flash_read(0x20, out, sizeof(out));
+    ck_assert_uint_eq(last_cmd, BYTE_READ);
+    spi_flash_sector_erase(0x1000);
+    ck_assert_uint_eq(last_erase_cmd, SECTOR_ERASE);
+}
+END_TEST
+
+START_TEST(test_sfdp_4byte_table_without_erase)
+{
+    reset_spi_mock();
+    /* 4-byte read and program only: stay in 3-byte mode */
+    mock_sfdp_build(0x0FFFFFFF, 8, 1, (1 << 1) | (1 << 6));
+    spi_flash_probe();
+
+    ck_assert_uint_eq(flash_cmds.addr_bytes, 3);
+    ck_assert_uint_eq(flash_cmds.read, FAST_READ);
+    ck_assert_uint_eq(flash_cmds.write, BYTE_WRITE);
+}
+END_TEST
+
+START_TEST(test_sfdp_page_size)
+{
+    uint8_t buf[100];
+    int i;
+
+    reset_spi_mock();
+    mock_sfdp_build(0x07FFFFFF, 6, 0, 0); /* 64-byte pages */
+    spi_flash_probe();
+    ck_assert_uint_eq(flash_cmds.page_size, 64);
+
+    for (i = 0; i < (int)sizeof(buf); i++)
+        buf[i] = (uint8_t)i;
+    program_count = 0;
+    ck_assert_int_eq(spi_flash_write(0x30, buf, sizeof(buf)), 0);
+    /* 0x30-0x3F, 0x40-0x7F, 0x80-0x93 */
+    ck_assert_int_eq(program_count, 3);
+    ck_assert_int_eq(0, memcmp(&mock_flash[0x30], buf, sizeof(buf)));
+}
+END_TEST
+
+START_TEST(test_sfdp_read_benchmark)
+{
+    static uint8_t out[MOCK_FLASH_SIZE];
+    unsigned long legacy_calls, sfdp_calls;
+    unsigned long long legacy_ps, sfdp_ps;
+    int i;
+
+    /* Per-byte HAL calls with the basic read command */
+    reset_spi_mock();
+    for (i = 0; i < MOCK_FLASH_SIZE; i++)
+        mock_flash[i] = (uint8_t)(i * 7);
+    spi_flash_probe();
+    hal_calls = 0;
+    bus_ps = 0;
+    spi_flash_read(0, out, sizeof(out));
+    legacy_calls = hal_calls;
+    legacy_ps = bus_ps;
+    ck_assert_uint_eq(out[1234], (uint8_t)(1234 * 7));
+
+    /* Fast Read selected from SFDP, streamed through a FIFO burst */
+    reset_spi_mock();
+    for (i = 0; i < MOCK_FLASH_SIZE; i++)
+        mock_flash[i] = (uint8_t)(i * 7);
+    mock_sfdp_build(0x07FFFFFF, 8, 0, 0);
+    spi_flash_probe();
+    mock_fifo = 1;
+    hal_calls = 0;
+    bus_ps = 0;
+    memset(out, 0, sizeof(out));
+    spi_flash_read(0, out, sizeof(out));
+    sfdp_calls = hal_calls;
+    sfdp_ps = bus_ps;
+    ck_assert_uint_eq(out[1234], (uint8_t)(1234 * 7));
+
+    printf("SPI read 64KB: legacy %lu HAL calls %llu us, "
+           "SFDP+burst %lu HAL calls %llu us\n",
+           legacy_calls, legacy_ps / 1000000ULL,
+           sfdp_calls, sfdp_ps / 1000000ULL);
+    ck_assert_uint_lt(sfdp_calls, legacy_calls);
+    ck_assert_uint_lt(sfdp_ps, legacy_ps);
+}
+END_TEST
+
+Suite *spi_flash_sfdp_suite(void)
+{
+    Suite *s = suite_create("SPI Flash SFDP");
+    TCase *tcase_probe = tcase_create("Probe");
+    TCase *tcase_xfer = tcase_create("Transfer");
+
+    tcase_add_test(tcase_probe, test_sfdp_16mb_uses_fast_read);
+    tcase_add_test(tcase_probe, test_sfdp_32mb_uses_4byte_commands);
+    tcase_add_test(tcase_probe, test_sfdp_missing_keeps_legacy_commands);
+    tcase_add_test(tcase_probe, test_sfdp_4byte_table_without_erase);
+    tcase_add_test(tcase_xfer, test_sfdp_page_size);
+    tcase_add_test(tcase_xfer, test_sfdp_read_benchmark);
+
+    suite_add_tcase(s, tcase_probe);
+    suite_add_tcase(s, tcase_xfer);
+
+    return s;
+}
+
+int main(void)
+{
+    int fails;
+    Suite *s = spi_flash_sfdp_suite();
+    SRunner *sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    fails = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return fails;
+}
@@ -0,0 +1,334 @@
+/* unit-tpm-measure.c
+ *
+ * Unit tests for measured boot from the verified image digest, and for
+ * the stepwise TPM initialization (WOLFBOOT_TPM_INIT_ASYNC).
+ */
+
+#include <check.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef SPI_CS_TPM
+#define SPI_CS_TPM 1
+#endif
+#ifndef WOLFBOOT_SHA_DIGEST_SIZE
+#define WOLFBOOT_SHA_DIGEST_SIZE 32
+#endif
+
+#include "wolfboot/wolfboot.h"
+#include "tpm.h"
+
+#define TEST_PCR 16
+
+static int extend_calls;
+static int extend_rc;
+static int last_extend_pcr;
+static int last_extend_alg;
+static int last_extend_sz;
+static uint8_t last_extend_digest[WOLFBOOT_TPM_PCR_DIG_SZ];
+static int spi_init_calls;
+static int tpm_init_calls;
+static int tpm_init_rc;
+static int caps_calls;
+
+int wolfBoot_printf(const char* fmt, ...)
+{
+    (void)fmt;
+    return 0;
+}
+
+void spi_init(int polarity, int phase)
+{
+    (void)polarity;
+    (void)phase;
+    spi_init_calls++;
+}
+
+int spi_xfer(int cs, const uint8_t *tx, uint8_t *rx, uint32_t sz, int flags)
+{
+    (void)cs;
+    (void)tx;
+    (void)rx;
+    (void)sz;
+    (void)flags;
+    return 0;
+}
+
+int wolfTPM2_Init(WOLFTPM2_DEV* dev, TPM2HalIoCb ioCb, void* userCtx)
+{
+    (void)dev;
+    (void)ioCb;
+    (void)userCtx;
+    tpm_init_calls++;
+    return tpm_init_rc;
+}
+
+int wolfTPM2_GetCapabilities(WOLFTPM2_DEV* dev, WOLFTPM2_CAPS* caps)
+{
+    (void)dev;
+    memset(caps, 0, sizeof(*caps));
+    caps_calls++;
+    return 0;
+}
+
+int wolfTPM2_SetAuthPassword(WOLFTPM2_DEV* dev, int index,
+    const TPM2B_AUTH* auth)
+{
+    (void)dev;
+    (void)index;
+    (void)auth;
+    return 0;
+}
+
+int wolfTPM2_ExtendPCR(WOLFTPM2_DEV* dev, int pcrIndex, int hashAlg,
+    const byte* digest, int digestLen)
+{
+    (void)dev;
+    extend_calls++;
+    last_extend_pcr = pcrIndex;
+    last_extend_alg = hashAlg;
+    last_extend_sz = digestLen;
+    memcpy(last_extend_digest, digest, sizeof(last_extend_digest));
+    return extend_rc;
+}
+
+int TPM2_GetHashDigestSize(TPMI_ALG_HASH hashAlg)
+{
+    return (hashAlg == TPM_ALG_SHA256) ? 32 : 0;
+}
+
+#include "../../src/tpm.c"
+
+static uint8_t test_digest[WOLFBOOT_SHA_DIGEST_SIZE];
+
+static void setup(void)
+{
+    extend_calls = 0;
+    extend_rc = 0;
+    last_extend_pcr = -1;
+    last_extend_alg = 0;
+    last_extend_sz = 0;
+    memset(last_extend_digest, 0, sizeof(last_extend_digest));
+    memset(measured_log, 0, sizeof(measured_log));
+    measured_log_count = 0;
+    measured_log_truncated = 0;
+    memset(test_digest, 0xA5, sizeof(test_digest));
+    test_digest[0] = 0x01;
+    spi_init_calls = 0;
+    tpm_init_calls = 0;
+    tpm_init_rc = 0;
+    caps_calls = 0;
+    tpm2_init_step = TPM2_INIT_IDLE;
+    tpm2_init_rc = 0;
+    tpm2_init_busy = 0;
+}
+
+static void setup_measure(void)
+{
+    setup();
+    ck_assert_int_eq(wolfBoot_tpm2_init(), 0);
+}
+
+static void verified_image(struct wolfBoot_image* img)
+{
+    memset(img, 0, sizeof(*img));
+    img->sha_ok = 1;
+    img->sha_hash = test_digest;
+}
+
+START_TEST(test_measure_image_uses_verified_digest)
+{
+    struct wolfBoot_image img;
+    const struct wolfBoot_tpm_event* log;
+    uint32_t count;
+
+    verified_image(&img);
+    ck_assert_int_eq(wolfBoot_tpm2_measure_image(TEST_PCR, &img), 0);
+    ck_assert_int_eq(extend_calls, 1);
+    ck_assert_int_eq(last_extend_pcr, TEST_PCR);
+    ck_assert_int_eq(last_extend_alg, TPM_ALG_SHA256);
+    ck_assert_int_eq(last_extend_sz, WOLFBOOT_TPM_PCR_DIG_SZ);
+    ck_assert_mem_eq(last_extend_digest, test_digest, WOLFBOOT_TPM_PCR_DIG_SZ);
+
+    ck_assert_int_eq(wolfBoot_tpm2_get_event_log(&log, &count), 0);
+    ck_assert_uint_eq(count, 1);
+    ck_assert_uint_eq(log[0].pcrIndex, TEST_PCR);
+    ck_assert_uint_eq(log[0].eventType, WOLFBOOT_EV_IPL);
+    ck_assert_mem_eq(log[0].digest, test_digest, WOLFBOOT_TPM_PCR_DIG_SZ);
+    ck_assert_uint_eq(log[0].eventSize, strlen("boot image"));
+    ck_assert_mem_eq(log[0].event, "boot image", log[0].eventSize);
+}
+END_TEST
+
+START_TEST(test_measure_image_rejects_unverified)
+{
+    struct wolfBoot_image img;
+    const struct wolfBoot_tpm_event* log;
+    uint32_t count;
+
+    verified_image(&img);
+    img.sha_ok = 0;
+    ck_assert_int_ne(wolfBoot_tpm2_measure_image(TEST_PCR, &img), 0);
+    verified_image(&img);
+    img.sha_hash = NULL;
+    ck_assert_int_ne(wolfBoot_tpm2_measure_image(TEST_PCR, &img), 0);
+    ck_assert_int_ne(wolfBoot_tpm2_measure_image(TEST_PCR, NULL), 0);
+
+    ck_assert_int_eq(extend_calls, 0);
+    ck_assert_int_eq(wolfBoot_tpm2_get_event_log(&log, &count), 0);
+    ck_assert_uint_eq(count, 0);
+}
+END_TEST
+
+START_TEST(test_measure_extend_failure_not_logged)
+{
+    const struct wolfBoot_tpm_event* log;
+    uint32_t count;
+
+    extend_rc = -1;
+    ck_assert_int_ne(wolfBoot_tpm2_measure(TEST_PCR, WOLFBOOT_EV_POST_CODE,
+        test_digest, "wolfBoot"), 0);
+    ck_assert_int_eq(extend_calls, 1);
+    ck_assert_int_eq(wolfBoot_tpm2_get_event_log(&log, &count), 0);
+    ck_assert_uint_eq(count, 0);
+}
+END_TEST
+
+START_TEST(test_measure_log_full)
+{
+    const struct wolfBoot_tpm_event* log;
+    uint32_t count;
+    int i;
+
+    for (i = 0; i < WOLFBOOT_MEASURED_LOG_ENTRIES; i++) {
+        test_digest[1] = (uint8_t)i;
+        ck_assert_int_eq(wolfBoot_tpm2_measure(TEST_PCR,
+            WOLFBOOT_EV_POST_CODE, test_digest,
+            "a description longer than an entry"), 0);
+    }
+    ck_assert_int_eq(wolfBoot_tpm2_get_event_log(&log, &count), 0);
+
+    /* the PCR is still extended when the event can't be logged */
+    test_digest[1] = 0xEE;
+    ck_assert_int_eq(wolfBoot_tpm2_measure(TEST_PCR, WOLFBOOT_EV_POST_CODE,
+        test_digest, "wolfBoot"), 0);
+    ck_assert_int_eq(extend_calls, WOLFBOOT_MEASURED_LOG_ENTRIES + 1);
+    ck_assert_int_eq(last_extend_pcr, TEST_PCR);
+    ck_assert_mem_eq(last_extend_digest, test_digest, WOLFBOOT_TPM_PCR_DIG_SZ);
+
+    ck_assert_int_eq(wolfBoot_tpm2_get_event_log(&log, &count), 1);
+    ck_assert_uint_eq(count, WOLFBOOT_MEASURED_LOG_ENTRIES);
+    for (i = 0; i < WOLFBOOT_MEASURED_LOG_ENTRIES; i++) {
+        ck_assert_uint_eq(log[i].digest[1], i);
+        ck_assert_uint_eq(log[i].eventSize, WOLFBOOT_MEASURED_EVENT_SZ);
+    }
+    ck_assert_int_ne(wolfBoot_tpm2_get_event_log(NULL, &count), 0);
+    ck_assert_int_ne(wolfBoot_tpm2_get_event_log(&log, NULL), 0);
+}
+END_TEST
+
+START_TEST(test_init_poll_steps)
+{
+    int polls = 0;
+    int rc;
+
+    ck_assert_int_eq(wolfBoot_tpm2_init_poll(), -1);
+    wolfBoot_tpm2_init_start();
+    wolfBoot_tpm2_init_start();
+    ck_assert_int_eq(spi_init_calls, 1);
+    ck_assert_int_eq(tpm_init_calls, 0);
+
+    do {
+        rc = wolfBoot_tpm2_init_poll();
+        polls++;
+    } while (rc == 1);
+    ck_assert_int_eq(rc, 0);
+    /* one wolfTPM call per poll */
+    ck_assert_int_gt(polls, 1);
+    ck_assert_int_eq(tpm_init_calls, 1);
+    ck_assert_int_eq(caps_calls, 1);
+
+    /* once done, the result is kept */
+    ck_assert_int_eq(wolfBoot_tpm2_init_poll(), 0);
+    ck_assert_int_eq(wolfBoot_tpm2_init_wait(), 0);
+    ck_assert_int_eq(tpm_init_calls, 1);
+}
+END_TEST
+
+START_TEST(test_init_failure)
+{
+    tpm_init_rc = -5;
+    wolfBoot_tpm2_init_start();
+    ck_assert_int_eq(wolfBoot_tpm2_init_poll(), -5);
+    ck_assert_int_eq(caps_calls, 0);
+    ck_assert_int_eq(wolfBoot_tpm2_init_wait(), -5);
+
+    /* the TPM is not used after a failed bring-up */
+    ck_assert_int_eq(wolfBoot_tpm2_measure(TEST_PCR, WOLFBOOT_EV_POST_CODE,
+        test_digest, "wolfBoot"), -5);
+    ck_assert_int_eq(extend_calls, 0);
+}
+END_TEST
+
+START_TEST(test_init_wait_before_extend)
+{
+    wolfBoot_tpm2_init_start();
+    ck_assert_int_eq(wolfBoot_tpm2_init_poll(), 1);
+    ck_assert_int_eq(caps_calls, 0);
+
+    ck_assert_int_eq(wolfBoot_tpm2_measure(TEST_PCR, WOLFBOOT_EV_POST_CODE,
+        test_digest, "wolfBoot"), 0);
+    ck_assert_int_eq(caps_calls, 1);
+    ck_assert_int_eq(extend_calls, 1);
+    ck_assert_int_eq(wolfBoot_tpm2_init_poll(), 0);
+}
+END_TEST
+
+START_TEST(test_init_not_started)
+{
+    ck_assert_int_eq(wolfBoot_tpm2_init_wait(), -1);
+    ck_assert_int_ne(wolfBoot_tpm2_measure(TEST_PCR, WOLFBOOT_EV_POST_CODE,
+        test_digest, "wolfBoot"), 0);
+    ck_assert_int_eq(extend_calls, 0);
+}
+END_TEST
+
+static Suite *tpm_measure_suite(void)
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("TPM Measure");
+    tc = tcase_create("wolfBoot_tpm2_init");
+    tcase_add_checked_fixture(tc, setup, NULL);
+    tcase_add_test(tc, test_init_poll_steps);
+    tcase_add_test(tc, test_init_failure);
+    tcase_add_test(tc, test_init_wait_before_extend);
+    tcase_add_test(tc, test_init_not_started);
+    suite_add_tcase(s, tc);
+
+    tc = tcase_create("wolfBoot_tpm2_measure");
+    tcase_add_checked_fixture(tc, setup_measure, NULL);
+    tcase_add_test(tc, test_measure_image_uses_verified_digest);
+    tcase_add_test(tc, test_measure_image_rejects_unverified);
+    tcase_add_test(tc, test_measure_extend_failure_not_logged);
+    tcase_add_test(tc, test_measure_log_full);
+    suite_add_tcase(s, tc);
+    return s;
+}
+
+int main(void)
+{
+    Suite *s;
+    SRunner *sr;
+    int failed;
+
+    s = tpm_measure_suite();
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+/* unit-uart-flash.c
+ *
+ * Unit test for the UART flash driver (src/uart_flash.c), talking to the
+ * uart-flash-server (ufserver) through a pseudo-terminal.
+ * Also reports the throughput of protocols v1 and v2.
+ *
+ *
+ * Copyright (C) 2025 wolfSSL Inc.
+ *
+ * This file is part of wolfBoot.
+ *
+ * wolfBoot is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfBoot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335, USA
+ */
+
+#define _GNU_SOURCE
+#define UART_FLASH
+
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "target.h"
+#include "uart_flash.c"
+
+#define UFSERVER "../uart-flash-server/ufserver"
+#define UFSERVER_IMAGE "/tmp/wolfboot-unit-ufserver.bin"
+#define TEST_ADDRESS 0x1000
+#define TEST_SIZE_V1 (4 * 1024)
+#define TEST_SIZE_V2 (32 * 1024)
+
+static int uart_fd = -1;
+static pid_t server_pid = -1;
+static uint32_t tx_count;
+static uint32_t tx_corrupt_every;
+static uint8_t wbuf[TEST_SIZE_V2];
+static uint8_t rbuf[TEST_SIZE_V2];
+
+uint32_t wolfBoot_get_image_version(uint8_t part)
+{
+    (void)part;
+    return 1;
+}
+
+/* Mock UART driver, on the master side of the pty */
+int uart_tx(const uint8_t c)
+{
+    uint8_t b = c;
+    tx_count++;
+    if ((tx_corrupt_every != 0) && ((tx_count % tx_corrupt_every) == 0))
+        b ^= 0x20;
+    while (write(uart_fd, &b, 1) != 1)
+        ;
+    return 1;
+}
+
+int uart_rx(uint8_t *c)
+{
+    return (read(uart_fd, c, 1) == 1) ? 1 : 0;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void start_server(void)
+{
+    struct termios options;
+    char *slave;
+    int slave_fd, img_fd, null_fd;
+
+    img_fd = open(UFSERVER_IMAGE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ck_assert(img_fd >= 0);
+    ck_assert_int_eq(write(img_fd, "TEST", 4), 4);
+    close(img_fd);
+
+    uart_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    ck_assert(uart_fd >= 0);
+    ck_assert_int_eq(grantpt(uart_fd), 0);
+    ck_assert_int_eq(unlockpt(uart_fd), 0);
+    slave = ptsname(uart_fd);
+    ck_assert(slave != NULL);
+    /* Keep the slave open in raw mode, until the server configures it */
+    slave_fd = open(slave, O_RDWR | O_NOCTTY);
+    ck_assert(slave_fd >= 0);
+    tcgetattr(slave_fd, &options);
+    cfmakeraw(&options);
+    tcsetattr(slave_fd, TCSANOW, &options);
+    fcntl(uart_fd, F_SETFL, O_NONBLOCK);
+
+    server_pid = fork();
+    ck_assert(server_pid >= 0);
+    if (server_pid == 0) {
+        null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        execl(UFSERVER, "ufserver", UFSERVER_IMAGE, slave, (char *)NULL);
+        exit(127);
+    }
+    close(slave_fd);
+    usleep(300000);
+    uart_proto = 0;
+    tx_count = 0;
+    tx_corrupt_every = 0;
+}
+
+static void stop_server(void)
+{
+    kill(server_pid, SIGTERM);
+    waitpid(server_pid, NULL, 0);
+    close(uart_fd);
+    unlink(UFSERVER_IMAGE);
+}
+
+/* Write, read back and erase 'len' bytes, return the transfer time */
+static double transfer(uint32_t len)
+{
+    double t0, t;
+    uint32_t i;
+
+    for (i = 0; i < len; i++)
+        wbuf[i] = (uint8_t)(i * 13 + (i >> 8));
+    t0 = now();
+    ck_assert_int_eq(ext_flash_write(TEST_ADDRESS, wbuf, len), len);
+    memset(rbuf, 0, len);
+    ck_assert_int_eq(ext_flash_read(TEST_ADDRESS, rbuf, len), len);
+    t = now() - t0;
+    ck_assert_mem_eq(rbuf, wbuf, len);
+    ck_assert_int_eq(ext_flash_erase(TEST_ADDRESS, WOLFBOOT_SECTOR_SIZE), 0);
+    ck_assert_int_eq(ext_flash_read(TEST_ADDRESS, rbuf, 16), 16);
+    for (i = 0; i < 16; i++)
+        ck_assert_uint_eq(rbuf[i], 0xFF);
+    return t;
+}
+
+START_TEST(test_uart_flash_v1_v2)
+{
+    double t1, t2;
+
+    start_server();
+    /* Protocol negotiation */
+    ck_assert_int_eq(ext_flash_read(TEST_ADDRESS, rbuf, 4), 4);
+    ck_assert_int_eq(uart_proto, UART_FLASH_PROTO_V2);
+    t2 = transfer(TEST_SIZE_V2);
+
+    /* Same transfers with protocol v1 */
+    uart_proto = UART_FLASH_PROTO_V1;
+    t1 = transfer(TEST_SIZE_V1);
+    stop_server();
+
+    printf("UART flash write+read: v1 %.1f KB/s, v2 %.1f KB/s\n",
+        2 * TEST_SIZE_V1 / t1 / 1024.0, 2 * TEST_SIZE_V2 / t2 / 1024.0);
+}
+END_TEST
+
+START_TEST(test_uart_flash_v2_corruption)
+{
+    start_server();
+    ck_assert_int_eq(ext_flash_read(TEST_ADDRESS, rbuf, 4), 4);
+    ck_assert_int_eq(uart_proto, UART_FLASH_PROTO_V2);
+    /* Corrupt one of every 1000 bytes sent to the server */
+    tx_corrupt_every = 1000;
+    transfer(TEST_SIZE_V2);
+    stop_server();
+}
+END_TEST
+
+Suite *wolfboot_suite(void)
+{
+    Suite *s = suite_create("wolfBoot");
+    TCase *uart_flash = tcase_create("UART flash protocol");
+
+    tcase_add_test(uart_flash, test_uart_flash_v1_v2);
+    tcase_add_test(uart_flash, test_uart_flash_v2_corruption);
+    tcase_set_timeout(uart_flash, 60);
+    suite_add_tcase(s, uart_flash);
+    return s;
+}
+
+int main(void)
+{
+    int fails;
+    Suite *s = wolfboot_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    fails = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return fails;
+}
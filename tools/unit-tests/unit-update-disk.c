@@ -1,5 +1,10 @@
 #define WOLFBOOT_UPDATE_DISK
+#ifdef UNIT_UPDATE_DISK_VERIFY
+/* Streaming load: several chunks per image */
+#define DISK_BLOCK_SIZE 64
+#else
 #define WOLFBOOT_SKIP_BOOT_VERIFY
+#endif
 #define EXT_ENCRYPTED
 #define ENCRYPT_WITH_CHACHA
 #define HAVE_CHACHA
@@ -17,8 +22,15 @@
 #include "image.h"
 #include "loader.h"
 #include <wolfssl/wolfcrypt/chacha.h>
+#ifdef UNIT_UPDATE_DISK_LZ4
+#include "lz4.c"
+#endif
 
+#ifdef UNIT_UPDATE_DISK_VERIFY
+#define TEST_PAYLOAD_SIZE 256
+#else
 #define TEST_PAYLOAD_SIZE 64
+#endif
 
 static uint8_t load_buffer[TEST_PAYLOAD_SIZE];
 #define WOLFBOOT_LOAD_ADDRESS ((uintptr_t)load_buffer)
@@ -29,6 +41,17 @@ static int mock_disk_init_ret;
 static int mock_disk_close_called;
 static int mock_do_boot_called;
 static const uint32_t *mock_boot_address;
+#ifdef UNIT_UPDATE_DISK_VERIFY
+static const uint8_t *mock_decrypted_ptr;
+static uint32_t mock_decrypted_len;
+static uint32_t mock_hashed_len;
+static uint32_t mock_hash_chunks;
+static int mock_hash_fused;
+static int mock_integrity_fail_part_b;
+#endif
+#ifdef UNIT_UPDATE_DISK_LZ4
+static uint32_t compressed_size;
+#endif
 
 ChaCha chacha;
 
@@ -46,15 +69,47 @@ static void set_u32_le(uint8_t *dst, uint32_t value)
     dst[3] = (uint8_t)(value >> 24);
 }
 
+#ifdef UNIT_UPDATE_DISK_LZ4
+/* First half does not compress, second half repeats it */
+static void build_raw_payload(uint8_t *raw, uint8_t fill)
+{
+    uint32_t i;
+
+    for (i = 0; i < TEST_PAYLOAD_SIZE; i++) {
+        if (i < TEST_PAYLOAD_SIZE / 2)
+            raw[i] = (uint8_t)(fill ^ (i * 37));
+        else
+            raw[i] = raw[i - TEST_PAYLOAD_SIZE / 2];
+    }
+}
+#endif
+
 static void build_image(uint8_t *image, uint32_t version, uint8_t fill)
 {
+    uint32_t fw_size = TEST_PAYLOAD_SIZE;
+#ifdef UNIT_UPDATE_DISK_LZ4
+    uint8_t raw[TEST_PAYLOAD_SIZE];
+    uint8_t frame[TEST_PAYLOAD_SIZE + 64];
+    int len;
+#endif
+
     memset(image, 0, IMAGE_HEADER_SIZE + TEST_PAYLOAD_SIZE);
+#ifdef UNIT_UPDATE_DISK_LZ4
+    build_raw_payload(raw, fill);
+    len = lz4_compress(raw, sizeof(raw), frame, sizeof(frame));
+    ck_assert_int_gt(len, DISK_BLOCK_SIZE);
+    ck_assert_int_lt(len, TEST_PAYLOAD_SIZE);
+    memcpy(image + IMAGE_HEADER_SIZE, frame, len);
+    fw_size = (uint32_t)len;
+    compressed_size = fw_size;
+#else
+    memset(image + IMAGE_HEADER_SIZE, fill, TEST_PAYLOAD_SIZE);
+#endif
     set_u32_le(image, WOLFBOOT_MAGIC);
-    set_u32_le(image + sizeof(uint32_t), TEST_PAYLOAD_SIZE);
+    set_u32_le(image + sizeof(uint32_t), fw_size);
     set_u16_le(image + IMAGE_HEADER_OFFSET, HDR_VERSION);
     set_u16_le(image + IMAGE_HEADER_OFFSET + sizeof(uint16_t), 4);
     set_u32_le(image + IMAGE_HEADER_OFFSET + 2 * sizeof(uint16_t), version);
-    memset(image + IMAGE_HEADER_SIZE, fill, TEST_PAYLOAD_SIZE);
 }
 
 static void reset_mocks(void)
@@ -69,6 +124,14 @@ static void reset_mocks(void)
     mock_do_boot_called = 0;
     mock_boot_address = NULL;
     wolfBoot_panicked = 0;
+#ifdef UNIT_UPDATE_DISK_VERIFY
+    mock_decrypted_ptr = NULL;
+    mock_decrypted_len = 0;
+    mock_hashed_len = 0;
+    mock_hash_chunks = 0;
+    mock_hash_fused = 1;
+    mock_integrity_fail_part_b = 0;
+#endif
 }
 
 int chacha_init(void)
@@ -88,6 +151,10 @@ int wc_Chacha_Process(ChaCha* ctx, byte* output, const byte* input, word32 msgle
 {
     (void)ctx;
     memmove(output, input, msglen);
+#ifdef UNIT_UPDATE_DISK_VERIFY
+    mock_decrypted_ptr = output;
+    mock_decrypted_len = msglen;
+#endif
     return 0;
 }
 
@@ -166,6 +233,47 @@ int wolfBoot_verify_integrity(struct wolfBoot_image* img)
     return 0;
 }
 
+#ifdef UNIT_UPDATE_DISK_VERIFY
+int wolfBoot_hash_stream_init(struct wolfBoot_image *img)
+{
+    (void)img;
+    mock_hashed_len = 0;
+    mock_hash_chunks = 0;
+    return 0;
+}
+
+void wolfBoot_hash_stream_update(const uint8_t *data, uint32_t len)
+{
+    /* Each chunk must be hashed right after being decrypted */
+    if ((data != mock_decrypted_ptr) || (len != mock_decrypted_len))
+        mock_hash_fused = 0;
+    mock_hashed_len += len;
+    mock_hash_chunks++;
+}
+
+int wolfBoot_verify_integrity_stream(struct wolfBoot_image *img)
+{
+    uint32_t version;
+
+    if (mock_hashed_len != img->fw_size)
+        return -1;
+    memcpy(&version, img->hdr + IMAGE_HEADER_OFFSET + 2 * sizeof(uint16_t),
+        sizeof(version));
+    if (mock_integrity_fail_part_b && (version == 2))
+        return -1;
+    return 0;
+}
+#endif
+
+#ifdef UNIT_UPDATE_DISK_LZ4
+int wolfBoot_image_compressed(struct wolfBoot_image *img, uint32_t *raw_size)
+{
+    (void)img;
+    *raw_size = TEST_PAYLOAD_SIZE;
+    return 1;
+}
+#endif
+
 int wolfBoot_verify_authenticity(struct wolfBoot_image* img)
 {
     (void)img;
@@ -259,6 +367,91 @@ START_TEST(test_get_decrypted_blob_version_rejects_truncated_version_tlv)
 }
 END_TEST
 
+#ifdef UNIT_UPDATE_DISK_VERIFY
+START_TEST(test_update_disk_streaming_load_hash)
+{
+    uint32_t i;
+
+    reset_mocks();
+
+    wolfBoot_start();
+
+    ck_assert_int_eq(wolfBoot_panicked, 0);
+    ck_assert_int_eq(mock_do_boot_called, 1);
+    ck_assert_int_eq(mock_hash_fused, 1);
+    ck_assert_uint_eq(mock_hashed_len, TEST_PAYLOAD_SIZE);
+    ck_assert_uint_eq(mock_hash_chunks, TEST_PAYLOAD_SIZE / DISK_BLOCK_SIZE);
+    for (i = 0; i < TEST_PAYLOAD_SIZE; i++)
+        ck_assert_uint_eq(load_buffer[i], 0xB2);
+}
+END_TEST
+
+START_TEST(test_update_disk_streaming_integrity_fallback)
+{
+    uint32_t i;
+
+    reset_mocks();
+    mock_integrity_fail_part_b = 1;
+
+    wolfBoot_start();
+
+    ck_assert_int_eq(wolfBoot_panicked, 0);
+    ck_assert_int_eq(mock_do_boot_called, 1);
+    ck_assert_int_eq(mock_hash_fused, 1);
+#ifdef UNIT_UPDATE_DISK_LZ4
+    {
+        uint8_t raw[TEST_PAYLOAD_SIZE];
+        build_raw_payload(raw, 0xA1);
+        ck_assert_mem_eq(load_buffer, raw, TEST_PAYLOAD_SIZE);
+    }
+#else
+    for (i = 0; i < TEST_PAYLOAD_SIZE; i++)
+        ck_assert_uint_eq(load_buffer[i], 0xA1);
+#endif
+    (void)i;
+}
+END_TEST
+#endif
+
+#ifdef UNIT_UPDATE_DISK_LZ4
+START_TEST(test_update_disk_lz4_inflate)
+{
+    uint8_t raw[TEST_PAYLOAD_SIZE];
+
+    reset_mocks();
+
+    wolfBoot_start();
+
+    ck_assert_int_eq(wolfBoot_panicked, 0);
+    ck_assert_int_eq(mock_do_boot_called, 1);
+    /* the compressed stream is hashed, as it is read */
+    ck_assert_int_eq(mock_hash_fused, 1);
+    ck_assert_uint_eq(mock_hashed_len, compressed_size);
+    ck_assert_uint_eq(mock_hash_chunks,
+        (compressed_size + DISK_BLOCK_SIZE - 1) / DISK_BLOCK_SIZE);
+    build_raw_payload(raw, 0xB2);
+    ck_assert_mem_eq(load_buffer, raw, TEST_PAYLOAD_SIZE);
+}
+END_TEST
+
+START_TEST(test_update_disk_lz4_corrupt_fallback)
+{
+    uint8_t raw[TEST_PAYLOAD_SIZE];
+
+    reset_mocks();
+    /* the end mark of the frame in part B is lost */
+    memset(part_b_image + IMAGE_HEADER_SIZE + compressed_size - 4, 0xFF, 4);
+
+    wolfBoot_start();
+
+    ck_assert_int_eq(wolfBoot_panicked, 0);
+    ck_assert_int_eq(mock_do_boot_called, 1);
+    build_raw_payload(raw, 0xA1);
+    ck_assert_mem_eq(load_buffer, raw, TEST_PAYLOAD_SIZE);
+}
+END_TEST
+#endif
+
 Suite *wolfboot_suite(void)
 {
     Suite *s = suite_create("wolfBoot");
@@ -267,6 +460,16 @@ Suite *wolfboot_suite(void)
     tcase_add_test(tc, test_update_disk_zeroizes_key_material_on_panic);
     tcase_add_test(tc, test_update_disk_zeroizes_key_material_before_boot);
     tcase_add_test(tc, test_get_decrypted_blob_version_rejects_truncated_version_tlv);
+#if defined(UNIT_UPDATE_DISK_VERIFY) && !defined(UNIT_UPDATE_DISK_LZ4)
+    tcase_add_test(tc, test_update_disk_streaming_load_hash);
+#endif
+#ifdef UNIT_UPDATE_DISK_VERIFY
+    tcase_add_test(tc, test_update_disk_streaming_integrity_fallback);
+#endif
+#ifdef UNIT_UPDATE_DISK_LZ4
+    tcase_add_test(tc, test_update_disk_lz4_inflate);
+    tcase_add_test(tc, test_update_disk_lz4_corrupt_fallback);
+#endif
     suite_add_tcase(s, tc);
 
     return s;
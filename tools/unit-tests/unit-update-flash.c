@@ -147,7 +147,13 @@ static void cleanup_flash(void)
 
 
 #define DIGEST_TLV_OFF_IN_HDR 28
-static int add_payload(uint8_t part, uint32_t version, uint32_t size)
+/* Image type written (and hashed) by add_payload_ex() */
+static uint16_t payload_img_type = HDR_IMG_TYPE_AUTH_NONE | HDR_IMG_TYPE_APP;
+
+/* Payload generated from 'seed'; if 'patch_off' is not 0, the word at that
+ * offset in the partition is modified */
+static int add_payload_ex(uint8_t part, uint32_t version, uint32_t size,
+    unsigned int seed, uint32_t patch_off)
 {
     uint32_t word;
     uint16_t word16;
@@ -164,7 +170,7 @@ static int add_payload(uint8_t part, uint32_t version, uint32_t size)
 
     if (part == PART_UPDATE)
         base = (uint8_t *)(uintptr_t)WOLFBOOT_PARTITION_UPDATE_ADDRESS;
-    srandom(part); /* Ensure reproducible "random" image */
+    srandom(seed); /* Ensure reproducible "random" image */
 
 
     hal_flash_unlock();
@@ -182,7 +188,7 @@ static int add_payload(uint8_t part, uint32_t version, uint32_t size)
 
     word = 2 << 16 | HDR_IMG_TYPE;
     hal_flash_write((uintptr_t)base + 16, (void *)&word, 4);
-    word16 = HDR_IMG_TYPE_AUTH_NONE | HDR_IMG_TYPE_APP;
+    word16 = payload_img_type;
     hal_flash_write((uintptr_t)base + 20, (void *)&word16, 2);
     printf("Written img_type: %04X\n", word16);
 
@@ -197,6 +203,10 @@ static int add_payload(uint8_t part, uint32_t version, uint32_t size)
         uint32_t word = (random() << 16) | random();
         hal_flash_write((uintptr_t)base + i, (void *)&word, 4);
     }
+    if (patch_off != 0) {
+        word = ~(*(uint32_t *)(base + patch_off));
+        hal_flash_write((uintptr_t)base + patch_off, (void *)&word, 4);
+    }
     for (i = IMAGE_HEADER_SIZE; i < size; i+= WOLFBOOT_SHA_BLOCK_SIZE) {
         int len = WOLFBOOT_SHA_BLOCK_SIZE;
         if ((size - i) < len)
@@ -225,6 +235,11 @@ static int add_payload(uint8_t part, uint32_t version, uint32_t size)
 
 }
 
+static int add_payload(uint8_t part, uint32_t version, uint32_t size)
+{
+    return add_payload_ex(part, version, size, part, 0);
+}
+
 #ifdef EXT_ENCRYPTED
 static int build_image_buffer(uint8_t part, uint32_t version, uint32_t size,
     uint8_t *buf, uint32_t buf_sz)
@@ -495,6 +510,26 @@ START_TEST (test_invalid_update_type) {
     cleanup_flash();
 }
 
+START_TEST (test_compressed_update_denied) {
+    struct wolfBoot_image img;
+    reset_mock_stats();
+    prepare_flash();
+    add_payload(PART_BOOT, 1, TEST_SIZE_SMALL);
+    /* Valid digest, but this loader has no way to inflate the payload */
+    payload_img_type = HDR_IMG_TYPE_AUTH_NONE | HDR_IMG_TYPE_LZ4 |
+        HDR_IMG_TYPE_APP;
+    add_payload(PART_UPDATE, 2, TEST_SIZE_SMALL);
+    payload_img_type = HDR_IMG_TYPE_AUTH_NONE | HDR_IMG_TYPE_APP;
+    ck_assert_int_eq(wolfBoot_open_image(&img, PART_UPDATE), 0);
+    ck_assert_int_eq(wolfBoot_verify_integrity(&img), -1);
+    wolfBoot_update_trigger();
+    wolfBoot_start();
+    ck_assert(!wolfBoot_panicked);
+    ck_assert(wolfBoot_staged_ok);
+    ck_assert(wolfBoot_current_firmware_version() == 1);
+    cleanup_flash();
+}
+
 START_TEST (test_update_toolarge) {
     uint32_t very_large = WOLFBOOT_PARTITION_SIZE;
     reset_mock_stats();
@@ -660,6 +695,499 @@ START_TEST (test_diffbase_version_reads)
 }
 END_TEST
 
+#if defined(WOLFBOOT_UPDATE_DISK) || defined(WOLFBOOT_LZ4)
+static uint8_t stream_fw[TEST_SIZE_LARGE];
+
+/* Pass the firmware to the streaming check in chunks of the sizes given,
+ * which do not follow WOLFBOOT_SHA_BLOCK_SIZE */
+static int verify_stream(struct wolfBoot_image *img, const uint32_t *chunks,
+    int n_chunks)
+{
+    uint32_t off = 0, len;
+    int i = 0;
+
+    if (wolfBoot_hash_stream_init(img) != 0)
+        return -1;
+    while (off < img->fw_size) {
+        len = chunks[i++ % n_chunks];
+        if (len > img->fw_size - off)
+            len = img->fw_size - off;
+        wolfBoot_hash_stream_update(stream_fw + off, len);
+        off += len;
+    }
+    return wolfBoot_verify_integrity_stream(img);
+}
+
+START_TEST (test_verify_integrity_stream) {
+    static const uint32_t odd[] = { 1, 63, 100, 257, 3, 1021, 65, 129 };
+    static const uint32_t whole[] = { TEST_SIZE_LARGE };
+    struct wolfBoot_image img, img_stream;
+    uint8_t part;
+    uint32_t pos;
+
+    reset_mock_stats();
+    prepare_flash();
+    add_payload(PART_BOOT, 1, TEST_SIZE_LARGE);
+    add_payload(PART_UPDATE, 2, TEST_SIZE_SMALL);
+
+    for (part = PART_BOOT; part <= PART_UPDATE; part++) {
+        ck_assert_int_eq(wolfBoot_open_image(&img, part), 0);
+        ck_assert_int_eq(wolfBoot_verify_integrity(&img), 0);
+        if (PARTN_IS_EXT(part))
+            ext_flash_read((uintptr_t)img.fw_base, stream_fw, img.fw_size);
+        else
+            memcpy(stream_fw, img.fw_base, img.fw_size);
+
+        /* same result and digest as wolfBoot_verify_integrity() */
+        ck_assert_int_eq(wolfBoot_open_image(&img_stream, part), 0);
+        ck_assert_int_eq(verify_stream(&img_stream, odd,
+            sizeof(odd) / sizeof(odd[0])), 0);
+        ck_assert(img_stream.sha_ok);
+        ck_assert_mem_eq(img_stream.sha_hash, img.sha_hash,
+            SHA256_DIGEST_SIZE);
+        ck_assert_int_eq(wolfBoot_open_image(&img_stream, part), 0);
+        ck_assert_int_eq(verify_stream(&img_stream, whole, 1), 0);
+
+        /* one bit changed anywhere is detected, across chunk boundaries */
+        for (pos = 0; pos < img.fw_size; pos += 997) {
+            stream_fw[pos] ^= 0x01;
+            ck_assert_int_eq(wolfBoot_open_image(&img_stream, part), 0);
+            ck_assert_int_eq(verify_stream(&img_stream, odd,
+                sizeof(odd) / sizeof(odd[0])), -1);
+            ck_assert(!img_stream.sha_ok);
+            stream_fw[pos] ^= 0x01;
+        }
+    }
+    cleanup_flash();
+}
+END_TEST
+#endif
+
+#ifdef WOLFBOOT_VERIFY_TICKET
+static uint8_t mock_ticket[128];
+static uint32_t mock_ticket_len = 0;
+static uint32_t mock_counter = 0;
+static int mock_uds_fail = 0;
+
+static void reset_mock_ticket(void)
+{
+    memset(mock_ticket, 0, sizeof(mock_ticket));
+    mock_ticket_len = 0;
+    mock_counter = 0;
+    mock_uds_fail = 0;
+}
+
+int hal_uds_derive_key(uint8_t *out, size_t out_len)
+{
+    if (mock_uds_fail)
+        return -1;
+    memset(out, 0x5A, out_len);
+    return 0;
+}
+
+int hal_verify_ticket_read(uint8_t *buf, uint32_t len)
+{
+    if (mock_ticket_len != len)
+        return -1;
+    memcpy(buf, mock_ticket, len);
+    return 0;
+}
+
+int hal_verify_ticket_write(const uint8_t *buf, uint32_t len)
+{
+    if (len > sizeof(mock_ticket))
+        return -1;
+    memcpy(mock_ticket, buf, len);
+    mock_ticket_len = len;
+    return 0;
+}
+
+int hal_monotonic_counter_read(uint32_t *value)
+{
+    *value = mock_counter;
+    return 0;
+}
+
+int hal_monotonic_counter_increment(uint32_t *value)
+{
+    *value = ++mock_counter;
+    return 0;
+}
+
+START_TEST (test_verify_ticket)
+{
+    struct wolfBoot_image boot;
+
+    reset_mock_stats();
+    reset_mock_ticket();
+    prepare_flash();
+    add_payload(PART_BOOT, 1, TEST_SIZE_SMALL);
+
+    /* First boot: full verification, ticket issued */
+    wolfBoot_start();
+    ck_assert(!wolfBoot_panicked);
+    ck_assert(wolfBoot_staged_ok == 1);
+    ck_assert_uint_eq(mock_counter, 1);
+    ck_assert(mock_ticket_len > 0);
+
+    /* Second boot: ticket accepted, no new ticket issued */
+    wolfBoot_start();
+    ck_assert(!wolfBoot_panicked);
+    ck_assert(wolfBoot_staged_ok == 2);
+    ck_assert_uint_eq(mock_counter, 1);
+    ck_assert_int_eq(wolfBoot_open_image(&boot, PART_BOOT), 0);
+    ck_assert_int_eq(wolfBoot_check_verify_ticket(&boot), 0);
+    ck_assert(boot.sha_ok == 1);
+    ck_assert(boot.signature_ok == 1);
+
+    /* Tampered ticket: rejected, full verification issues a new one */
+    mock_ticket[mock_ticket_len - 1] ^= 0x01;
+    ck_assert_int_eq(wolfBoot_open_image(&boot, PART_BOOT), 0);
+    ck_assert_int_eq(wolfBoot_check_verify_ticket(&boot), -1);
+    wolfBoot_start();
+    ck_assert(!wolfBoot_panicked);
+    ck_assert(wolfBoot_staged_ok == 3);
+    ck_assert_uint_eq(mock_counter, 2);
+
+    /* Stale counter: rejected */
+    mock_counter++;
+    ck_assert_int_eq(wolfBoot_open_image(&boot, PART_BOOT), 0);
+    ck_assert_int_eq(wolfBoot_check_verify_ticket(&boot), -1);
+    wolfBoot_start();
+    ck_assert_uint_eq(mock_counter, 4);
+    ck_assert_int_eq(wolfBoot_open_image(&boot, PART_BOOT), 0);
+    ck_assert_int_eq(wolfBoot_check_verify_ticket(&boot), 0);
+
+    /* No device secret: tickets are never accepted */
+    mock_uds_fail = 1;
+    ck_assert_int_eq(wolfBoot_open_image(&boot, PART_BOOT), 0);
+    ck_assert_int_eq(wolfBoot_check_verify_ticket(&boot), -1);
+    wolfBoot_start();
+    ck_assert(!wolfBoot_panicked);
+    ck_assert(wolfBoot_staged_ok == 5);
+    cleanup_flash();
+}
+END_TEST
+
+START_TEST (test_verify_ticket_other_image)
+{
+    struct wolfBoot_image boot;
+
+    reset_mock_stats();
+    reset_mock_ticket();
+    prepare_flash();
+    add_payload(PART_BOOT, 1, TEST_SIZE_SMALL);
+    wolfBoot_start();
+    ck_assert_uint_eq(mock_counter, 1);
+
+    /* Same counter, different image: the ticket must not be accepted */
+    cleanup_flash();
+    prepare_flash();
+    add_payload(PART_BOOT, 2, TEST_SIZE_SMALL);
+    ck_assert_int_eq(wolfBoot_open_image(&boot, PART_BOOT), 0);
+    ck_assert_int_eq(wolfBoot_check_verify_ticket(&boot), -1);
+    wolfBoot_start();
+    ck_assert(!wolfBoot_panicked);
+    ck_assert_uint_eq(mock_counter, 2);
+    ck_assert(wolfBoot_current_firmware_version() == 2);
+    cleanup_flash();
+}
+END_TEST
+#endif /* WOLFBOOT_VERIFY_TICKET */
+
+
+#ifdef WOLFBOOT_MERKLE
+#define MERKLE_TLV_OFF_IN_HDR 24
+#define MERKLE_DIGEST_TLV_OFF_IN_HDR 72
+/* Same layout as add_payload(), with the table of sector hashes appended to
+ * the payload and the HDR_MERKLE_ROOT TLV in the header, as 'sign --merkle'
+ * does. The header digest does not cover the payload. */
+static int add_payload_merkle(uint8_t part, uint32_t version, uint32_t size)
+{
+    uint32_t word;
+    uint16_t word16;
+    uint32_t i, n_leaves, fw_size;
+    uint8_t *base = (uint8_t *)(uintptr_t)WOLFBOOT_PARTITION_BOOT_ADDRESS;
+    uint8_t *table;
+    uint8_t root[SHA256_DIGEST_SIZE];
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    wc_Sha256 sha;
+
+    if (part == PART_UPDATE)
+        base = (uint8_t *)(uintptr_t)WOLFBOOT_PARTITION_UPDATE_ADDRESS;
+    srandom(part);
+    n_leaves = (IMAGE_HEADER_SIZE + size + WOLFBOOT_SECTOR_SIZE - 1) /
+        WOLFBOOT_SECTOR_SIZE;
+    fw_size = size + n_leaves * SHA256_DIGEST_SIZE;
+
+    hal_flash_unlock();
+    hal_flash_write((uintptr_t)base, "WOLF", 4);
+    hal_flash_write((uintptr_t)base + 4, (void *)&fw_size, 4);
+    word = 4 << 16 | HDR_VERSION;
+    hal_flash_write((uintptr_t)base + 8, (void *)&word, 4);
+    hal_flash_write((uintptr_t)base + 12, (void *)&version, 4);
+    word = 2 << 16 | HDR_IMG_TYPE;
+    hal_flash_write((uintptr_t)base + 16, (void *)&word, 4);
+    word16 = HDR_IMG_TYPE_AUTH_NONE | HDR_IMG_TYPE_APP;
+    hal_flash_write((uintptr_t)base + 20, (void *)&word16, 2);
+
+    /* Payload and leaf hashes */
+    for (i = IMAGE_HEADER_SIZE; i < IMAGE_HEADER_SIZE + size; i += 4) {
+        uint32_t word = (random() << 16) | random();
+        hal_flash_write((uintptr_t)base + i, (void *)&word, 4);
+    }
+    table = base + IMAGE_HEADER_SIZE + size;
+    for (i = 0; i < n_leaves; i++) {
+        uint32_t start = i * WOLFBOOT_SECTOR_SIZE;
+        uint32_t end = start + WOLFBOOT_SECTOR_SIZE;
+        if (start < IMAGE_HEADER_SIZE)
+            start = IMAGE_HEADER_SIZE;
+        if (end > IMAGE_HEADER_SIZE + size)
+            end = IMAGE_HEADER_SIZE + size;
+        wc_InitSha256(&sha);
+        wc_Sha256Update(&sha, base + start, end - start);
+        wc_Sha256Final(&sha, digest);
+        hal_flash_write((uintptr_t)table + i * SHA256_DIGEST_SIZE, digest,
+                SHA256_DIGEST_SIZE);
+    }
+    wc_InitSha256(&sha);
+    wc_Sha256Update(&sha, table, n_leaves * SHA256_DIGEST_SIZE);
+    wc_Sha256Final(&sha, root);
+
+    word = (8 + SHA256_DIGEST_SIZE) << 16 | HDR_MERKLE_ROOT;
+    hal_flash_write((uintptr_t)base + MERKLE_TLV_OFF_IN_HDR, (void *)&word, 4);
+    word = WOLFBOOT_SECTOR_SIZE;
+    hal_flash_write((uintptr_t)base + MERKLE_TLV_OFF_IN_HDR + 4,
+            (void *)&word, 4);
+    hal_flash_write((uintptr_t)base + MERKLE_TLV_OFF_IN_HDR + 8,
+            (void *)&size, 4);
+    hal_flash_write((uintptr_t)base + MERKLE_TLV_OFF_IN_HDR + 12, root,
+            SHA256_DIGEST_SIZE);
+
+    wc_InitSha256(&sha);
+    wc_Sha256Update(&sha, base, MERKLE_DIGEST_TLV_OFF_IN_HDR);
+    wc_Sha256Final(&sha, digest);
+    word = SHA256_DIGEST_SIZE << 16 | HDR_SHA256;
+    hal_flash_write((uintptr_t)base + MERKLE_DIGEST_TLV_OFF_IN_HDR,
+            (void *)&word, 4);
+    hal_flash_write((uintptr_t)base + MERKLE_DIGEST_TLV_OFF_IN_HDR + 4,
+            digest, SHA256_DIGEST_SIZE);
+    hal_flash_lock();
+    return 0;
+}
+
+START_TEST (test_merkle_update)
+{
+    struct wolfBoot_image boot;
+    struct wolfBoot_merkle m;
+
+    reset_mock_stats();
+    prepare_flash();
+    add_payload_merkle(PART_BOOT, 1, TEST_SIZE_SMALL);
+    add_payload_merkle(PART_UPDATE, 2, TEST_SIZE_LARGE);
+    wolfBoot_update_trigger();
+    wolfBoot_start();
+    ck_assert(!wolfBoot_panicked);
+    ck_assert(wolfBoot_staged_ok);
+    ck_assert(wolfBoot_current_firmware_version() == 2);
+
+    ck_assert_int_eq(wolfBoot_open_image(&boot, PART_BOOT), 0);
+    ck_assert_int_eq(wolfBoot_merkle_open(&boot, &m), 1);
+    ck_assert_uint_eq(m.leaf_size, WOLFBOOT_SECTOR_SIZE);
+    ck_assert_uint_eq(m.table_off, TEST_SIZE_LARGE);
+    ck_assert_uint_eq(m.n_leaves, 10);
+    ck_assert_int_eq(wolfBoot_verify_integrity(&boot), 0);
+
+    /* Swap check of the last sector: the leaf hash is read from the
+     * following sector in UPDATE, fill it with the new image */
+    hal_flash_unlock();
+    hal_flash_write(WOLFBOOT_PARTITION_UPDATE_ADDRESS,
+            (void *)WOLFBOOT_PARTITION_BOOT_ADDRESS, 11 * WOLFBOOT_SECTOR_SIZE);
+    hal_flash_lock();
+    ck_assert_int_eq(wolfBoot_merkle_check_sector(&m, 9, PART_BOOT), 0);
+
+    /* Same check on the copy in SWAP, before it is written to BOOT */
+    ext_flash_unlock();
+    ext_flash_erase(WOLFBOOT_PARTITION_SWAP_ADDRESS, WOLFBOOT_SECTOR_SIZE);
+    ext_flash_write(WOLFBOOT_PARTITION_SWAP_ADDRESS,
+            (void *)(WOLFBOOT_PARTITION_BOOT_ADDRESS + 9 * WOLFBOOT_SECTOR_SIZE),
+            WOLFBOOT_SECTOR_SIZE);
+    ext_flash_lock();
+    ck_assert_int_eq(wolfBoot_merkle_check_sector(&m, 9, PART_SWAP), 0);
+    ext_flash_unlock();
+    ext_flash_write(WOLFBOOT_PARTITION_SWAP_ADDRESS + 100,
+            (void *)"\x00\x00\x00\x00", 4);
+    ext_flash_lock();
+    ck_assert_int_eq(wolfBoot_merkle_check_sector(&m, 9, PART_SWAP), -1);
+    ck_assert_int_eq(wolfBoot_merkle_check_sector(&m, 9, PART_UPDATE), -1);
+
+    /* Corrupt the last sector of BOOT */
+    hal_flash_unlock();
+    hal_flash_write(WOLFBOOT_PARTITION_BOOT_ADDRESS + 9 * WOLFBOOT_SECTOR_SIZE,
+            (void *)"\x00\x00\x00\x00", 4);
+    hal_flash_lock();
+    ck_assert_int_eq(wolfBoot_merkle_check_sector(&m, 9, PART_BOOT), -1);
+    ck_assert_int_eq(wolfBoot_merkle_check_leaf(&boot, &m, 8), 0);
+    ck_assert_int_eq(wolfBoot_merkle_check_leaf(&boot, &m, 9), -1);
+    ck_assert_int_eq(wolfBoot_verify_integrity(&boot), -1);
+    cleanup_flash();
+}
+END_TEST
+
+START_TEST (test_merkle_corrupted_update)
+{
+    reset_mock_stats();
+    prepare_flash();
+    add_payload_merkle(PART_BOOT, 1, TEST_SIZE_SMALL);
+    add_payload_merkle(PART_UPDATE, 2, TEST_SIZE_SMALL);
+    ext_flash_unlock();
+    ext_flash_write(WOLFBOOT_PARTITION_UPDATE_ADDRESS +
+            3 * WOLFBOOT_SECTOR_SIZE + 10, (void *)"\x00\x00\x00\x00", 4);
+    ext_flash_lock();
+    wolfBoot_update_trigger();
+    wolfBoot_start();
+    ck_assert(!wolfBoot_panicked);
+    ck_assert(wolfBoot_staged_ok);
+    ck_assert(wolfBoot_current_firmware_version() == 1);
+    cleanup_flash();
+}
+END_TEST
+
+START_TEST (test_merkle_corrupted_swap)
+{
+    reset_mock_stats();
+    prepare_flash();
+    add_payload_merkle(PART_BOOT, 1, TEST_SIZE_SMALL);
+    add_payload_merkle(PART_UPDATE, 2, TEST_SIZE_SMALL);
+    wolfBoot_update_trigger();
+
+    /* Both copies of the first sector to SWAP are corrupted: the update
+     * stops before BOOT and UPDATE are modified, the current image boots */
+    ext_flash_swap_corrupt = 2;
+    wolfBoot_start();
+    ck_assert_int_eq(ext_flash_swap_corrupt, 0);
+    ck_assert(!wolfBoot_panicked);
+    ck_assert(wolfBoot_staged_ok);
+    ck_assert(wolfBoot_current_firmware_version() == 1);
+
+    /* The update starts over at the next boot */
+    wolfBoot_staged_ok = 0;
+    wolfBoot_start();
+    ck_assert(!wolfBoot_panicked);
+    ck_assert(wolfBoot_staged_ok);
+    ck_assert(wolfBoot_current_firmware_version() == 2);
+    cleanup_flash();
+}
+END_TEST
+
+START_TEST (test_merkle_corrupted_swap_resume)
+{
+    reset_mock_stats();
+    prepare_flash();
+    add_payload_merkle(PART_BOOT, 1, TEST_SIZE_SMALL);
+    add_payload_merkle(PART_UPDATE, 2, TEST_SIZE_SMALL);
+    wolfBoot_update_trigger();
+
+    /* Stopped in the middle of the swap: sector 2 is left untouched, and the
+     * emergency update resumes the swap from it */
+    ext_flash_swap_corrupt_skip = 2;
+    ext_flash_swap_corrupt = 2;
+    wolfBoot_start();
+    ck_assert_int_eq(ext_flash_swap_corrupt, 0);
+    ck_assert(!wolfBoot_panicked);
+    ck_assert(wolfBoot_staged_ok);
+    ck_assert(wolfBoot_current_firmware_version() == 2);
+    cleanup_flash();
+}
+END_TEST
+#endif /* WOLFBOOT_MERKLE */
+
+#ifdef WOLFBOOT_SKIP_SAME_SECTORS
+#define SKIP_TEST_SECTORS \
+    ((TEST_SIZE_LARGE + IMAGE_HEADER_SIZE + WOLFBOOT_SECTOR_SIZE - 1) / \
+     WOLFBOOT_SECTOR_SIZE)
+
+/* Update from v1 to a v2 that only differs in the header and in sector 3 */
+static void prepare_same_payloads(void)
+{
+    reset_mock_stats();
+    prepare_flash();
+    add_payload(PART_BOOT, 1, TEST_SIZE_LARGE);
+    add_payload_ex(PART_UPDATE, 2, TEST_SIZE_LARGE, PART_BOOT,
+        3 * WOLFBOOT_SECTOR_SIZE + 16);
+    wolfBoot_update_trigger();
+}
+
+static void check_same_sectors_update(void)
+{
+    struct wolfBoot_image img;
+
+    ck_assert(!wolfBoot_panicked);
+    ck_assert(wolfBoot_staged_ok);
+    ck_assert(wolfBoot_current_firmware_version() == 2);
+    ck_assert_int_eq(wolfBoot_open_image(&img, PART_BOOT), 0);
+    ck_assert_int_eq(wolfBoot_verify_integrity(&img), 0);
+    /* The previous image is still available for a rollback */
+    ck_assert(wolfBoot_update_firmware_version() == 1);
+    ck_assert_int_eq(wolfBoot_open_image(&img, PART_UPDATE), 0);
+    ck_assert_int_eq(wolfBoot_verify_integrity(&img), 0);
+}
+
+START_TEST (test_skip_same_sectors)
+{
+    int erased_all;
+
+    /* Reference: all the sectors are different */
+    reset_mock_stats();
+    prepare_flash();
+    add_payload(PART_BOOT, 1, TEST_SIZE_LARGE);
+    add_payload_ex(PART_UPDATE, 2, TEST_SIZE_LARGE, 0x5EED, 0);
+    wolfBoot_update_trigger();
+    erased_boot = 0;
+    wolfBoot_start();
+    ck_assert(wolfBoot_current_firmware_version() == 2);
+    erased_all = erased_boot;
+    cleanup_flash();
+
+    prepare_same_payloads();
+    erased_boot = 0;
+    wolfBoot_start();
+    check_same_sectors_update();
+    /* Only sector 0 and sector 3 have been rewritten */
+    ck_assert_int_eq(erased_all - erased_boot, SKIP_TEST_SECTORS - 2);
+    cleanup_flash();
+}
+END_TEST
+
+START_TEST (test_skip_same_sectors_resume)
+{
+    struct wolfBoot_image boot, update;
+    uint8_t flag;
+
+    /* Power failure after the sectors were marked */
+    prepare_same_payloads();
+    wolfBoot_open_image(&boot, PART_BOOT);
+    wolfBoot_open_image(&update, PART_UPDATE);
+    hal_flash_unlock();
+    ext_flash_unlock();
+    wolfBoot_mark_same_sectors(&boot, &update,
+        wolfBoot_get_total_size(&boot, &update));
+    ext_flash_lock();
+    hal_flash_lock();
+    ck_assert_int_eq(wolfBoot_get_update_sector_flag(0, &flag), 0);
+    ck_assert_uint_eq(flag, SECT_FLAG_NEW);
+    ck_assert_int_eq(wolfBoot_get_update_sector_flag(2, &flag), 0);
+    ck_assert_uint_eq(flag, SECT_FLAG_SAME);
+    ck_assert_int_eq(wolfBoot_get_update_sector_flag(3, &flag), 0);
+    ck_assert_uint_eq(flag, SECT_FLAG_NEW);
+
+    wolfBoot_start();
+    check_same_sectors_update();
+    cleanup_flash();
+}
+END_TEST
+#endif /* WOLFBOOT_SKIP_SAME_SECTORS */
+
 
 Suite *wolfboot_suite(void)
 {
@@ -684,6 +1212,8 @@ Suite *wolfboot_suite(void)
         tcase_create("Update to older version denied");
     TCase *invalid_update_type =
         tcase_create("Invalid update type");
+    TCase *compressed_update_denied =
+        tcase_create("Compressed update denied");
     TCase *update_toolarge = tcase_create("Update too large");
     TCase *invalid_sha = tcase_create("Invalid SHA digest");
     TCase *emergency_rollback = tcase_create("Emergency rollback");
@@ -693,6 +1223,18 @@ Suite *wolfboot_suite(void)
     TCase *swap_resume = tcase_create("Swap resume noop");
     TCase *diffbase_version = tcase_create("Diffbase version lookup");
     TCase *boot_success = tcase_create("Boot success state");
+#if defined(WOLFBOOT_UPDATE_DISK) || defined(WOLFBOOT_LZ4)
+    TCase *verify_stream = tcase_create("Streaming integrity check");
+#endif
+#ifdef WOLFBOOT_VERIFY_TICKET
+    TCase *verify_ticket = tcase_create("Verification ticket");
+#endif
+#ifdef WOLFBOOT_MERKLE
+    TCase *merkle = tcase_create("Merkle tree");
+#endif
+#ifdef WOLFBOOT_SKIP_SAME_SECTORS
+    TCase *skip_same = tcase_create("Skip same sectors");
+#endif
 #ifdef EXT_ENCRYPTED
     TCase *fallback_verify = tcase_create("Fallback verify");
 #endif
@@ -714,6 +1256,7 @@ Suite *wolfboot_suite(void)
     tcase_add_test(forward_update_sameversion_denied, test_forward_update_sameversion_denied);
     tcase_add_test(update_oldversion_denied, test_update_oldversion_denied);
     tcase_add_test(invalid_update_type, test_invalid_update_type);
+    tcase_add_test(compressed_update_denied, test_compressed_update_denied);
     tcase_add_test(update_toolarge, test_update_toolarge);
     tcase_add_test(invalid_sha, test_invalid_sha);
     tcase_add_test(emergency_rollback, test_emergency_rollback);
@@ -723,6 +1266,23 @@ Suite *wolfboot_suite(void)
     tcase_add_test(swap_resume, test_swap_resume_noop);
     tcase_add_test(diffbase_version, test_diffbase_version_reads);
     tcase_add_test(boot_success, test_boot_success_sets_state);
+#if defined(WOLFBOOT_UPDATE_DISK) || defined(WOLFBOOT_LZ4)
+    tcase_add_test(verify_stream, test_verify_integrity_stream);
+#endif
+#ifdef WOLFBOOT_VERIFY_TICKET
+    tcase_add_test(verify_ticket, test_verify_ticket);
+    tcase_add_test(verify_ticket, test_verify_ticket_other_image);
+#endif
+#ifdef WOLFBOOT_MERKLE
+    tcase_add_test(merkle, test_merkle_update);
+    tcase_add_test(merkle, test_merkle_corrupted_update);
+    tcase_add_test(merkle, test_merkle_corrupted_swap);
+    tcase_add_test(merkle, test_merkle_corrupted_swap_resume);
+#endif
+#ifdef WOLFBOOT_SKIP_SAME_SECTORS
+    tcase_add_test(skip_same, test_skip_same_sectors);
+    tcase_add_test(skip_same, test_skip_same_sectors_resume);
+#endif
 #ifdef EXT_ENCRYPTED
     tcase_add_test(fallback_verify, test_fallback_image_verification_rejects_corruption);
 #endif
@@ -735,6 +1295,7 @@ Suite *wolfboot_suite(void)
     suite_add_tcase(s, forward_update_sameversion_denied);
     suite_add_tcase(s, update_oldversion_denied);
     suite_add_tcase(s, invalid_update_type);
+    suite_add_tcase(s, compressed_update_denied);
     suite_add_tcase(s, update_toolarge);
     suite_add_tcase(s, invalid_sha);
     suite_add_tcase(s, emergency_rollback);
@@ -744,6 +1305,18 @@ Suite *wolfboot_suite(void)
     suite_add_tcase(s, swap_resume);
     suite_add_tcase(s, diffbase_version);
     suite_add_tcase(s, boot_success);
+#if defined(WOLFBOOT_UPDATE_DISK) || defined(WOLFBOOT_LZ4)
+    suite_add_tcase(s, verify_stream);
+#endif
+#ifdef WOLFBOOT_VERIFY_TICKET
+    suite_add_tcase(s, verify_ticket);
+#endif
+#ifdef WOLFBOOT_MERKLE
+    suite_add_tcase(s, merkle);
+#endif
+#ifdef WOLFBOOT_SKIP_SAME_SECTORS
+    suite_add_tcase(s, skip_same);
+#endif
 #ifdef EXT_ENCRYPTED
     suite_add_tcase(s, fallback_verify);
 #endif